@@ -31,40 +31,104 @@
  * missed packets are not fatal -- the next message will provide similar data a little
  * bit later.
  * 
- * All messages have a constant length and frame format.  all are preceded by a START_CHAR
- * and terminated by an END_CHAR; they all also include a checksum character just prior
- * to the END_CHAR. 
+ * All messages share one frame format.  all are preceded by a START_CHAR and terminated
+ * by an END_CHAR; the header carries a protocol version, the message type and the payload
+ * length, so frames of different types and sizes can follow each other on the link
+ * without the receiver having to know in advance what is coming.  a CRC-16 just prior
+ * to the END_CHAR protects the header and payload.
  *
  * processing starts in FSM_SEEKING_START state looking for a 
- * START_CHAR.  once it is found, it accepts the approprate number of characters, then
- * it expects to see an END_CHAR.  if the END_CHAR is not seen, then we assume that we
+ * START_CHAR.  once it is found, it collects the header, checks the version and length,
+ * then accepts the approprate number of characters and expects to see an END_CHAR.  
+ * if the header is not sensible or the END_CHAR is not seen, then we assume that we
  * "started" the frome on a message-embedded byte that matches START_CHAR (this is called  
  * a framing error), so we discard the packet and start over at FSM_SEEKING_START.  
- * simiarly, if the checksum does not match we assume an error and discard the packet.
+ * simiarly, if the CRC does not match we assume an error and discard the packet.
+ * (before discarding, the rejected bytes are re-scanned for another START_CHAR).
+ * 
+ * The receive state machine itself lives in cam_parser.cpp, which has no Arduino
+ * dependencies; this module only moves bytes from Serial1 into it and acts on the
+ * frames it returns.  Bytes are taken from the UART in bulk (see sercom1_poll())
+ * and the parser block-scans for START_CHAR rather than switching on every byte.
  * 
  * Note that the same protocol is used to send configuration commands from the main
  * processor to the camera.  In this case discarded packets would be a problem, so 
- * its best for the caller to then REQUEST a readback of the presumably sent parameter
- * to verify that it got it.  
+ * commands carry a sequence number and the camera answers each with MSG_ACK (or
+ * MSG_NACK if it could not use it) carrying the same number.  commands that are not
+ * answered in time are re-sent from cam_loop() a few times before being given up on.
+ * CAM_CMD_SEND_PIC, CAM_CMD_RESEND_CHUNK, CAM_CMD_RESEND_FROM, CAM_CMD_LINK_TEST and
+ * CAM_CMD_TIME_PING are not sequenced; the picture (or chunks, test frames or
+ * MSG_TIME_PONG) itself is the answer.
+ *
+ * the camera remembers the last few sequence numbers with the answer it gave, and
+ * answers a repeat (our retransmit after a lost ACK or NACK) the same way without
+ * carrying it out again.  the camera may stay powered while the robot restarts, so
+ * cam_init() starts each session at a random sequence number and first sends
+ *    CAM_CMD_SESSION    0,1 session id (random, not 0); not sequenced -- a new id
+ *                       makes the camera forget the sequence numbers it remembers
+ * (if that frame is lost, the random start still makes a clash with the old
+ * session's last few numbers unlikely)
  * 
- * Message format for camera-to-main packets (10 bytes):
- *    0   START_CHAR 
- *    1   Status  (context-depended; camera related)
- *    2,3 Parameter 1 (turn cmd (-255 to +255))  LSB, MSB
- *    4,5 Parameter 2 (measured angle (blob mode), theta (regres1 mode))  LSB, MSB
- *    6,7 Parameter 3 (rho (regres1 mode))  LSB, MSB
- *    8   checksum (LSB of sum of 1,2,3,4,5,6,7) NOT 2's complemented
- *    9   END_CHAR
+ * Frame format (both directions) (N + 8 bytes):
+ *    0       START_CHAR 
+ *    1       protocol version (CAM_PROTOCOL_VERSION)
+ *    2       message type (MSG_xxx camera-to-main, CAM_CMD_xxx main-to-camera)
+ *    3       sequence number (0 when not used; echoed back in MSG_ACK / MSG_NACK)
+ *    4       payload length N (0 to CAM_MAX_PAYLOAD)
+ *    5..     payload (N bytes, multi-byte values are LSB first)
+ *    5+N,6+N CRC-16/CCITT-FALSE of bytes 1 .. 4+N, LSB, MSB
+ *    7+N     END_CHAR
  *    
- *    Note that the meaning of bytes 2-7 may be interpreted differently
- *    for some context messages
+ * MSG_ACK and MSG_NACK (camera-to-main) have no payload.
+ *
+ * Payload of MSG_STEERANGLE (camera-to-main):
+ *    0,1 turn cmd (-255 to +255)
+ *    2,3 angle error (degrees)
+ *    4,5 target angle (degrees)
+ *    6-9 camera millis() when the image was taken (optional; used for latency tracing
+ *        and as the time base of the on-robot PID)
+ *    the header sequence number counts steering frames so lost ones can be noticed
  *    
- * Message format for main-to-camera command packets (8 bytes) (enhanced simple commands mode)
- *    0       START_CHAR
- *    1       Command
- *    2,3,4,5 data (may be (2) ints, (1) float, or (4) bytes
- *    6       checksum (LSB of sum of 1,2,3,4,5) NOT 2's complemented
- *    7   END_CHAR
+ * Pictures (answer to CAM_CMD_SEND_PIC) are binary JPEG, sent as one MSG_IMG_HEADER
+ * followed by MSG_IMG_CHUNK frames (see cam_image.h):
+ *    MSG_IMG_HEADER  0,1 image id, 2-5 total length, 6,7 chunk size, 8,9 chunk count
+ *    MSG_IMG_CHUNK   0,1 image id, 2,3 chunk index, 4.. data (chunk size bytes;
+ *                    the last chunk holds whatever is left)
+ * CAM_CMD_RESEND_CHUNK asks for one chunk again: 0,1 image id, 2,3 chunk index
+ * CAM_CMD_RESEND_FROM asks for that chunk and all after it (same payload)
+ * the chunks are the link's image channel; everything else is its control channel.
+ * the camera gives control frames priority (chunks only go in the time left before
+ * the next steering frame is due) so steering keeps its timing during a picture;
+ * cam_stats keeps the worst steering gap seen while chunks were arriving
+ *
+ * Link speed: the link comes up at BAUD_RATE_SERCOM1, and cam_negotiate_baud() (at
+ * boot) moves it to the fastest rate both ends carry cleanly (see cam_baud_rates[]):
+ *    CAM_CMD_SET_BAUD   0-3 baud rate; sequenced -- the camera ACKs at the old rate,
+ *                       then both ends switch
+ *    CAM_CMD_LINK_TEST  0,1 test id, 2,3 number of MSG_LINK_TEST frames wanted,
+ *                       4.. test pattern (CAM_LINK_TEST_PATTERN_LEN bytes)
+ *    MSG_LINK_TEST      0,1 test id, 2,3 index, 4,5 errors the camera has counted
+ *                       since its rate was set, 6.. the same test pattern
+ * the pattern is pseudo-random, seeded by the test id (cam_link_pattern()), so
+ * each end checks every byte the other sent.  at a faster rate the camera goes
+ * back to BAUD_RATE_SERCOM1 by itself once nothing good has come in for a few
+ * seconds, and the robot does the same when errors keep coming (cam_baud_check())
+ *
+ * Clock: CAM_CMD_TIME_PING goes out every CAM_CLOCK_PING_MS (cam_clock_ping()) and
+ * the camera answers at once; cam_clock.cpp turns the answers into an offset and
+ * drift between the two clocks:
+ *    CAM_CMD_TIME_PING  0-3 robot time (uS, low 32 bits of esp_timer_get_time())
+ *    MSG_TIME_PONG      0-3 the same, 4-7 camera millis() when the ping was read,
+ *                       8-11 camera millis() when the answer was sent
+ *    
+ * Payload of main-to-camera commands is empty, (1) int (2 bytes), (2) ints (4 bytes)
+ * or (1) float (4 bytes) depending on the command, except for CAM_CMD_PARAM_BLOCK
+ * which carries every tuning parameter at once (66 bytes):
+ *    0..39   floats: roi weight T, M, B, floating thresh, seed thresh,
+ *                    pid kp, ki, kd, steering gain, perspective factor
+ *    40..65  ints:   roi loc T, height T, loc M, height M, loc B, height B,
+ *                    seed loc, steering direction, lumi low, lumi high,
+ *                    histeq wanted, negate wanted, perspective wanted
  *    
  *        
  * May enhance it to communicate using OpenMV RPC library (using uart, same Serial1 port; not simultaneous)   
@@ -74,8 +138,14 @@
  */
 
 #include "cam.h"
+#include "cam_parser.h"
 #include "serial_com_esp32.h"
 #include "mode_mgr.h"
+#include "cam_stats.h"
+#include "cam_latency.h"
+#include "cam_image.h"
+#include "cam_clock.h"
+#include "esp_timer.h"
 
 #define CAM_MODE_UNKNOWN  0
 #define CAM_MODE_IDLE     1
@@ -83,39 +153,234 @@
 #define CAM_MODE_REGRES1  3
 #define CAM_MODE_LANE_LINES 4
 
-#define START_CHAR 0xAA
-#define END_CHAR 0xA8
-#define MESSAGE_LENGTH 10
-#define MESSAGE_LENGTH_ENHANCED 8
-#define IMG_END_CHAR '\n'
+CamParser cam_parser;
+int  cam_mode;
 
-#define FSM_SEEKING_START     0
-#define FSM_COLLECTING_CHARS  1
-#define FSM_EXPECTING_STOP    2
-#define FSM_COLLECTING_IMAGE  3
+/*
+ * outgoing frames are built straight into one of these preallocated slots
+ * and handed to the UART whole from cam_tx_service(); when all slots are
+ * full the new frame is dropped (and counted) rather than waiting
+ */
+#define CAM_TXQ_SLOTS 8     // must be a power of 2
 
-// incoming message types
-#define MSG_STEERANGLE    1
+struct CamTxSlot {
+  uint8_t frame[CAM_MAX_FRAME];
+  int     len;
+};
 
-#define IMG_TIMEOUT_MS 5000
+CamTxSlot cam_txq[CAM_TXQ_SLOTS];
+uint32_t  cam_txq_head;       // next slot to fill (free-running, masked on use)
+uint32_t  cam_txq_tail;       // next slot to send (free-running, masked on use)
+uint32_t  cam_txq_drops;
 
-byte buffer[MESSAGE_LENGTH];
-int  next_buffer_index;
-int  fsm_state;
-int  msg_type_expected;
-int  numGoodMessages, numErrorFraming, numErrorChecksum;
-int  cam_mode;
+/*
+ * shadow of the tuning parameters the camera currently holds, indexed by
+ * the command id that sets each one (the perspective on/off pair is kept
+ * under CAM_CMD_CAM_PERSPECTIVE_ON as a 1 byte 0/1 value).  it is filled
+ * in as the camera acknowledges commands, and cam_sync_parameters() compares it against
+ * config so only changed parameters go over the link
+ */
+#define CAM_SHADOW_SLOTS (CAM_CMD_PARAM_BLOCK + 1)
+#define CAM_SHADOW_MAX_LEN 4
+#define CAM_NUM_PARAMS 20
+#define CAM_SYNC_BLOCK_THRESHOLD 6   // this many changes (or more) are cheaper sent as one block
+
+struct CamParamEntry {
+  uint8_t cmd;
+  uint8_t len;
+  uint8_t val[CAM_SHADOW_MAX_LEN];
+};
+
+struct CamShadow {
+  bool    valid[CAM_SHADOW_SLOTS];
+  uint8_t len[CAM_SHADOW_SLOTS];
+  uint8_t val[CAM_SHADOW_SLOTS][CAM_SHADOW_MAX_LEN];
+};
+
+CamShadow cam_shadow;
+
+/*
+ * every command except CAM_CMD_SEND_PIC carries a sequence number (1-255)
+ * and the camera answers it with MSG_ACK (or MSG_NACK) carrying the same
+ * number.  frames that have been sent but not yet answered wait in this
+ * small window and are re-sent if no answer comes back in time.  the effects
+ * of a command (cam_mode, the parameter shadow) are only taken as fact when
+ * its ACK arrives
+ */
+#define CAM_ACK_WINDOW 4
+#define CAM_ACK_TIMEOUT_MS 100    // camera checks for commands once per image frame
+#define CAM_MAX_RETRIES 3
+
+struct CamPending {
+  bool          in_use;
+  uint8_t       frame[CAM_MAX_FRAME];
+  int           len;
+  unsigned long sent_ms;
+  int           retries;
+};
+
+CamPending cam_window[CAM_ACK_WINDOW];
+uint8_t  cam_next_seq;
+uint32_t cam_num_acks;
+uint32_t cam_num_nacks;
+uint32_t cam_num_retries;
+uint32_t cam_num_failures;
+
+/*
+ * layout of the CAM_CMD_PARAM_BLOCK payload, as (command, bytes) pairs for
+ * the single-parameter command each field corresponds to; used to bring
+ * the shadow up to date when a block is acknowledged
+ */
+const uint8_t cam_block_layout[][2] = {
+  {CAM_CMD_BLOB_ROI_WEIGHT_T, 4},
+  {CAM_CMD_BLOB_ROI_WEIGHT_M, 4},
+  {CAM_CMD_BLOB_ROI_WEIGHT_B, 4},
+  {CAM_CMD_BLOB_SET_FLOATING_THRESH, 4},
+  {CAM_CMD_BLOB_SET_SEED_THRESH, 4},
+  {CAM_CMD_PID_SET_KP, 4},
+  {CAM_CMD_PID_SET_KI, 4},
+  {CAM_CMD_PID_SET_KD, 4},
+  {CAM_CMD_PID_SET_STEERING_GAIN, 4},
+  {CAM_CMD_CAM_SET_PERSPECTIVE_FACTOR, 4},
+  {CAM_CMD_BLOB_ROI_POSITION_T, 4},
+  {CAM_CMD_BLOB_ROI_POSITION_M, 4},
+  {CAM_CMD_BLOB_ROI_POSITION_B, 4},
+  {CAM_CMD_BLOB_SET_SEED_LOC, 2},
+  {CAM_CMD_PID_SET_STEERING_DIRECTION, 2},
+  {CAM_CMD_BLOB_SET_LUMI_LOW, 2},
+  {CAM_CMD_BLOB_SET_LUMI_HIGH, 2},
+  {CAM_CMD_HISTEQ_WANTED, 2},
+  {CAM_CMD_NEGATE_WANTED, 2},
+  {CAM_CMD_CAM_PERSPECTIVE_ON, 2},
+};
+#define CAM_BLOCK_FIELDS (sizeof(cam_block_layout) / sizeof(cam_block_layout[0]))
+
+/*
+ * link speed.  the rates are tried fastest first, after a test at
+ * BAUD_RATE_SERCOM1 has shown the camera is there and answering; the first
+ * one whose test comes back clean is kept.  results are kept for every rate
+ * so the effective throughput of each can be reported (cam_baud_summary())
+ */
+#define CAM_BAUD_TEST_FRAMES  16      // MSG_LINK_TEST frames asked for at each rate
+#define CAM_BAUD_TEST_MS      500     // camera answers at its next pass, then the frames take their time
+#define CAM_BAUD_ACK_MS       500     // longest wait for CAM_CMD_SET_BAUD to be answered (covers its retries)
+#define CAM_BAUD_REVERT_MS    600     // camera goes back to base by itself 500 mS after a switch with nothing good
+#define CAM_BAUD_LOST_MS      3500    // ... or 3 S after the last good frame once a rate is in use
+#define CAM_BAUD_CHECK_MS     1000    // cam_baud_check() interval (and keep-alive test)
+#define CAM_BAUD_NEGOTIATE_MS 2500    // cam_negotiate_baud() starts nothing it could not finish by then
+
+#define CAM_BAUD_SET_IDLE     0
+#define CAM_BAUD_SET_PENDING  1
+#define CAM_BAUD_SET_ACKED    2
+#define CAM_BAUD_SET_FAILED   3
+
+const uint32_t cam_baud_rates[CAM_BAUD_NUM_RATES] = {BAUD_RATE_SERCOM1, 2000000, 921600};
+
+struct CamBaudResult {
+  bool     tried;
+  bool     clean;
+  uint32_t frames;          // test frames that came back good
+  uint32_t errors;          // bad test frames, parser errors and FIFO overflows here, plus the camera's count
+  uint32_t bytes_per_sec;   // effective, measured from the first test frame to the last
+};
 
+struct CamLinkTest {
+  uint16_t id;
+  int      wanted;
+  int      good;
+  int      bad;
+  uint16_t cam_errors;      // largest count reported by the camera
+  unsigned long first_us;
+  unsigned long last_us;
+};
 
+CamBaudResult cam_baud_results[CAM_BAUD_NUM_RATES];
+CamLinkTest cam_link_test;
+uint32_t cam_baud_current;
+uint32_t cam_baud_switch_to;      // rate to change to at the end of cam_loop() (0 for none)
+int      cam_baud_set_state;      // CAM_BAUD_SET_xxx for the last CAM_CMD_SET_BAUD sent
+bool     cam_baud_probing;        // cam_negotiate_baud() is running
+uint32_t cam_baud_fallbacks;
+uint32_t cam_baud_last_errors;
+uint32_t cam_baud_last_late_drops;
+int      cam_baud_bad_seconds;
+unsigned long cam_baud_next_check_ms;
+
+unsigned long cam_clock_next_ping_ms;
 
-#define IMAGE_BUFFER_SIZE 24000
-char img_buffer[IMAGE_BUFFER_SIZE];
-bool img_ready;
-int img_index;
-long img_timeout_ms;
 /*
  * templates for private functions
  */
+void cam_got_frame(uint8_t msg_type, uint8_t seq, const uint8_t *payload, int len, void *context);
+bool cam_send_frame(uint8_t cmd, const uint8_t *payload, int len);
+int  cam_desired_params(CamParamEntry *list);
+int  cam_add_int_param(CamParamEntry *list, int n, uint8_t cmd, int value);
+int  cam_add_ints_param(CamParamEntry *list, int n, uint8_t cmd, int value1, int value2);
+int  cam_add_float_param(CamParamEntry *list, int n, uint8_t cmd, float value);
+void cam_send_param(CamParamEntry *entry);
+void cam_shadow_note(uint8_t cmd, const uint8_t *payload, int len);
+bool cam_shadow_matches(CamParamEntry *entry);
+void cam_tx_service(void);
+void cam_retransmit_check(void);
+CamPending *cam_window_alloc(uint8_t cmd);
+CamPending *cam_window_find(uint8_t seq);
+uint8_t cam_cmd_group(uint8_t cmd);
+bool cam_cmd_in_block(uint8_t cmd);
+void cam_cmd_acked(const uint8_t *frame);
+void cam_cmd_failed(const uint8_t *frame);
+void cam_shadow_note_block(const uint8_t *payload, int len);
+int  cam_put_int(uint8_t *payload, int index, int value);
+int  cam_put_float(uint8_t *payload, int index, float value);
+int  cam_put_uint32(uint8_t *payload, int index, uint32_t value);
+void cam_msg_steerangle(uint8_t seq, const uint8_t *payload, int len);
+void cam_msg_ack(uint8_t seq, const uint8_t *payload, int len);
+void cam_msg_nack(uint8_t seq, const uint8_t *payload, int len);
+void cam_msg_img_header(uint8_t seq, const uint8_t *payload, int len);
+void cam_msg_img_chunk(uint8_t seq, const uint8_t *payload, int len);
+void cam_msg_link_test(uint8_t seq, const uint8_t *payload, int len);
+void cam_msg_time_pong(uint8_t seq, const uint8_t *payload, int len);
+void cam_link_pattern(uint16_t id, uint8_t *pattern);
+void cam_link_test_start(int wanted);
+bool cam_baud_request(uint32_t baud);
+bool cam_baud_probe(int rate_index);
+void cam_baud_pump(unsigned long ms);
+void cam_baud_apply(void);
+void cam_baud_check(unsigned long now_ms);
+uint32_t cam_baud_link_errors(void);
+uint32_t cam_baud_late_drops(void);
+void cam_clock_ping(unsigned long now_ms);
+
+/*
+ * handlers for messages from the camera, indexed by message type so
+ * dispatch is one bounds check and one indirect call.  a type with no
+ * handler (NULL) is ignored.  to handle a new message type, add its 
+ * MSG_xxx in cam.h and fill in its row here; the static_assert below
+ * stops the build if a row ends up out of order
+ */
+struct CamMsgType {
+  uint8_t msg_type;
+  uint8_t channel;        // CAM_CH_xxx
+  uint8_t min_len;        // shorter payloads are dropped before the handler runs
+  void (*handler)(uint8_t seq, const uint8_t *payload, int len);
+};
+
+constexpr CamMsgType cam_msg_types[] = {
+  {0,              CAM_CH_CONTROL, 0,                      NULL},                 // (no type 0)
+  {MSG_STEERANGLE, CAM_CH_CONTROL, MSG_STEERANGLE_LENGTH,  cam_msg_steerangle},
+  {MSG_TELEMETRY,  CAM_CH_CONTROL, 0,                      NULL},                 // not yet used by the robot
+  {MSG_ACK,        CAM_CH_CONTROL, 0,                      cam_msg_ack},
+  {MSG_NACK,       CAM_CH_CONTROL, 0,                      cam_msg_nack},
+  {MSG_IMG_HEADER, CAM_CH_CONTROL, CAM_IMG_HEADER_LENGTH,  cam_msg_img_header},
+  {MSG_IMG_CHUNK,  CAM_CH_IMAGE,   CAM_IMG_CHUNK_OVERHEAD, cam_msg_img_chunk},
+  {MSG_LINK_TEST,  CAM_CH_CONTROL, MSG_LINK_TEST_LENGTH,   cam_msg_link_test},
+  {MSG_TIME_PONG,  CAM_CH_CONTROL, MSG_TIME_PONG_LENGTH,   cam_msg_time_pong},
+};
+#define CAM_NUM_MSG_TYPES (sizeof(cam_msg_types) / sizeof(cam_msg_types[0]))
+
+constexpr bool cam_msg_types_in_order(unsigned int i) {
+  return (i >= CAM_NUM_MSG_TYPES) || ((cam_msg_types[i].msg_type == i) && cam_msg_types_in_order(i + 1));
+}
+static_assert(cam_msg_types_in_order(0), "cam_msg_types[] rows must be in MSG_xxx order");
 
  /*
   * **************************************************************
@@ -123,121 +388,74 @@ long img_timeout_ms;
   * **************************************************************
   */
 void cam_init(void) {
+  uint8_t payload[2];
+
   sercom1_init();  
-  next_buffer_index = 0;
-  fsm_state = FSM_SEEKING_START;
-  msg_type_expected = MSG_STEERANGLE; 
-  numGoodMessages = 0;
-  numErrorFraming = 0;
-  numErrorChecksum = 0;
+  cam_parser_init(&cam_parser, cam_got_frame, NULL);
   cam_mode = CAM_MODE_UNKNOWN;
-  
-  img_index = 0;
-  img_ready = false;
-  img_timeout_ms = 0;
-  
+  cam_txq_head = 0;
+  cam_txq_tail = 0;
+  cam_txq_drops = 0;
+  cam_shadow_invalidate();
+  for (int i=0; i<CAM_ACK_WINDOW; i++) {
+    cam_window[i].in_use = false;
+  }
+  cam_next_seq = random(1, 256);
+  cam_baud_current = BAUD_RATE_SERCOM1;
+  cam_baud_switch_to = 0;
+  cam_baud_set_state = CAM_BAUD_SET_IDLE;
+  cam_baud_probing = false;
+  cam_baud_fallbacks = 0;
+  cam_baud_bad_seconds = 0;
+  cam_baud_next_check_ms = 0;
+  memset(cam_baud_results, 0, sizeof(cam_baud_results));
+  memset(&cam_link_test, 0, sizeof(cam_link_test));
+  cam_clock_next_ping_ms = 0;
+  cam_num_acks = 0;
+  cam_num_nacks = 0;
+  cam_num_retries = 0;
+  cam_num_failures = 0;
+  cam_stats_init();
+  cam_image_init();
+  cam_clock_init();
+#ifdef CAM_LATENCY_TRACE
+  cam_latency_init();
+#endif
+
+  // ahead of every sequenced command (see "the camera may stay powered" above)
+  cam_put_int(payload, 0, random(1, 65536));
+  cam_send_frame(CAM_CMD_SESSION, payload, 2);
   cam_preset_paremeters();
 }
 
+/*
+ * pulls everything the UART driver holds into the sercom1 ring buffer
+ * in bulk, then hands the ring contents to the parser span by span;
+ * complete frames come back via cam_got_frame().  after a long pass the
+ * driver may hold more than the ring, so this goes round until it is empty
+ */
 void cam_loop(void) {
-  byte rcvdChar;
-  int  checksumCalculated;
-  int16_t steer_cmd_val, angle_error;  // params for MSG_STEERANGLE
+  const uint8_t *span;
+  int  num_bytes;
   
-  while (sercom1_available()) {
-    rcvdChar = sercom1_read();  
-     
-    switch(fsm_state) {
-      case FSM_SEEKING_START:
-        if (rcvdChar == START_CHAR) {
-          fsm_state = FSM_COLLECTING_CHARS;
-          buffer[0] = rcvdChar;
-          next_buffer_index = 1;
-        }
-        break;
-
-      case FSM_COLLECTING_CHARS:
-        /*
-         * note START or STOP character is ok in middle of message
-         * when we reach the LAST expected char, it must be a STOP char
-         * if not, then we discard whole message and return to FSM_SEEKING_START
-         * if it IS a STOP character, then we check the message for valid checksum
-         * and parse it of checksum ok, else discard it
-         * there is no ACK or NACK on messages or discarded messages, they just 
-         * disappear. 
-         */
-        buffer[next_buffer_index++] = rcvdChar;
-        if (next_buffer_index >= (MESSAGE_LENGTH - 1)) {
-          // have received checksum (index 8) now expecting stop char (index 9)
-          fsm_state = FSM_EXPECTING_STOP;
-          next_buffer_index = (MESSAGE_LENGTH - 1);   // just to be sure
-        }
-        break;
-        
-      case FSM_EXPECTING_STOP:
-        if (rcvdChar == END_CHAR) {
-          /*
-           * successfully received END_CHAR as expected, so buffer is complete
-           * now verify checksum before accepting message
-           */
-          checksumCalculated = 0;
-          for (int i=1; i<((MESSAGE_LENGTH - 2)); i++) {
-            checksumCalculated += buffer[i];
-          }
-          checksumCalculated = checksumCalculated & 0xFF;
-          if ( (checksumCalculated & 0xFF) != buffer[MESSAGE_LENGTH - 2]) {
-            next_buffer_index = 0;
-            fsm_state = FSM_SEEKING_START;
-            numErrorChecksum++;            
-          } else {
-            if (msg_type_expected == MSG_STEERANGLE) {
-              steer_cmd_val = buffer[2] | (buffer[3] << 8);
-              angle_error =  buffer[4] | (buffer[5] << 8);
-              // the "steer_angle" should be an integer -255 full left, +255 full right, 0=straight
-              mode_got_msg_steerangle(steer_cmd_val, angle_error);
-              DEBUG_PRINT("CAM GOT MESSAGE");
-              DEBUG_PRINTLN(steer_cmd_val);
-            } 
-            
-            next_buffer_index = 0;
-            fsm_state = FSM_SEEKING_START; 
-            numGoodMessages++;   
-          }          
-          
-        } else {
-          /*
-           * if we wanted an END_CHAR and its not, then this is an error
-           * so throw away this buffer and wait for a new one  
-           */
-          next_buffer_index = 0;
-          fsm_state = FSM_SEEKING_START;
-          numErrorFraming++;
-        }
-        break;        
-
-      case FSM_COLLECTING_IMAGE:
-        /*
-         * note chars are stored in buffer until end char is reached ( ),  
-         * or error condition is reached (too many chars or too much time)
-         */
-        if (rcvdChar == IMG_END_CHAR) {
-          img_buffer[img_index] = '\0';
-          img_ready = true;
-          fsm_state = FSM_SEEKING_START;
-          next_buffer_index = 0;
-        } else {
-          img_buffer[img_index++] = rcvdChar;  
-          if (img_index >= (IMAGE_BUFFER_SIZE - 1)) {
-            // note this is an error state -- it needs to be developed further
-            fsm_state = FSM_SEEKING_START;
-            img_index = (IMAGE_BUFFER_SIZE - 1);   // just to be sure
-            DEBUG_PRINTLN("buffer over-run when collecting image");
-          }
-        }
-        break;
-      
-    } // switch
-  }   // if character available
+  while (sercom1_poll() > 0) {
+    while ((num_bytes = sercom1_rx_span(&span)) > 0) {
+      cam_parser_feed(&cam_parser, span, num_bytes);
+      sercom1_rx_consume(num_bytes);
+    }
+  }
+  cam_tx_service();
+  cam_retransmit_check();
+  if (cam_baud_switch_to != 0) {
+    cam_baud_apply();
+  }
+  cam_stats_tick(&cam_parser, millis());
+#ifdef CAM_BAUD_NEGOTIATE
+  cam_baud_check(millis());
+#endif
+#ifdef CAM_CLOCK_SYNC
+  cam_clock_ping(millis());
+#endif
 }
 
 /* 
@@ -248,210 +466,177 @@ void cam_loop(void) {
  *  prototypes and the compiler picks the correct one
  */
 void cam_send_cmd(uint8_t cmd) {
-  int  checksumCalculated;
-
-  // some commands (the ones that change camera mode in a way
-  // that the robot needs to care about) need to be noticed here
-  switch(cmd) {
-    case CAM_CMD_MODE_IDLE:
-      cam_mode = CAM_MODE_IDLE;
-      break;
-    case CAM_CMD_MODE_BLOBS:
-      cam_mode = CAM_MODE_BLOB1;
-      break;
-    case CAM_CMD_MODE_REGRESSION_LINE:
-      cam_mode = CAM_MODE_REGRES1;
-      break;
-    case CAM_CMD_MODE_LANE_LINES:
-      cam_mode = CAM_MODE_LANE_LINES;
-      break;
-    case CAM_CMD_SEND_PIC:
-      fsm_state = FSM_COLLECTING_IMAGE;
-      img_index = 0;
-      img_ready = false;
-      img_timeout_ms = millis() + IMG_TIMEOUT_MS;
-      break;
-  }  
-  sercom1_sendchar(START_CHAR);
-  sercom1_sendchar(cmd);
-  checksumCalculated = cmd;   // note the START_CHAR is not included in checksum
-  for (int i=0; i<4; i++) {
-    sercom1_sendchar(0);
-  }
-  sercom1_sendchar( checksumCalculated & 0xFF );
-  sercom1_sendchar(END_CHAR);
+  // note commands that change camera mode in a way the robot needs
+  // to care about are noticed in cam_cmd_acked(), once the camera has them
+  cam_send_frame(cmd, NULL, 0);
 }
 
 void cam_send_cmd(uint8_t cmd, int param1) {
-  int  checksumCalculated;
-  uint8_t thisByte;
+  uint8_t payload[2];
   
-  sercom1_sendchar(START_CHAR);
-  sercom1_sendchar(cmd);
-  checksumCalculated = cmd;   // note the START_CHAR is not included in checksum
-  // least significant byte of integer param
-  thisByte = param1 & 0xFF;
-  sercom1_sendchar(thisByte);
-  checksumCalculated += thisByte;
-  // most significant byte of integer param
-  thisByte = (param1 >> 8) & 0xFF;
-  sercom1_sendchar(thisByte);
-  checksumCalculated += thisByte;
-  // 2 bytes of zeros for unused param
-  sercom1_sendchar(0);
-  sercom1_sendchar(0);
-  
-  sercom1_sendchar( checksumCalculated & 0xFF );
-  sercom1_sendchar(END_CHAR);  
+  cam_put_int(payload, 0, param1);
+  cam_send_frame(cmd, payload, 2);
 }
 
 void cam_send_cmd(uint8_t cmd, int param1, int param2) {
-  int  checksumCalculated;
-  uint8_t thisByte;
-  
-  sercom1_sendchar(START_CHAR);
-  sercom1_sendchar(cmd);
-  checksumCalculated = cmd;   // note the START_CHAR is not included in checksum
-  
-  // least significant byte of integer_1 param
-  thisByte = param1 & 0xFF;
-  sercom1_sendchar(thisByte);
-  checksumCalculated += thisByte;
-  // most significant byte of integer_1 param
-  thisByte = (param1 >> 8) & 0xFF;
-  sercom1_sendchar(thisByte);
-  checksumCalculated += thisByte;
+  uint8_t payload[4];
   
-  // least significant byte of integer_2 param
-  thisByte = param2 & 0xFF;
-  sercom1_sendchar(thisByte);
-  checksumCalculated += thisByte;
-  // most significant byte of integer_2 param
-  thisByte = (param2 >> 8) & 0xFF;
-  sercom1_sendchar(thisByte);
-  checksumCalculated += thisByte;
-  
-  sercom1_sendchar( checksumCalculated & 0xFF );
-  sercom1_sendchar(END_CHAR);    
+  cam_put_int(payload, 0, param1);
+  cam_put_int(payload, 2, param2);
+  cam_send_frame(cmd, payload, 4);
 }
 
 void cam_send_cmd(uint8_t cmd, float param) {
-  int  checksumCalculated;
-  uint8_t thisByte;
-  union {
-    float floatval;
-    uint8_t bytes[4];
-  } myVal;
-  float testy;
-  
-  sercom1_sendchar(START_CHAR);
-  sercom1_sendchar(cmd);
-  checksumCalculated = cmd;   // note the START_CHAR is not included in checksum
+  uint8_t payload[4];
 
-  myVal.floatval = param;
-  
-  // least significant byte of float param
-  thisByte = myVal.bytes[0] & 0xFF;
-  sercom1_sendchar(thisByte);
-  checksumCalculated += thisByte;
-  
-  // next byte of float param
-  thisByte = (myVal.bytes[1]) & 0xFF;
-  sercom1_sendchar(thisByte);
-  checksumCalculated += thisByte;
-  
-  // next byte of float param
-  thisByte = myVal.bytes[2] & 0xFF;
-  sercom1_sendchar(thisByte);
-  checksumCalculated += thisByte;
-  
-  // most significant byte of float param
-  thisByte = (myVal.bytes[3]) & 0xFF;
-  sercom1_sendchar(thisByte);
-  checksumCalculated += thisByte;
-  sercom1_sendchar( checksumCalculated & 0xFF );
-  sercom1_sendchar(END_CHAR);    
+  cam_put_float(payload, 0, param);
+  cam_send_frame(cmd, payload, 4);
 }
 
+/*
+ * picture transfer housekeeping (resends and timeouts, see cam_image.cpp)
+ */
 void cam_timeout_check(void) {
-  if (fsm_state == FSM_COLLECTING_IMAGE) {
-    if (millis() > img_timeout_ms) {
-      // note this is an error state -- it needs to be developed further
-      DEBUG_PRINT("timeout when collecting image "); 
-      img_buffer[img_index] = '\0';
-      fsm_state = FSM_SEEKING_START;
-      img_index = (IMAGE_BUFFER_SIZE - 1);   // just to be sure
-    }
-  }
+  cam_image_check();
 }
 
 void cam_request_pic() {
-  cam_send_cmd(CAM_CMD_SEND_PIC);
+  cam_image_request();
 }
 
 /*
- * https://forum.arduino.cc/t/string-arguments-to-functions-string-msg-or-string-msg/629828/2
- * https://www.tutorialspoint.com/concatenate-strings-in-arduino
+ * appends the picture to pagebuf as base64 and frees it; returns false
+ * (appending nothing) if the picture could not be collected
  */
 bool cam_append_pic(String &pagebuf) {
-    //pagebuf = pagebuf + String(img_buffer);
-    pagebuf.concat(img_buffer);
-    img_ready = false;
-    return true;
-}
+  bool ok;
 
-char* cam_return_pic() {
-  img_ready = false;
-  return img_buffer;
+  ok = (cam_image_state() == CAM_IMG_READY);
+  if (ok) {
+    cam_image_append_base64(pagebuf);
+  }
+  cam_image_release();
+  return ok;
 }
 
+/*
+ * true once the picture asked for has either arrived or been given up on
+ */
 bool cam_check_cam_image_readiness() {
-  return img_ready;
+  return (cam_image_state() == CAM_IMG_READY) || (cam_image_state() == CAM_IMG_FAILED);
+}
+
+uint32_t cam_tx_drops() {
+  return cam_txq_drops;
+}
+
+uint32_t cam_cmd_retries() {
+  return cam_num_retries;
 }
 
+uint32_t cam_cmd_failures() {
+  return cam_num_failures;
+}
+
+uint32_t cam_cmd_acks() {
+  return cam_num_acks;
+}
+
+/*
+ * number of commands sent but not yet acknowledged
+ */
+int cam_cmd_pending() {
+  int n = 0;
+
+  for (int i=0; i<CAM_ACK_WINDOW; i++) {
+    if (cam_window[i].in_use) {
+      n++;
+    }
+  }
+  return n;
+}
+
+/*
+ * sends every tuning parameter from config to the camera as a single
+ * CAM_CMD_PARAM_BLOCK frame.  like every command it is queued and sent
+ * in the background (see cam_send_frame()), so this returns
+ * right away (it used to send ~20 separate commands with a delay after each)
+ */
 void cam_preset_paremeters() {  
-  cam_send_cmd(CAM_CMD_BLOB_ROI_WEIGHT_T, config.blob_roiTweight);
-  delay(3);
-  cam_send_cmd(CAM_CMD_BLOB_ROI_WEIGHT_M, config.blob_roiMweight);
-  delay(3);
-  cam_send_cmd(CAM_CMD_BLOB_ROI_WEIGHT_B, config.blob_roiBweight);  
-  delay(3);
-  cam_send_cmd(CAM_CMD_BLOB_ROI_POSITION_T, config.blob_roiTloc, config.blob_roiTheight);
-  delay(3);
-  cam_send_cmd(CAM_CMD_BLOB_ROI_POSITION_M, config.blob_roiMloc, config.blob_roiMheight);
-  delay(3);
-  cam_send_cmd(CAM_CMD_BLOB_ROI_POSITION_B, config.blob_roiBloc, config.blob_roiBheight);
-  delay(3);
-  cam_send_cmd(CAM_CMD_BLOB_SET_FLOATING_THRESH, config.blob_float_thresh);
-  delay(3);
-  cam_send_cmd(CAM_CMD_BLOB_SET_SEED_THRESH, config.blob_seed_thresh);
-  delay(3);
-  cam_send_cmd(CAM_CMD_BLOB_SET_SEED_LOC, config.blob_seed_loc);
-  delay(3);
-  cam_send_cmd(CAM_CMD_PID_SET_KP, config.pid_kp);
-  delay(3);
-  cam_send_cmd(CAM_CMD_PID_SET_KI, config.pid_ki);
-  delay(3);
-  cam_send_cmd(CAM_CMD_PID_SET_KD, config.pid_kd);
-  delay(3);
-  cam_send_cmd(CAM_CMD_PID_SET_STEERING_GAIN, config.pid_steering_gain);   
-  delay(3);   
-  cam_send_cmd(CAM_CMD_PID_SET_STEERING_DIRECTION, config.pid_steering_direction);
-  delay(3);    
-  cam_send_cmd(CAM_CMD_CAM_SET_PERSPECTIVE_FACTOR, config.cam_perspective_factor);
-  delay(3);     
-  cam_send_cmd(CAM_CMD_BLOB_SET_LUMI_LOW, config.blob_lumi_low);
-  delay(3);    
-  cam_send_cmd(CAM_CMD_BLOB_SET_LUMI_HIGH, config.blob_lumi_high);
-  delay(3);   
-  cam_send_cmd(CAM_CMD_HISTEQ_WANTED, config.cam_histeq_wanted);
-  delay(3);   
-  cam_send_cmd(CAM_CMD_NEGATE_WANTED, config.cam_negate_wanted);
-  delay(3);  
-  if (config.cam_perspective_wanted == 0) {
-    cam_send_cmd(CAM_CMD_CAM_PERSPECTIVE_OFF);
-  } else {
-    cam_send_cmd(CAM_CMD_CAM_PERSPECTIVE_ON);
+  uint8_t payload[CAM_PARAM_BLOCK_LENGTH];
+  int n = 0;
+
+  n = cam_put_float(payload, n, config.blob_roiTweight);
+  n = cam_put_float(payload, n, config.blob_roiMweight);
+  n = cam_put_float(payload, n, config.blob_roiBweight);
+  n = cam_put_float(payload, n, config.blob_float_thresh);
+  n = cam_put_float(payload, n, config.blob_seed_thresh);
+  n = cam_put_float(payload, n, config.pid_kp);
+  n = cam_put_float(payload, n, config.pid_ki);
+  n = cam_put_float(payload, n, config.pid_kd);
+  n = cam_put_float(payload, n, config.pid_steering_gain);
+  n = cam_put_float(payload, n, config.cam_perspective_factor);
+  n = cam_put_int(payload, n, config.blob_roiTloc);
+  n = cam_put_int(payload, n, config.blob_roiTheight);
+  n = cam_put_int(payload, n, config.blob_roiMloc);
+  n = cam_put_int(payload, n, config.blob_roiMheight);
+  n = cam_put_int(payload, n, config.blob_roiBloc);
+  n = cam_put_int(payload, n, config.blob_roiBheight);
+  n = cam_put_int(payload, n, config.blob_seed_loc);
+  n = cam_put_int(payload, n, config.pid_steering_direction);
+  n = cam_put_int(payload, n, config.blob_lumi_low);
+  n = cam_put_int(payload, n, config.blob_lumi_high);
+  n = cam_put_int(payload, n, config.cam_histeq_wanted);
+  n = cam_put_int(payload, n, config.cam_negate_wanted);
+  n = cam_put_int(payload, n, config.cam_perspective_wanted);
+  cam_send_frame(CAM_CMD_PARAM_BLOCK, payload, n);
+}
+
+/*
+ * brings the camera's tuning parameters in line with config, sending only
+ * those that differ from what the shadow says the camera already has.
+ * if the shadow is cold (nothing known yet) or many things changed, the
+ * whole set goes as one CAM_CMD_PARAM_BLOCK instead
+ * returns the number of frames queued (0 if the camera was already in sync)
+ */
+int cam_sync_parameters() {
+  CamParamEntry params[CAM_NUM_PARAMS];
+  int num_params, num_changed;
+  bool cold;
+
+  num_params = cam_desired_params(params);
+  num_changed = 0;
+  cold = false;
+  for (int i=0; i<num_params; i++) {
+    if (!cam_shadow.valid[params[i].cmd]) {
+      cold = true;
+    }
+    if (!cam_shadow_matches(&params[i])) {
+      num_changed++;
+    }
+  }
+  if (num_changed == 0) {
+    return 0;
+  }
+  if (cold || (num_changed >= CAM_SYNC_BLOCK_THRESHOLD)) {
+    cam_preset_paremeters();
+    return 1;
+  }
+  for (int i=0; i<num_params; i++) {
+    if (!cam_shadow_matches(&params[i])) {
+      cam_send_param(&params[i]);
+    }
+  }
+  return num_changed;
+}
+
+/*
+ * forget everything the shadow knows (eg if the camera may have restarted)
+ * so the next cam_sync_parameters() sends the full block
+ */
+void cam_shadow_invalidate() {
+  for (int i=0; i<CAM_SHADOW_SLOTS; i++) {
+    cam_shadow.valid[i] = false;
   }
 }
 
@@ -466,8 +651,832 @@ void cam_enter_preferred_mode() {
     cam_send_cmd(CAM_CMD_MODE_IDLE);
   }
 }
+
+/*
+ * finds the fastest link rate that carries a burst of test frames cleanly
+ * both ways, and leaves the link there.  called once from setup(); it
+ * blocks (running cam_loop()) for well under 1 second when all goes well
+ * and never much past CAM_BAUD_NEGOTIATE_MS: a faster rate is only tried
+ * if its request, test and the way back all fit in what is left.  if the
+ * camera does not answer the test at BAUD_RATE_SERCOM1 (not up yet, or
+ * older camera code) nothing is changed
+ *
+ * when the way back to base is not answered this end goes back anyway and
+ * does not wait for the camera: it returns to base by itself within
+ * CAM_BAUD_LOST_MS while loop() runs, and commands sent meanwhile are retried
+ */
+void cam_negotiate_baud() {
+  unsigned long start_ms, negotiate_ms;
+
+  cam_baud_probing = true;
+  memset(cam_baud_results, 0, sizeof(cam_baud_results));
+
+  // let whatever cam_init() queued (the parameter block) be answered first
+  negotiate_ms = millis();
+  start_ms = millis();
+  while (((cam_txq_head != cam_txq_tail) || (cam_cmd_pending() > 0)) && ((millis() - start_ms) < CAM_BAUD_ACK_MS)) {
+    cam_loop();
+  }
+
+  if (!cam_baud_probe(0)) {
+    DEBUG_PRINTLN("cam link test failed at base rate, not trying faster rates");
+  } else {
+    for (int i=1; i<CAM_BAUD_NUM_RATES; i++) {
+      if ((millis() - negotiate_ms) + CAM_BAUD_ACK_MS + CAM_BAUD_TEST_MS + CAM_BAUD_ACK_MS > CAM_BAUD_NEGOTIATE_MS) {
+        DEBUG_PRINTLN("cam link negotiation out of time, not trying slower rates");
+        break;
+      }
+      if (!cam_baud_request(cam_baud_rates[i])) {
+        // refused, or the answer was lost; if it did switch the camera comes back by itself
+        cam_baud_pump(CAM_BAUD_REVERT_MS);
+        continue;
+      }
+      if (cam_baud_probe(i)) {
+        break;
+      }
+      if (!cam_baud_request(BAUD_RATE_SERCOM1)) {
+        break;
+      }
+    }
+  }
+
+  DEBUG_PRINT("cam link rate ");
+  DEBUG_PRINTLN(cam_baud_current);
+  for (int i=0; i<CAM_BAUD_NUM_RATES; i++) {
+    if (cam_baud_results[i].tried) {
+      DEBUG_PRINT("  ");
+      DEBUG_PRINT(cam_baud_rates[i]);
+      DEBUG_PRINT(cam_baud_results[i].clean ? " clean, " : " FAILED, ");
+      DEBUG_PRINT(cam_baud_results[i].bytes_per_sec);
+      DEBUG_PRINT(" bytes/s, errors ");
+      DEBUG_PRINTLN(cam_baud_results[i].errors);
+    }
+  }
+  cam_baud_last_errors = cam_baud_link_errors();
+  cam_baud_last_late_drops = cam_baud_late_drops();
+  cam_baud_bad_seconds = 0;
+  cam_baud_next_check_ms = millis() + CAM_BAUD_CHECK_MS;
+  cam_baud_probing = false;
+}
+
+uint32_t cam_baud_rate() {
+  return cam_baud_current;
+}
+
+/*
+ * link speed results as one string with no spaces (fields separated by ':'):
+ * current rate, fallbacks, then for each rate tried (cam_baud_rates[] order):
+ * rate, tried (0/1), clean (0/1), good test frames, errors, effective bytes/s
+ */
+String cam_baud_summary() {
+  String summary;
+
+  summary = String(cam_baud_current) + ":" + String(cam_baud_fallbacks);
+  for (int i=0; i<CAM_BAUD_NUM_RATES; i++) {
+    summary = summary + ":" + String(cam_baud_rates[i]);
+    summary = summary + ":" + String(cam_baud_results[i].tried ? 1 : 0);
+    summary = summary + ":" + String(cam_baud_results[i].clean ? 1 : 0);
+    summary = summary + ":" + String(cam_baud_results[i].frames);
+    summary = summary + ":" + String(cam_baud_results[i].errors);
+    summary = summary + ":" + String(cam_baud_results[i].bytes_per_sec);
+  }
+  return summary;
+}
+
 /*
  * **************************************************
  * private functions
  * **************************************************
  */
+
+/*
+ * called by the parser for every frame that passed framing and CRC
+ * checks; payload[] holds only the payload bytes of the frame.
+ * frames of an unknown type, or too short for their type, are dropped 
+ * here so the handlers never see them
+ */
+void cam_got_frame(uint8_t msg_type, uint8_t seq, const uint8_t *payload, int len, void *context) {
+  const CamMsgType *mt;
+
+  if (msg_type >= CAM_NUM_MSG_TYPES) {
+    return;
+  }
+  mt = &cam_msg_types[msg_type];
+  cam_stats_note_frame(mt->channel, len, millis());
+  if ((mt->handler == NULL) || (len < mt->min_len)) {
+    return;
+  }
+  mt->handler(seq, payload, len);
+}
+
+/*
+ * MSG_STEERANGLE
+ * the "steer_angle" should be an integer -255 full left, +255 full right, 0=straight
+ */
+void cam_msg_steerangle(uint8_t seq, const uint8_t *payload, int len) {
+  int16_t steer_cmd_val, angle_error, target_angle;
+  uint32_t frame_ms;     // time the frame's image was taken
+
+  cam_stats_note_steer(millis());
+  steer_cmd_val = cam_get_int16(payload, len, 0, 0);
+  angle_error = cam_get_int16(payload, len, 2, 0);
+  target_angle = cam_get_int16(payload, len, 4, 0);
+  frame_ms = millis();     // unstamped frames: arrival time is the best there is
+  if (len >= MSG_STEERANGLE_STAMPED_LENGTH) {
+    frame_ms = cam_get_uint32(payload, len, 6, frame_ms);
+    CAM_LAT_PARSE(seq, frame_ms);
+  }
+  mode_got_msg_steerangle(steer_cmd_val, angle_error, target_angle, frame_ms);
+  DEBUG_PRINT("CAM GOT MESSAGE");
+  DEBUG_PRINTLN(steer_cmd_val);
+}
+
+/*
+ * MSG_ACK
+ */
+void cam_msg_ack(uint8_t seq, const uint8_t *payload, int len) {
+  CamPending *pend;
+
+  pend = cam_window_find(seq);
+  if (pend != NULL) {
+    cam_num_acks++;
+    cam_cmd_acked(pend->frame);
+    pend->in_use = false;
+  }
+}
+
+/*
+ * MSG_NACK
+ * the camera got the command but could not use it; sending it again will not help
+ */
+void cam_msg_nack(uint8_t seq, const uint8_t *payload, int len) {
+  CamPending *pend;
+
+  pend = cam_window_find(seq);
+  if (pend != NULL) {
+    cam_num_nacks++;
+    cam_cmd_failed(pend->frame);
+    pend->in_use = false;
+  }
+}
+
+/*
+ * MSG_IMG_HEADER and MSG_IMG_CHUNK (pictures are put together in cam_image.cpp)
+ */
+void cam_msg_img_header(uint8_t seq, const uint8_t *payload, int len) {
+  cam_image_got_header(payload, len);
+}
+
+void cam_msg_img_chunk(uint8_t seq, const uint8_t *payload, int len) {
+  cam_image_got_chunk(payload, len);
+}
+
+/*
+ * MSG_LINK_TEST
+ * frames from an older test (or a keep-alive already given up on) are ignored
+ */
+void cam_msg_link_test(uint8_t seq, const uint8_t *payload, int len) {
+  uint8_t pattern[CAM_LINK_TEST_PATTERN_LEN];
+  uint16_t cam_errors;
+
+  if ((uint16_t) cam_get_int16(payload, len, 0, 0) != cam_link_test.id) {
+    return;
+  }
+  cam_link_pattern(cam_link_test.id, pattern);
+  if (memcmp(&payload[6], pattern, CAM_LINK_TEST_PATTERN_LEN) != 0) {
+    cam_link_test.bad++;
+    return;
+  }
+  cam_errors = (uint16_t) cam_get_int16(payload, len, 4, 0);
+  if (cam_errors > cam_link_test.cam_errors) {
+    cam_link_test.cam_errors = cam_errors;
+  }
+  cam_link_test.last_us = micros();
+  if (cam_link_test.good == 0) {
+    cam_link_test.first_us = cam_link_test.last_us;
+  }
+  cam_link_test.good++;
+}
+
+/*
+ * MSG_TIME_PONG
+ * stamped as soon as it is decoded; any wait in cam_loop() only adds to
+ * the exchange's delay, which cam_clock allows for
+ */
+void cam_msg_time_pong(uint8_t seq, const uint8_t *payload, int len) {
+  int64_t now_us = esp_timer_get_time();
+
+  cam_clock_got_pong(cam_get_uint32(payload, len, 0, 0), cam_get_uint32(payload, len, 4, 0),
+                     cam_get_uint32(payload, len, 8, 0), now_us);
+}
+
+/*
+ * all commands to the camera go out through here so the frame
+ * is built in one place.  the frame is encoded into the next free
+ * queue slot and sent as soon as the UART has room; this never waits
+ */
+bool cam_send_frame(uint8_t cmd, const uint8_t *payload, int len) {
+  CamTxSlot *slot;
+  uint8_t seq;
+
+  if ((cam_txq_head - cam_txq_tail) >= CAM_TXQ_SLOTS) {
+    cam_txq_drops++;
+    DEBUG_PRINTLN("cam tx queue full, frame dropped");
+    return false;
+  }
+  if ((cmd == CAM_CMD_SEND_PIC) || (cmd == CAM_CMD_RESEND_CHUNK) || (cmd == CAM_CMD_RESEND_FROM)
+      || (cmd == CAM_CMD_LINK_TEST) || (cmd == CAM_CMD_TIME_PING) || (cmd == CAM_CMD_SESSION)) {
+    seq = 0;      // answered by the picture (test frames, pong) itself, or not at all
+  } else {
+    seq = cam_next_seq++;
+    if (cam_next_seq == 0) {
+      cam_next_seq = 1;
+    }
+  }
+  slot = &cam_txq[cam_txq_head & (CAM_TXQ_SLOTS - 1)];
+  slot->len = cam_frame_encode(slot->frame, cmd, seq, payload, len);
+  if (slot->len <= 0) {
+    return false;
+  }
+  cam_txq_head++;
+  cam_tx_service();
+  return true;
+}
+
+/*
+ * hands queued frames to the UART, oldest first, one write() per frame,
+ * for as long as each whole frame fits in the driver's transmit buffer.
+ * a sequenced frame also needs a free place in the ACK window
+ */
+void cam_tx_service(void) {
+  CamTxSlot *slot;
+  CamPending *pend;
+  uint8_t cmd, seq;
+
+  while (cam_txq_tail != cam_txq_head) {
+    slot = &cam_txq[cam_txq_tail & (CAM_TXQ_SLOTS - 1)];
+    cmd = slot->frame[2];
+    seq = slot->frame[3];
+    if (sercom1_tx_room() < slot->len) {
+      break;
+    }
+    pend = NULL;
+    if (seq != 0) {
+      pend = cam_window_alloc(cmd);
+      if (pend == NULL) {
+        break;
+      }
+    }
+    sercom1_write(slot->frame, slot->len);
+    if (pend != NULL) {
+      memcpy(pend->frame, slot->frame, slot->len);
+      pend->len = slot->len;
+      pend->sent_ms = millis();
+      pend->retries = 0;
+      pend->in_use = true;
+    }
+    cam_txq_tail++;
+  }
+}
+
+/*
+ * re-sends commands whose ACK is overdue; after CAM_MAX_RETRIES the
+ * command is given up on (and counted as a failure)
+ */
+void cam_retransmit_check(void) {
+  CamPending *pend;
+  unsigned long now = millis();
+
+  for (int i=0; i<CAM_ACK_WINDOW; i++) {
+    pend = &cam_window[i];
+    if (!pend->in_use || ((now - pend->sent_ms) < CAM_ACK_TIMEOUT_MS)) {
+      continue;
+    }
+    if (pend->retries >= CAM_MAX_RETRIES) {
+      cam_num_failures++;
+      DEBUG_PRINT("cam command not acknowledged, giving up on ");
+      DEBUG_PRINTLN(pend->frame[2]);
+      cam_cmd_failed(pend->frame);
+      pend->in_use = false;
+      continue;
+    }
+    if (sercom1_tx_room() < pend->len) {
+      break;
+    }
+    sercom1_write(pend->frame, pend->len);
+    pend->sent_ms = now;
+    pend->retries++;
+    cam_num_retries++;
+  }
+}
+
+/*
+ * finds a free place in the ACK window for a command.  a command that is
+ * still waiting for an answer but would be overridden by this one (same
+ * group) is dropped, so a late re-send can never undo a newer command.
+ * a CAM_CMD_PARAM_BLOCK and a single parameter it carries override each
+ * other too: a block dropped that way may or may not have got through,
+ * so it is handled as failed (the next cam_sync_parameters() resends)
+ */
+CamPending *cam_window_alloc(uint8_t cmd) {
+  CamPending *found = NULL;
+  uint8_t group = cam_cmd_group(cmd);
+  uint8_t pending_cmd;
+
+  for (int i=0; i<CAM_ACK_WINDOW; i++) {
+    if (cam_window[i].in_use) {
+      pending_cmd = cam_window[i].frame[2];
+      if (cam_cmd_group(pending_cmd) == group) {
+        cam_window[i].in_use = false;
+      } else if ((cmd == CAM_CMD_PARAM_BLOCK) && cam_cmd_in_block(pending_cmd)) {
+        cam_window[i].in_use = false;
+      } else if ((pending_cmd == CAM_CMD_PARAM_BLOCK) && cam_cmd_in_block(cmd)) {
+        cam_cmd_failed(cam_window[i].frame);
+        cam_window[i].in_use = false;
+      }
+    }
+    if (!cam_window[i].in_use && (found == NULL)) {
+      found = &cam_window[i];
+    }
+  }
+  return found;
+}
+
+CamPending *cam_window_find(uint8_t seq) {
+  for (int i=0; i<CAM_ACK_WINDOW; i++) {
+    if (cam_window[i].in_use && (cam_window[i].frame[3] == seq)) {
+      return &cam_window[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * true for the single-parameter commands whose value is also a
+ * CAM_CMD_PARAM_BLOCK field
+ */
+bool cam_cmd_in_block(uint8_t cmd) {
+  for (unsigned int i=0; i<CAM_BLOCK_FIELDS; i++) {
+    if (cam_block_layout[i][0] == cmd) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * commands that set the same camera state share a group
+ */
+uint8_t cam_cmd_group(uint8_t cmd) {
+  switch(cmd) {
+    case CAM_CMD_MODE_IDLE:
+    case CAM_CMD_MODE_BLOBS:
+    case CAM_CMD_MODE_REGRESSION_LINE:
+    case CAM_CMD_MODE_GRAYSCALE:
+    case CAM_CMD_MODE_LANE_LINES:
+      return CAM_CMD_MODE_IDLE;
+    case CAM_CMD_DRIVE_ON:
+    case CAM_CMD_DRIVE_OFF:
+    case CAM_CMD_DRIVE_READY:
+      return CAM_CMD_DRIVE_ON;
+    case CAM_CMD_CAM_PERSPECTIVE_ON:
+    case CAM_CMD_CAM_PERSPECTIVE_OFF:
+      return CAM_CMD_CAM_PERSPECTIVE_ON;
+  }
+  return cmd;
+}
+
+/*
+ * the camera has confirmed the command in frame[], so its effects are now fact
+ */
+void cam_cmd_acked(const uint8_t *frame) {
+  uint8_t cmd = frame[2];
+  const uint8_t *payload = &frame[CAM_HEADER_LENGTH];
+  int len = frame[4];
+
+  if ((cmd == CAM_CMD_DRIVE_OFF) || (cam_cmd_group(cmd) == CAM_CMD_MODE_IDLE)) {
+    // every steering frame sent before this has already arrived
+    cam_stats_steer_stopped();
+  }
+  switch(cmd) {
+    case CAM_CMD_MODE_IDLE:
+      cam_mode = CAM_MODE_IDLE;
+      break;
+    case CAM_CMD_MODE_BLOBS:
+      cam_mode = CAM_MODE_BLOB1;
+      break;
+    case CAM_CMD_MODE_REGRESSION_LINE:
+      cam_mode = CAM_MODE_REGRES1;
+      break;
+    case CAM_CMD_MODE_LANE_LINES:
+      cam_mode = CAM_MODE_LANE_LINES;
+      break;
+    case CAM_CMD_MODE_GRAYSCALE:
+      cam_mode = CAM_MODE_UNKNOWN;
+      break;
+    case CAM_CMD_PARAM_BLOCK:
+      cam_shadow_note_block(payload, len);
+      break;
+    case CAM_CMD_SET_BAUD:
+      // the camera has switched; this end follows at the end of cam_loop()
+      cam_baud_switch_to = cam_get_uint32(payload, len, 0, 0);
+      cam_baud_set_state = CAM_BAUD_SET_ACKED;
+      break;
+    default:
+      cam_shadow_note(cmd, payload, len);
+      break;
+  }
+}
+
+/*
+ * the command in frame[] was refused or never confirmed, so we no longer
+ * know what the camera holds for the state it sets
+ */
+void cam_cmd_failed(const uint8_t *frame) {
+  uint8_t cmd = frame[2];
+
+  switch(cam_cmd_group(cmd)) {
+    case CAM_CMD_MODE_IDLE:
+      cam_mode = CAM_MODE_UNKNOWN;
+      break;
+    case CAM_CMD_PARAM_BLOCK:
+      cam_shadow_invalidate();
+      break;
+    case CAM_CMD_CAM_PERSPECTIVE_ON:
+      cam_shadow.valid[CAM_CMD_CAM_PERSPECTIVE_ON] = false;
+      break;
+    case CAM_CMD_SET_BAUD:
+      // going back to base happens regardless: a camera that did not hear it
+      // returns there by itself once nothing good gets through
+      if (cam_get_uint32(&frame[CAM_HEADER_LENGTH], frame[4], 0, 0) == BAUD_RATE_SERCOM1) {
+        cam_baud_switch_to = BAUD_RATE_SERCOM1;
+      }
+      cam_baud_set_state = CAM_BAUD_SET_FAILED;
+      break;
+    default:
+      if (cmd < CAM_SHADOW_SLOTS) {
+        cam_shadow.valid[cmd] = false;
+      }
+      break;
+  }
+}
+
+/*
+ * fills list[] with the value config wants for every shadowed parameter,
+ * in the same form the single-parameter commands send it
+ */
+int cam_desired_params(CamParamEntry *list) {
+  int n = 0;
+
+  n = cam_add_float_param(list, n, CAM_CMD_BLOB_ROI_WEIGHT_T, config.blob_roiTweight);
+  n = cam_add_float_param(list, n, CAM_CMD_BLOB_ROI_WEIGHT_M, config.blob_roiMweight);
+  n = cam_add_float_param(list, n, CAM_CMD_BLOB_ROI_WEIGHT_B, config.blob_roiBweight);
+  n = cam_add_ints_param(list, n, CAM_CMD_BLOB_ROI_POSITION_T, config.blob_roiTloc, config.blob_roiTheight);
+  n = cam_add_ints_param(list, n, CAM_CMD_BLOB_ROI_POSITION_M, config.blob_roiMloc, config.blob_roiMheight);
+  n = cam_add_ints_param(list, n, CAM_CMD_BLOB_ROI_POSITION_B, config.blob_roiBloc, config.blob_roiBheight);
+  n = cam_add_float_param(list, n, CAM_CMD_BLOB_SET_FLOATING_THRESH, config.blob_float_thresh);
+  n = cam_add_float_param(list, n, CAM_CMD_BLOB_SET_SEED_THRESH, config.blob_seed_thresh);
+  n = cam_add_int_param(list, n, CAM_CMD_BLOB_SET_SEED_LOC, config.blob_seed_loc);
+  n = cam_add_float_param(list, n, CAM_CMD_PID_SET_KP, config.pid_kp);
+  n = cam_add_float_param(list, n, CAM_CMD_PID_SET_KI, config.pid_ki);
+  n = cam_add_float_param(list, n, CAM_CMD_PID_SET_KD, config.pid_kd);
+  n = cam_add_float_param(list, n, CAM_CMD_PID_SET_STEERING_GAIN, config.pid_steering_gain);
+  n = cam_add_int_param(list, n, CAM_CMD_PID_SET_STEERING_DIRECTION, config.pid_steering_direction);
+  n = cam_add_float_param(list, n, CAM_CMD_CAM_SET_PERSPECTIVE_FACTOR, config.cam_perspective_factor);
+  n = cam_add_int_param(list, n, CAM_CMD_BLOB_SET_LUMI_LOW, config.blob_lumi_low);
+  n = cam_add_int_param(list, n, CAM_CMD_BLOB_SET_LUMI_HIGH, config.blob_lumi_high);
+  n = cam_add_int_param(list, n, CAM_CMD_HISTEQ_WANTED, config.cam_histeq_wanted);
+  n = cam_add_int_param(list, n, CAM_CMD_NEGATE_WANTED, config.cam_negate_wanted);
+  list[n].cmd = CAM_CMD_CAM_PERSPECTIVE_ON;
+  list[n].len = 1;
+  list[n].val[0] = (config.cam_perspective_wanted == 0) ? 0 : 1;
+  n++;
+  return n;
+}
+
+int cam_add_int_param(CamParamEntry *list, int n, uint8_t cmd, int value) {
+  list[n].cmd = cmd;
+  list[n].len = cam_put_int(list[n].val, 0, value);
+  return n + 1;
+}
+
+int cam_add_ints_param(CamParamEntry *list, int n, uint8_t cmd, int value1, int value2) {
+  list[n].cmd = cmd;
+  list[n].len = cam_put_int(list[n].val, cam_put_int(list[n].val, 0, value1), value2);
+  return n + 1;
+}
+
+int cam_add_float_param(CamParamEntry *list, int n, uint8_t cmd, float value) {
+  list[n].cmd = cmd;
+  list[n].len = cam_put_float(list[n].val, 0, value);
+  return n + 1;
+}
+
+/*
+ * sends one shadowed parameter using its own command
+ */
+void cam_send_param(CamParamEntry *entry) {
+  if (entry->cmd == CAM_CMD_CAM_PERSPECTIVE_ON) {
+    cam_send_cmd((entry->val[0] == 0) ? CAM_CMD_CAM_PERSPECTIVE_OFF : CAM_CMD_CAM_PERSPECTIVE_ON);
+  } else {
+    cam_send_frame(entry->cmd, entry->val, entry->len);
+  }
+}
+
+/*
+ * records a parameter command in the shadow; commands that are not
+ * tuning parameters (modes, pictures, the block itself) are ignored here
+ */
+void cam_shadow_note(uint8_t cmd, const uint8_t *payload, int len) {
+  uint8_t onoff;
+
+  switch(cmd) {
+    case CAM_CMD_CAM_PERSPECTIVE_ON:
+    case CAM_CMD_CAM_PERSPECTIVE_OFF:
+      // the commands themselves have no payload; entries from cam_desired_params() already carry the 0/1
+      if (len == 0) {
+        onoff = (cmd == CAM_CMD_CAM_PERSPECTIVE_ON) ? 1 : 0;
+        cmd = CAM_CMD_CAM_PERSPECTIVE_ON;
+        payload = &onoff;
+        len = 1;
+      }
+      break;
+    case CAM_CMD_BLOB_SET_SEED_LOC:
+    case CAM_CMD_BLOB_SET_FLOATING_THRESH:
+    case CAM_CMD_BLOB_SET_SEED_THRESH:
+    case CAM_CMD_BLOB_ROI_WEIGHT_T:
+    case CAM_CMD_BLOB_ROI_WEIGHT_M:
+    case CAM_CMD_BLOB_ROI_WEIGHT_B:
+    case CAM_CMD_BLOB_ROI_POSITION_T:
+    case CAM_CMD_BLOB_ROI_POSITION_M:
+    case CAM_CMD_BLOB_ROI_POSITION_B:
+    case CAM_CMD_PID_SET_KP:
+    case CAM_CMD_PID_SET_KI:
+    case CAM_CMD_PID_SET_KD:
+    case CAM_CMD_PID_SET_STEERING_GAIN:
+    case CAM_CMD_PID_SET_STEERING_DIRECTION:
+    case CAM_CMD_CAM_SET_PERSPECTIVE_FACTOR:
+    case CAM_CMD_BLOB_SET_LUMI_LOW:
+    case CAM_CMD_BLOB_SET_LUMI_HIGH:
+    case CAM_CMD_HISTEQ_WANTED:
+    case CAM_CMD_NEGATE_WANTED:
+      break;
+    default:
+      return;
+  }
+  if ((len <= 0) || (len > CAM_SHADOW_MAX_LEN)) {
+    return;
+  }
+  memcpy(cam_shadow.val[cmd], payload, len);
+  cam_shadow.len[cmd] = len;
+  cam_shadow.valid[cmd] = true;
+}
+
+/*
+ * records every field of an acknowledged CAM_CMD_PARAM_BLOCK in the shadow
+ */
+void cam_shadow_note_block(const uint8_t *payload, int len) {
+  uint8_t cmd, onoff;
+  int index = 0;
+
+  for (unsigned int i=0; i<CAM_BLOCK_FIELDS; i++) {
+    cmd = cam_block_layout[i][0];
+    if ((index + cam_block_layout[i][1]) > len) {
+      return;
+    }
+    if (cmd == CAM_CMD_CAM_PERSPECTIVE_ON) {
+      onoff = ((payload[index] | payload[index+1]) != 0) ? 1 : 0;
+      cam_shadow_note(cmd, &onoff, 1);
+    } else {
+      cam_shadow_note(cmd, &payload[index], cam_block_layout[i][1]);
+    }
+    index += cam_block_layout[i][1];
+  }
+}
+
+bool cam_shadow_matches(CamParamEntry *entry) {
+  if (!cam_shadow.valid[entry->cmd] || (cam_shadow.len[entry->cmd] != entry->len)) {
+    return false;
+  }
+  return (memcmp(cam_shadow.val[entry->cmd], entry->val, entry->len) == 0);
+}
+
+/*
+ * payload packing helpers; each stores one value LSB first at payload[index]
+ * and returns the index of the next free byte
+ */
+int cam_put_int(uint8_t *payload, int index, int value) {
+  payload[index] = value & 0xFF;
+  payload[index+1] = (value >> 8) & 0xFF;
+  return index + 2;
+}
+
+int cam_put_float(uint8_t *payload, int index, float value) {
+  // note both processors are little-endian IEEE-754, so the bytes go as-is
+  memcpy(&payload[index], &value, 4);
+  return index + 4;
+}
+
+int cam_put_uint32(uint8_t *payload, int index, uint32_t value) {
+  payload[index] = value & 0xFF;
+  payload[index+1] = (value >> 8) & 0xFF;
+  payload[index+2] = (value >> 16) & 0xFF;
+  payload[index+3] = (value >> 24) & 0xFF;
+  return index + 4;
+}
+
+/*
+ * the test pattern for a link test id: an LCG seeded from the id, taking
+ * the middle byte of each step (communicator.link_pattern() makes the same)
+ */
+void cam_link_pattern(uint16_t id, uint8_t *pattern) {
+  uint32_t x = 0x9E3779B9UL ^ id;
+
+  for (int i=0; i<CAM_LINK_TEST_PATTERN_LEN; i++) {
+    x = x * 1103515245UL + 12345UL;
+    pattern[i] = (x >> 16) & 0xFF;
+  }
+}
+
+/*
+ * sends CAM_CMD_LINK_TEST under a new id, asking for wanted frames back
+ */
+void cam_link_test_start(int wanted) {
+  uint8_t payload[CAM_LINK_TEST_LENGTH];
+
+  memset(&cam_link_test, 0, sizeof(cam_link_test));
+  cam_link_test.id = (uint16_t) ((micros() & 0x7FFE) + 1);
+  cam_link_test.wanted = wanted;
+  cam_put_int(payload, 0, cam_link_test.id);
+  cam_put_int(payload, 2, wanted);
+  cam_link_pattern(cam_link_test.id, &payload[4]);
+  cam_send_frame(CAM_CMD_LINK_TEST, payload, CAM_LINK_TEST_LENGTH);
+}
+
+/*
+ * asks the camera to change rate and waits (running cam_loop()) for the
+ * answer; true if it switched, in which case this end has too
+ */
+bool cam_baud_request(uint32_t baud) {
+  uint8_t payload[4];
+  unsigned long start_ms;
+
+  cam_put_uint32(payload, 0, baud);
+  cam_baud_set_state = CAM_BAUD_SET_PENDING;
+  cam_send_frame(CAM_CMD_SET_BAUD, payload, 4);
+  start_ms = millis();
+  while ((cam_baud_set_state == CAM_BAUD_SET_PENDING) && ((millis() - start_ms) < CAM_BAUD_ACK_MS)) {
+    cam_loop();
+    delay(1);
+  }
+  if (cam_baud_set_state == CAM_BAUD_SET_PENDING) {
+    cam_baud_set_state = CAM_BAUD_SET_FAILED;
+    if (baud == BAUD_RATE_SERCOM1) {
+      cam_baud_switch_to = BAUD_RATE_SERCOM1;
+      cam_baud_apply();
+    }
+  }
+  return (cam_baud_set_state == CAM_BAUD_SET_ACKED);
+}
+
+/*
+ * runs a link test at the current rate and keeps the result under
+ * cam_baud_rates[rate_index]; true if every frame came back and no error
+ * was seen at either end.  the effective rate counts whole frames over the
+ * time between the first test frame and the last, so it includes the
+ * camera's own per-frame overhead, not just the wire
+ */
+bool cam_baud_probe(int rate_index) {
+  CamBaudResult *result = &cam_baud_results[rate_index];
+  unsigned long start_ms;
+  uint32_t errors_before;
+
+  errors_before = cam_baud_link_errors();
+  cam_link_test_start(CAM_BAUD_TEST_FRAMES);
+  start_ms = millis();
+  // no delay() in here: frames are timed as they are parsed
+  while (((cam_link_test.good + cam_link_test.bad) < cam_link_test.wanted) && ((millis() - start_ms) < CAM_BAUD_TEST_MS)) {
+    cam_loop();
+  }
+  result->tried = true;
+  result->frames = cam_link_test.good;
+  result->errors = cam_link_test.bad + (cam_baud_link_errors() - errors_before) + cam_link_test.cam_errors;
+  result->bytes_per_sec = 0;
+  if ((cam_link_test.good > 1) && (cam_link_test.last_us != cam_link_test.first_us)) {
+    result->bytes_per_sec = (uint32_t) ((uint64_t) (cam_link_test.good - 1) * (MSG_LINK_TEST_LENGTH + CAM_HEADER_LENGTH + CAM_TRAILER_LENGTH)
+                                        * 1000000UL / (cam_link_test.last_us - cam_link_test.first_us));
+  }
+  result->clean = (cam_link_test.good == cam_link_test.wanted) && (result->errors == 0);
+  return result->clean;
+}
+
+/*
+ * keeps the link serviced for a while (used to sit out the camera's own revert)
+ */
+void cam_baud_pump(unsigned long ms) {
+  unsigned long start_ms = millis();
+
+  while ((millis() - start_ms) < ms) {
+    cam_loop();
+    delay(1);
+  }
+}
+
+/*
+ * switches this end to cam_baud_switch_to.  done between cam_loop() passes
+ * (never from inside a frame handler) since it empties the receive ring
+ */
+void cam_baud_apply(void) {
+  sercom1_set_baud(cam_baud_switch_to);
+  cam_parser_reset_frame(&cam_parser);
+  cam_baud_current = cam_baud_switch_to;
+  cam_baud_switch_to = 0;
+}
+
+/*
+ * once a second, while the link is above BAUD_RATE_SERCOM1: a second with
+ * CAM_BAUD_MAX_ERRORS or more errors, or with no answer to the last
+ * keep-alive test, is a bad second, and CAM_BAUD_BAD_SECONDS of them in a
+ * row send the link back to base.  the keep-alive (one small test frame
+ * each way) also keeps the camera from reverting on its own while nothing
+ * else is being sent
+ *
+ * a second in which the driver buffer overflowed is not counted either
+ * way: loop() came round too late, and the frames cut short by it show up
+ * as parser errors that say nothing about the wire
+ */
+void cam_baud_check(unsigned long now_ms) {
+  uint8_t payload[4];
+  uint32_t errors, new_errors, late_drops;
+  bool late;
+
+  if (cam_baud_probing || ((long) (now_ms - cam_baud_next_check_ms) < 0)) {
+    return;
+  }
+  cam_baud_next_check_ms = now_ms + CAM_BAUD_CHECK_MS;
+  errors = cam_baud_link_errors();
+  new_errors = errors - cam_baud_last_errors;
+  cam_baud_last_errors = errors;
+  late_drops = cam_baud_late_drops();
+  late = (late_drops != cam_baud_last_late_drops);
+  cam_baud_last_late_drops = late_drops;
+  if ((cam_baud_current == BAUD_RATE_SERCOM1) || (cam_baud_set_state == CAM_BAUD_SET_PENDING)) {
+    cam_baud_bad_seconds = 0;
+    return;
+  }
+
+  if (!late) {
+    if ((new_errors >= CAM_BAUD_MAX_ERRORS) || (cam_link_test.good == 0)) {
+      cam_baud_bad_seconds++;
+    } else {
+      cam_baud_bad_seconds = 0;
+    }
+  }
+  if (cam_baud_bad_seconds >= CAM_BAUD_BAD_SECONDS) {
+    cam_baud_fallbacks++;
+    cam_baud_bad_seconds = 0;
+    DEBUG_PRINT("cam link errors at ");
+    DEBUG_PRINT(cam_baud_current);
+    DEBUG_PRINTLN(", falling back to base rate");
+    // not waited for: cam_cmd_acked() / cam_cmd_failed() switch this end either way
+    cam_baud_set_state = CAM_BAUD_SET_PENDING;
+    cam_send_frame(CAM_CMD_SET_BAUD, payload, cam_put_uint32(payload, 0, BAUD_RATE_SERCOM1));
+    return;
+  }
+  cam_link_test_start(1);
+}
+
+/*
+ * the errors that say the wire is too fast: parser framing and CRC errors
+ * and UART FIFO overflows.  driver buffer overflows are left out (see
+ * cam_baud_late_drops()); they only mean loop() took too long
+ */
+uint32_t cam_baud_link_errors(void) {
+  return cam_parser.numErrorFraming + cam_parser.numErrorChecksum + sercom1_rx_fifo_overflows();
+}
+
+/*
+ * receive drops from the driver buffer filling up before loop() came round
+ */
+uint32_t cam_baud_late_drops(void) {
+  return sercom1_rx_overruns() - sercom1_rx_fifo_overflows();
+}
+
+/*
+ * every CAM_CLOCK_PING_MS, sends CAM_CMD_TIME_PING stamped with the robot's
+ * time (not while the link speed is being tested, so the test sees only
+ * its own frames).  the stamp is taken when the frame is queued, so time
+ * spent in the queue counts as delay, which is allowed for
+ */
+void cam_clock_ping(unsigned long now_ms) {
+  uint8_t payload[CAM_TIME_PING_LENGTH];
+
+  if (cam_baud_probing || ((long) (now_ms - cam_clock_next_ping_ms) < 0)) {
+    return;
+  }
+  cam_clock_next_ping_ms = now_ms + CAM_CLOCK_PING_MS;
+  cam_put_uint32(payload, 0, (uint32_t) esp_timer_get_time());
+  if (cam_send_frame(CAM_CMD_TIME_PING, payload, CAM_TIME_PING_LENGTH)) {
+    cam_clock_note_ping();
+  }
+}
@@ -30,6 +30,37 @@
 
 #include <Arduino.h>
 #include "config.h"
+#include "cam_parser.h"
+
+/*
+ * message types sent from camera to robot (frame type byte)
+ * note the frame format itself (version, lengths, CRC) is defined in cam_parser.h
+ */
+#define MSG_STEERANGLE    1
+#define MSG_TELEMETRY     2
+#define MSG_ACK           3
+#define MSG_NACK          4
+#define MSG_IMG_HEADER    5       // start of a picture (see cam_image.h)
+#define MSG_IMG_CHUNK     6       // one piece of a picture
+#define MSG_LINK_TEST     7       // test pattern, answer to CAM_CMD_LINK_TEST
+#define MSG_TIME_PONG     8       // answer to CAM_CMD_TIME_PING (see cam_clock.h)
+
+/*
+ * the link carries two logical channels, told apart by message type (see the
+ * table in cam.cpp): control (steering, ACK/NACK, picture headers) and image
+ * (picture chunks).  the camera sends image frames only in the time left
+ * before its next control frame is due
+ */
+#define CAM_CH_CONTROL    0
+#define CAM_CH_IMAGE      1
+#define CAM_NUM_CHANNELS  2
+
+#define MSG_STEERANGLE_LENGTH 6           // turn cmd, angle error, target angle
+#define MSG_STEERANGLE_STAMPED_LENGTH 10  // ... followed by camera millis() at image capture
+
+/*
+ * commands sent from robot to camera (frame type byte)
+ */
 
 #define CAM_CMD_MODE_IDLE 1
 #define CAM_CMD_MODE_BLOBS 2
@@ -60,6 +91,22 @@
 #define CAM_CMD_BLOB_SET_LUMI_HIGH 27
 #define CAM_CMD_HISTEQ_WANTED 28
 #define CAM_CMD_NEGATE_WANTED 29
+#define CAM_CMD_PARAM_BLOCK 30      // all tuning parameters in one frame (see cam.cpp)
+#define CAM_CMD_RESEND_CHUNK 31     // send one chunk of the last picture again
+#define CAM_CMD_RESEND_FROM 32      // send the last picture again from a given chunk on
+#define CAM_CMD_SET_BAUD 33         // change the link speed (see cam_negotiate_baud())
+#define CAM_CMD_LINK_TEST 34        // ask for test pattern frames back
+#define CAM_CMD_TIME_PING 35        // ask for the camera's time (see cam_clock.h)
+#define CAM_CMD_DRIVE_READY 36      // steering frames on, as CAM_CMD_DRIVE_ON, but the camera's PID does not integrate
+#define CAM_CMD_SESSION 37          // a robot (re)start: the camera forgets the sequence numbers it has seen
+
+#define CAM_PARAM_BLOCK_LENGTH 66
+
+#define CAM_LINK_TEST_PATTERN_LEN 120
+#define CAM_LINK_TEST_LENGTH (4 + CAM_LINK_TEST_PATTERN_LEN)    // CAM_CMD_LINK_TEST payload
+#define MSG_LINK_TEST_LENGTH (6 + CAM_LINK_TEST_PATTERN_LEN)    // MSG_LINK_TEST payload
+
+#define CAM_BAUD_NUM_RATES 3        // BAUD_RATE_SERCOM1 and the two faster rates tried
 
 void cam_init(void);
 void cam_loop(void);
@@ -69,11 +116,21 @@ void cam_send_cmd(uint8_t cmd, int param1, int param2);
 void cam_send_cmd(uint8_t cmd, float param1);
 void cam_timeout_check(void);
 void cam_preset_paremeters();
+int  cam_sync_parameters();
+void cam_shadow_invalidate();
 void cam_enter_preferred_mode();
+void cam_negotiate_baud();
+uint32_t cam_baud_rate();
+String cam_baud_summary();
 
 bool cam_append_pic(String &pagebuf);
 void cam_request_pic();
-char* cam_return_pic();
 bool cam_check_cam_image_readiness();
 
+uint32_t cam_tx_drops();
+uint32_t cam_cmd_retries();
+uint32_t cam_cmd_failures();
+uint32_t cam_cmd_acks();
+int cam_cmd_pending();
+
 #endif  /* CAM_H */
@@ -0,0 +1,300 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include "cam_clock.h"
+#include "esp_timer.h"
+
+#define CAM_CLOCK_WINDOW        8       // exchanges per window; the one with the smallest delay is kept
+#define CAM_CLOCK_POINTS        64      // kept exchanges the drift is fitted over (about 2 minutes at 4 pings a second)
+#define CAM_CLOCK_CAM_RES_US    500     // camera stamps are whole mS: +/- half of one
+#define CAM_CLOCK_MAX_RTT_US    1000000 // longer round trips are answers to pings from before a restart
+#define CAM_CLOCK_STEP_US       50000   // a kept exchange this far outside the estimate (beyond both bounds) starts it over
+#define CAM_CLOCK_FIT_MIN_US    15000000 // points must span this long before the drift is believed
+#define CAM_CLOCK_MAX_PPM       200.0   // ... and it is never more than this (crystals are within 100)
+#define CAM_CLOCK_MIN_ERR_PPM   2.0     // the drift is never taken to be known better than this
+
+struct CamClockPoint {
+  int64_t  at_us;           // robot time of the middle of the exchange
+  int64_t  offset_us;       // robot - camera
+  uint32_t delay_us;
+};
+
+CamClock cam_clock;
+CamClockPoint cam_clock_points[CAM_CLOCK_POINTS];
+int cam_clock_num_points;
+int cam_clock_next_point;
+CamClockPoint cam_clock_best;   // smallest delay so far in the current window
+int cam_clock_win_count;
+
+/*
+ * templates for private functions
+ */
+void cam_clock_step_check(const CamClockPoint *point);
+void cam_clock_add_point(const CamClockPoint *point);
+void cam_clock_fit(void);
+void cam_clock_pick(int64_t now_us);
+int64_t cam_clock_offset_at(int64_t robot_us);
+uint32_t cam_clock_error_at(int64_t robot_us);
+uint32_t cam_clock_point_error(const CamClockPoint *point, int64_t robot_us);
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+void cam_clock_init() {
+  memset(&cam_clock, 0, sizeof(cam_clock));
+  cam_clock.drift_err_ppm = CAM_CLOCK_MAX_PPM;
+  cam_clock_num_points = 0;
+  cam_clock_next_point = 0;
+  cam_clock_win_count = 0;
+}
+
+void cam_clock_note_ping() {
+  cam_clock.pings++;
+}
+
+/*
+ * one answered ping.  t1_us is the low 32 bits of the robot time it was
+ * sent at; no exchange is anywhere near 71 minutes long, so the rest of
+ * it comes from t4_us
+ */
+void cam_clock_got_pong(uint32_t t1_us, uint32_t t2_ms, uint32_t t3_ms, int64_t t4_us) {
+  CamClockPoint point;
+  uint32_t rtt_us, cam_us;
+
+  rtt_us = (uint32_t) t4_us - t1_us;
+  if (rtt_us > CAM_CLOCK_MAX_RTT_US) {
+    return;
+  }
+  cam_us = (t3_ms - t2_ms) * 1000;
+  if (cam_us > rtt_us) {
+    cam_us = rtt_us;      // the two ends rounded opposite ways
+  }
+  cam_clock.pongs++;
+  cam_clock.last_rtt_us = rtt_us;
+
+  // each camera stamp is taken as the middle of its mS
+  point.at_us = t4_us - rtt_us + rtt_us / 2;
+  point.offset_us = point.at_us - (((int64_t) t2_ms + t3_ms) * 500 + CAM_CLOCK_CAM_RES_US);
+  point.delay_us = rtt_us - cam_us;
+  cam_clock_step_check(&point);
+
+  if ((cam_clock_win_count == 0) || (point.delay_us < cam_clock_best.delay_us)) {
+    cam_clock_best = point;
+  }
+  if (++cam_clock_win_count >= CAM_CLOCK_WINDOW) {
+    cam_clock_win_count = 0;
+    cam_clock_add_point(&cam_clock_best);
+  }
+}
+
+/*
+ * maps a camera millis() stamp to robot millis(); error_ms bounds how far
+ * the answer may be from the truth.  false until the first window is in
+ */
+bool cam_clock_to_robot_ms(uint32_t cam_ms, uint32_t *robot_ms, uint32_t *error_ms) {
+  int64_t now_us, robot_us;
+
+  if (!cam_clock.valid) {
+    return false;
+  }
+  // the stamps being mapped are recent, so the offset as of now is used for them
+  now_us = esp_timer_get_time();
+  robot_us = (int64_t) cam_ms * 1000 + CAM_CLOCK_CAM_RES_US + cam_clock_offset_at(now_us);
+  *robot_ms = (uint32_t) (robot_us / 1000);    // as millis() on the ESP32
+  if (error_ms != NULL) {
+    *error_ms = (cam_clock_error_at(now_us) + CAM_CLOCK_CAM_RES_US + 999) / 1000;
+  }
+  return true;
+}
+
+const CamClock *cam_clock_get() {
+  return &cam_clock;
+}
+
+/*
+ * the estimate as one string with no spaces (fields separated by ':'):
+ * valid (0/1), offset (mS, robot - camera, as of now), drift and how far
+ * off it may be (ppm), error bound now (uS), delay of the exchange it came from (uS), latest round
+ * trip (uS), pings, pongs, windows, steps
+ */
+String cam_clock_summary() {
+  String summary;
+  int64_t now_us = esp_timer_get_time();
+
+  summary = String(cam_clock.valid ? 1 : 0);
+  summary = summary + ":" + String((double) cam_clock_offset_at(now_us) / 1000.0, 3);
+  summary = summary + ":" + String(cam_clock.drift_ppm, 1);
+  summary = summary + ":" + String(cam_clock.drift_err_ppm, 1);
+  summary = summary + ":" + String(cam_clock.valid ? cam_clock_error_at(now_us) : 0);
+  summary = summary + ":" + String(cam_clock.delay_us);
+  summary = summary + ":" + String(cam_clock.last_rtt_us);
+  summary = summary + ":" + String(cam_clock.pings);
+  summary = summary + ":" + String(cam_clock.pongs);
+  summary = summary + ":" + String(cam_clock.windows);
+  summary = summary + ":" + String(cam_clock.steps);
+  return summary;
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+/*
+ * an exchange that is nowhere near the estimate means the camera has
+ * restarted (its millis() began again), so everything so far is thrown
+ * away and the estimate starts over from this exchange
+ */
+void cam_clock_step_check(const CamClockPoint *point) {
+  int64_t miss_us;
+
+  if (!cam_clock.valid) {
+    return;
+  }
+  miss_us = point->offset_us - cam_clock_offset_at(point->at_us);
+  if (miss_us < 0) {
+    miss_us = -miss_us;
+  }
+  if (miss_us <= (int64_t) CAM_CLOCK_STEP_US + cam_clock_error_at(point->at_us) + point->delay_us / 2) {
+    return;
+  }
+  cam_clock.steps++;
+  cam_clock.drift_ppm = 0.0;
+  cam_clock.drift_err_ppm = CAM_CLOCK_MAX_PPM;
+  cam_clock_num_points = 0;
+  cam_clock_next_point = 0;
+  cam_clock_win_count = 0;
+  DEBUG_PRINT("cam clock stepped by mS ");
+  DEBUG_PRINTLN((long) ((point->offset_us - cam_clock.offset_us) / 1000));
+  cam_clock_add_point(point);
+}
+
+/*
+ * keeps the best exchange of a window
+ */
+void cam_clock_add_point(const CamClockPoint *point) {
+  cam_clock_points[cam_clock_next_point] = *point;
+  cam_clock_next_point = (cam_clock_next_point + 1) % CAM_CLOCK_POINTS;
+  if (cam_clock_num_points < CAM_CLOCK_POINTS) {
+    cam_clock_num_points++;
+  }
+  cam_clock.windows++;
+  cam_clock.valid = true;
+  cam_clock_fit();
+  cam_clock_pick(point->at_us);
+}
+
+/*
+ * least squares slope of offset against time over the kept points, each
+ * weighted by 1 / (its error bound)^2 so a window that only had slow
+ * exchanges counts for little.  times are taken relative to the newest
+ * point to keep the numbers small.  the slope could be off by as much as
+ * a line from the bottom of the error bars at one end to the top at the
+ * other, which is what drift_err_ppm is (taking the mean bound)
+ */
+void cam_clock_fit(void) {
+  const CamClockPoint *newest, *pt;
+  double e, w, x, y, sw, sx, sy, sxx, sxy, se, denom, slope, slope_err;
+  int64_t span_us;
+
+  if (cam_clock_num_points < 3) {
+    return;
+  }
+  newest = &cam_clock_points[(cam_clock_next_point + CAM_CLOCK_POINTS - 1) % CAM_CLOCK_POINTS];
+  sw = sx = sy = sxx = sxy = se = 0.0;
+  span_us = 0;
+  for (int i=0; i<cam_clock_num_points; i++) {
+    pt = &cam_clock_points[i];
+    if (newest->at_us - pt->at_us > span_us) {
+      span_us = newest->at_us - pt->at_us;
+    }
+    e = (double) (pt->delay_us / 2 + CAM_CLOCK_CAM_RES_US);
+    w = 1.0 / (e * e);
+    x = (double) (pt->at_us - newest->at_us);
+    y = (double) (pt->offset_us - newest->offset_us);
+    sw += w;
+    sx += w * x;
+    sy += w * y;
+    sxx += w * x * x;
+    sxy += w * x * y;
+    se += e;
+  }
+  denom = sw * sxx - sx * sx;
+  if ((span_us < CAM_CLOCK_FIT_MIN_US) || (denom <= 0.0)) {
+    return;
+  }
+  slope = (sw * sxy - sx * sy) / denom * 1.0e6;
+  slope_err = 2.0 * (se / cam_clock_num_points) / (double) span_us * 1.0e6;
+  if ((slope > CAM_CLOCK_MAX_PPM) || (slope < -CAM_CLOCK_MAX_PPM) || (slope_err > CAM_CLOCK_MAX_PPM)) {
+    return;
+  }
+  cam_clock.drift_ppm = (float) slope;
+  cam_clock.drift_err_ppm = (float) max(slope_err, CAM_CLOCK_MIN_ERR_PPM);
+}
+
+/*
+ * takes the offset from the kept point whose bound, carried forward to
+ * now_us, is the smallest
+ */
+void cam_clock_pick(int64_t now_us) {
+  const CamClockPoint *best = NULL;
+  uint32_t error_us, best_error_us = 0;
+
+  for (int i=0; i<cam_clock_num_points; i++) {
+    error_us = cam_clock_point_error(&cam_clock_points[i], now_us);
+    if ((best == NULL) || (error_us < best_error_us)) {
+      best = &cam_clock_points[i];
+      best_error_us = error_us;
+    }
+  }
+  cam_clock.at_us = best->at_us;
+  cam_clock.offset_us = best->offset_us;
+  cam_clock.delay_us = best->delay_us;
+  cam_clock.error_us = best->delay_us / 2 + CAM_CLOCK_CAM_RES_US;
+}
+
+int64_t cam_clock_offset_at(int64_t robot_us) {
+  return cam_clock.offset_us + (int64_t) ((double) cam_clock.drift_ppm * (double) (robot_us - cam_clock.at_us) / 1.0e6);
+}
+
+uint32_t cam_clock_error_at(int64_t robot_us) {
+  int64_t age_us = robot_us - cam_clock.at_us;
+
+  if (age_us < 0) {
+    age_us = -age_us;
+  }
+  return cam_clock.error_us + (uint32_t) ((double) age_us * cam_clock.drift_err_ppm / 1.0e6);
+}
+
+uint32_t cam_clock_point_error(const CamClockPoint *point, int64_t robot_us) {
+  int64_t age_us = robot_us - point->at_us;
+
+  return point->delay_us / 2 + CAM_CLOCK_CAM_RES_US + (uint32_t) ((double) age_us * cam_clock.drift_err_ppm / 1.0e6);
+}
@@ -0,0 +1,89 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef CAM_CLOCK_H
+#define CAM_CLOCK_H
+
+/*
+ * ***************************************************************
+ * the cam_clock module keeps an estimate of how the camera's
+ * millis() relates to the robot's clock, so anything the camera
+ * stamps (steering frames carry the time their image was taken)
+ * can be placed on the robot's time line with a known error.
+ *
+ * cam.cpp sends CAM_CMD_TIME_PING every CAM_CLOCK_PING_MS with the
+ * robot's time t1; the camera answers MSG_TIME_PONG with t1 and
+ * its own millis() on receipt (t2) and on sending (t3), and the
+ * answer is stamped t4 here.  as in NTP, for each exchange
+ *    offset = ((t1 - t2) + (t4 - t3)) / 2    (robot - camera)
+ *    delay  = (t4 - t1) - (t3 - t2)
+ * and the true offset is within delay / 2 of the one measured,
+ * however the delay was split between the two directions.  the
+ * camera only reads commands once per pass, so most exchanges sit
+ * in its UART for a while; of each CAM_CLOCK_WINDOW exchanges only
+ * the one with the smallest delay is kept.  drift is the slope of
+ * a least squares line through the last CAM_CLOCK_POINTS of those
+ * (until they span long enough it is taken as 0, give or take any
+ * crystal's worst),
+ * and the offset is taken from whichever of them, carried forward
+ * along that line, has the smallest error bound now.
+ *
+ * robot times are esp_timer_get_time() (uS, 64 bit, the clock
+ * behind millis() and micros()); camera times are whole mS, which
+ * adds half a mS to the error bound
+ * ***************************************************************
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+#define CAM_TIME_PING_LENGTH  4     // CAM_CMD_TIME_PING: 0-3 robot time (uS, low 32 bits)
+#define MSG_TIME_PONG_LENGTH  12    // MSG_TIME_PONG: 0-3 the same, 4-7 camera mS on receipt, 8-11 on sending
+
+struct CamClock {
+  bool     valid;           // at least one window has been completed
+  int64_t  offset_us;       // robot uS - camera uS, as of at_us
+  int64_t  at_us;           // robot time the offset was measured at (middle of its exchange)
+  float    drift_ppm;       // how fast offset_us grows: + when the robot clock runs faster
+  float    drift_err_ppm;   // drift_ppm is within this of the truth
+  uint32_t error_us;        // offset_us is within this of the truth (at at_us)
+  uint32_t delay_us;        // delay of the exchange offset_us came from
+  uint32_t last_rtt_us;     // round trip of the latest exchange
+  uint32_t pings;
+  uint32_t pongs;
+  uint32_t windows;         // windows completed (one kept exchange each)
+  uint32_t steps;           // times the estimate was thrown away (camera restarted)
+};
+
+void cam_clock_init();
+void cam_clock_note_ping();
+void cam_clock_got_pong(uint32_t t1_us, uint32_t t2_ms, uint32_t t3_ms, int64_t t4_us);
+bool cam_clock_to_robot_ms(uint32_t cam_ms, uint32_t *robot_ms, uint32_t *error_ms);
+const CamClock *cam_clock_get();
+String cam_clock_summary();
+
+#endif  /* CAM_CLOCK_H */
@@ -0,0 +1,361 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include "cam_image.h"
+#include "cam.h"
+#include "cam_parser.h"
+#include "img_buf.h"
+
+#define CAM_IMG_HEADER_WAIT_MS 1000   // camera answers within one of its frames (plus JPEG compression)
+#define CAM_IMG_GAP_MS         250    // no chunk for this long means the camera has sent all it is going to
+                                      // (it sends a few chunks per pass of its main loop)
+#define CAM_IMG_RESEND_BATCH   4      // chunks asked for again after each gap
+#define CAM_IMG_TIMEOUT_MS     5000   // whole picture, from the request
+
+uint8_t *cam_img_buffer = NULL;     // from img_buf, see cam_image_free_buffer()
+uint32_t cam_img_buffer_size = 0;
+uint8_t cam_img_have[(CAM_IMG_MAX_CHUNKS + 7) / 8];     // one bit per chunk received
+int      cam_img_state;
+uint16_t cam_img_id;
+uint32_t cam_img_len;
+int      cam_img_chunk_size;
+int      cam_img_num_chunks;
+int      cam_img_chunks_in;
+int      cam_img_next_missing;      // where the next search for missing chunks starts
+unsigned long cam_img_request_ms;
+unsigned long cam_img_last_rx_ms;
+uint32_t cam_img_resends;           // chunks asked for again, this picture
+CamImageSink cam_img_sink;          // NULL unless the picture is being streamed
+void        *cam_img_sink_ctx;
+CamImageStats cam_image_stats;
+
+/*
+ * templates for private functions
+ */
+void cam_image_start(CamImageSink sink, void *ctx);
+void cam_image_fail();
+void cam_image_resend_missing();
+bool cam_image_have_chunk(int index);
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+void cam_image_init() {
+  cam_img_state = CAM_IMG_IDLE;
+  cam_img_sink = NULL;
+  cam_img_len = 0;
+  cam_img_num_chunks = 0;
+  memset(&cam_image_stats, 0, sizeof(cam_image_stats));
+}
+
+/*
+ * asks the camera for a picture; see cam_image_state() for progress
+ */
+void cam_image_request() {
+  cam_image_start(NULL, NULL);
+}
+
+/*
+ * asks the camera for a picture and hands each chunk to sink, in order,
+ * as it arrives (nothing is buffered; cam_image_data() stays NULL).  
+ * cam_image_state() still tells when it is complete (READY) or FAILED
+ */
+void cam_image_stream(CamImageSink sink, void *ctx) {
+  cam_image_start(sink, ctx);
+}
+
+/*
+ * MSG_IMG_HEADER: image id, total length (4 bytes), chunk size, chunk count
+ */
+void cam_image_got_header(const uint8_t *payload, int len) {
+  uint32_t total;
+  int chunk_size, num_chunks;
+
+  if (cam_img_state != CAM_IMG_WAITING) {
+    return;     // not asked for (or already given up on)
+  }
+  total = cam_get_uint32(payload, len, 2, 0);
+  chunk_size = (uint16_t) cam_get_int16(payload, len, 6, 0);
+  num_chunks = (uint16_t) cam_get_int16(payload, len, 8, 0);
+  if ((total == 0) || (total > CAM_IMG_BUFFER_SIZE) || (chunk_size <= 0) || (chunk_size > CAM_IMG_MAX_CHUNK)
+      || ((chunk_size % 3) != 0) || (num_chunks != (int) ((total + chunk_size - 1) / chunk_size))) {
+    DEBUG_PRINTLN("cam image header not usable (too big?)");
+    cam_image_fail();
+    return;
+  }
+  if (cam_img_sink == NULL) {
+    cam_img_buffer = imgbuf_fit(cam_img_buffer, &cam_img_buffer_size, total);
+    if (cam_img_buffer == NULL) {
+      cam_image_fail();
+      return;
+    }
+  }
+  cam_img_id = (uint16_t) cam_get_int16(payload, len, 0, 0);
+  cam_img_len = total;
+  cam_img_chunk_size = chunk_size;
+  cam_img_num_chunks = num_chunks;
+  cam_img_chunks_in = 0;
+  cam_img_next_missing = 0;
+  memset(cam_img_have, 0, sizeof(cam_img_have));
+  cam_img_last_rx_ms = millis();
+  cam_img_state = CAM_IMG_RECEIVING;
+}
+
+/*
+ * MSG_IMG_CHUNK: image id, chunk index, data; chunks may come in any
+ * order (resent ones arrive after the rest) and repeats are ignored
+ */
+void cam_image_got_chunk(const uint8_t *payload, int len) {
+  int index, expected;
+
+  if ((cam_img_state != CAM_IMG_RECEIVING) || ((uint16_t) cam_get_int16(payload, len, 0, 0) != cam_img_id)) {
+    return;
+  }
+  index = (uint16_t) cam_get_int16(payload, len, 2, 0);
+  if (index >= cam_img_num_chunks) {
+    return;
+  }
+  expected = cam_img_chunk_size;
+  if (index == (cam_img_num_chunks - 1)) {
+    expected = cam_img_len - (index * cam_img_chunk_size);
+  }
+  if ((len - CAM_IMG_CHUNK_OVERHEAD) != expected) {
+    return;
+  }
+  if (cam_img_sink != NULL) {
+    // streaming: only the next chunk in order is any use.  any chunk
+    // at all shows the camera is still sending, so hold off the go-back
+    cam_img_last_rx_ms = millis();
+    if (index != cam_img_chunks_in) {
+      return;
+    }
+    if (!cam_img_sink(&payload[CAM_IMG_CHUNK_OVERHEAD], expected, cam_img_sink_ctx)) {
+      return;
+    }
+  } else {
+    if (cam_image_have_chunk(index)) {
+      return;
+    }
+    memcpy(&cam_img_buffer[index * cam_img_chunk_size], &payload[CAM_IMG_CHUNK_OVERHEAD], expected);
+    cam_img_have[index >> 3] |= (1 << (index & 7));
+    cam_img_last_rx_ms = millis();
+  }
+  cam_img_chunks_in++;
+
+  if (cam_img_chunks_in == cam_img_num_chunks) {
+    cam_img_state = CAM_IMG_READY;
+    cam_image_stats.completed++;
+    cam_image_stats.last_bytes = cam_img_len;
+    cam_image_stats.last_ms = cam_img_last_rx_ms - cam_img_request_ms;
+    cam_image_stats.last_resends = cam_img_resends;
+  }
+}
+
+/*
+ * called often from loop(); asks again for missing chunks once the
+ * camera has stopped sending, and gives up on a picture that takes too long
+ */
+void cam_image_check() {
+  unsigned long now = millis();
+
+  if (cam_img_state == CAM_IMG_WAITING) {
+    if ((now - cam_img_request_ms) > CAM_IMG_HEADER_WAIT_MS) {
+      DEBUG_PRINTLN("timeout waiting for cam image header");
+      cam_image_fail();
+    }
+  } else if (cam_img_state == CAM_IMG_RECEIVING) {
+    if ((now - cam_img_request_ms) > CAM_IMG_TIMEOUT_MS) {
+      DEBUG_PRINTLN("timeout when collecting image");
+      cam_image_fail();
+    } else if ((now - cam_img_last_rx_ms) >= CAM_IMG_GAP_MS) {
+      cam_image_resend_missing();
+      cam_img_last_rx_ms = now;
+    }
+  }
+}
+
+int cam_image_state() {
+  return cam_img_state;
+}
+
+/*
+ * the completed picture (JPEG), or NULL if there isn't one
+ */
+const uint8_t *cam_image_data(int *len) {
+  if ((cam_img_state != CAM_IMG_READY) || (cam_img_sink != NULL)) {
+    *len = 0;
+    return NULL;
+  }
+  *len = cam_img_len;
+  return cam_img_buffer;
+}
+
+/*
+ * done with the picture (or with waiting for it)
+ */
+void cam_image_release() {
+  cam_img_state = CAM_IMG_IDLE;
+  cam_img_sink = NULL;
+}
+
+/*
+ * gives the picture buffer back to img_buf, dropping any picture that
+ * is being collected into it; the next picture gets a new one
+ */
+void cam_image_free_buffer() {
+  if ((cam_img_sink == NULL) && (cam_img_state != CAM_IMG_IDLE)) {
+    cam_image_release();
+  }
+  imgbuf_free(cam_img_buffer);
+  cam_img_buffer = NULL;
+  cam_img_buffer_size = 0;
+}
+
+/*
+ * appends the completed picture to s as base64 (for a data: url); this 
+ * is the only place the picture is ever base64 encoded
+ */
+void cam_image_append_base64(String &s) {
+  char tmp[((CAM_IMG_MAX_CHUNK / 3) * 4) + 1];
+  int n;
+
+  if ((cam_img_state != CAM_IMG_READY) || (cam_img_sink != NULL)) {
+    return;
+  }
+  s.reserve(s.length() + (((cam_img_len + 2) / 3) * 4) + 1);
+  for (uint32_t i=0; i<cam_img_len; i+=CAM_IMG_MAX_CHUNK) {
+    n = cam_img_len - i;
+    if (n > CAM_IMG_MAX_CHUNK) {
+      n = CAM_IMG_MAX_CHUNK;
+    }
+    n = cam_base64_encode(&cam_img_buffer[i], n, tmp);
+    tmp[n] = '\0';
+    s.concat(tmp);
+  }
+}
+
+/*
+ * standard base64 (with padding); out must hold 4 chars per 3 input
+ * bytes, rounded up.  returns the number of chars written (no terminator)
+ */
+int cam_base64_encode(const uint8_t *in, int len, char *out) {
+  static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  uint32_t v;
+  int i, n = 0;
+
+  for (i=0; (i + 2)<len; i+=3) {
+    v = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
+    out[n++] = digits[(v >> 18) & 0x3F];
+    out[n++] = digits[(v >> 12) & 0x3F];
+    out[n++] = digits[(v >> 6) & 0x3F];
+    out[n++] = digits[v & 0x3F];
+  }
+  if (i < len) {
+    v = in[i] << 16;
+    if ((i + 1) < len) {
+      v |= in[i+1] << 8;
+    }
+    out[n++] = digits[(v >> 18) & 0x3F];
+    out[n++] = digits[(v >> 12) & 0x3F];
+    out[n++] = ((i + 1) < len) ? digits[(v >> 6) & 0x3F] : '=';
+    out[n++] = '=';
+  }
+  return n;
+}
+
+const CamImageStats *cam_image_stats_get() {
+  return &cam_image_stats;
+}
+
+/*
+ * stats as one string with no spaces (fields separated by ':'), in the
+ * order: requested, completed, failed, resends, then for the last completed
+ * picture its size, transfer mS, and chunks resent
+ */
+String cam_image_summary() {
+  String s;
+
+  s = String(cam_image_stats.requested) + ":" + String(cam_image_stats.completed) + ":" + String(cam_image_stats.failed);
+  s += ":" + String(cam_image_stats.resends) + ":" + String(cam_image_stats.last_bytes);
+  s += ":" + String(cam_image_stats.last_ms) + ":" + String(cam_image_stats.last_resends);
+  return s;
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+void cam_image_start(CamImageSink sink, void *ctx) {
+  cam_send_cmd(CAM_CMD_SEND_PIC);
+  cam_img_sink = sink;
+  cam_img_sink_ctx = ctx;
+  cam_img_state = CAM_IMG_WAITING;
+  cam_img_request_ms = millis();
+  cam_img_resends = 0;
+  cam_image_stats.requested++;
+}
+
+void cam_image_fail() {
+  cam_img_state = CAM_IMG_FAILED;
+  cam_image_stats.failed++;
+}
+
+/*
+ * asks for the next few missing chunks, carrying on from where the 
+ * last search stopped so that every missing chunk gets its turn
+ */
+void cam_image_resend_missing() {
+  int asked = 0;
+  int index = cam_img_next_missing;
+
+  if (cam_img_sink != NULL) {
+    // streaming keeps no bitmap; go back to the first chunk not yet passed on
+    cam_send_cmd(CAM_CMD_RESEND_FROM, cam_img_id, cam_img_chunks_in);
+    cam_img_resends += cam_img_num_chunks - cam_img_chunks_in;
+    cam_image_stats.resends += cam_img_num_chunks - cam_img_chunks_in;
+    return;
+  }
+
+  for (int i=0; (i<cam_img_num_chunks) && (asked < CAM_IMG_RESEND_BATCH); i++) {
+    if (!cam_image_have_chunk(index)) {
+      cam_send_cmd(CAM_CMD_RESEND_CHUNK, cam_img_id, index);
+      asked++;
+    }
+    index = (index + 1) % cam_img_num_chunks;
+  }
+  cam_img_next_missing = index;
+  cam_img_resends += asked;
+  cam_image_stats.resends += asked;
+}
+
+bool cam_image_have_chunk(int index) {
+  return (cam_img_have[index >> 3] & (1 << (index & 7))) != 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef CAM_IMAGE_H
+#define CAM_IMAGE_H
+
+/*
+ * ***************************************************************
+ * the cam_image module collects JPEG pictures from the camera. 
+ * a picture arrives as ordinary frames on the camera link (so 
+ * steering and ACK frames keep flowing while it comes in):
+ *   - one MSG_IMG_HEADER giving the picture's id, length and how
+ *     it is cut into chunks
+ *   - MSG_IMG_CHUNK frames, each with the picture id, its chunk
+ *     index and up to CAM_IMG_MAX_CHUNK bytes of the JPEG.  each is
+ *     covered by the frame's own CRC, so a damaged chunk is simply
+ *     dropped by the parser
+ * chunks that are still missing once the flow stops are asked for
+ * again (CAM_CMD_RESEND_CHUNK), a few at a time, until the picture
+ * is whole or CAM_IMG_TIMEOUT_MS runs out.
+ *
+ * the picture is kept as binary; base64 is only produced at the
+ * HTTP edge (cam_image_append_base64()).  chunks are a multiple of
+ * 3 bytes so each one base64-encodes on its own
+ *
+ * the picture buffer comes from img_buf when the first picture is
+ * collected, sized (and grown) to fit, and is kept for the next one
+ * until cam_image_free_buffer() gives it back
+ *
+ * cam_image_stream() is the cut-through alternative: nothing is 
+ * stored, each chunk goes straight to a sink (eg the web client) in 
+ * order as it arrives.  a chunk that comes in ahead of a gap (or
+ * that the sink has no room for) is skipped, and once the flow stops
+ * the camera is asked to go back and send everything from the gap on
+ * (CAM_CMD_RESEND_FROM)
+ * ***************************************************************
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+#define CAM_IMG_BUFFER_SIZE  61440    // largest JPEG that can be received (buffers are sized to the picture)
+#define CAM_IMG_MAX_CHUNK    120      // data bytes per chunk (multiple of 3)
+#define CAM_IMG_MAX_CHUNKS   ((CAM_IMG_BUFFER_SIZE + CAM_IMG_MAX_CHUNK - 1) / CAM_IMG_MAX_CHUNK)
+
+#define CAM_IMG_HEADER_LENGTH 10      // MSG_IMG_HEADER: image id, total length, chunk size, chunk count
+#define CAM_IMG_CHUNK_OVERHEAD 4      // MSG_IMG_CHUNK: image id, chunk index, then the data
+
+#define CAM_IMG_IDLE       0
+#define CAM_IMG_WAITING    1   // asked for, header not in yet
+#define CAM_IMG_RECEIVING  2
+#define CAM_IMG_READY      3
+#define CAM_IMG_FAILED     4
+
+// receives each chunk of a streamed picture, in order; returns false if it
+// has no room for it just now (the chunk then comes again with the go-back)
+typedef bool (*CamImageSink)(const uint8_t *data, int len, void *ctx);
+
+struct CamImageStats {
+  uint32_t requested;
+  uint32_t completed;
+  uint32_t failed;
+  uint32_t resends;         // chunks asked for again, all pictures
+  uint32_t last_bytes;      // size of the last completed picture
+  uint32_t last_ms;         // request to last chunk, last completed picture
+  uint32_t last_resends;
+};
+
+void cam_image_init();
+void cam_image_request();
+void cam_image_stream(CamImageSink sink, void *ctx);
+void cam_image_got_header(const uint8_t *payload, int len);
+void cam_image_got_chunk(const uint8_t *payload, int len);
+void cam_image_check();
+int  cam_image_state();
+const uint8_t *cam_image_data(int *len);
+void cam_image_release();
+void cam_image_free_buffer();
+void cam_image_append_base64(String &s);
+int  cam_base64_encode(const uint8_t *in, int len, char *out);
+const CamImageStats *cam_image_stats_get();
+String cam_image_summary();
+
+#endif  /* CAM_IMAGE_H */
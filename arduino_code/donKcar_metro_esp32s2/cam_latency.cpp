@@ -0,0 +1,203 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include "cam_latency.h"
+#include "cam_clock.h"
+
+#define CAM_LAT_BUCKETS 201       // 0-199 mS in 1 mS steps, last bucket is 200 mS or more
+#define CAM_LAT_OFFSET_WINDOW 64  // samples per clock-offset window
+
+struct CamLatency {
+  uint32_t hist[CAM_LAT_NUM_STAGES][CAM_LAT_BUCKETS];
+  uint32_t count[CAM_LAT_NUM_STAGES];
+  uint32_t max_ms[CAM_LAT_NUM_STAGES];
+  uint32_t samples;
+  uint32_t missed;                // steering frames lost (gaps in the sequence number)
+};
+
+CamLatency cam_lat;
+
+/*
+ * clock offset (robot millis - camera millis) is the minimum over the
+ * current and previous window of samples, so it follows slow drift
+ * between the two clocks without being thrown by one slow frame
+ */
+long     cam_lat_offset;
+long     cam_lat_win_min;
+long     cam_lat_prev_win_min;
+int      cam_lat_win_count;
+bool     cam_lat_have_offset;
+
+uint32_t cam_lat_cur_cam_ms;      // camera time of the sample now in flight
+long     cam_lat_cur_offset;      // offset its ages are measured with
+uint8_t  cam_lat_cur_pending;     // bit per stage still to be recorded for it
+uint8_t  cam_lat_last_seq;
+bool     cam_lat_have_seq;
+
+/*
+ * templates for private functions
+ */
+void cam_latency_record(int stage, unsigned long now_ms);
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+void cam_latency_init() {
+  cam_latency_reset();
+  cam_lat_have_offset = false;
+  cam_lat_win_count = 0;
+  cam_lat_have_seq = false;
+  cam_lat_cur_pending = 0;
+}
+
+void cam_latency_reset() {
+  memset(&cam_lat, 0, sizeof(cam_lat));
+}
+
+/*
+ * called when a steering frame has been decoded; starts a new sample
+ */
+void cam_latency_parse(uint8_t seq, uint32_t cam_ms) {
+  unsigned long now_ms = millis();
+  long diff;
+  int gap;
+
+  if (cam_lat_have_seq) {
+    gap = ((int) seq - (int) cam_lat_last_seq + 255) % 255;   // camera counts 1-255, skipping 0
+    if (gap > 1) {
+      cam_lat.missed += gap - 1;
+    }
+  }
+  cam_lat_last_seq = seq;
+  cam_lat_have_seq = true;
+
+  diff = (long) (now_ms - cam_ms);
+  if (!cam_lat_have_offset) {
+    cam_lat_offset = diff;
+    cam_lat_win_min = diff;
+    cam_lat_prev_win_min = diff;
+    cam_lat_have_offset = true;
+  }
+  if (diff < cam_lat_win_min) {
+    cam_lat_win_min = diff;
+  }
+  if (++cam_lat_win_count >= CAM_LAT_OFFSET_WINDOW) {
+    cam_lat_prev_win_min = cam_lat_win_min;
+    cam_lat_win_min = diff;
+    cam_lat_win_count = 0;
+  }
+  cam_lat_offset = min(cam_lat_win_min, cam_lat_prev_win_min);
+
+  cam_lat_cur_offset = cam_lat_offset;
+#ifdef CAM_CLOCK_SYNC
+  uint32_t robot_ms;
+  if (cam_clock_to_robot_ms(cam_ms, &robot_ms, NULL)) {
+    cam_lat_cur_offset = (long) (robot_ms - cam_ms);
+  }
+#endif
+
+  cam_lat.samples++;
+  cam_lat_cur_cam_ms = cam_ms;
+  cam_lat_cur_pending = (1 << CAM_LAT_STAGE_DISPATCH) | (1 << CAM_LAT_STAGE_ACTUATE);
+  cam_latency_record(CAM_LAT_STAGE_PARSE, now_ms);
+}
+
+/*
+ * called at a later trace point; only the first pass through each stage
+ * after a new frame counts (manual steering also goes through the servo)
+ */
+void cam_latency_point(int stage) {
+  if (cam_lat_cur_pending & (1 << stage)) {
+    cam_lat_cur_pending &= ~(1 << stage);
+    cam_latency_record(stage, millis());
+  }
+}
+
+/*
+ * returns the age (mS) below which (percent)% of the samples for the stage fall
+ */
+int cam_latency_percentile(int stage, int percent) {
+  uint32_t wanted, seen;
+
+  if (cam_lat.count[stage] == 0) {
+    return 0;
+  }
+  wanted = ((cam_lat.count[stage] * (uint32_t) percent) + 99) / 100;
+  seen = 0;
+  for (int i=0; i<CAM_LAT_BUCKETS; i++) {
+    seen += cam_lat.hist[stage][i];
+    if (seen >= wanted) {
+      return i;
+    }
+  }
+  return CAM_LAT_BUCKETS - 1;
+}
+
+uint32_t cam_latency_max(int stage) {
+  return cam_lat.max_ms[stage];
+}
+
+/*
+ * p50, p95 and max for parse, dispatch and actuate (in that order),
+ * then samples, missed frames and the clock offset, ':' separated
+ */
+String cam_latency_summary() {
+  String s = "";
+
+  for (int stage=0; stage<CAM_LAT_NUM_STAGES; stage++) {
+    s += String(cam_latency_percentile(stage, 50)) + ":" + String(cam_latency_percentile(stage, 95));
+    s += ":" + String(cam_lat.max_ms[stage]) + ":";
+  }
+  s += String(cam_lat.samples) + ":" + String(cam_lat.missed) + ":" + String(cam_lat_offset);
+  return s;
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+void cam_latency_record(int stage, unsigned long now_ms) {
+  long age;
+
+  age = (long) (now_ms - cam_lat_cur_cam_ms) - cam_lat_cur_offset;
+  if (age < 0) {
+    age = 0;
+  }
+  if (age >= CAM_LAT_BUCKETS) {
+    cam_lat.hist[stage][CAM_LAT_BUCKETS - 1]++;
+  } else {
+    cam_lat.hist[stage][age]++;
+  }
+  cam_lat.count[stage]++;
+  if ((uint32_t) age > cam_lat.max_ms[stage]) {
+    cam_lat.max_ms[stage] = age;
+  }
+}
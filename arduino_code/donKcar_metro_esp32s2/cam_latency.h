@@ -0,0 +1,82 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef CAM_LATENCY_H
+#define CAM_LATENCY_H
+
+/*
+ * ***************************************************************
+ * the cam_latency module measures how old a steering command is
+ * at each step between the camera and the steering servo.
+ *
+ * each MSG_STEERANGLE frame carries the camera's millis() at the
+ * time the image was taken.  the robot estimates the offset between
+ * the two clocks as the smallest (robot receive time - camera time)
+ * seen recently, so ages are measured from image capture plus the
+ * fastest transit seen (the floor is roughly the frame's wire time).
+ * with CAM_CLOCK_SYNC the camera time is mapped to robot time by
+ * cam_clock instead (once it has an estimate), so ages are measured
+ * from image capture itself, wire time included.
+ *
+ * trace points:
+ *   PARSE     the frame has been decoded in cam_loop()
+ *   DISPATCH  mode_got_msg_steerangle() has it
+ *   ACTUATE   servo_set_steering_value() is writing it to the servo
+ * each feeds a 1 mS histogram from which p50 / p95 / max are read.
+ *
+ * everything compiles out unless CAM_LATENCY_TRACE is defined in
+ * config.h, so race builds pay nothing for it
+ * ***************************************************************
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+#define CAM_LAT_STAGE_PARSE     0
+#define CAM_LAT_STAGE_DISPATCH  1
+#define CAM_LAT_STAGE_ACTUATE   2
+#define CAM_LAT_NUM_STAGES      3
+
+#ifdef CAM_LATENCY_TRACE
+  #define CAM_LAT_PARSE(seq, cam_ms)  cam_latency_parse(seq, cam_ms)
+  #define CAM_LAT_DISPATCH()          cam_latency_point(CAM_LAT_STAGE_DISPATCH)
+  #define CAM_LAT_ACTUATE()           cam_latency_point(CAM_LAT_STAGE_ACTUATE)
+#else
+  #define CAM_LAT_PARSE(seq, cam_ms)
+  #define CAM_LAT_DISPATCH()
+  #define CAM_LAT_ACTUATE()
+#endif
+
+void cam_latency_init();
+void cam_latency_reset();
+void cam_latency_parse(uint8_t seq, uint32_t cam_ms);
+void cam_latency_point(int stage);
+int  cam_latency_percentile(int stage, int percent);
+uint32_t cam_latency_max(int stage);
+String cam_latency_summary();
+
+#endif  /* CAM_LATENCY_H */
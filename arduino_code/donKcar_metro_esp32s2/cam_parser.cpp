@@ -0,0 +1,321 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ * 
+ * Note this module holds the receive state machine for the camera link
+ * (see cam.cpp for the frame format) along with the matching frame encoder.
+ * it deliberately has no dependency on Arduino.h so that the identical source
+ * can be compiled on a linux host (g++ -c cam_parser.cpp) and fed recorded or
+ * synthetic byte streams.
+ *
+ * bytes are handed in with cam_parser_feed() in spans of any size; the state
+ * is kept in the CamParser object so a span may end anywhere inside a frame.
+ * the frame length is taken from the header, so frames of any type and size
+ * (up to CAM_MAX_PAYLOAD) share one state machine.
+ *
+ * when a frame is rejected (bad header, framing or CRC error) the bytes already
+ * collected are re-scanned for another START_CHAR before being discarded, so
+ * a START_CHAR that appeared inside a corrupted frame is not lost.  the number
+ * of bytes consumed between an error and the next good frame is recorded in
+ * resync_bytes_last / resync_bytes_max.
+ *
+ * the CRC is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF, no reflection),
+ * computed with a 16 entry nibble table to keep it small
+ */
+
+#include <string.h>
+#include "cam_parser.h"
+
+const uint16_t crc16_nibble_table[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/*
+ * templates for private functions
+ */
+void cam_parser_step(CamParser *p, uint8_t rcvdChar);
+void cam_parser_resync(CamParser *p, uint8_t rcvdChar);
+void cam_parser_drain_replay(CamParser *p);
+void cam_parser_frame_done(CamParser *p);
+
+ /*
+  * **************************************************************
+  * public functions
+  * **************************************************************
+  */
+void cam_parser_init(CamParser *p, cam_frame_handler on_frame, void *context) {
+  p->next_buffer_index = 0;
+  p->frame_length = 0;
+  p->fsm_state = CAM_FSM_SEEKING_START;
+  p->replay_len = 0;
+  p->replay_pos = 0;
+  p->on_frame = on_frame;
+  p->context = context;
+  cam_parser_reset_stats(p);
+}
+
+void cam_parser_reset_stats(CamParser *p) {
+  p->numGoodMessages = 0;
+  p->numErrorFraming = 0;
+  p->numErrorChecksum = 0;
+  p->numBytes = 0;
+  p->resync_pending = false;
+  p->resync_bytes = 0;
+  p->resync_bytes_last = 0;
+  p->resync_bytes_max = 0;
+}
+
+/*
+ * drops any frame part-way collected (and anything waiting to be re-scanned)
+ * but leaves the counts alone; used when the link changes speed, so bytes
+ * from either side of the change are never joined into one frame
+ */
+void cam_parser_reset_frame(CamParser *p) {
+  p->next_buffer_index = 0;
+  p->frame_length = 0;
+  p->fsm_state = CAM_FSM_SEEKING_START;
+  p->replay_len = 0;
+  p->replay_pos = 0;
+}
+
+/*
+ * bytes between frames (noise, or anything after a rejected frame) are 
+ * skipped in blocks: while seeking we memchr() for the next START_CHAR.
+ * the per-byte state machine only sees the bytes that make up each frame
+ */
+void cam_parser_feed(CamParser *p, const uint8_t *bytes, int len) {
+  const uint8_t *found;
+  int i, run;
+
+  p->numBytes += len;
+  i = 0;
+  while (i < len) {
+    if (p->fsm_state == CAM_FSM_SEEKING_START) {
+      found = (const uint8_t *) memchr(&bytes[i], CAM_START_CHAR, len - i);
+      run = (found == NULL) ? (len - i) : (int) (found - &bytes[i]);
+      if (p->resync_pending) {
+        p->resync_bytes += run;
+      }
+      i += run;
+      if (found == NULL) {
+        break;
+      }
+    }
+
+    if (i < len) {
+      if (p->resync_pending) {
+        p->resync_bytes++;
+      }
+      cam_parser_step(p, bytes[i++]);
+      cam_parser_drain_replay(p);
+    }
+  }
+}
+
+/*
+ * CRC-16/CCITT-FALSE over the given bytes
+ */
+uint16_t cam_crc16(const uint8_t *bytes, int len) {
+  uint16_t crc = 0xFFFF;
+
+  for (int i=0; i<len; i++) {
+    crc = (crc << 4) ^ crc16_nibble_table[((crc >> 12) ^ (bytes[i] >> 4)) & 0x0F];
+    crc = (crc << 4) ^ crc16_nibble_table[((crc >> 12) ^ (bytes[i] & 0x0F)) & 0x0F];
+  }
+  return crc;
+}
+
+/*
+ * builds a complete frame in out[] (which must hold CAM_MAX_FRAME bytes)
+ * returns the frame length, or 0 if the payload is too long
+ */
+int cam_frame_encode(uint8_t *out, uint8_t msg_type, uint8_t seq, const uint8_t *payload, int len) {
+  uint16_t crc;
+
+  if ((len < 0) || (len > CAM_MAX_PAYLOAD)) {
+    return 0;
+  }
+  out[0] = CAM_START_CHAR;
+  out[1] = CAM_PROTOCOL_VERSION;
+  out[2] = msg_type;
+  out[3] = seq;
+  out[4] = (uint8_t) len;
+  if (len > 0) {
+    memcpy(&out[CAM_HEADER_LENGTH], payload, len);
+  }
+  crc = cam_crc16(&out[1], CAM_HEADER_LENGTH - 1 + len);  // note the START_CHAR is not included in CRC
+  out[CAM_HEADER_LENGTH + len] = crc & 0xFF;
+  out[CAM_HEADER_LENGTH + len + 1] = (crc >> 8) & 0xFF;
+  out[CAM_HEADER_LENGTH + len + 2] = CAM_END_CHAR;
+  return CAM_HEADER_LENGTH + len + CAM_TRAILER_LENGTH;
+}
+
+/*
+ * payload field readers (little endian, as packed by the camera); a field 
+ * that does not fit inside the len bytes received returns dflt instead
+ */
+int16_t cam_get_int16(const uint8_t *payload, int len, int index, int16_t dflt) {
+  if ((index < 0) || ((index + 2) > len)) {
+    return dflt;
+  }
+  return (int16_t) (payload[index] | (payload[index+1] << 8));
+}
+
+uint32_t cam_get_uint32(const uint8_t *payload, int len, int index, uint32_t dflt) {
+  if ((index < 0) || ((index + 4) > len)) {
+    return dflt;
+  }
+  return payload[index] | (payload[index+1] << 8) | ((uint32_t) payload[index+2] << 16) | ((uint32_t) payload[index+3] << 24);
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+void cam_parser_step(CamParser *p, uint8_t rcvdChar) {
+  switch(p->fsm_state) {
+    case CAM_FSM_SEEKING_START:
+      if (rcvdChar == CAM_START_CHAR) {
+        p->fsm_state = CAM_FSM_COLLECTING_CHARS;
+        p->buffer[0] = rcvdChar;
+        p->next_buffer_index = 1;
+        p->frame_length = 0;
+      }
+      break;
+
+    case CAM_FSM_COLLECTING_CHARS:
+      /*
+       * note START or STOP character is ok in middle of message.
+       * once the header is in we know how long the frame is; a header
+       * with the wrong version or an impossible length is treated as
+       * a framing error (we probably "started" on a data byte)
+       */
+      p->buffer[p->next_buffer_index++] = rcvdChar;
+      if (p->next_buffer_index == CAM_HEADER_LENGTH) {
+        if ((p->buffer[1] != CAM_PROTOCOL_VERSION) || (p->buffer[4] > CAM_MAX_PAYLOAD)) {
+          p->numErrorFraming++;
+          p->next_buffer_index--;     // rcvdChar is handed to resync separately
+          cam_parser_resync(p, rcvdChar);
+          break;
+        }
+        p->frame_length = CAM_HEADER_LENGTH + p->buffer[4] + CAM_TRAILER_LENGTH;
+      }
+      if ((p->frame_length > 0) && (p->next_buffer_index >= (p->frame_length - 1))) {
+        // have received CRC, now expecting stop char
+        p->fsm_state = CAM_FSM_EXPECTING_STOP;
+      }
+      break;
+
+    case CAM_FSM_EXPECTING_STOP:
+      if (rcvdChar == CAM_END_CHAR) {
+        cam_parser_frame_done(p);
+      } else {
+        // we wanted an END_CHAR and its not, so this is a framing error
+        p->numErrorFraming++;
+        cam_parser_resync(p, rcvdChar);
+      }
+      break;
+  }
+}
+
+/*
+ * END_CHAR has arrived where expected; verify CRC and hand the frame on
+ */
+void cam_parser_frame_done(CamParser *p) {
+  int payload_len = p->buffer[4];
+  uint16_t crc_rcvd, crc_calculated;
+
+  crc_calculated = cam_crc16(&p->buffer[1], CAM_HEADER_LENGTH - 1 + payload_len);
+  crc_rcvd = p->buffer[CAM_HEADER_LENGTH + payload_len] | (p->buffer[CAM_HEADER_LENGTH + payload_len + 1] << 8);
+  if (crc_rcvd != crc_calculated) {
+    p->numErrorChecksum++;
+    cam_parser_resync(p, CAM_END_CHAR);
+    return;
+  }
+
+  p->next_buffer_index = 0;
+  p->fsm_state = CAM_FSM_SEEKING_START;
+  p->numGoodMessages++;
+  if (p->resync_pending) {
+    p->resync_pending = false;
+    p->resync_bytes_last = p->resync_bytes;
+    if (p->resync_bytes > p->resync_bytes_max) {
+      p->resync_bytes_max = p->resync_bytes;
+    }
+  }
+  if (p->on_frame != NULL) {
+    p->on_frame(p->buffer[2], p->buffer[3], &p->buffer[CAM_HEADER_LENGTH], payload_len, p->context);
+  }
+}
+
+/*
+ * called when the frame being collected is rejected.  rather than
+ * throwing away everything, we look for another START_CHAR among the
+ * bytes already collected (the real frame may have started there) and
+ * queue the remainder, plus the byte that caused the rejection, to be
+ * fed back through the state machine.  any replay bytes not yet used
+ * are kept behind them, so the replay never exceeds one frame
+ */
+void cam_parser_resync(CamParser *p, uint8_t rcvdChar) {
+  uint8_t tmp[CAM_MAX_FRAME];
+  int n = 0;
+  int i;
+
+  if (!p->resync_pending) {
+    p->resync_pending = true;
+    p->resync_bytes = 0;
+  }
+
+  for (i=1; i<p->next_buffer_index; i++) {
+    if (p->buffer[i] == CAM_START_CHAR) {
+      break;
+    }
+  }
+  for ( ; i<p->next_buffer_index; i++) {
+    tmp[n++] = p->buffer[i];
+  }
+  tmp[n++] = rcvdChar;
+  for (i=p->replay_pos; (i<p->replay_len) && (n < CAM_MAX_FRAME); i++) {
+    tmp[n++] = p->replay[i];
+  }
+  memcpy(p->replay, tmp, n);
+  p->replay_len = n;
+  p->replay_pos = 0;
+
+  p->next_buffer_index = 0;
+  p->frame_length = 0;
+  p->fsm_state = CAM_FSM_SEEKING_START;
+}
+
+void cam_parser_drain_replay(CamParser *p) {
+  while (p->replay_pos < p->replay_len) {
+    cam_parser_step(p, p->replay[p->replay_pos++]);
+  }
+  p->replay_len = 0;
+  p->replay_pos = 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef CAM_PARSER_H
+#define CAM_PARSER_H
+
+/*
+ * ***************************************************************
+ * the cam_parser module holds the receive state machine for the
+ * camera serial link.  it knows nothing about Serial1, millis() or
+ * the robot -- bytes are handed to it in spans and it calls back
+ * with each complete, CRC-verified frame.  this keeps it buildable
+ * on a linux host (plain g++) as well as on the ESP32-S2 so it can
+ * be replayed against captured streams off the car (see
+ * host_tools/cam_parser_bench.cpp).
+ *
+ * it also holds the frame encoder and CRC so that both directions
+ * of the link are built from the same code.
+ *
+ * see cam.cpp for a description of the frame format
+ * ***************************************************************
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAM_START_CHAR 0xAA
+#define CAM_END_CHAR 0xA8
+
+#define CAM_PROTOCOL_VERSION 2
+#define CAM_HEADER_LENGTH 5     // START, version, type, seq, length
+#define CAM_TRAILER_LENGTH 3    // CRC lsb, CRC msb, END
+#define CAM_MAX_PAYLOAD 128     // largest payload is MSG_IMG_CHUNK
+#define CAM_MAX_FRAME (CAM_HEADER_LENGTH + CAM_MAX_PAYLOAD + CAM_TRAILER_LENGTH)
+
+#define CAM_FSM_SEEKING_START     0
+#define CAM_FSM_COLLECTING_CHARS  1
+#define CAM_FSM_EXPECTING_STOP    2
+
+// called once for every good frame
+typedef void (*cam_frame_handler)(uint8_t msg_type, uint8_t seq, const uint8_t *payload, int len, void *context);
+
+struct CamParser {
+  uint8_t  buffer[CAM_MAX_FRAME];
+  int      next_buffer_index;
+  int      frame_length;      // total length of frame being collected (known once header is in)
+  int      fsm_state;
+
+  uint8_t  replay[CAM_MAX_FRAME];   // bytes of a rejected frame being re-scanned
+  int      replay_len;
+  int      replay_pos;
+
+  uint32_t numGoodMessages;
+  uint32_t numErrorFraming;
+  uint32_t numErrorChecksum;
+  uint32_t numBytes;
+
+  // resync accounting: bytes consumed between an error and the next good frame
+  bool     resync_pending;
+  uint32_t resync_bytes;
+  uint32_t resync_bytes_last;
+  uint32_t resync_bytes_max;
+
+  cam_frame_handler on_frame;
+  void     *context;
+};
+
+void cam_parser_init(CamParser *p, cam_frame_handler on_frame, void *context);
+void cam_parser_feed(CamParser *p, const uint8_t *bytes, int len);
+void cam_parser_reset_stats(CamParser *p);
+void cam_parser_reset_frame(CamParser *p);
+
+uint16_t cam_crc16(const uint8_t *bytes, int len);
+int cam_frame_encode(uint8_t *out, uint8_t msg_type, uint8_t seq, const uint8_t *payload, int len);
+int16_t cam_get_int16(const uint8_t *payload, int len, int index, int16_t dflt);
+uint32_t cam_get_uint32(const uint8_t *payload, int len, int index, uint32_t dflt);
+
+#endif  /* CAM_PARSER_H */
@@ -0,0 +1,256 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include "cam_stats.h"
+#include "cam.h"
+#include "serial_com_esp32.h"
+#include "status.h"
+
+#define CAM_STATS_INTERVAL_MS 1000
+
+/*
+ * upper limits (mS) of the gap histogram buckets; the last bucket
+ * catches everything longer.  the camera normally sends a steering
+ * frame every 100 mS when driving
+ */
+const uint32_t cam_stats_gap_limits[CAM_STATS_GAP_BUCKETS - 1] = {
+  25, 50, 75, 100, 150, 250, 500
+};
+
+CamStats cam_stats;
+
+/*
+ * raw counters as they stood at the last reset and at the last tick;
+ * totals are reported relative to the first, rates relative to the second
+ */
+struct CamStatsRaw {
+  uint32_t good_frames;
+  uint32_t framing_errors;
+  uint32_t crc_errors;
+  uint32_t rx_bytes;
+  uint32_t steer_frames;
+  uint32_t rx_overruns;
+  uint32_t tx_drops;
+  uint32_t cmd_retries;
+  uint32_t cmd_failures;
+};
+
+CamStatsRaw cam_stats_base;
+CamStatsRaw cam_stats_prev;
+uint32_t cam_stats_steer_count;     // steering frames seen (raw, never reset)
+unsigned long cam_stats_last_steer_ms;
+unsigned long cam_stats_last_img_ms;  // last image channel frame
+unsigned long cam_stats_next_tick_ms;
+bool cam_stats_want_reset;
+
+/*
+ * templates for private functions
+ */
+void cam_stats_read_raw(const CamParser *p, CamStatsRaw *raw);
+void cam_stats_show();
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+void cam_stats_init() {
+  memset(&cam_stats, 0, sizeof(cam_stats));
+  memset(&cam_stats_base, 0, sizeof(cam_stats_base));
+  memset(&cam_stats_prev, 0, sizeof(cam_stats_prev));
+  cam_stats_steer_count = 0;
+  cam_stats_last_steer_ms = 0;
+  cam_stats_last_img_ms = 0;
+  cam_stats_next_tick_ms = 0;
+  cam_stats_want_reset = false;
+}
+
+/*
+ * zeroes the totals, histogram and max gap; the new baseline is taken
+ * at the next tick so this can be called from anywhere (eg a web request)
+ */
+void cam_stats_reset() {
+  cam_stats_want_reset = true;
+}
+
+/*
+ * called for every steering frame as it arrives
+ */
+void cam_stats_note_steer(unsigned long now_ms) {
+  uint32_t gap;
+  int bucket;
+
+  cam_stats_steer_count++;
+  if (cam_stats_last_steer_ms != 0) {
+    gap = now_ms - cam_stats_last_steer_ms;
+    for (bucket=0; bucket<(CAM_STATS_GAP_BUCKETS - 1); bucket++) {
+      if (gap < cam_stats_gap_limits[bucket]) {
+        break;
+      }
+    }
+    cam_stats.gap_hist[bucket]++;
+    cam_stats.gap_last_ms = gap;
+    if (gap > cam_stats.gap_max_ms) {
+      cam_stats.gap_max_ms = gap;
+    }
+    if ((long) (cam_stats_last_img_ms - cam_stats_last_steer_ms) > 0) {
+      cam_stats.gap_img_count++;
+      if (gap > cam_stats.gap_img_max_ms) {
+        cam_stats.gap_img_max_ms = gap;
+      }
+    }
+  }
+  cam_stats_last_steer_ms = now_ms;
+}
+
+/*
+ * called when the camera stops sending steering frames (drive off or a
+ * mode change), so the gap up to the first frame of the next run, which
+ * may be minutes, is not counted as a link gap
+ */
+void cam_stats_steer_stopped() {
+  cam_stats_last_steer_ms = 0;
+}
+
+/*
+ * called for every good frame, with its channel (CAM_CH_xxx) and payload length
+ */
+void cam_stats_note_frame(int channel, int len, unsigned long now_ms) {
+  cam_stats.ch_frames[channel]++;
+  cam_stats.ch_bytes[channel] += len;
+  if (channel == CAM_CH_IMAGE) {
+    cam_stats_last_img_ms = now_ms;
+  }
+}
+
+/*
+ * called often (from cam_loop); only does any work once per second
+ */
+void cam_stats_tick(const CamParser *p, unsigned long now_ms) {
+  CamStatsRaw raw;
+
+  if ((long) (now_ms - cam_stats_next_tick_ms) < 0) {
+    return;
+  }
+  cam_stats_next_tick_ms = now_ms + CAM_STATS_INTERVAL_MS;
+  cam_stats_read_raw(p, &raw);
+
+  if (cam_stats_want_reset) {
+    cam_stats_base = raw;
+    memset(cam_stats.gap_hist, 0, sizeof(cam_stats.gap_hist));
+    cam_stats.gap_max_ms = 0;
+    memset(cam_stats.ch_frames, 0, sizeof(cam_stats.ch_frames));
+    memset(cam_stats.ch_bytes, 0, sizeof(cam_stats.ch_bytes));
+    cam_stats.gap_img_count = 0;
+    cam_stats.gap_img_max_ms = 0;
+    cam_stats_want_reset = false;
+  }
+
+  cam_stats.good_frames = raw.good_frames - cam_stats_base.good_frames;
+  cam_stats.framing_errors = raw.framing_errors - cam_stats_base.framing_errors;
+  cam_stats.crc_errors = raw.crc_errors - cam_stats_base.crc_errors;
+  cam_stats.rx_bytes = raw.rx_bytes - cam_stats_base.rx_bytes;
+  cam_stats.steer_frames = raw.steer_frames - cam_stats_base.steer_frames;
+  cam_stats.rx_overruns = raw.rx_overruns - cam_stats_base.rx_overruns;
+  cam_stats.tx_drops = raw.tx_drops - cam_stats_base.tx_drops;
+  cam_stats.cmd_retries = raw.cmd_retries - cam_stats_base.cmd_retries;
+  cam_stats.cmd_failures = raw.cmd_failures - cam_stats_base.cmd_failures;
+
+  cam_stats.frames_per_sec = raw.good_frames - cam_stats_prev.good_frames;
+  cam_stats.steer_per_sec = raw.steer_frames - cam_stats_prev.steer_frames;
+  cam_stats.bytes_per_sec = raw.rx_bytes - cam_stats_prev.rx_bytes;
+  cam_stats.errors_per_sec = (raw.framing_errors - cam_stats_prev.framing_errors)
+                           + (raw.crc_errors - cam_stats_prev.crc_errors);
+  cam_stats_prev = raw;
+
+#ifdef CAM_STATS_ON_TFT
+  cam_stats_show();
+#endif
+}
+
+const CamStats *cam_stats_get() {
+  return &cam_stats;
+}
+
+/*
+ * all stats as one string with no spaces (fields separated by ':'), in the
+ * order: good, framing err, crc err, bytes, steer frames, rx overruns,
+ * tx drops, retries, failures, frames/s, steer/s, bytes/s, errors/s,
+ * max gap, the gap histogram buckets, then image channel frames and bytes,
+ * steering gaps during pictures and the worst of those
+ */
+String cam_stats_summary() {
+  String s;
+
+  s = String(cam_stats.good_frames) + ":" + String(cam_stats.framing_errors) + ":" + String(cam_stats.crc_errors);
+  s += ":" + String(cam_stats.rx_bytes) + ":" + String(cam_stats.steer_frames) + ":" + String(cam_stats.rx_overruns);
+  s += ":" + String(cam_stats.tx_drops) + ":" + String(cam_stats.cmd_retries) + ":" + String(cam_stats.cmd_failures);
+  s += ":" + String(cam_stats.frames_per_sec) + ":" + String(cam_stats.steer_per_sec);
+  s += ":" + String(cam_stats.bytes_per_sec) + ":" + String(cam_stats.errors_per_sec);
+  s += ":" + String(cam_stats.gap_max_ms);
+  for (int i=0; i<CAM_STATS_GAP_BUCKETS; i++) {
+    s += ":" + String(cam_stats.gap_hist[i]);
+  }
+  s += ":" + String(cam_stats.ch_frames[CAM_CH_IMAGE]) + ":" + String(cam_stats.ch_bytes[CAM_CH_IMAGE]);
+  s += ":" + String(cam_stats.gap_img_count) + ":" + String(cam_stats.gap_img_max_ms);
+  return s;
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+void cam_stats_read_raw(const CamParser *p, CamStatsRaw *raw) {
+  raw->good_frames = p->numGoodMessages;
+  raw->framing_errors = p->numErrorFraming;
+  raw->crc_errors = p->numErrorChecksum;
+  raw->rx_bytes = p->numBytes;
+  raw->steer_frames = cam_stats_steer_count;
+  raw->rx_overruns = sercom1_rx_overruns();
+  raw->tx_drops = cam_tx_drops();
+  raw->cmd_retries = cam_cmd_retries();
+  raw->cmd_failures = cam_cmd_failures();
+}
+
+/*
+ * one line on the (otherwise unused) top row of the TFT:
+ * steering frames/s, errors/s and the worst gap seen
+ */
+void cam_stats_show() {
+  char colorcode;
+
+  if (cam_stats.errors_per_sec > 0) {
+    colorcode = 'R';
+  } else if (cam_stats.gap_last_ms > 250) {
+    colorcode = 'Y';
+  } else {
+    colorcode = 'G';
+  }
+  status_disp_cam_stats(cam_stats.steer_per_sec, cam_stats.errors_per_sec, cam_stats.gap_max_ms, colorcode);
+}
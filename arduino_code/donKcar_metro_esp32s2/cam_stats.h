@@ -0,0 +1,92 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef CAM_STATS_H
+#define CAM_STATS_H
+
+/*
+ * ***************************************************************
+ * the cam_stats module keeps health figures for the camera serial
+ * link: running totals, per-second rates, and a histogram of the
+ * gaps between steering frames (so a dropped-frame problem can be
+ * told apart from a tuning problem).
+ *
+ * the totals and rates are refreshed once per second by 
+ * cam_stats_tick(); cam_stats_get() just returns a pointer to them,
+ * so reading stats is cheap enough to do from the hot loop
+ * ***************************************************************
+ */
+
+#include <Arduino.h>
+#include "config.h"
+#include "cam_parser.h"
+#include "cam.h"
+
+#define CAM_STATS_GAP_BUCKETS 8
+
+struct CamStats {
+  // totals since last cam_stats_reset()
+  uint32_t good_frames;
+  uint32_t framing_errors;
+  uint32_t crc_errors;
+  uint32_t rx_bytes;
+  uint32_t steer_frames;
+  uint32_t rx_overruns;
+  uint32_t tx_drops;
+  uint32_t cmd_retries;
+  uint32_t cmd_failures;
+
+  // per-second rates, from the most recent 1 second interval
+  uint32_t frames_per_sec;
+  uint32_t steer_per_sec;
+  uint32_t bytes_per_sec;
+  uint32_t errors_per_sec;
+
+  // gaps between steering frames (see cam_stats.cpp for bucket limits)
+  uint32_t gap_hist[CAM_STATS_GAP_BUCKETS];
+  uint32_t gap_max_ms;
+  uint32_t gap_last_ms;
+
+  // per channel (CAM_CH_xxx): frames and payload bytes
+  uint32_t ch_frames[CAM_NUM_CHANNELS];
+  uint32_t ch_bytes[CAM_NUM_CHANNELS];
+
+  // steering gaps that had picture chunks arriving in them
+  uint32_t gap_img_count;
+  uint32_t gap_img_max_ms;
+};
+
+void cam_stats_init();
+void cam_stats_reset();
+void cam_stats_note_steer(unsigned long now_ms);
+void cam_stats_steer_stopped();
+void cam_stats_note_frame(int channel, int len, unsigned long now_ms);
+void cam_stats_tick(const CamParser *p, unsigned long now_ms);
+const CamStats *cam_stats_get();
+String cam_stats_summary();
+
+#endif  /* CAM_STATS_H */
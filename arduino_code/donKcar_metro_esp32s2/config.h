@@ -148,6 +148,68 @@ extern Config config;
 #define FLAVOR_RC
 //#define FLAVOR_DIFFERENTIAL
 
+/*
+ * ************************************************************************
+ * Control loop timing (see control.h)
+ * ************************************************************************
+ */
+
+#define CONTROL_RATE_HZ     100     // drive outputs are recomputed and written at this rate
+#define CONTROL_DISPLAY_MS  100     // TFT / neopixel refresh interval for the drive display
+
+//#define STEER_PID_ON_ROBOT          // steer from the camera's target angle with the PID here (see steer_pid.h)
+#define AUTO_HOT_STANDBY            // "Autonomous Drive" waits ready with the camera tracking, Z starts it
+                                    // (comment out for the old cold start, eg to compare go latency)
+
+/*
+ * ************************************************************************
+ * Camera pictures (see cam_image.h)
+ * ************************************************************************
+ */
+
+#define CAM_IMAGE_CUT_THROUGH       // cam_image.html streams chunks to the browser as they arrive
+                                    // (comment out to collect the whole picture first)
+#define CAM_STREAM_FPS          5   // default target frame rate of cam_stream.html (1-15)
+
+//#define DATASET_RECORDER            // record pictures + drive outputs to SD while driving (see recorder.h)
+#define REC_FPS                 2   // pictures per second while recording
+#define REC_FILE_MB             64  // each recording file is preallocated this big
+
+#define PREVIEW_FPS             4   // camera preview on the TFT (menu "Camera Preview", see tft_preview.h)
+#define PREVIEW_BUDGET_MS       30  // longest one preview picture may hold up loop(); keep it under the
+                                    // ~44 mS the camera UART buffer (1024 bytes at 230400) covers
+                                    // (4096 bytes with CAM_BAUD_NEGOTIATE; the camera sends at most
+                                    // ~2 KB of picture per pass at the faster rates)
+
+/*
+ * ************************************************************************
+ * Camera link speed (see cam_negotiate_baud() in cam.cpp)
+ * ************************************************************************
+ */
+
+#define CAM_BAUD_NEGOTIATE          // at boot, move the camera link up from BAUD_RATE_SERCOM1 to the
+                                    // fastest of 2000000 / 921600 that passes a bit-error test
+#define CAM_BAUD_MAX_ERRORS     4   // link errors in one second that make it a "bad" second
+#define CAM_BAUD_BAD_SECONDS    3   // this many bad seconds in a row drop the link back to BAUD_RATE_SERCOM1
+
+/*
+ * ************************************************************************
+ * Camera clock (see cam_clock.h)
+ * ************************************************************************
+ */
+
+#define CAM_CLOCK_SYNC              // keep an offset / drift estimate that maps camera millis() to robot time
+#define CAM_CLOCK_PING_MS     250   // one CAM_CMD_TIME_PING this often (12 bytes out, 20 back on the link)
+
+/*
+ * ************************************************************************
+ * Optional diagnostics (uncomment to build them in)
+ * ************************************************************************
+ */
+
+//#define CAM_STATS_ON_TFT        // camera link steer rate / errors / max gap on top row of TFT
+//#define CAM_LATENCY_TRACE       // camera-to-servo latency histograms (see cam_latency.h)
+
 /*
  * *******************************************************************
  * ******************************************************************* 
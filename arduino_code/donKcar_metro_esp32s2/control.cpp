@@ -0,0 +1,205 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include "control.h"
+#include "drivetrain.h"
+#include "mode_mgr.h"
+
+#define CONTROL_PERIOD_US (1000000L / CONTROL_RATE_HZ)
+
+ControlStats control_stats;
+int control_req_joyY, control_req_joyX;   // newest requested outputs
+int control_out_joyY, control_out_joyX;   // outputs last written
+bool control_out_valid;                   // false forces a write on the next tick
+bool control_disp_pending;                // outputs changed since the display was refreshed
+unsigned long control_next_tick_us;
+unsigned long control_next_disp_ms;
+bool control_want_reset;
+
+/*
+ * templates for private functions
+ */
+void control_tick();
+void control_display();
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+void control_init() {
+  memset(&control_stats, 0, sizeof(control_stats));
+  control_req_joyY = 0;
+  control_req_joyX = 0;
+  control_out_joyY = 0;
+  control_out_joyX = 0;
+  control_out_valid = false;
+  control_disp_pending = false;
+  control_want_reset = false;
+  control_next_tick_us = micros() + CONTROL_PERIOD_US;
+  control_next_disp_ms = millis() + CONTROL_DISPLAY_MS;
+}
+
+/*
+ * leaves the newest drive command for the next tick; safe to call from
+ * anywhere (camera parser, nunchuk events) since nothing is written here
+ * @param: int cmd_joyY, cmd_joyX  should be -255 to +255
+ */
+void control_request(int cmd_joyY, int cmd_joyX) {
+  control_req_joyY = cmd_joyY;
+  control_req_joyX = cmd_joyX;
+}
+
+/*
+ * called on every pass of loop(); runs a tick when one is due and
+ * refreshes the drive display every CONTROL_DISPLAY_MS
+ */
+void control_loop() {
+  unsigned long now_us;
+  unsigned long tick_us;
+  long late_us;
+  long missed;
+
+  now_us = micros();
+  late_us = (long) (now_us - control_next_tick_us);
+  if (late_us >= 0) {
+    if (control_want_reset) {
+      memset(&control_stats, 0, sizeof(control_stats));
+      control_want_reset = false;
+    }
+    if (late_us >= CONTROL_PERIOD_US) {
+      // loop() was held up for a whole period or more; skip the missed
+      // ticks rather than running them back to back
+      missed = late_us / CONTROL_PERIOD_US;
+      control_stats.overruns += missed;
+      control_next_tick_us += missed * CONTROL_PERIOD_US;
+      late_us -= missed * CONTROL_PERIOD_US;
+    }
+    control_next_tick_us += CONTROL_PERIOD_US;
+    control_stats.ticks++;
+    control_stats.late_sum_us += late_us;
+    if ((uint32_t) late_us > control_stats.late_max_us) {
+      control_stats.late_max_us = late_us;
+    }
+    
+    control_tick();
+    
+    tick_us = micros() - now_us;
+    if (tick_us > control_stats.tick_max_us) {
+      control_stats.tick_max_us = tick_us;
+    }
+  }
+
+  if ((long) (millis() - control_next_disp_ms) >= 0) {
+    control_next_disp_ms = millis() + CONTROL_DISPLAY_MS;
+    control_display();
+  }
+}
+
+/*
+ * the drive command last written to the drivetrain (what the car is
+ * actually doing, as opposed to the newest request)
+ */
+void control_get_outputs(int *cmd_joyY, int *cmd_joyX) {
+  *cmd_joyY = control_out_joyY;
+  *cmd_joyX = control_out_joyX;
+}
+
+/*
+ * zeroes the counters; done at the start of the next tick so this
+ * can be called from anywhere (eg a web request)
+ */
+void control_stats_reset() {
+  control_want_reset = true;
+}
+
+const ControlStats *control_stats_get() {
+  return &control_stats;
+}
+
+/*
+ * all stats as one string with no spaces (fields separated by ':'), in the
+ * order: rate (Hz), ticks, overruns, writes, mean jitter uS, max jitter uS,
+ * longest tick uS
+ */
+String control_stats_summary() {
+  String s;
+  uint32_t late_mean;
+
+  late_mean = 0;
+  if (control_stats.ticks > 0) {
+    late_mean = control_stats.late_sum_us / control_stats.ticks;
+  }
+  s = String(CONTROL_RATE_HZ) + ":" + String(control_stats.ticks) + ":" + String(control_stats.overruns);
+  s += ":" + String(control_stats.writes) + ":" + String(late_mean);
+  s += ":" + String(control_stats.late_max_us) + ":" + String(control_stats.tick_max_us);
+  return s;
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+/*
+ * one control period: bring the autonomous steering up to date, then
+ * write the newest command if it differs from what is on the servos
+ */
+void control_tick() {
+  mode_steer_tick();
+
+  if (!mode_motion_permitted()) {
+    // drivetrain_stop() has already put the outputs in a safe state; drop
+    // any leftover command so it isn't replayed when driving resumes
+    control_req_joyY = 0;
+    control_req_joyX = 0;
+    control_out_valid = false;
+    return;
+  }
+  if (control_out_valid && (control_req_joyY == control_out_joyY) && (control_req_joyX == control_out_joyX)) {
+    return;
+  }
+  drivetrain_actuate(control_req_joyY, control_req_joyX);
+  control_out_joyY = control_req_joyY;
+  control_out_joyX = control_req_joyX;
+  control_out_valid = true;
+  control_disp_pending = true;
+  control_stats.writes++;
+}
+
+/*
+ * TFT / neopixel refresh, kept out of the tick because each update is a
+ * few mS of SPI / I2C traffic
+ */
+void control_display() {
+  if (control_disp_pending) {
+    control_disp_pending = false;
+    drivetrain_show(control_out_joyY, control_out_joyX);
+  }
+  mode_display_tick();
+}
@@ -0,0 +1,69 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef CONTROL_H
+#define CONTROL_H
+
+/*
+ * ***************************************************************
+ * the control module runs the drive outputs at a fixed rate 
+ * (CONTROL_RATE_HZ in config.h) instead of from inside the event
+ * that produced them.  camera frames and nunchuk events only leave
+ * their latest drive command here (control_request()); each tick
+ * picks up the newest one and writes the servos / motors at most
+ * once.  the TFT and neopixel are refreshed separately, at a slower
+ * rate, so a busy display can't hold up the parser or the servos.
+ *
+ * ticks are scheduled on fixed deadlines (not "now + period") so 
+ * the average rate holds even when one tick starts late; how late
+ * each tick starts (jitter) and how many whole periods were missed
+ * (overruns) are counted so the rate can be checked while the web
+ * configurator or display is busy
+ * ***************************************************************
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+struct ControlStats {
+  uint32_t ticks;           // ticks run since last reset
+  uint32_t overruns;        // ticks skipped because loop() was late by a whole period or more
+  uint32_t writes;          // ticks that actually wrote new outputs
+  uint32_t late_max_us;     // worst tick start jitter
+  uint32_t late_sum_us;     // total jitter (for the mean)
+  uint32_t tick_max_us;     // longest time spent inside a tick
+};
+
+void control_init();
+void control_request(int cmd_joyY, int cmd_joyX);
+void control_loop();
+void control_get_outputs(int *cmd_joyY, int *cmd_joyX);
+void control_stats_reset();
+const ControlStats *control_stats_get();
+String control_stats_summary();
+
+#endif  /* CONTROL_H */
@@ -36,18 +36,32 @@
 #include "nunchuk.h"
 #include "battery.h"
 #include "cam.h"
+#include "control.h"
+#include "recorder.h"
+#include "tft_preview.h"
+#include "sched.h"
 //#include "serial_com_esp32.h"
 
-long nextBattDispDue_E, nextBattDispDue_M;
-long nextBattSendDue_E, nextBattSendDue_M;
-long nextHeartbeatCheckDue, nextMenuCheckDue;
-long nextCam1QueryDue, nextStatusMessageClearCheck;
+Sched loop_sched;
+
+long nextCam1QueryDue;
 
 long nextTestDue;
 int testangle, testFlavor;
 
 int  last_joyXR, last_joyYR, last_joyXL, last_joy_YL;
 
+/*
+ * templates for private functions
+ */
+uint32_t loop_clock_us();
+void loop_check_heartbeat();
+void loop_check_menu();
+void loop_check_batt_E();
+void loop_check_batt_M();
+void loop_send_batt_E();
+void loop_send_batt_M();
+
 void setup() {
   // note it takes a while for Serial to start; this empty loop waits for it
   // ref   https://forum.arduino.cc/t/cant-view-serial-print-from-setup/167916
@@ -73,19 +87,29 @@ void setup() {
   wifi_init();
   drivetrain_init();    // this also initializes motors  
     
-  nextBattDispDue_E = millis() + 233;
-  nextBattDispDue_M = millis() + 468;
-  nextBattSendDue_E = millis() + 570;
-  nextBattSendDue_M = millis() + 1540;
+  /*
+   * periodic jobs run from sched_run() in loop(); the first runs are
+   * staggered so they do not all land in the same pass
+   */
+  sched_init(&loop_sched, loop_clock_us);
+  sched_every(&loop_sched, "hbeat", loop_check_heartbeat, SCHED_PRIO_SAFETY, 500, 0);
+  sched_every(&loop_sched, "battE", loop_check_batt_E, SCHED_PRIO_HOUSEKEEP, 60000, 233);
+  sched_every(&loop_sched, "battM", loop_check_batt_M, SCHED_PRIO_HOUSEKEEP, 60000, 468);
+  sched_every(&loop_sched, "menu", loop_check_menu, SCHED_PRIO_HOUSEKEEP, 1000, 0);
+  sched_every(&loop_sched, "sendE", loop_send_batt_E, SCHED_PRIO_DISPLAY, 60000, 570);
+  sched_every(&loop_sched, "sendM", loop_send_batt_M, SCHED_PRIO_DISPLAY, 60000, 1540);
+  // status messages time out after 30 seconds
+  sched_every(&loop_sched, "msg", status_message_area_clear_check, SCHED_PRIO_DISPLAY, 100, 263);
   nextCam1QueryDue = millis() + 315;
-  nextStatusMessageClearCheck = millis() + 263;
-  nextHeartbeatCheckDue = 0;
-  nextMenuCheckDue = 0;
   
   nextTestDue = millis() + 230;
   testFlavor = 0;   // currently no camera polls
   
   cam_init();
+#ifdef CAM_BAUD_NEGOTIATE
+  cam_negotiate_baud();
+#endif
+  control_init();
   mode_set_mode(MODE_IDLE);
   status_disp_info_msgs(String("Boot Complete."), String("This vehicle is"), String("ready to RACE"), 'G');
 }
@@ -121,52 +145,11 @@ void loop() {
     flagY = false;
   }
 
- 
-  if (current_time > nextBattDispDue_E) {
-    nextBattDispDue_E = current_time + 60000;
-    if (batt_read('E')) {
-      mode_set_mode(MODE_ERROR_BATT);
-    }
-    batt_display('E');
-  }
-  
-  if (current_time > nextBattDispDue_M) {
-    nextBattDispDue_M = current_time + 60000;
-    if (batt_read('M')) {
-      mode_set_mode(MODE_ERROR_BATT);
-    }
-    batt_display('M');
-  }
- 
-  if (current_time > nextBattSendDue_E) {
-    nextBattSendDue_E = current_time + 60000;
-    batt_send('E');
-  }
- 
-  if (current_time > nextBattSendDue_M) {
-    nextBattSendDue_M = current_time + 60000;
-    batt_send('M');
-  }
-  
-  if (current_time > nextHeartbeatCheckDue) {
-    nextHeartbeatCheckDue = current_time + 500;
-    mode_check_heartbeat();   // check for heartbeat timeouts
-    mode_check_webap_heartbeat();
-  }
-
-  if (current_time > nextMenuCheckDue) {
-    nextMenuCheckDue = current_time + 1000;
-    mode_check_menu_timeout();   // check for menu timeouts
-  }
-
-  /* 
-   *  implement "clear status message" process after appropriate timeouts
-   *  (note messages time out after 30 seconds)
+  /*
+   * periodic jobs (registered in setup(), see sched.h): heartbeat timeouts
+   * first, at most one of the battery / menu / display jobs per pass
    */
-  if (current_time > nextStatusMessageClearCheck) {
-    nextStatusMessageClearCheck = current_time + 100;
-    status_message_area_clear_check();   // check for menu timeouts
-  }
+  sched_run(&loop_sched);
 
   /*
    * if the web configurator is running we process any requests
@@ -195,6 +178,27 @@ void loop() {
   cam_loop();
   cam_timeout_check();
 
+#ifdef DATASET_RECORDER
+  /*
+   * while driving, pictures and drive outputs go to the SD card (a sector
+   * at a time, never waiting on the card)
+   */
+  rec_loop();
+#endif
+
+  /*
+   * camera preview on the TFT (MODE_PREVIEW only); decoding a picture holds
+   * this pass up for at most about PREVIEW_BUDGET_MS
+   */
+  preview_loop();
+
+  /*
+   * drive outputs are written here, at a fixed rate (CONTROL_RATE_HZ), from 
+   * whatever the camera and nunchuk last asked for; this also carries the 
+   * steering along between camera frames in autonomous mode
+   */
+  control_loop();
+
   //if (current_time > nextCam1QueryDue)  {
   //  if (testFlavor == 1) {
   //    for (int ii=0; ii<10; ii++) {
@@ -217,3 +221,41 @@ void loop() {
   
   //delay(5);
 }
+
+/*
+ * the periodic jobs of loop() (see setup())
+ */
+uint32_t loop_clock_us() {
+  return micros();
+}
+
+void loop_check_heartbeat() {
+  mode_check_heartbeat();   // check for heartbeat timeouts
+  mode_check_webap_heartbeat();
+}
+
+void loop_check_menu() {
+  mode_check_menu_timeout();   // check for menu timeouts
+}
+
+void loop_check_batt_E() {
+  if (batt_read('E')) {
+    mode_set_mode(MODE_ERROR_BATT);
+  }
+  batt_display('E');
+}
+
+void loop_check_batt_M() {
+  if (batt_read('M')) {
+    mode_set_mode(MODE_ERROR_BATT);
+  }
+  batt_display('M');
+}
+
+void loop_send_batt_E() {
+  batt_send('E');
+}
+
+void loop_send_batt_M() {
+  batt_send('M');
+}
@@ -88,9 +88,27 @@ void drivetrain_disable() {
  * @param: int cmd_joyY, cmd_joyX  should be -255 (back) to +255 (fwd)
  */
 void drivetrain_go(int cmd_joyY, int cmd_joyX) {  
+  drivetrain_actuate(cmd_joyY, cmd_joyX);
+  drivetrain_show(cmd_joyY, cmd_joyX);
+}
+
+/*
+ * drivetrain_actuate() sets steering and throttle servos only (no display)
+ * @param: int cmd_joyY, cmd_joyX  should be -255 (back) to +255 (fwd)
+ */
+void drivetrain_actuate(int cmd_joyY, int cmd_joyX) {  
   if (mode_motion_permitted()) { 
     servo_set_steering_value(cmd_joyX);
     servo_set_throttle(cmd_joyY);
+  }
+}
+
+/*
+ * drivetrain_show() puts steering and throttle on the neopixels and TFT
+ * @param: int cmd_joyY, cmd_joyX  should be -255 (back) to +255 (fwd)
+ */
+void drivetrain_show(int cmd_joyY, int cmd_joyX) {  
+  if (mode_motion_permitted()) { 
     status_neo_show_movement_info(cmd_joyY, cmd_joyX, mode_get_speed_mode_color());    // neopixel display
     status_disp_throt_value('Y', cmd_joyY, mode_get_speed_mode_color());
     status_disp_throt_value('X', cmd_joyX, 'W');    
@@ -198,17 +216,34 @@ void drivetrain_disable() {
  * @param: int cmd_joyY, cmd_joyX  should be -255 (back) to +255 (fwd)
  */
 void drivetrain_go(int cmd_joyY, int cmd_joyX) {  
+  drivetrain_actuate(cmd_joyY, cmd_joyX);
+  drivetrain_show(cmd_joyY, cmd_joyX);
+}
+
+/*
+ * drivetrain_actuate() mixes steering into the two motor throttles and 
+ * drives the motors (no display)
+ * @param: int cmd_joyY, cmd_joyX  should be -255 (back) to +255 (fwd)
+ */
+void drivetrain_actuate(int cmd_joyY, int cmd_joyX) {  
   if (mode_motion_permitted()) {  
     motor_throtL = cmd_joyY + ( (float) config.steering_fraction * (float) cmd_joyX);
     motor_throtR = cmd_joyY - ( (float) config.steering_fraction * (float) cmd_joyX);
     rescale_throttles();
-    
-    motor_driveL(throtL);
-    status_disp_throt_value('L', throtL, 'W');
-    
-    motor_driveR(throtR);
-    status_disp_throt_value('R', throtR, 'W');
-    
+    motor_driveL(motor_throtL);
+    motor_driveR(motor_throtR);
+  }
+}
+
+/*
+ * drivetrain_show() puts the motor throttles on the TFT and the
+ * steering on the neopixels
+ * @param: int cmd_joyY, cmd_joyX  should be -255 (back) to +255 (fwd)
+ */
+void drivetrain_show(int cmd_joyY, int cmd_joyX) {  
+  if (mode_motion_permitted()) {  
+    status_disp_throt_value('L', motor_throtL, 'W');
+    status_disp_throt_value('R', motor_throtR, 'W');
     status_show_steering_info(cmd_joyY, cmd_joyX);    // neopixel display
   }
 }
@@ -34,6 +34,8 @@
 void drivetrain_init();
 void drivetrain_stop(void);
 void drivetrain_go(int cmd_joyY, int cmd_joyX);
+void drivetrain_actuate(int cmd_joyY, int cmd_joyX);
+void drivetrain_show(int cmd_joyY, int cmd_joyX);
 void drivetrain_enable();
 void drivetrain_disable();
 
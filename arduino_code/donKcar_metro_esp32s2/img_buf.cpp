@@ -0,0 +1,147 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+#include "img_buf.h"
+
+/*
+ * every buffer handed out, so imgbuf_free() knows its size and where it came from
+ */
+struct ImgBufSlot {
+  uint8_t *buf;
+  uint32_t size;
+  bool     psram;
+};
+
+ImgBufSlot  imgbuf_slots[IMGBUF_MAX_BUFFERS];
+ImgBufStats imgbuf_stats;
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+
+/*
+ * a buffer of at least size bytes, from PSRAM if there is any; NULL
+ * (and counted as a failure) if neither PSRAM nor the heap can give it
+ */
+uint8_t *imgbuf_alloc(uint32_t size) {
+  ImgBufSlot *slot = NULL;
+
+  for (int i=0; i<IMGBUF_MAX_BUFFERS; i++) {
+    if (imgbuf_slots[i].buf == NULL) {
+      slot = &imgbuf_slots[i];
+      break;
+    }
+  }
+  if (slot == NULL) {
+    imgbuf_stats.failures++;
+    return NULL;
+  }
+  slot->psram = false;
+  slot->buf = NULL;
+  if (psramFound()) {
+    slot->buf = (uint8_t *) ps_malloc(size);
+    slot->psram = (slot->buf != NULL);
+  }
+  if (slot->buf == NULL) {
+    slot->buf = (uint8_t *) malloc(size);
+  }
+  if (slot->buf == NULL) {
+    imgbuf_stats.failures++;
+    DEBUG_PRINTLN("no memory for a " + String(size) + " byte picture buffer");
+    return NULL;
+  }
+  slot->size = size;
+  imgbuf_stats.allocs++;
+  imgbuf_stats.buffers++;
+  imgbuf_stats.bytes += size;
+  if (slot->psram) {
+    imgbuf_stats.psram_bytes += size;
+  }
+  if (imgbuf_stats.bytes > imgbuf_stats.peak_bytes) {
+    imgbuf_stats.peak_bytes = imgbuf_stats.bytes;
+  }
+  return slot->buf;
+}
+
+/*
+ * makes sure buf (*size bytes, or NULL) holds at least needed bytes.  a
+ * buffer that is too small is replaced by one rounded up to IMGBUF_STEP
+ * (its contents are not kept) and *size updated; returns the buffer to
+ * use, or NULL with the old one freed and *size 0 if there is no memory
+ */
+uint8_t *imgbuf_fit(uint8_t *buf, uint32_t *size, uint32_t needed) {
+  uint32_t new_size;
+
+  if ((buf != NULL) && (*size >= needed)) {
+    return buf;
+  }
+  imgbuf_free(buf);
+  new_size = ((needed + IMGBUF_STEP - 1) / IMGBUF_STEP) * IMGBUF_STEP;
+  buf = imgbuf_alloc(new_size);
+  *size = (buf == NULL) ? 0 : new_size;
+  return buf;
+}
+
+void imgbuf_free(uint8_t *buf) {
+  if (buf == NULL) {
+    return;
+  }
+  for (int i=0; i<IMGBUF_MAX_BUFFERS; i++) {
+    if (imgbuf_slots[i].buf == buf) {
+      imgbuf_stats.buffers--;
+      imgbuf_stats.bytes -= imgbuf_slots[i].size;
+      if (imgbuf_slots[i].psram) {
+        imgbuf_stats.psram_bytes -= imgbuf_slots[i].size;
+      }
+      imgbuf_slots[i].buf = NULL;
+      break;
+    }
+  }
+  free(buf);
+}
+
+const ImgBufStats *imgbuf_stats_get() {
+  return &imgbuf_stats;
+}
+
+/*
+ * buffer and heap figures as one string with no spaces (fields separated
+ * by ':'), in the order: PSRAM found (0/1), PSRAM free, internal heap free,
+ * internal heap low water mark, buffers outstanding, their bytes, bytes of
+ * them in PSRAM, peak bytes, allocations, failures.  internal heap free
+ * plus the bytes in PSRAM is the headroom pictures would otherwise take
+ */
+String imgbuf_summary() {
+  return String(psramFound() ? 1 : 0) + ":" + String(ESP.getFreePsram())
+    + ":" + String(ESP.getFreeHeap()) + ":" + String(ESP.getMinFreeHeap())
+    + ":" + String(imgbuf_stats.buffers) + ":" + String(imgbuf_stats.bytes)
+    + ":" + String(imgbuf_stats.psram_bytes) + ":" + String(imgbuf_stats.peak_bytes)
+    + ":" + String(imgbuf_stats.allocs) + ":" + String(imgbuf_stats.failures);
+}
@@ -0,0 +1,69 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef IMG_BUF_H
+#define IMG_BUF_H
+
+/*
+ * ***************************************************************
+ * the img_buf module hands out the large buffers pictures are kept 
+ * in.  none are allocated at build time: cam_image gets one when a
+ * picture is first collected, the MJPEG stream and the recorder when
+ * they start, and each gives it back when it is done (everything
+ * picture related is let go by webap_deinit() when web mode ends).
+ * so while the car is just driving no internal SRAM is held for 
+ * pictures at all.
+ *
+ * buffers come from PSRAM when the board has it (the Metro ESP32-S2
+ * has 2 MB) and from the internal heap otherwise.  imgbuf_fit() 
+ * grows a buffer in IMGBUF_STEP steps to whatever a picture needs,
+ * so a large picture (QVGA JPEG) is taken whole rather than cut off
+ * ***************************************************************
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+#define IMGBUF_STEP         8192    // buffers grow in steps of this many bytes
+#define IMGBUF_MAX_BUFFERS  4       // outstanding at once (cam_image, stream, recorder + 1 spare)
+
+struct ImgBufStats {
+  uint32_t buffers;         // outstanding now
+  uint32_t bytes;           // ... and their total size
+  uint32_t psram_bytes;     // ... of which in PSRAM
+  uint32_t peak_bytes;
+  uint32_t allocs;
+  uint32_t failures;        // requests that could not be met
+};
+
+uint8_t *imgbuf_alloc(uint32_t size);
+uint8_t *imgbuf_fit(uint8_t *buf, uint32_t *size, uint32_t needed);
+void imgbuf_free(uint8_t *buf);
+const ImgBufStats *imgbuf_stats_get();
+String imgbuf_summary();
+
+#endif  /* IMG_BUF_H */
@@ -0,0 +1,173 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include <new>
+#include <string.h>
+#include <JPEGDEC.h>
+#include "jpeg_preview.h"
+
+#ifndef ARDUINO
+// PC build (host_tools/preview_bench.cpp)
+#include <time.h>
+static uint32_t micros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) ((ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000));
+}
+#endif
+
+JPEGDEC     *jpv_decoder = NULL;    // ~17K, so only allocated while it is wanted
+bool         jpv_is_open = false;
+int          jpv_width, jpv_height;
+
+// the decode in progress (for jpv_draw)
+JpvStripSink jpv_sink;
+void        *jpv_ctx;
+JpvResult   *jpv_res;
+uint32_t     jpv_start_us;
+uint32_t     jpv_budget_us;
+int          jpv_bottom;            // one past the last row of the picture, as placed
+
+/*
+ * templates for private functions
+ */
+int jpv_draw(JPEGDRAW *pDraw);
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+
+/*
+ * false if there isn't the memory for the decoder
+ */
+bool jpv_begin() {
+  if (jpv_decoder == NULL) {
+    jpv_decoder = new (std::nothrow) JPEGDEC;
+  }
+  return (jpv_decoder != NULL);
+}
+
+void jpv_end() {
+  jpv_close();
+  delete jpv_decoder;
+  jpv_decoder = NULL;
+}
+
+/*
+ * reads the JPEG's header; the picture must stay put until jpv_close()
+ */
+bool jpv_open(const uint8_t *jpg, int len, int *width, int *height) {
+  jpv_close();
+  if ((jpv_decoder == NULL) || !jpv_decoder->openRAM((uint8_t *) jpg, len, jpv_draw)) {
+    return false;
+  }
+  jpv_decoder->setPixelType(RGB565_BIG_ENDIAN);
+  jpv_is_open = true;
+  jpv_width = jpv_decoder->getWidth();
+  jpv_height = jpv_decoder->getHeight();
+  *width = jpv_width;
+  *height = jpv_height;
+  return true;
+}
+
+/*
+ * decodes the open picture at 1/scale (1, 2, 4 or 8) with its top left 
+ * corner at x, y.  true if it decoded, including when it was stopped 
+ * part way by the budget (res->over_budget); false on a bad JPEG, or if
+ * the sink stopped it
+ */
+bool jpv_decode(int scale, int x, int y, uint32_t budget_us, JpvStripSink sink, void *ctx, JpvResult *res) {
+  int options;
+  int ok;
+
+  memset(res, 0, sizeof(JpvResult));
+  if (!jpv_is_open) {
+    return false;
+  }
+  switch (scale) {
+    case 2:
+      options = JPEG_SCALE_HALF;
+      break;
+    case 4:
+      options = JPEG_SCALE_QUARTER;
+      break;
+    case 8:
+      options = JPEG_SCALE_EIGHTH;
+      break;
+    default:
+      scale = 1;
+      options = 0;
+  }
+  res->width = (jpv_width + scale - 1) / scale;
+  res->height = (jpv_height + scale - 1) / scale;
+  jpv_sink = sink;
+  jpv_ctx = ctx;
+  jpv_res = res;
+  jpv_budget_us = budget_us;
+  jpv_bottom = y + res->height;
+
+  jpv_start_us = micros();
+  ok = jpv_decoder->decode(x, y, options);
+  res->decode_us = (micros() - jpv_start_us) - res->sink_us;
+  return ok || res->over_budget;
+}
+
+void jpv_close() {
+  if (jpv_is_open) {
+    jpv_decoder->close();
+    jpv_is_open = false;
+  }
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+/*
+ * JPEGDEC's draw callback, once per strip; returning 0 stops the decode
+ */
+int jpv_draw(JPEGDRAW *pDraw) {
+  uint32_t sink_start_us;
+  bool more;
+
+  sink_start_us = micros();
+  more = jpv_sink(pDraw->x, pDraw->y, pDraw->iWidth, pDraw->iHeight, pDraw->pPixels, jpv_ctx);
+  jpv_res->sink_us += micros() - sink_start_us;
+  jpv_res->strips++;
+  if (!more) {
+    return 0;
+  }
+  if (((pDraw->y + pDraw->iHeight) < jpv_bottom) && ((micros() - jpv_start_us) > jpv_budget_us)) {
+    jpv_res->over_budget = true;
+    return 0;
+  }
+  return 1;
+}
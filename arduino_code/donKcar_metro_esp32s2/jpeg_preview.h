@@ -0,0 +1,75 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef JPEG_PREVIEW_H
+#define JPEG_PREVIEW_H
+
+/*
+ * ***************************************************************
+ * the jpeg_preview module decodes a camera JPEG, at full size or
+ * scaled down 2, 4 or 8 times, and hands the pixels (RGB565, high 
+ * byte first, as the TFT wants them) to a sink one strip at a time.
+ * a strip is a row of JPEG blocks (MCUs), so the picture is never
+ * held decoded in memory and the sink can blit each strip while the
+ * next one is decoded.  the scaling is done inside the decoder (it 
+ * skips the fine detail rather than decoding and then shrinking), 
+ * so a smaller scale is also a much faster one -- 1/8 uses only the
+ * DC value of each block.
+ *
+ * a decode is given a budget: once decode + sink time passes it the
+ * decode stops after the current strip, leaving the rest of the
+ * picture as it was.  the caller sees that in JpvResult and can go
+ * to a smaller scale.
+ *
+ * decoding is done by JPEGDEC (https://github.com/bitbank2/JPEGDEC, 
+ * Arduino library manager "JPEGDEC").  this module uses nothing else
+ * from the robot, so it also builds on a PC for benchmarking; see
+ * arduino_code/host_tools/preview_bench.cpp
+ * ***************************************************************
+ */
+
+#include <stdint.h>
+
+// receives one decoded strip; return false to stop the decode
+typedef bool (*JpvStripSink)(int x, int y, int w, int h, uint16_t *pixels, void *ctx);
+
+struct JpvResult {
+  int      width;           // size of the picture at the scale decoded
+  int      height;
+  int      strips;          // strips handed to the sink
+  uint32_t decode_us;       // time in the decoder (not counting the sink)
+  uint32_t sink_us;         // time in the sink (ie blitting)
+  bool     over_budget;     // stopped part way through, out of time
+};
+
+bool jpv_begin();
+void jpv_end();
+bool jpv_open(const uint8_t *jpg, int len, int *width, int *height);
+bool jpv_decode(int scale, int x, int y, uint32_t budget_us, JpvStripSink sink, void *ctx, JpvResult *res);
+void jpv_close();
+
+#endif  /* JPEG_PREVIEW_H */
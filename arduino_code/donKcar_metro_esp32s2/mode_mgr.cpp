@@ -30,6 +30,13 @@
 #include "drivetrain.h"
 #include "webap_core.h"
 #include "cam.h"
+#include "cam_latency.h"
+#include "steer_predict.h"
+#include "steer_pid.h"
+#include "control.h"
+#include "recorder.h"
+#include "tft_preview.h"
+#include "battery.h"
 
 #define HEARTBEAT_MAX 8             // heartbeat (nunchuk) timeout in 500 mS increments ( = 4 seconds)
 #define MENU_TIMEOUT 15             // menu timeout in seconds
@@ -54,23 +61,51 @@ char speed_mode_color;   // color code for neopixel display center section based
 char speed_creep_normal_boost_reverse;      // 'C', 'N', 'B', or 'R'
 int  speed_mode_straight_throttle;          // throttle setting for non-turning operation
 int cmd_joyX, cmd_joyY;    // as-commanded values
+SteerPredictor steer_predictor;   // fills in steering between camera frames in MODE_AUTO
+bool steer_stale;                 // true once camera steering has been missing too long
+bool steer_msg_pending;           // a new camera steering value is waiting to be displayed
+bool auto_armed;                  // MODE_AUTO: driving, rather than waiting ready (see AUTO_HOT_STANDBY)
 
-
-#define NUM_MENU_ITEMS 5
+/*
+ * go latency: from the button press that starts autonomous driving to the
+ * first valid steering command written (and, separately, to the first
+ * camera steering frame after the press)
+ */
+struct ModeGoStats {
+  uint32_t count;
+  uint32_t steer_last_ms;
+  uint32_t steer_max_ms;
+  uint32_t steer_total_ms;
+  uint32_t frame_last_ms;
+  uint32_t frame_max_ms;
+};
+ModeGoStats go_stats;
+unsigned long go_press_ms;
+bool go_wait_steer;
+bool go_wait_frame;
+#ifdef STEER_PID_ON_ROBOT
+SteerPid steer_pid;               // turns the camera's target angle into steering
+bool pid_sample_pending;          // a camera frame is waiting for the next control tick
+int16_t pid_target_angle;
+uint32_t pid_frame_ms;
+#endif
+
+
+#define NUM_MENU_ITEMS 6
 String menuStrings[] = {
-  "IDLE", "Manual Drive", "Autonomous Drive", "Web Configurator",  "Quick Setup"
+  "IDLE", "Manual Drive", "Autonomous Drive", "Web Configurator",  "Quick Setup", "Camera Preview"
 };
 
 int menuItems[] = {
-  MODE_IDLE, MODE_MANUAL2, MODE_AUTO, MODE_WAITING_CNX, MODE_QUICKSETUP
+  MODE_IDLE, MODE_MANUAL2, MODE_AUTO, MODE_WAITING_CNX, MODE_QUICKSETUP, MODE_PREVIEW
 };
 
 int menuColors_NEO[] = {
-  NEO_COLOR_YELLOW, NEO_COLOR_BLUE, NEO_COLOR_GREEN, NEO_COLOR_PURPLE, NEO_COLOR_ORANGE
+  NEO_COLOR_YELLOW, NEO_COLOR_BLUE, NEO_COLOR_GREEN, NEO_COLOR_PURPLE, NEO_COLOR_ORANGE, NEO_COLOR_CYAN
 };
 
 char menuColorCodes[] = {
-  'Y', 'B', 'G', 'P', 'O'
+  'Y', 'B', 'G', 'P', 'O', 'C'
 };
 
 /*
@@ -80,6 +115,12 @@ char menuColorCodes[] = {
  void mode_but_D_clicked_action();
  void mode_but_L_clicked_action();
  void mode_but_R_clicked_action();
+ void mode_auto_drive(int16_t steer_angle);
+ void mode_auto_new_steer(int16_t steer_angle, int16_t error_in_angle, int16_t target_angle);
+ void mode_auto_reset_steer();
+ void mode_auto_go();
+ void mode_auto_ready();
+ void mode_go_note_steer();
 
 /*
  * public functions
@@ -99,6 +140,12 @@ void mode_init(void) {
   current_steer_angle = 0;
   last_steer_angle = 0;
   angle_error = 0;
+  mode_auto_reset_steer();
+  steer_msg_pending = false;
+  auto_armed = false;
+  memset(&go_stats, 0, sizeof(go_stats));
+  go_wait_steer = false;
+  go_wait_frame = false;
   
   speed_mode_color = 'W';
   speed_creep_normal_boost_reverse = 'N';
@@ -151,10 +198,22 @@ void mode_check_webap_heartbeat() {
 }
 
 void mode_set_mode(int newMode) {
+#ifdef DEBUG
+  unsigned long entry_us = micros();    // to check how long a mode change holds up loop()
+#endif
   if (curMode != MODE_MENU) {
     lastMode = curMode;   // keep "current" mode so menu indexer cah start there
   }
+  if ((curMode == MODE_PREVIEW) && (newMode != MODE_PREVIEW)) {
+    preview_stop();
+    status_set_screen(STATUS_SCREEN_MAIN);
+    batt_display('E');      // (the main screen doesn't keep these)
+    batt_display('M');
+  }
   curMode = newMode;
+#ifdef DATASET_RECORDER
+  rec_mode_change(newMode);     // opens a recording when driving starts, closes it when driving stops
+#endif
   switch (newMode) {
     case MODE_INITIALIZING:
       status_disp_menu_msg("Initializing", 'C');
@@ -195,15 +254,32 @@ void mode_set_mode(int newMode) {
       cam_send_cmd(CAM_CMD_DRIVE_OFF);
       break;
     case MODE_AUTO:
-      status_disp_menu_msg("Autonomous Drive", 'G');
       status_neo_send(NEO_CMD_SETBACKGROUND,NEO_COLOR_GREEN);
       status_neo_send(NEO_CMD_SETFOREGROUND,NEO_COLOR_WHITE);
       status_neo_send(NEO_CMD_SETMODE,NEO_MODE_WINDOWED);
       status_neo_show_movement_info(0, 0, true);
-      drivetrain_enable(); 
-      cam_preset_paremeters();
+      mode_auto_reset_steer();
+      cam_sync_parameters();
       cam_enter_preferred_mode();   
+#ifdef AUTO_HOT_STANDBY
+      // the camera tracks and steering frames are filtered from now on;
+      // the Z button only has to arm the car (mode_auto_go())
+      auto_armed = false;
+      go_wait_steer = false;
+      go_wait_frame = false;
+      drivetrain_disable();
+      cam_send_cmd(CAM_CMD_DRIVE_READY);
+      status_disp_menu_msg("Auto Ready (Z=Go)", 'G');
+#else
+      // cold start: the menu select is the go press
+      status_disp_menu_msg("Autonomous Drive", 'G');
+      auto_armed = true;
+      drivetrain_enable(); 
       cam_send_cmd(CAM_CMD_DRIVE_ON);  
+      go_press_ms = millis();
+      go_wait_steer = true;
+      go_wait_frame = true;
+#endif
       break;
     case MODE_WAITING_CNX:                                    
       //status_disp_menu_msg("Waiting Connect", 'P');
@@ -224,6 +300,7 @@ void mode_set_mode(int newMode) {
       status_neo_send(NEO_CMD_SETMODE,NEO_MODE_SOLID);
       drivetrain_stop();
       drivetrain_disable();
+      cam_sync_parameters();
       cam_enter_preferred_mode();   
       cam_send_cmd(CAM_CMD_DRIVE_OFF);
       status_disp_info_msgs("USING WEB BROWSER", "TO CONFIGURE", "Nunchuk Not Avail", 'O'); 
@@ -235,6 +312,21 @@ void mode_set_mode(int newMode) {
       status_neo_send(NEO_CMD_SETMODE,NEO_MODE_SOLID);
       drivetrain_enable();
       break;
+    case MODE_PREVIEW:
+      status_disp_menu_msg("Camera Preview", 'C');
+      status_neo_send(NEO_CMD_SETBACKGROUND,NEO_COLOR_CYAN);
+      status_neo_send(NEO_CMD_SETFOREGROUND,NEO_COLOR_WHITE);
+      status_neo_send(NEO_CMD_SETMODE,NEO_MODE_SOLID);
+      drivetrain_stop();
+      drivetrain_disable();
+      cam_enter_preferred_mode();
+      cam_send_cmd(CAM_CMD_DRIVE_OFF);
+      if (preview_start()) {
+        status_set_screen(STATUS_SCREEN_PREVIEW);   // C button (menu) goes back to the main screen
+      } else {
+        status_disp_info_msgs("Camera Preview", "no memory", "", 'R');
+      }
+      break;
     case MODE_MENU:
       status_disp_menu_msg("Menu", 'W');
       status_neo_send(NEO_CMD_SETBACKGROUND,NEO_COLOR_GRAY);
@@ -266,19 +358,48 @@ void mode_set_mode(int newMode) {
       cam_send_cmd(CAM_CMD_DRIVE_OFF);
       break;
   }
+#ifdef DEBUG
+  DEBUG_PRINT("mode_set_mode ");
+  DEBUG_PRINT(newMode);
+  DEBUG_PRINT(" took uS: ");
+  DEBUG_PRINTLN(micros() - entry_us);
+#endif
 }
 
 bool mode_motion_permitted() {
-  if ((curMode == MODE_MANUAL1) || (curMode == MODE_MANUAL2) || (curMode == MODE_AUTO)) {
+  if ((curMode == MODE_MANUAL1) || (curMode == MODE_MANUAL2) || ((curMode == MODE_AUTO) && auto_armed)) {
       return true;    
   }
   return false;
 }
 
+/*
+ * go latency as one string with no spaces (fields separated by ':'):
+ * hot standby built in (0/1), number of starts measured, then to the first
+ * valid steering command: last, mean and max (mS), then to the first camera
+ * steering frame after the press: last and max (mS)
+ */
+String mode_go_summary() {
+  String summary;
+
+#ifdef AUTO_HOT_STANDBY
+  summary = "1";
+#else
+  summary = "0";
+#endif
+  summary = summary + ":" + String(go_stats.count);
+  summary = summary + ":" + String(go_stats.steer_last_ms);
+  summary = summary + ":" + String((go_stats.count > 0) ? (go_stats.steer_total_ms / go_stats.count) : 0);
+  summary = summary + ":" + String(go_stats.steer_max_ms);
+  summary = summary + ":" + String(go_stats.frame_last_ms);
+  summary = summary + ":" + String(go_stats.frame_max_ms);
+  return summary;
+}
+
 void mode_joyX_event(int myValue) { 
   if (curMode == MODE_MANUAL1) {      
     cmd_joyX = myValue;  
-    drivetrain_go(cmd_joyY, cmd_joyX);
+    control_request(cmd_joyY, cmd_joyX);
   }
   if ((curMode == MODE_MANUAL2) && (but_Z_status)) {      
     cmd_joyX = myValue;  
@@ -289,7 +410,7 @@ void mode_joyX_event(int myValue) {
       cmd_joyY = speed_mode_straight_throttle;
       speed_mode_color = speed_mode_color;
     }
-    drivetrain_go(cmd_joyY, cmd_joyX);
+    control_request(cmd_joyY, cmd_joyX);
   }
 
   bool last_but_R_status = but_R_status;
@@ -322,7 +443,7 @@ void mode_joyY_event(int myValue) {
     } else {
       cmd_joyY = 0;
     }
-    drivetrain_go(cmd_joyY, cmd_joyX);
+    control_request(cmd_joyY, cmd_joyX);
   }
   if (curMode == MODE_MANUAL2) { 
     // ignore joystick Y events in MODE_MANUAL2
@@ -352,31 +473,183 @@ void mode_joyY_event(int myValue) {
 /*
  * note this function is called when a message is received from camera
  * the "steer_angle" should be an integer -255 full left, +255 full right, 0=straight
+ * frame_ms is the (camera) time the image was taken
  */
-void mode_got_msg_steerangle(int16_t steer_angle, int16_t error_in_angle) {
+void mode_got_msg_steerangle(int16_t steer_angle, int16_t error_in_angle, int16_t target_angle, uint32_t frame_ms) {
+  CAM_LAT_DISPATCH();
   if (curMode == MODE_AUTO) { 
-    
-    last_steer_angle = current_steer_angle;
-    current_steer_angle = constrain(steer_angle, -255, 255);
-    status_disp_simple_msg(String(current_steer_angle), 'Y');
-
-    if (but_Z_status) {         
-      cmd_joyX = constrain(current_steer_angle, -255, 255);        
-      if (abs(current_steer_angle) > config.manual_turn_threshold) {
-        cmd_joyY = config.manual_speed_turns;
-        speed_mode_color = 'Y';
-      } else {
-        cmd_joyY = speed_mode_straight_throttle;
-        speed_mode_color = speed_mode_color;
-      }         
-    } else {
-      //DEBUG_PRINTLN(" BUT Z OFF");
-      cmd_joyY = 0;
+    if (go_wait_frame) {
+      go_wait_frame = false;
+      go_stats.frame_last_ms = millis() - go_press_ms;
+      if (go_stats.frame_last_ms > go_stats.frame_max_ms) {
+        go_stats.frame_max_ms = go_stats.frame_last_ms;
+      }
+    }
+#ifdef STEER_PID_ON_ROBOT
+    // the camera's own turn cmd is not used; the PID runs on the next control tick
+    pid_target_angle = target_angle;
+    pid_frame_ms = frame_ms;
+    pid_sample_pending = true;
+#else
+    mode_auto_new_steer(steer_angle, error_in_angle, target_angle);
+#endif
+  }
+}
+
+/*
+ * called on every control tick (see control.cpp); between camera frames
+ * this moves the steering along the predicted path, and if frames stop
+ * arriving it holds the last real command and stops the car until they
+ * come back
+ */
+void mode_steer_tick() {
+  int16_t predicted;
+  int state;
+
+  if (curMode != MODE_AUTO) {
+    return;
+  }
+#ifdef STEER_PID_ON_ROBOT
+  if (pid_sample_pending) {
+    pid_sample_pending = false;
+    predicted = steer_pid_update(&steer_pid, config.pid_kp, config.pid_ki, config.pid_kd, pid_frame_ms, pid_target_angle);
+    if (!auto_armed) {
+      steer_pid.i_term = 0.0;     // ready: nothing is steering, so nothing to integrate (as the camera)
+    }
+    mode_auto_new_steer(predicted, 0 - pid_target_angle, pid_target_angle);
+    return;
+  }
+#endif
+  state = steer_predict_get(&steer_predictor, millis(), &predicted);
+  if (state == STEER_PREDICT_EXTRAPOLATED) {
+    if (predicted != current_steer_angle) {
+      mode_auto_drive(predicted);
+    }
+  } else if ((state == STEER_PREDICT_STALE) && !steer_stale) {
+    steer_stale = true;
+    mode_auto_drive(predicted);
+    status_disp_simple_msg("No Camera Steering", 'R');
+  }
+}
+
+/*
+ * called at the control module's display rate; shows the newest camera
+ * steering value (kept out of mode_got_msg_steerangle() so the TFT
+ * isn't written from the camera parser)
+ */
+void mode_display_tick() {
+  if (steer_msg_pending) {
+    steer_msg_pending = false;
+    if (curMode == MODE_AUTO) {
+      status_disp_simple_msg(String(current_steer_angle), 'Y');
     }
-    drivetrain_go(cmd_joyY, cmd_joyX);
   }
 }
 
+/*
+ * a new real steering command for autonomous mode (from the camera, or
+ * from the on-robot PID)
+ */
+void mode_auto_new_steer(int16_t steer_angle, int16_t error_in_angle, int16_t target_angle) {
+  steer_predict_add(&steer_predictor, millis(), constrain(steer_angle, -255, 255), error_in_angle, target_angle);
+  angle_error = error_in_angle;
+  steer_stale = false;
+  mode_auto_drive(steer_angle);
+  steer_msg_pending = true;
+}
+
+/*
+ * forget the steering history when (re)entering autonomous mode
+ */
+void mode_auto_reset_steer() {
+  steer_predict_init(&steer_predictor);
+  steer_stale = false;
+#ifdef STEER_PID_ON_ROBOT
+  steer_pid_init(&steer_pid);
+  pid_sample_pending = false;
+#endif
+}
+
+/*
+ * go (Z pressed while ready): the camera has been tracking and its frames
+ * filtered all along, so the current steering goes out straight away if it
+ * is fresh enough; DRIVE_ON is only needed to let the camera's PID integrate
+ */
+void mode_auto_go() {
+  int16_t predicted;
+  int state;
+
+  go_press_ms = millis();
+  go_wait_steer = true;
+  go_wait_frame = true;
+  auto_armed = true;
+  drivetrain_enable();
+  cam_send_cmd(CAM_CMD_DRIVE_ON);
+  status_disp_menu_msg("Autonomous Drive", 'G');
+  state = steer_predict_get(&steer_predictor, millis(), &predicted);
+  if ((state != STEER_PREDICT_NONE) && (state != STEER_PREDICT_STALE)) {
+    mode_auto_drive(predicted);
+  }
+}
+
+/*
+ * back to ready (Z released): stop and disarm, but keep the camera tracking
+ */
+void mode_auto_ready() {
+  cmd_joyY = 0;
+  cmd_joyX = 0;
+  control_request(cmd_joyY, cmd_joyX);
+  drivetrain_stop();
+  auto_armed = false;
+  go_wait_steer = false;
+  go_wait_frame = false;
+  drivetrain_disable();
+  cam_send_cmd(CAM_CMD_DRIVE_READY);
+  status_disp_menu_msg("Auto Ready (Z=Go)", 'G');
+}
+
+void mode_go_note_steer() {
+  go_wait_steer = false;
+  go_stats.steer_last_ms = millis() - go_press_ms;
+  go_stats.steer_total_ms += go_stats.steer_last_ms;
+  if (go_stats.steer_last_ms > go_stats.steer_max_ms) {
+    go_stats.steer_max_ms = go_stats.steer_last_ms;
+  }
+  go_stats.count++;
+  DEBUG_PRINT("go to first valid steering, mS: ");
+  DEBUG_PRINTLN(go_stats.steer_last_ms);
+}
+
+/*
+ * sets steering (and throttle, if Z is held) for autonomous mode;
+ * throttle is cut whenever the steering data is stale
+ */
+void mode_auto_drive(int16_t steer_angle) {
+  last_steer_angle = current_steer_angle;
+  current_steer_angle = constrain(steer_angle, -255, 255);
+  if (!auto_armed) {
+    return;       // ready: keep following the camera, but drive nothing
+  }
+  if (go_wait_steer && !steer_stale) {
+    mode_go_note_steer();
+  }
+
+  if (but_Z_status && !steer_stale) {         
+    cmd_joyX = constrain(current_steer_angle, -255, 255);        
+    if (abs(current_steer_angle) > config.manual_turn_threshold) {
+      cmd_joyY = config.manual_speed_turns;
+      speed_mode_color = 'Y';
+    } else {
+      cmd_joyY = speed_mode_straight_throttle;
+      speed_mode_color = speed_mode_color;
+    }         
+  } else {
+    //DEBUG_PRINTLN(" BUT Z OFF");
+    cmd_joyY = 0;
+  }
+  control_request(cmd_joyY, cmd_joyX);
+}
+
 /*
  * called when activity from z button on nunchuk
  * note this is the "bottom" (bigger) button, closer to the bottom of the nunchuk
@@ -388,18 +661,27 @@ void mode_z_button_event(int action) {
   } else {
     but_Z_status = false;
   }
+#ifdef AUTO_HOT_STANDBY
+  // (ahead of the menu check, so the press that selects autonomous mode
+  // leaves it ready rather than starting it)
+  if ((curMode == MODE_AUTO) && (action == 1) && !auto_armed) {
+    mode_auto_go();
+  } else if ((curMode == MODE_AUTO) && (action == 0) && auto_armed) {
+    mode_auto_ready();
+  }
+#endif
   if ((curMode == MODE_MENU) && (action == 1)) {
     mode_menu_itemselect();
   }
   if ((curMode == MODE_MANUAL2) && (action == 0)) {
     cmd_joyY = 0;
     cmd_joyX = 0;
-    drivetrain_go(cmd_joyY, cmd_joyX);
+    control_request(cmd_joyY, cmd_joyX);
   }
   if ((curMode == MODE_MANUAL2) && (action == 1)) {
     cmd_joyY = config.manual_speed_normal;
     cmd_joyX = 0;
-    drivetrain_go(cmd_joyY, cmd_joyX);
+    control_request(cmd_joyY, cmd_joyX);
   }
 }
 
@@ -447,7 +729,7 @@ void mode_menu_indexer() {
     mode_set_mode(MODE_MENU);
   }
   mode_notice_menuaction();
-  status_neo_show_menu_psn5(menu_index, menuColors_NEO[menu_index]);
+  status_neo_show_menu_psn6(menu_index, menuColors_NEO[menu_index]);
   status_disp_menu_msg(String(">>") + menuStrings[menu_index] + String("<<"), menuColorCodes[menu_index]);
 }
 
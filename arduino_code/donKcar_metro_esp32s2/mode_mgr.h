@@ -42,6 +42,7 @@
 #define MODE_ERROR_BATT   8
 #define MODE_ERROR_HBEAT  9
 #define MODE_WAITING_CNX  10
+#define MODE_PREVIEW      11  // camera picture on the TFT
 
 void mode_init(void);
 void mode_notice_heartbeat(void);
@@ -59,7 +60,10 @@ void mode_menu_itemselect();
 void mode_check_webap_heartbeat();
 void mode_notice_webap_heartbeat(void);
 void mode_init_webap_heartbeat();
-void mode_got_msg_steerangle(int16_t steer_angle, int16_t angle_error);
+void mode_got_msg_steerangle(int16_t steer_angle, int16_t angle_error, int16_t target_angle, uint32_t frame_ms);
+void mode_steer_tick();
+void mode_display_tick();
+String mode_go_summary();
 char mode_get_speed_mode_color();
 bool mode_check_but_U();
 bool mode_check_but_D();
@@ -0,0 +1,307 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include <SdFat.h>
+#include "recorder.h"
+#include "cam.h"
+#include "cam_image.h"
+#include "cam_parser.h"
+#include "control.h"
+#include "mode_mgr.h"
+#include "status.h"
+#include "img_buf.h"
+
+#define REC_BUF_START    24576          // grown (see imgbuf_fit()) if a picture is bigger
+
+extern SdFat SD;          // (see config.cpp)
+
+File     rec_file;
+char     rec_filename[16];
+bool     rec_active = false;            // a recording file is open
+bool     rec_halted;                    // ... but it is full, or the card failed
+uint8_t *rec_buf = NULL;              // record being written; only allocated while recording
+uint32_t rec_buf_size = 0;
+int      rec_buf_sectors;             // sectors in rec_buf, 0 when it is free
+int      rec_buf_next;                // next of them to write
+uint32_t rec_next_sector;             // card sector the next write goes to
+uint32_t rec_end_sector;              // last sector of the preallocated file
+uint16_t rec_session;
+bool     rec_pic_outstanding;         // cam_image is collecting a picture for us
+unsigned long rec_next_request_ms;
+unsigned long rec_request_ms;         // when that picture was asked for ...
+int      rec_joyY, rec_joyX, rec_mode;  // ... and the labels that go with it
+RecStats rec_stats;
+
+/*
+ * templates for private functions
+ */
+void rec_start();
+void rec_stop();
+void rec_take_picture(unsigned long now);
+bool rec_write_sector();
+void rec_put16(uint8_t *buf, int index, uint16_t value);
+void rec_put32(uint8_t *buf, int index, uint32_t value);
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+
+/*
+ * called from mode_set_mode(); starts a recording when driving starts
+ * and finishes it when driving stops.  both of these may take a while
+ * (preallocating, writing what is left) which is fine here since the 
+ * car is not being driven at that moment
+ */
+void rec_mode_change(int newMode) {
+  bool driving;
+
+  driving = (newMode == MODE_MANUAL1) || (newMode == MODE_MANUAL2) || (newMode == MODE_AUTO);
+  rec_mode = newMode;
+  if (driving && !rec_active) {
+    rec_start();
+  } else if (!driving && rec_active) {
+    rec_stop();
+  }
+}
+
+/*
+ * called on every pass of loop(); never waits on the card or the camera
+ */
+void rec_loop() {
+  unsigned long now;
+  unsigned long write_us;
+
+  if (!rec_active || rec_halted) {
+    return;
+  }
+  now = millis();
+
+  rec_take_picture(now);
+
+  // ask for the next picture; the labels are taken now, as close as we 
+  // can get to when the camera grabs it
+  if (!rec_pic_outstanding && (cam_image_state() == CAM_IMG_IDLE) && ((long) (now - rec_next_request_ms) >= 0)) {
+    control_get_outputs(&rec_joyY, &rec_joyX);
+    cam_image_request();
+    rec_pic_outstanding = true;
+    rec_request_ms = now;
+    rec_next_request_ms = now + (1000 / REC_FPS);
+  }
+
+  if (rec_buf_sectors > 0) {
+    if (SD.card()->isBusy()) {
+      rec_stats.busy++;
+      return;
+    }
+    write_us = micros();
+    if (!rec_write_sector()) {
+      return;
+    }
+    write_us = micros() - write_us;
+    if (write_us > rec_stats.write_max_us) {
+      rec_stats.write_max_us = write_us;
+    }
+  }
+}
+
+bool rec_is_recording() {
+  return rec_active && !rec_halted;
+}
+
+const RecStats *rec_stats_get() {
+  return &rec_stats;
+}
+
+/*
+ * stats as one string with no spaces (fields separated by ':'), in the
+ * order: recording (0/1), records, failed, sectors, busy, write max uS
+ */
+String rec_summary() {
+  String s;
+
+  s = String((rec_active && !rec_halted) ? 1 : 0) + ":" + String(rec_stats.records) + ":" + String(rec_stats.failed);
+  s += ":" + String(rec_stats.sectors) + ":" + String(rec_stats.busy) + ":" + String(rec_stats.write_max_us);
+  return s;
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+void rec_start() {
+  uint32_t first;
+  int n;
+
+  memset(&rec_stats, 0, sizeof(rec_stats));
+  for (n=0; n<10000; n++) {
+    sprintf(rec_filename, "/rec%04d.dkr", n);
+    if (!SD.exists(rec_filename)) {
+      break;
+    }
+  }
+  rec_buf = imgbuf_fit(NULL, &rec_buf_size, REC_BUF_START);
+  if (rec_buf == NULL) {
+    status_disp_info_msgs("Recorder", "no memory", "not recording", 'R');
+    return;
+  }
+  rec_file = SD.open(rec_filename, O_RDWR | O_CREAT | O_TRUNC);
+  if (!rec_file || !rec_file.preAllocate((uint64_t) REC_FILE_MB * 1024 * 1024)
+      || !rec_file.contiguousRange(&first, &rec_end_sector) || !SD.card()->writeStart(first)) {
+    status_disp_info_msgs("Recorder", "SD card full or", "not usable", 'R');
+    if (rec_file) {
+      rec_file.close();
+      SD.remove(rec_filename);
+    }
+    imgbuf_free(rec_buf);
+    rec_buf = NULL;
+    return;
+  }
+  rec_next_sector = first;
+  rec_session = (uint16_t) (micros() ^ (micros() >> 16));
+  rec_buf_sectors = 0;
+  rec_pic_outstanding = false;
+  rec_next_request_ms = millis();
+  rec_halted = false;
+  rec_active = true;
+  status_disp_info_msgs("Recording", String(&rec_filename[1]), "", 'G');
+}
+
+/*
+ * writes out whatever is still buffered, ends the multi-block write,
+ * then cuts the file to length
+ */
+void rec_stop() {
+  rec_active = false;
+  if (rec_pic_outstanding) {
+    cam_image_release();
+  }
+  while (!rec_halted && (rec_buf_sectors > 0) && rec_write_sector()) {
+    // (the car has stopped; waiting on the card is fine now)
+  }
+  if (!SD.card()->writeStop()) {
+    DEBUG_PRINTLN("recorder: card did not end the write cleanly");
+  }
+  rec_file.truncate((uint64_t) rec_stats.sectors * REC_SECTOR);
+  rec_file.close();
+  imgbuf_free(rec_buf);
+  rec_buf = NULL;
+  cam_image_free_buffer();
+  status_disp_info_msgs("Recorded " + String(rec_stats.records) + " pictures", String(&rec_filename[1]), "", 'C');
+  DEBUG_PRINTLN("recorder " + String(rec_filename) + " " + rec_summary());
+}
+
+/*
+ * moves a picture that has come in to rec_buf (with its header) once
+ * that is free, leaving cam_image to collect the next one
+ */
+void rec_take_picture(unsigned long now) {
+  const uint8_t *data;
+  int len, total;
+
+  if (!rec_pic_outstanding) {
+    return;
+  }
+  if (cam_image_state() == CAM_IMG_FAILED) {
+    cam_image_release();
+    rec_pic_outstanding = false;
+    rec_stats.failed++;
+    return;
+  }
+  if ((cam_image_state() != CAM_IMG_READY) || (rec_buf_sectors != 0)) {
+    return;
+  }
+  data = cam_image_data(&len);
+  total = REC_HEADER_LEN + len;
+  rec_buf = imgbuf_fit(rec_buf, &rec_buf_size, ((total + REC_SECTOR - 1) / REC_SECTOR) * REC_SECTOR);
+  if (rec_buf == NULL) {
+    // no memory for a picture this big: drop it (and try a new buffer next time)
+    cam_image_release();
+    rec_pic_outstanding = false;
+    rec_stats.failed++;
+    return;
+  }
+  rec_buf_sectors = (total + REC_SECTOR - 1) / REC_SECTOR;
+  rec_buf_next = 0;
+
+  rec_put32(rec_buf, 0, REC_MAGIC);
+  rec_put32(rec_buf, 4, rec_stats.records);
+  rec_put32(rec_buf, 8, rec_request_ms);
+  rec_put32(rec_buf, 12, now);
+  rec_put32(rec_buf, 16, len);
+  rec_put16(rec_buf, 20, rec_joyY);
+  rec_put16(rec_buf, 22, rec_joyX);
+  rec_buf[24] = rec_mode;
+  rec_buf[25] = 0;
+  rec_put16(rec_buf, 26, rec_session);
+  rec_put16(rec_buf, 28, rec_buf_sectors);
+  rec_put16(rec_buf, 30, cam_crc16(rec_buf, 30));
+  memcpy(&rec_buf[REC_HEADER_LEN], data, len);
+  memset(&rec_buf[total], 0, (rec_buf_sectors * REC_SECTOR) - total);
+
+  cam_image_release();
+  rec_pic_outstanding = false;
+  rec_stats.records++;
+}
+
+/*
+ * sends the next sector of rec_buf as the next block of the multi-block
+ * write started by rec_start().  unlike writeSector() this returns as
+ * soon as the card has the data, without waiting for it to be programmed;
+ * the wait is left to the next block (see the isBusy() check in rec_loop())
+ * or to writeStop().  false (and recording halts until driving stops) once
+ * the preallocated file is full or the card fails
+ */
+bool rec_write_sector() {
+  if ((rec_next_sector > rec_end_sector)
+      || !SD.card()->writeData(&rec_buf[rec_buf_next * REC_SECTOR])) {
+    DEBUG_PRINTLN("recorder halted, file full or write failed");
+    rec_buf_sectors = 0;
+    rec_halted = true;
+    return false;
+  }
+  rec_next_sector++;
+  rec_buf_next++;
+  rec_stats.sectors++;
+  if (rec_buf_next >= rec_buf_sectors) {
+    rec_buf_sectors = 0;
+  }
+  return true;
+}
+
+void rec_put16(uint8_t *buf, int index, uint16_t value) {
+  buf[index] = value & 0xFF;
+  buf[index + 1] = (value >> 8) & 0xFF;
+}
+
+void rec_put32(uint8_t *buf, int index, uint32_t value) {
+  rec_put16(buf, index, value & 0xFFFF);
+  rec_put16(buf, index + 2, value >> 16);
+}
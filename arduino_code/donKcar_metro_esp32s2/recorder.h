@@ -0,0 +1,93 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef RECORDER_H
+#define RECORDER_H
+
+/*
+ * ***************************************************************
+ * the recorder builds datasets for training / offline tuning: while
+ * the car is being driven (MODE_MANUAL1/2 or MODE_AUTO) it asks the
+ * camera for a picture REC_FPS times a second and writes each one
+ * to the SD card along with the drive outputs in effect when the 
+ * picture was asked for.  build it in with DATASET_RECORDER (config.h);
+ * every driving session then gets its own file, /recNNNN.dkr
+ *
+ * the file is preallocated (REC_FILE_MB, contiguous) when driving
+ * starts, so recording never touches the FAT.  the whole session is 
+ * one multi-block write straight to the card (writeStart() when driving
+ * starts, writeStop() when it ends); each pass of loop() sends at most
+ * one sector, and only once the card has finished programming the last
+ * one (isBusy()), so a slow card holds up the recording and not the 
+ * control loop.  pictures are double buffered: one is collected by 
+ * cam_image while the last one drains from rec_buf.  the file is cut
+ * to the length recorded when driving stops.  rec_summary() is shown
+ * on cam_general.html
+ *
+ * every record starts on a sector boundary (all values LSB first):
+ *    0-3    REC_MAGIC ("DKR1")
+ *    4-7    record number (0, 1, 2 ...)
+ *    8-11   robot millis() when the picture was asked for (labels are from then)
+ *    12-15  robot millis() when the whole picture had arrived
+ *    16-19  JPEG length
+ *    20,21  throttle written to the drivetrain (-255 to +255)
+ *    22,23  steering written to the drivetrain (-255 to +255)
+ *    24     mode (MODE_xxx)
+ *    25     0
+ *    26,27  session id (the same in every record of a file)
+ *    28,29  record length in sectors (header and JPEG, padded)
+ *    30,31  CRC-16/CCITT-FALSE of bytes 0 .. 29
+ *    32..   JPEG, then zeros to the end of the last sector
+ * a reader stops at the first header that does not check out (bad
+ * magic / CRC, wrong record number or session id), which also covers
+ * a file left at full length by a power cut.  see 
+ * code_openmv/host_tools/recording_tool.py
+ * ***************************************************************
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+#define REC_SECTOR       512
+#define REC_HEADER_LEN   32
+#define REC_MAGIC        0x31524B44UL    // "DKR1"
+
+struct RecStats {
+  uint32_t records;         // written, this session
+  uint32_t failed;          // pictures the camera did not deliver
+  uint32_t sectors;
+  uint32_t busy;            // passes that found the card busy and waited
+  uint32_t write_max_us;    // longest single sector sent to the card
+};
+
+void rec_mode_change(int newMode);
+void rec_loop();
+bool rec_is_recording();
+const RecStats *rec_stats_get();
+String rec_summary();
+
+#endif  /* RECORDER_H */
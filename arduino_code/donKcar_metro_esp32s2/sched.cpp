@@ -0,0 +1,276 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include <stdio.h>
+#include <string.h>
+#include "sched.h"
+
+/*
+ * templates for private functions
+ */
+int  sched_add(Sched *s, const char *name, SchedFn fn, uint8_t prio, uint32_t period_ms, uint32_t first_ms);
+bool sched_is_due(SchedTask *t, uint32_t now_us);
+int  sched_pick(Sched *s, uint32_t now_us, bool minor_allowed);
+void sched_start(Sched *s, SchedTask *t);
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+
+void sched_init(Sched *s, SchedClockFn clock_us) {
+  memset(s, 0, sizeof(Sched));
+  s->clock_us = clock_us;
+}
+
+/*
+ * registers fn to run every period_ms, the first time first_ms from now;
+ * returns the task id (for sched_cancel) or -1 if the table is full
+ */
+int sched_every(Sched *s, const char *name, SchedFn fn, uint8_t prio, uint32_t period_ms, uint32_t first_ms) {
+  if (period_ms == 0) {
+    return -1;
+  }
+  return sched_add(s, name, fn, prio, period_ms, first_ms);
+}
+
+/*
+ * registers fn to run once, delay_ms from now.  a one-shot's slot is
+ * re-used by a later one-shot with the same name, so a job that
+ * re-arms itself does not fill the table (and keeps its statistics)
+ */
+int sched_once(Sched *s, const char *name, SchedFn fn, uint8_t prio, uint32_t delay_ms) {
+  return sched_add(s, name, fn, prio, 0, delay_ms);
+}
+
+void sched_cancel(Sched *s, int id) {
+  if ((id >= 0) && (id < s->count)) {
+    s->task[id].active = false;
+  }
+}
+
+/*
+ * runs the tasks that are due (see sched.h for the order); returns
+ * how many ran
+ */
+int sched_run(Sched *s) {
+  uint32_t now_us;
+  bool minor_done;
+  int ran;
+  int id;
+
+  s->passes++;
+  minor_done = false;
+  ran = 0;
+  while (true) {
+    now_us = s->clock_us();
+    id = sched_pick(s, now_us, !minor_done);
+    if (id < 0) {
+      break;
+    }
+    if (s->task[id].prio < SCHED_PRIO_URGENT) {
+      minor_done = true;
+    }
+    sched_start(s, &s->task[id]);
+    ran++;
+  }
+  if (minor_done && (sched_pick(s, now_us, true) >= 0)) {
+    s->deferred++;
+  }
+  return ran;
+}
+
+/*
+ * earliest due time of the active tasks (false if there are none);
+ * a host harness can move its fake clock straight there
+ */
+bool sched_next_due(Sched *s, uint32_t *due_us) {
+  uint32_t now_us;
+  bool found;
+
+  now_us = s->clock_us();
+  found = false;
+  for (int i = 0; i < s->count; i++) {
+    if (!s->task[i].active) {
+      continue;
+    }
+    if (!found || ((int32_t) (s->task[i].due_us - *due_us) < 0)) {
+      *due_us = s->task[i].due_us;
+      found = true;
+    }
+  }
+  if (found && ((int32_t) (*due_us - now_us) < 0)) {
+    *due_us = now_us;
+  }
+  return found;
+}
+
+void sched_reset_stats(Sched *s) {
+  SchedTask *t;
+
+  s->passes = 0;
+  s->deferred = 0;
+  for (int i = 0; i < s->count; i++) {
+    t = &s->task[i];
+    t->last_pass = 0;
+    t->runs = 0;
+    t->skipped = 0;
+    t->run_total_us = 0;
+    t->run_max_us = 0;
+    t->late_total_us = 0;
+    t->late_max_us = 0;
+  }
+}
+
+/*
+ * passes:deferred:tasks, then for each task
+ *    name:prio:period_ms:runs:run_mean_us:run_max_us:late_mean_us:late_max_us:skipped
+ * returns the length written (truncated to buflen - 1)
+ */
+int sched_summary(Sched *s, char *buf, int buflen) {
+  SchedTask *t;
+  int len;
+
+  len = snprintf(buf, buflen, "%lu:%lu:%d", (unsigned long) s->passes, (unsigned long) s->deferred, s->count);
+  for (int i = 0; (i < s->count) && (len < buflen); i++) {
+    t = &s->task[i];
+    len += snprintf(buf + len, buflen - len, ":%s:%d:%lu:%lu:%lu:%lu:%lu:%lu:%lu",
+                    t->name, t->prio, (unsigned long) (t->period_us / 1000), (unsigned long) t->runs,
+                    (unsigned long) ((t->runs > 0) ? (t->run_total_us / t->runs) : 0), (unsigned long) t->run_max_us,
+                    (unsigned long) ((t->runs > 0) ? (t->late_total_us / t->runs) : 0), (unsigned long) t->late_max_us,
+                    (unsigned long) t->skipped);
+  }
+  return (len < buflen) ? len : (buflen - 1);
+}
+
+/*
+ * **************************************************************
+ * private functions
+ * **************************************************************
+ */
+
+int sched_add(Sched *s, const char *name, SchedFn fn, uint8_t prio, uint32_t period_ms, uint32_t first_ms) {
+  SchedTask *t;
+  int id;
+
+  id = -1;
+  if (period_ms == 0) {
+    for (int i = 0; i < s->count; i++) {
+      if (!s->task[i].active && (s->task[i].period_us == 0) && (strcmp(s->task[i].name, name) == 0)) {
+        id = i;
+        break;
+      }
+    }
+  }
+  if (id < 0) {
+    if (s->count >= SCHED_MAX_TASKS) {
+      return -1;
+    }
+    id = s->count++;
+    memset(&s->task[id], 0, sizeof(SchedTask));
+  }
+
+  t = &s->task[id];
+  t->name = name;
+  t->fn = fn;
+  t->prio = prio;
+  t->period_us = period_ms * 1000;
+  t->due_us = s->clock_us() + (first_ms * 1000);
+  t->active = true;
+  return id;
+}
+
+bool sched_is_due(SchedTask *t, uint32_t now_us) {
+  return t->active && ((int32_t) (now_us - t->due_us) >= 0);
+}
+
+/*
+ * the due task to run next: highest priority, then the most overdue;
+ * tasks below SCHED_PRIO_URGENT only when minor_allowed
+ */
+int sched_pick(Sched *s, uint32_t now_us, bool minor_allowed) {
+  SchedTask *t;
+  SchedTask *best;
+  int best_id;
+
+  best = NULL;
+  best_id = -1;
+  for (int i = 0; i < s->count; i++) {
+    t = &s->task[i];
+    if (!sched_is_due(t, now_us) || (t->last_pass == s->passes)) {
+      continue;
+    }
+    if (!minor_allowed && (t->prio < SCHED_PRIO_URGENT)) {
+      continue;
+    }
+    if ((best == NULL) || (t->prio > best->prio) ||
+        ((t->prio == best->prio) && ((int32_t) (t->due_us - best->due_us) < 0))) {
+      best = t;
+      best_id = i;
+    }
+  }
+  return best_id;
+}
+
+/*
+ * the next due time is set before fn is called, so fn may re-arm
+ * (sched_once) or cancel itself
+ */
+void sched_start(Sched *s, SchedTask *t) {
+  uint32_t start_us;
+  uint32_t late_us;
+  uint32_t run_us;
+  uint32_t missed;
+
+  start_us = s->clock_us();
+  late_us = start_us - t->due_us;
+  t->last_pass = s->passes;
+  if (t->period_us == 0) {
+    t->active = false;
+  } else {
+    if (late_us >= t->period_us) {
+      missed = late_us / t->period_us;
+      t->skipped += missed;
+      t->due_us += missed * t->period_us;
+    }
+    t->due_us += t->period_us;
+  }
+
+  t->fn();
+
+  run_us = s->clock_us() - start_us;
+  t->runs++;
+  t->run_total_us += run_us;
+  if (run_us > t->run_max_us) {
+    t->run_max_us = run_us;
+  }
+  t->late_total_us += late_us;
+  if (late_us > t->late_max_us) {
+    t->late_max_us = late_us;
+  }
+}
@@ -0,0 +1,111 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef SCHED_H
+#define SCHED_H
+
+/*
+ * ***************************************************************
+ * the sched module runs loop()'s periodic jobs (battery checks,
+ * heartbeat and menu timeouts, status message clearing ...) from
+ * a table of tasks instead of a "nextXxxDue" variable per job.
+ *
+ * each task has a period (0 for a one-shot), a priority and a due
+ * time.  times are a 32 bit uS clock compared as
+ *    (int32_t) (now - due) >= 0
+ * so they keep working when the clock wraps (every 71 minutes for
+ * micros()), as long as no period is longer than half of that.
+ *
+ * sched_run() is called once per pass of loop().  it runs every
+ * due task of SCHED_PRIO_URGENT or above, highest priority first,
+ * but at most one due task below that, so cosmetic jobs (TFT and
+ * controller display) are spread over passes rather than holding
+ * up cam_loop() / control_loop() back to back.  no task runs twice
+ * in one pass.  a periodic task that is late by a whole period or
+ * more skips the missed runs (counted in skipped) rather than
+ * running them back to back, as control_loop() does for its ticks.
+ *
+ * for every task it keeps the number of runs, run time (mean and
+ * max) and lateness (mean and max, how long after its due time it
+ * was started).
+ *
+ * like cam_parser it has no Arduino dependencies; the clock is a
+ * function handed to sched_init(), so on a host a fake clock that
+ * the task functions advance can drive (and time) a whole schedule
+ * ***************************************************************
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SCHED_MAX_TASKS         12
+
+#define SCHED_PRIO_DISPLAY      0   // cosmetic: displays, messages to the controller
+#define SCHED_PRIO_HOUSEKEEP    1   // battery checks, menu timeouts
+#define SCHED_PRIO_URGENT       2   // this and above all run in the pass they come due
+#define SCHED_PRIO_SAFETY       2   // heartbeat timeouts (stop the car)
+#define SCHED_PRIO_CONTROL      3   // anything that drives the outputs
+
+typedef void (*SchedFn)(void);
+typedef uint32_t (*SchedClockFn)(void);   // uS, free running, may wrap
+
+struct SchedTask {
+  const char *name;       // short, shown on the web page
+  SchedFn  fn;
+  uint8_t  prio;
+  bool     active;        // false once a one-shot has run (or the task is cancelled)
+  uint32_t period_us;     // 0 for a one-shot
+  uint32_t due_us;
+  uint32_t last_pass;     // pass it last ran in (no task runs twice in one pass)
+  uint32_t runs;
+  uint32_t skipped;       // periods missed because loop() was held up
+  uint64_t run_total_us;
+  uint32_t run_max_us;
+  uint64_t late_total_us;
+  uint32_t late_max_us;
+};
+
+struct Sched {
+  SchedTask    task[SCHED_MAX_TASKS];
+  int          count;     // slots in use (including inactive one-shots)
+  SchedClockFn clock_us;
+  uint32_t     passes;    // calls to sched_run()
+  uint32_t     deferred;  // passes that left a due low priority task for the next pass
+};
+
+extern Sched loop_sched;  // the one loop() runs (donKcar_metro_esp32s2.ino)
+
+void sched_init(Sched *s, SchedClockFn clock_us);
+int  sched_every(Sched *s, const char *name, SchedFn fn, uint8_t prio, uint32_t period_ms, uint32_t first_ms);
+int  sched_once(Sched *s, const char *name, SchedFn fn, uint8_t prio, uint32_t delay_ms);
+void sched_cancel(Sched *s, int id);
+int  sched_run(Sched *s);
+bool sched_next_due(Sched *s, uint32_t *due_us);
+void sched_reset_stats(Sched *s);
+int  sched_summary(Sched *s, char *buf, int buflen);
+
+#endif  /* SCHED_H */
@@ -190,6 +190,21 @@ void screen_centerString(int rowindex, String myString, int color) {
   screen_centerText(rowindex, myText, color);
 }
 
+void screen_clear_area(int x, int y, int w, int h) {
+  util_enable_my_spi(PIN_TFT_CS);
+  display.fillRect(x, y, w, h, COLOR_BACKGROUND);
+}
+
+// copies a block of pixels (RGB565, high byte first, w * h of them, row
+// by row) straight to the display; used for the camera preview strips
+void screen_blit_rgb565(int x, int y, int w, int h, uint16_t *pixels) {
+  util_enable_my_spi(PIN_TFT_CS);
+  display.startWrite();
+  display.setAddrWindow(x, y, w, h);
+  display.writePixels(pixels, (uint32_t) w * h, true, true);
+  display.endWrite();
+}
+
 
 /*
  * colorcode char for messages is as follows:
@@ -37,6 +37,7 @@
 #include <SPI.h>
 
 // screen locations for text
+#define ROW_CAMSTATS 0  // note only used if CAM_STATS_ON_TFT is defined (see config.h)
 #define ROW_BATT_E 1
 #define ROW_BATT_M 2
 #define ROW_MAC 3
@@ -131,5 +132,7 @@ void screen_writeString_colrow(int col, int rowindex, int nc, String myString, i
 
 void screen_centerText(int rowindex, char myText[], int color);
 void screen_centerString(int rowindex, String myString, int color);
+void screen_clear_area(int x, int y, int w, int h);
+void screen_blit_rgb565(int x, int y, int w, int h, uint16_t *pixels);
 
 #endif  /* SCREEN_H */
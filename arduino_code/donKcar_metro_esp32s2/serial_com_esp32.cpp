@@ -30,8 +30,17 @@
 
 /*
  * *********************************************************
- * this module is currently NOT USED but is kept for 
- * future reference
+ * sercom1 is the camera link (cam.cpp).  the UART driver
+ * buffers SERCOM1_RX_DRIVER_SIZE bytes; sercom1_poll() moves
+ * whatever it holds into sercom1_ring in at most 2 bulk
+ * read() calls, and cam_loop() hands the ring to the parser
+ * span by span (sercom1_rx_span() / sercom1_rx_consume()).
+ * a full ring is not an error, the bytes wait in the driver;
+ * sercom1_rx_overruns() counts only bytes really lost (driver
+ * buffer or UART FIFO overflows, from the core's receive
+ * error events, or with an older core the polls that find
+ * the driver buffer full), and sercom1_rx_fifo_overflows()
+ * the FIFO part of those
  * *********************************************************
  */
 
@@ -55,9 +64,33 @@
 
 bool sercom1avail = false;
 bool sercom2avail = false;
+
+uint8_t  sercom1_ring[SERCOM1_RX_RING_SIZE];
+uint32_t sercom1_ring_head;     // next byte to be written (free-running, masked on use)
+uint32_t sercom1_ring_tail;     // next byte to be read (free-running, masked on use)
+volatile uint32_t sercom1_rx_drops;   // times the UART driver buffer or FIFO overflowed (bytes were lost)
+volatile uint32_t sercom1_rx_fifo_drops;  // ... of those, the hardware FIFO (the driver could not keep up with the rate)
+
+/*
+ * the core reports driver buffer and FIFO overflows as events (2.0.3 on);
+ * with an older core sercom1_poll() counts the times it finds the driver
+ * buffer full instead
+ */
+#ifdef ESP_ARDUINO_VERSION_VAL
+  #if ESP_ARDUINO_VERSION >= ESP_ARDUINO_VERSION_VAL(2, 0, 3)
+    #define SERCOM1_RX_ERROR_EVENTS
+  #endif
+#endif
  
 SoftwareSerial myPort;
 
+/*
+ * templates for private functions
+ */
+#ifdef SERCOM1_RX_ERROR_EVENTS
+void sercom1_rx_error(hardwareSerial_error_t err);
+#endif
+
 void sercom2_init(void) {  
   if (PIN_TX_SERCOM1 > 0) {
     sercom2avail = true;
@@ -106,8 +139,17 @@ void sercom1_init(void) {
   
   if (sercom1avail) {
     // Note the format for setting a serial port is as follows: Serial1.begin(baud-rate, protocol, RX pin, TX pin);
+    Serial1.setRxBufferSize(SERCOM1_RX_DRIVER_SIZE);
+    Serial1.setTxBufferSize(SERCOM1_TX_DRIVER_SIZE);
     Serial1.begin(BAUD_RATE_SERCOM1, SERIAL_8N1, PIN_RX_SERCOM1, PIN_TX_SERCOM1);
+#ifdef SERCOM1_RX_ERROR_EVENTS
+    Serial1.onReceiveError(sercom1_rx_error);
+#endif
   }
+  sercom1_ring_head = 0;
+  sercom1_ring_tail = 0;
+  sercom1_rx_drops = 0;
+  sercom1_rx_fifo_drops = 0;
 }
 
 void sercom1_sendchar(char theChar) {
@@ -131,3 +173,148 @@ char sercom1_read() {
     return '\0';
   }
 }
+
+/*
+ * moves everything currently held by the UART driver into the ring buffer.
+ * the free space in the ring is at most 2 contiguous pieces (before and after
+ * the wrap point) so this takes at most 2 bulk read() calls regardless of how
+ * many bytes are waiting.  returns the number of bytes moved
+ *
+ * a full ring is not an error: whatever does not fit stays in the driver
+ * buffer (SERCOM1_RX_DRIVER_SIZE) and is picked up on a later poll.  bytes
+ * are only lost when that buffer or the UART FIFO overflows
+ */
+int sercom1_poll() {
+  int waiting, space, piece, got, total;
+  uint32_t head_index;
+
+  if (!sercom1avail) {
+    return 0;
+  }
+  waiting = Serial1.available();
+#ifndef SERCOM1_RX_ERROR_EVENTS
+  if (waiting >= SERCOM1_RX_DRIVER_SIZE) {
+    sercom1_rx_drops++;
+  }
+#endif
+  total = 0;
+  while (waiting > 0) {
+    space = SERCOM1_RX_RING_SIZE - (int) (sercom1_ring_head - sercom1_ring_tail);
+    if (space <= 0) {
+      break;
+    }
+    head_index = sercom1_ring_head & (SERCOM1_RX_RING_SIZE - 1);
+    piece = SERCOM1_RX_RING_SIZE - head_index;    // contiguous room up to the wrap
+    if (piece > space) {
+      piece = space;
+    }
+    if (piece > waiting) {
+      piece = waiting;
+    }
+    got = Serial1.read(&sercom1_ring[head_index], piece);
+    if (got <= 0) {
+      break;
+    }
+    sercom1_ring_head += got;
+    total += got;
+    waiting -= got;
+  }
+  return total;
+}
+
+/*
+ * returns the number of bytes that can be read contiguously from the ring
+ * and points *span at the first of them; call sercom1_rx_consume() once
+ * they have been used.  (a wrapped ring gives 2 spans on successive calls)
+ */
+int sercom1_rx_span(const uint8_t **span) {
+  uint32_t tail_index;
+  int num_bytes;
+
+  num_bytes = (int) (sercom1_ring_head - sercom1_ring_tail);
+  if (num_bytes <= 0) {
+    return 0;
+  }
+  tail_index = sercom1_ring_tail & (SERCOM1_RX_RING_SIZE - 1);
+  if (num_bytes > (int) (SERCOM1_RX_RING_SIZE - tail_index)) {
+    num_bytes = SERCOM1_RX_RING_SIZE - tail_index;
+  }
+  *span = &sercom1_ring[tail_index];
+  return num_bytes;
+}
+
+void sercom1_rx_consume(int num_bytes) {
+  sercom1_ring_tail += num_bytes;
+}
+
+/*
+ * receive overflows in the UART driver or FIFO: bytes from the camera
+ * that were lost before sercom1_poll() could take them
+ */
+uint32_t sercom1_rx_overruns() {
+  return sercom1_rx_drops;
+}
+
+/*
+ * the part of sercom1_rx_overruns() that was the UART FIFO: the driver's
+ * interrupt did not empty it in time, which depends on the baud rate, not
+ * on how long loop() takes to come round (that fills the driver buffer).
+ * always 0 with a core that does not report receive errors
+ */
+uint32_t sercom1_rx_fifo_overflows() {
+  return sercom1_rx_fifo_drops;
+}
+
+/*
+ * returns how many bytes can be written right now without blocking
+ */
+int sercom1_tx_room() {
+  if (sercom1avail) {
+    return Serial1.availableForWrite();
+  } else {
+    return 0;
+  }
+}
+
+/*
+ * writes buf[] in a single call; callers should check sercom1_tx_room()
+ * first if they must not block.  returns the number of bytes written
+ */
+int sercom1_write(const uint8_t *buf, int len) {
+  if (sercom1avail) {
+    return Serial1.write(buf, len);
+  } else {
+    return 0;
+  }
+}
+
+/*
+ * changes the link speed.  whatever is still going out is sent first (at
+ * the old rate); whatever has come in and not been read yet is dropped,
+ * since the far end changes speed at the same time
+ */
+void sercom1_set_baud(uint32_t baud) {
+  if (sercom1avail) {
+    Serial1.flush();
+    Serial1.updateBaudRate(baud);
+    while (Serial1.available() > 0) {
+      Serial1.read();
+    }
+  }
+  sercom1_ring_head = 0;
+  sercom1_ring_tail = 0;
+}
+
+#ifdef SERCOM1_RX_ERROR_EVENTS
+/*
+ * called from the core's UART event task, not an interrupt
+ */
+void sercom1_rx_error(hardwareSerial_error_t err) {
+  if ((err == UART_BUFFER_FULL_ERROR) || (err == UART_FIFO_OVF_ERROR)) {
+    sercom1_rx_drops++;
+  }
+  if (err == UART_FIFO_OVF_ERROR) {
+    sercom1_rx_fifo_drops++;
+  }
+}
+#endif
@@ -33,8 +33,11 @@
 
 /*
  * *********************************************************
- * this module is currently NOT USED but is kept for 
- * future reference
+ * sercom1 (Serial1) is the camera link: cam.cpp receives
+ * through the ring buffer below and transmits with
+ * sercom1_tx_room() / sercom1_write(); cam_stats.cpp reports
+ * the receive drops.  sercom2 (software serial) drives the
+ * neopixel board
  * *********************************************************
  */
 
@@ -60,4 +63,32 @@ void sercom1_sendchar(char theChar);
 bool sercom1_available();
 char sercom1_read();
 
+/*
+ * bulk receive path for sercom1: sercom1_poll() moves whatever the UART
+ * driver holds into a fixed ring buffer in as few read() calls as possible,
+ * and the consumer then takes contiguous spans straight out of the ring
+ */
+#define SERCOM1_RX_RING_SIZE 1024   // must be a power of 2
+#ifdef CAM_BAUD_NEGOTIATE
+#define SERCOM1_RX_DRIVER_SIZE 4096 // UART driver receive buffer (set before begin); ~20 mS at 2 Mbaud
+#else
+#define SERCOM1_RX_DRIVER_SIZE 1024 // UART driver receive buffer (set before begin)
+#endif
+#define SERCOM1_TX_DRIVER_SIZE 256  // UART driver transmit buffer; writes that fit return without waiting
+
+int  sercom1_poll();
+int  sercom1_rx_span(const uint8_t **span);
+void sercom1_rx_consume(int num_bytes);
+uint32_t sercom1_rx_overruns();
+uint32_t sercom1_rx_fifo_overflows();
+
+/*
+ * bulk transmit path for sercom1: a whole frame is handed to the UART
+ * driver in one write(), but only when it fits without waiting
+ */
+int  sercom1_tx_room();
+int  sercom1_write(const uint8_t *buf, int len);
+
+void sercom1_set_baud(uint32_t baud);
+
 #endif  /* COMMUNIC_H */
@@ -26,6 +26,7 @@
  * SOFTWARE. * 
  */
 #include "servo.h"
+#include "cam_latency.h"
 
 /*
  * *************************************************************************************
@@ -237,6 +238,7 @@ void servo_set_steering_value(int value) {
     turn_fraction_of_fullrange = abs(config.steer_center_us - config.steer_right_us) * (float) value / 255.00;
     send_uS = (float) config.steer_center_us + turn_fraction_of_fullrange;
   }
+  CAM_LAT_ACTUATE();
   set_pulsewidth(servoSteering, send_uS);
 }
 
@@ -47,6 +47,8 @@ int  lastJoyX, lastJoyY;
 int  neo_background_color, neo_foreground_color;
 int  current_screen;
 int  status_message_timer;  // status messages disappear after 30 sec
+String last_address;        // IP or MAC, to put back when returning to the main screen
+char last_address_flavor;
 
 void status_init() {
   screen_init();
@@ -202,6 +204,8 @@ void status_disp_batt_volts(char battcode, float battvolts, float cellvolts, cha
 }
 
 void status_disp_IP_or_MAC(String address, char flavor) {  
+  last_address = address;
+  last_address_flavor = flavor;
   if (current_screen == STATUS_SCREEN_MAIN) {
     screen_clearLine(ROW_MAC);
     if (flavor == 'M') {
@@ -230,6 +234,60 @@ void status_disp_webconnect_downcounter(int ticks_left) {
   }
 }
 
+/*
+ * camera link health line (see cam_stats.cpp); "S" is steering frames
+ * per second, "E" link errors per second, "G" the longest gap in mS
+ */
+void status_disp_cam_stats(uint32_t steer_per_sec, uint32_t errors_per_sec, uint32_t gap_max_ms, char colorcode) {
+  char tmpBuf[24];
+
+  if (current_screen == STATUS_SCREEN_MAIN) {
+    snprintf(tmpBuf, sizeof(tmpBuf), "S%lu E%lu G%lu", (unsigned long) steer_per_sec, 
+             (unsigned long) errors_per_sec, (unsigned long) gap_max_ms);
+    screen_centerText(ROW_CAMSTATS, tmpBuf, ccToRGB(colorcode));
+  }
+}
+
+/*
+ * timing line(s) under the camera preview: decode and blit time of the 
+ * last picture, the scale it was decoded at, pictures shown, and how 
+ * many of those ran out of decode budget
+ */
+void status_disp_preview_stats(uint32_t decode_us, uint32_t blit_us, int scale, uint32_t frames, uint32_t over_budget) {
+  char tmpBuf[24];
+
+  if (current_screen == STATUS_SCREEN_PREVIEW) {
+    snprintf(tmpBuf, sizeof(tmpBuf), "D%lu.%lu B%lu.%lu ms", (unsigned long) (decode_us / 1000), 
+             (unsigned long) ((decode_us / 100) % 10), (unsigned long) (blit_us / 1000), (unsigned long) ((blit_us / 100) % 10));
+    screen_centerText(ROW_RACERNAME, tmpBuf, ccToRGB('C'));
+    snprintf(tmpBuf, sizeof(tmpBuf), "1/%d #%lu over %lu", scale, (unsigned long) frames, (unsigned long) over_budget);
+    screen_centerText(ROW_STAT4, tmpBuf, ccToRGB((over_budget > 0) ? 'O' : 'W'));
+  }
+}
+
+/*
+ * switches the whole TFT between the main status screen and the others
+ * (eg the camera preview); the main screen is redrawn on the way back, 
+ * what it doesn't keep (battery values, the bottom line) is up to the caller
+ */
+void status_set_screen(int screen) {
+  if (screen == current_screen) {
+    return;
+  }
+  current_screen = screen;
+  screen_clear();
+  if (current_screen == STATUS_SCREEN_MAIN) {
+    status_disp_mainpage_skeleton();
+    if (last_address.length() > 0) {
+      status_disp_IP_or_MAC(last_address, last_address_flavor);
+    }
+  }
+}
+
+int status_get_screen() {
+  return current_screen;
+}
+
 void status_disp_mainpage_skeleton(void) {
   if (current_screen == STATUS_SCREEN_MAIN) {
     status_disp_racername_msg();
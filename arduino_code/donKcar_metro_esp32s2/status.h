@@ -45,6 +45,7 @@
 #define STATUS_SCREEN_MAIN      0
 #define STATUS_SCREEN_NODISP    1
 #define STATUS_SCREEN_SPECIAL   2
+#define STATUS_SCREEN_PREVIEW   3   // camera picture (see tft_preview.h)
 
 #define STATUS_INITIALIZING     0
 #define STATUS_IDLE             1
@@ -95,6 +96,10 @@ void status_disp_IP_or_MAC(String address, char flavor);
 void status_disp_webconnect_downcounter(int ticks_left);
 void status_disp_mainpage_skeleton(void);
 void status_disp_clear_status_area();
+void status_disp_cam_stats(uint32_t steer_per_sec, uint32_t errors_per_sec, uint32_t gap_max_ms, char colorcode);
+void status_disp_preview_stats(uint32_t decode_us, uint32_t blit_us, int scale, uint32_t frames, uint32_t over_budget);
+void status_set_screen(int screen);
+int  status_get_screen();
 
 void status_neo_send(int cmd, int param);
 void status_neo_show_movement_info(int cmd_joyY, int cmd_joyX, char ctrColor);
@@ -0,0 +1,96 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include "steer_pid.h"
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+void steer_pid_init(SteerPid *pid) {
+  pid->primed = false;
+  pid->last_ms = 0;
+  pid->last_error = 0;
+  pid->p_term = 0;
+  pid->i_term = 0;
+  pid->d_term = 0;
+  pid->servo_angle = 0;
+}
+
+/*
+ * runs one PID step for a new camera frame and returns the turn cmd 
+ * (-255 full left, +255 full right)
+ * @param: frame_ms  camera time the image was taken
+ * @param: target_angle  degrees the camera wants to steer (0 = straight)
+ */
+int16_t steer_pid_update(SteerPid *pid, float kp, float ki, float kd, uint32_t frame_ms, int16_t target_angle) {
+  float error, de, d_raw, alpha, sum;
+  int32_t dt;
+
+  error = 0 - target_angle;     // the PID always seeks straight ahead
+  dt = (int32_t) (frame_ms - pid->last_ms);
+  if (!pid->primed || (dt <= 0) || (dt > STEER_PID_GAP_MS)) {
+    // nothing to take a derivative against; also drop a filter state 
+    // that no longer means anything
+    pid->primed = true;
+    pid->d_term = 0;
+    dt = 0;
+  }
+
+  pid->p_term = kp * error;
+
+  if (dt > 0) {
+    de = error - pid->last_error;
+    d_raw = (de / dt) * kd;
+    alpha = dt / (STEER_PID_D_TAU_MS + dt);
+    pid->d_term += alpha * (d_raw - pid->d_term);
+  }
+
+  // anti-windup: hold the integral while the output is already pinned
+  // and this error would push it further the same way
+  sum = pid->p_term + pid->i_term + pid->d_term;
+  if (!((sum >= STEER_PID_OUT_LIMIT) && (error > 0)) && !((sum <= -STEER_PID_OUT_LIMIT) && (error < 0))) {
+    pid->i_term += ki * error;
+    if (pid->i_term > STEER_PID_MAX_I) {
+      pid->i_term = STEER_PID_MAX_I;
+    } else if (pid->i_term < -STEER_PID_MAX_I) {
+      pid->i_term = -STEER_PID_MAX_I;
+    }
+  }
+
+  sum = pid->p_term + pid->i_term + pid->d_term;
+  if (sum > STEER_PID_OUT_LIMIT) {
+    sum = STEER_PID_OUT_LIMIT;
+  } else if (sum < -STEER_PID_OUT_LIMIT) {
+    sum = -STEER_PID_OUT_LIMIT;
+  }
+  pid->servo_angle = sum;
+  pid->last_error = error;
+  pid->last_ms = frame_ms;
+  return (int16_t) (STEER_PID_OUT_SCALE * sum);
+}
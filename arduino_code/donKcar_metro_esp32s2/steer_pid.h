@@ -0,0 +1,85 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef STEER_PID_H
+#define STEER_PID_H
+
+/*
+ * ***************************************************************
+ * the steer_pid module turns the camera's raw target angle into a
+ * steering command on the robot, instead of on the camera (see
+ * mypid.py in code_openmv, which it follows).  gains are passed in
+ * on every update so they can come straight from config.pid_kp/ki/kd
+ * and keep the meaning they have on the camera:
+ *   - kp per degree of error
+ *   - ki added per camera frame (not per second)
+ *   - kd per degree/mS of error change
+ * the output is the servo angle (+/- 50 degrees) times 5, ie the
+ * same -255..+255 turn cmd the camera sends.
+ *
+ * differences from mypid.py:
+ *   - dt is the time between the images the targets came from (camera
+ *     timestamps), not between calls, so UART and loop() jitter don't
+ *     show up in the derivative
+ *   - the derivative goes through a first order low-pass filter
+ *     (STEER_PID_D_TAU_MS; 0 turns it off)
+ *   - besides the +/- STEER_PID_MAX_I clamp, the integral stops 
+ *     growing while the output is saturated in the same direction
+ *     (anti-windup)
+ *   - the first frame, and the first after a gap longer than 
+ *     STEER_PID_GAP_MS, has no derivative kick
+ *
+ * like cam_parser it has no Arduino dependencies so it can be run 
+ * on a host next to the python version
+ * ***************************************************************
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define STEER_PID_MAX_I      3.0    // integral term limit (servo degrees)
+#define STEER_PID_OUT_LIMIT  50.0   // servo angle limit (degrees)
+#define STEER_PID_OUT_SCALE  5      // servo degrees to turn cmd
+#ifndef STEER_PID_D_TAU_MS
+#define STEER_PID_D_TAU_MS   30.0   // derivative filter time constant (a host build may set it, see steer_pid_compare.py)
+#endif
+#define STEER_PID_GAP_MS     500    // frames further apart than this restart the PID
+
+struct SteerPid {
+  bool     primed;        // false until the first frame has been seen
+  uint32_t last_ms;       // camera time of the previous frame
+  float    last_error;
+  float    p_term;
+  float    i_term;
+  float    d_term;        // after filtering
+  float    servo_angle;   // last output, degrees
+};
+
+void    steer_pid_init(SteerPid *pid);
+int16_t steer_pid_update(SteerPid *pid, float kp, float ki, float kd, uint32_t frame_ms, int16_t target_angle);
+
+#endif  /* STEER_PID_H */
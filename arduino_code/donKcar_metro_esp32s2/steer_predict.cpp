@@ -0,0 +1,181 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ * 
+ * Note the trend is a least-squares slope of command against arrival time
+ * over the samples in the history, so one noisy frame does not send the
+ * prediction off; it is only used when the last steps all move the same way.
+ */
+#include "steer_predict.h"
+
+/*
+ * templates for private functions
+ */
+bool steer_predict_slope(SteerPredictor *sp, float *slope);
+const SteerSample *steer_predict_sample(SteerPredictor *sp, int age_index);
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+void steer_predict_init(SteerPredictor *sp) {
+  sp->count = 0;
+  sp->newest = 0;
+  sp->hold_cmd = 0;
+}
+
+/*
+ * the first sample after a stale period starts a new history, so the
+ * trend is never fitted across the dropout
+ */
+void steer_predict_add(SteerPredictor *sp, uint32_t now_ms, int16_t cmd, int16_t angle_error, int16_t target_angle) {
+  SteerSample *s;
+
+  if ((sp->count > 0) && ((now_ms - sp->hist[sp->newest].t_ms) > STEER_PREDICT_STALE_MS)) {
+    sp->count = 0;
+  }
+  sp->newest = (sp->newest + 1) % STEER_PREDICT_HISTORY;
+  s = &sp->hist[sp->newest];
+  s->t_ms = now_ms;
+  s->cmd = cmd;
+  s->angle_error = angle_error;
+  s->target_angle = target_angle;
+  if (sp->count < STEER_PREDICT_HISTORY) {
+    sp->count++;
+  }
+  sp->hold_cmd = cmd;
+}
+
+/*
+ * puts the steering command to use right now in *cmd_out and returns
+ * one of the STEER_PREDICT_xxx states describing where it came from
+ */
+int steer_predict_get(SteerPredictor *sp, uint32_t now_ms, int16_t *cmd_out) {
+  const SteerSample *last;
+  uint32_t age;
+  float slope, delta;
+
+  if (sp->count == 0) {
+    *cmd_out = 0;
+    return STEER_PREDICT_NONE;
+  }
+  last = steer_predict_sample(sp, 0);
+  age = now_ms - last->t_ms;
+
+  if (age >= STEER_PREDICT_STALE_MS) {
+    *cmd_out = last->cmd;
+    return STEER_PREDICT_STALE;
+  }
+  if (age > STEER_PREDICT_EXTRAP_MS) {
+    *cmd_out = sp->hold_cmd;
+    return STEER_PREDICT_HOLD;
+  }
+  if ((age == 0) || !steer_predict_slope(sp, &slope)) {
+    *cmd_out = last->cmd;
+    sp->hold_cmd = last->cmd;
+    return STEER_PREDICT_FRESH;
+  }
+
+  delta = slope * (float) age;
+  if (delta > STEER_PREDICT_MAX_DELTA) {
+    delta = STEER_PREDICT_MAX_DELTA;
+  } else if (delta < -STEER_PREDICT_MAX_DELTA) {
+    delta = -STEER_PREDICT_MAX_DELTA;
+  }
+  delta += last->cmd;
+  if (delta > 255) {
+    delta = 255;
+  } else if (delta < -255) {
+    delta = -255;
+  }
+  *cmd_out = (int16_t) delta;
+  sp->hold_cmd = *cmd_out;
+  return STEER_PREDICT_EXTRAPOLATED;
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+/*
+ * age_index 0 is the newest sample, 1 the one before, etc
+ */
+const SteerSample *steer_predict_sample(SteerPredictor *sp, int age_index) {
+  return &sp->hist[(sp->newest - age_index + STEER_PREDICT_HISTORY) % STEER_PREDICT_HISTORY];
+}
+
+/*
+ * least-squares slope (cmd units per mS) over the history; returns false
+ * if there are too few samples or the recent steps disagree on direction
+ */
+bool steer_predict_slope(SteerPredictor *sp, float *slope) {
+  const SteerSample *s, *prev;
+  float mean_t, mean_c, num, den, t;
+  int n = sp->count;
+  int dir, step_dir;
+
+  if (n < 2) {
+    return false;
+  }
+  dir = 0;
+  for (int i=0; i<(n - 1); i++) {
+    s = steer_predict_sample(sp, i);
+    prev = steer_predict_sample(sp, i + 1);
+    step_dir = (s->cmd > prev->cmd) ? 1 : ((s->cmd < prev->cmd) ? -1 : 0);
+    if ((step_dir == 0) || ((dir != 0) && (step_dir != dir))) {
+      return false;
+    }
+    dir = step_dir;
+  }
+
+  // times are taken relative to the newest sample to keep the floats small
+  s = steer_predict_sample(sp, 0);
+  mean_t = 0;
+  mean_c = 0;
+  for (int i=0; i<n; i++) {
+    prev = steer_predict_sample(sp, i);
+    mean_t += -(float) (s->t_ms - prev->t_ms);
+    mean_c += prev->cmd;
+  }
+  mean_t /= n;
+  mean_c /= n;
+  num = 0;
+  den = 0;
+  for (int i=0; i<n; i++) {
+    prev = steer_predict_sample(sp, i);
+    t = -(float) (s->t_ms - prev->t_ms) - mean_t;
+    num += t * (prev->cmd - mean_c);
+    den += t * t;
+  }
+  if (den <= 0) {
+    return false;
+  }
+  *slope = num / den;
+  return true;
+}
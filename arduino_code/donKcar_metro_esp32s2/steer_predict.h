@@ -0,0 +1,86 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef STEER_PREDICT_H
+#define STEER_PREDICT_H
+
+/*
+ * ***************************************************************
+ * the steer_predict module fills in the steering command between
+ * camera frames.  the camera only sends steering every 100 mS, and
+ * when a frame is late or lost the servo would otherwise sit on the
+ * old command for 200 mS or more.
+ *
+ * it keeps a short history of steering samples and:
+ *   - right after a frame, returns that frame's command (FRESH)
+ *   - while the newest sample is younger than STEER_PREDICT_EXTRAP_MS,
+ *     continues the recent trend (EXTRAPOLATED), limited to
+ *     STEER_PREDICT_MAX_DELTA away from the last real command, and
+ *     only when the last samples agree on the direction of change
+ *   - after that holds the last predicted value (HOLD)
+ *   - once the newest sample is older than STEER_PREDICT_STALE_MS
+ *     falls back to the last real command and reports STALE so the
+ *     caller can stop the car (safe hold)
+ *
+ * like cam_parser it has no Arduino dependencies (times are passed
+ * in) so it can be run on a host against recorded steering streams
+ * ***************************************************************
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define STEER_PREDICT_HISTORY    4      // samples kept
+#define STEER_PREDICT_EXTRAP_MS  150    // extrapolate this long after the newest sample
+#define STEER_PREDICT_STALE_MS   400    // then hold until this age, after which data is stale
+#define STEER_PREDICT_MAX_DELTA  64     // most the prediction may move away from the last real command
+
+#define STEER_PREDICT_NONE          0   // no samples yet
+#define STEER_PREDICT_FRESH         1
+#define STEER_PREDICT_EXTRAPOLATED  2
+#define STEER_PREDICT_HOLD          3
+#define STEER_PREDICT_STALE         4
+
+struct SteerSample {
+  uint32_t t_ms;          // robot time the sample arrived
+  int16_t  cmd;           // turn cmd -255 to +255
+  int16_t  angle_error;   // degrees
+  int16_t  target_angle;  // degrees
+};
+
+struct SteerPredictor {
+  SteerSample hist[STEER_PREDICT_HISTORY];
+  int      count;         // valid samples in hist[]
+  int      newest;        // index of newest sample
+  int16_t  hold_cmd;      // value held once extrapolation stops
+};
+
+void steer_predict_init(SteerPredictor *sp);
+void steer_predict_add(SteerPredictor *sp, uint32_t now_ms, int16_t cmd, int16_t angle_error, int16_t target_angle);
+int  steer_predict_get(SteerPredictor *sp, uint32_t now_ms, int16_t *cmd_out);
+
+#endif  /* STEER_PREDICT_H */
@@ -0,0 +1,224 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include "tft_preview.h"
+#include "jpeg_preview.h"
+#include "cam_image.h"
+#include "screen.h"
+#include "status.h"
+
+bool     preview_active = false;
+bool     preview_pic_outstanding;     // cam_image is collecting a picture for us
+unsigned long preview_next_request_ms;
+int      preview_fit_scale;           // smallest scale at which the picture fits the area
+int      preview_good_count;          // pictures in a row well inside the budget
+int      preview_pic_right;           // picture as placed on the display (for clipping strips)
+int      preview_pic_bottom;
+PreviewStats preview_stats;
+
+/*
+ * templates for private functions
+ */
+void preview_show(const uint8_t *jpg, int len);
+void preview_set_scale(int scale);
+bool preview_blit_strip(int x, int y, int w, int h, uint16_t *pixels, void *ctx);
+
+/*
+ * **************************************************************
+ * public functions
+ * **************************************************************
+ */
+
+/*
+ * false if there isn't the memory for the decoder
+ */
+bool preview_start() {
+  if (!jpv_begin()) {
+    return false;
+  }
+  memset(&preview_stats, 0, sizeof(preview_stats));
+  preview_fit_scale = 0;            // (not known until the first picture)
+  preview_good_count = 0;
+  preview_pic_outstanding = false;
+  preview_next_request_ms = millis();
+  preview_active = true;
+  return true;
+}
+
+void preview_stop() {
+  if (!preview_active) {
+    return;
+  }
+  preview_active = false;
+  if (preview_pic_outstanding) {
+    cam_image_release();
+    preview_pic_outstanding = false;
+  }
+  cam_image_free_buffer();
+  jpv_end();
+  DEBUG_PRINTLN("preview frames " + String(preview_stats.frames) + " over budget " + String(preview_stats.over_budget)
+                + " max uS " + String(preview_stats.max_decode_us));
+}
+
+/*
+ * called on every pass of loop(); only a picture that has fully arrived
+ * holds it up, for at most about PREVIEW_BUDGET_MS
+ */
+void preview_loop() {
+  const uint8_t *data;
+  int len;
+  unsigned long now;
+
+  if (!preview_active) {
+    return;
+  }
+  now = millis();
+
+  if (!preview_pic_outstanding) {
+    if ((cam_image_state() == CAM_IMG_IDLE) && ((long) (now - preview_next_request_ms) >= 0)) {
+      cam_image_request();
+      preview_pic_outstanding = true;
+      preview_next_request_ms = now + (1000 / PREVIEW_FPS);
+    }
+    return;
+  }
+
+  if (cam_image_state() == CAM_IMG_FAILED) {
+    cam_image_release();
+    preview_pic_outstanding = false;
+    preview_stats.failed++;
+    return;
+  }
+  if (cam_image_state() != CAM_IMG_READY) {
+    return;
+  }
+  data = cam_image_data(&len);
+  preview_show(data, len);
+  cam_image_release();
+  preview_pic_outstanding = false;
+}
+
+const PreviewStats *preview_stats_get() {
+  return &preview_stats;
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+void preview_show(const uint8_t *jpg, int len) {
+  JpvResult res;
+  int width, height;
+  int scaled_w, scaled_h;
+  int x, y;
+  uint32_t total_us;
+
+  if (!jpv_open(jpg, len, &width, &height)) {
+    preview_stats.failed++;
+    return;
+  }
+  if (preview_fit_scale == 0) {
+    preview_fit_scale = 1;
+    while ((preview_fit_scale < PREVIEW_MAX_SCALE) 
+           && (((width / preview_fit_scale) > PREVIEW_AREA_WIDTH) || ((height / preview_fit_scale) > PREVIEW_AREA_HEIGHT))) {
+      preview_fit_scale *= 2;
+    }
+    preview_set_scale(preview_fit_scale);
+  }
+
+  scaled_w = (width + preview_stats.scale - 1) / preview_stats.scale;
+  scaled_h = (height + preview_stats.scale - 1) / preview_stats.scale;
+  x = max((PREVIEW_AREA_WIDTH - scaled_w) / 2, 0);
+  y = max((PREVIEW_AREA_HEIGHT - scaled_h) / 2, 0);
+  preview_pic_right = min(x + scaled_w, PREVIEW_AREA_WIDTH);
+  preview_pic_bottom = min(y + scaled_h, PREVIEW_AREA_HEIGHT);
+  if (!jpv_decode(preview_stats.scale, x, y, (uint32_t) PREVIEW_BUDGET_MS * 1000, 
+                  preview_blit_strip, NULL, &res)) {
+    jpv_close();
+    preview_stats.failed++;
+    return;
+  }
+  jpv_close();
+
+  total_us = res.decode_us + res.sink_us;
+  preview_stats.frames++;
+  preview_stats.last_decode_us = res.decode_us;
+  preview_stats.last_blit_us = res.sink_us;
+  if (total_us > preview_stats.max_decode_us) {
+    preview_stats.max_decode_us = total_us;
+  }
+  status_disp_preview_stats(res.decode_us, res.sink_us, preview_stats.scale, preview_stats.frames, preview_stats.over_budget);
+
+  // adjust the scale for the next picture
+  if (res.over_budget) {
+    preview_stats.over_budget++;
+    preview_good_count = 0;
+    if (preview_stats.scale < PREVIEW_MAX_SCALE) {
+      preview_set_scale(preview_stats.scale * 2);
+    }
+  } else if ((total_us < ((uint32_t) PREVIEW_BUDGET_MS * 500)) && (preview_stats.scale > preview_fit_scale)) {
+    preview_good_count++;
+    if (preview_good_count >= PREVIEW_STEP_BACK) {
+      preview_good_count = 0;
+      preview_set_scale(preview_stats.scale / 2);
+    }
+  } else {
+    preview_good_count = 0;
+  }
+}
+
+/*
+ * a new scale leaves a different sized picture, so the area is cleared
+ */
+void preview_set_scale(int scale) {
+  preview_stats.scale = scale;
+  screen_clear_area(0, 0, PREVIEW_AREA_WIDTH, PREVIEW_AREA_HEIGHT);
+}
+
+/*
+ * jpeg_preview's sink: one strip to the TFT.  strips are whole JPEG 
+ * blocks, so the last ones can run past the picture's edge; that part
+ * is not drawn
+ */
+bool preview_blit_strip(int x, int y, int w, int h, uint16_t *pixels, void *ctx) {
+  int rows, r;
+
+  rows = min(h, preview_pic_bottom - y);
+  if (rows <= 0) {
+    return true;
+  }
+  if ((x + w) <= preview_pic_right) {
+    screen_blit_rgb565(x, y, w, rows, pixels);
+  } else {
+    for (r=0; r<rows; r++) {
+      screen_blit_rgb565(x, y + r, preview_pic_right - x, 1, &pixels[r * w]);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,72 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef TFT_PREVIEW_H
+#define TFT_PREVIEW_H
+
+/*
+ * ***************************************************************
+ * the tft_preview module shows what the camera sees on the robot's
+ * own TFT (menu item "Camera Preview", MODE_PREVIEW), for tuning at
+ * the track without a laptop.  PREVIEW_FPS times a second it asks
+ * cam_image for a picture, decodes it (jpeg_preview) straight to the
+ * display a strip at a time, and shows the decode and blit times
+ * underneath.
+ *
+ * the picture is decoded at the largest size that fits the area
+ * above the timing lines.  the decode + blit of one picture holds up
+ * loop(), so it gets PREVIEW_BUDGET_MS: a picture that runs over is
+ * cut off there, and the following ones are decoded at the next 
+ * smaller scale.  after PREVIEW_STEP_BACK pictures in a row that 
+ * took less than half the budget it tries the larger scale again
+ * ***************************************************************
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+#define PREVIEW_AREA_WIDTH   240
+#define PREVIEW_AREA_HEIGHT  190    // (down to the timing lines, ROW_RACERNAME)
+#define PREVIEW_MAX_SCALE    8
+#define PREVIEW_STEP_BACK    8
+
+struct PreviewStats {
+  uint32_t frames;          // pictures shown (whole or cut off)
+  uint32_t over_budget;     // ... of which were cut off
+  uint32_t failed;          // pictures the camera did not deliver, or bad JPEGs
+  uint32_t last_decode_us;
+  uint32_t last_blit_us;
+  uint32_t max_decode_us;   // decode + blit, worst picture
+  int      scale;           // 1, 2, 4 or 8 (1/scale of the camera's size)
+};
+
+bool preview_start();
+void preview_stop();
+void preview_loop();
+const PreviewStats *preview_stats_get();
+
+#endif  /* TFT_PREVIEW_H */
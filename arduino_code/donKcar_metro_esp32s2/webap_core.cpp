@@ -35,9 +35,11 @@
 #include "webap_pages_cam_general.h"
 #include "webap_pages_cam_blobs.h"
 #include "webap_pages_cam_pid.h"
+#include "webap_pages_cam_stream.h"
 #include "mode_mgr.h"
 #include "status.h"
 #include "cam.h"
+#include "cam_image.h"
 
 
 /*
@@ -119,6 +121,8 @@ void webap_init(void) {
 }
 
 void webap_deinit(int reason) {
+  webap_cam_stream_stop();
+  cam_image_free_buffer();      // pictures were only for the web pages
   webModeActive = false;
   webModeEndRequest = false;
   wifi_init();    // this re-initializes ESP-NOW mode
@@ -154,6 +158,9 @@ void webap_adjustWebEndRequest(bool newValue) {
 void webap_process(void) {
   String actionResponseStatus;
 
+  // a running camera stream sends a little more on every pass
+  webap_cam_stream_loop();
+
   if (in_a_build_waiting_for_cam_to_continue_v1) {
     // note this does nothing if pic isn't yet ready; 
     // if pic is ready it finishes building the page then sends it, then clears waiting flag
@@ -183,7 +190,12 @@ void webap_process(void) {
 
             webap_allow_page_close = true;
             in_a_build_waiting_for_cam_to_continue_v1 = false;
-            if (headerX.indexOf("/wcmd/") >= 0) {
+            if (headerX.indexOf("GET /cam_stream.mjpg") >= 0) {
+              // the stream sends its own headers and keeps the connection (see webap_pages_cam_stream.cpp)
+              webap_cam_stream_start(clientAP);
+              webap_allow_page_close = false;
+
+            } else if (headerX.indexOf("/wcmd/") >= 0) {
               actionResponseStatus = webap_process_API(headerX);                  
               // HTTP headers always start with a response code (e.g. HTTP/1.1 200 OK)
               // and a content-type so the client knows what's coming, then a blank line:
@@ -234,6 +246,25 @@ void webap_print_pageBuf() {
   clientAP.println(pageBuf);
 }
 
+/*
+ * for pages that send parts of themselves as they become available
+ * (see webap_util_finish_cam()) rather than all at once from pageBuf
+ */
+void webap_print(String s) {
+  clientAP.print(s);
+}
+
+/*
+ * returns how many of the bytes the connection took
+ */
+int webap_write(const char *buf, int len) {
+  return clientAP.write((const uint8_t *) buf, len);
+}
+
+bool webap_client_connected() {
+  return clientAP.connected();
+}
+
 void webap_closeout_client() {
   // Clear the header variable
   headerX = "";
@@ -324,8 +355,9 @@ String show_menu(void) {
   pageBuf = pageBuf + "</tr>\n";
     
   pageBuf = pageBuf + "<tr>\n";
-    pageBuf = pageBuf + "<td class='menu crimson lightlink' colspan='2'><a href=\"/bye.html\">EXIT CONFIGURATOR</a></td>\n";
+    pageBuf = pageBuf + "<td class='menu crimson lightlink'><a href=\"/bye.html\">EXIT CONFIGURATOR</a></td>\n";
     pageBuf = pageBuf + "<td class='menu gold'><a href=\"/cam_pid.html\">PID</a></td>\n";
+    pageBuf = pageBuf + "<td class='menu gold'><a href=\"/cam_stream.html\">Camera Stream</a></td>\n";
   pageBuf = pageBuf + "</tr>\n";
   pageBuf = pageBuf + "</table>\n";
 
@@ -460,6 +492,11 @@ String webap_process_API(String header) {
   if (api_response != "NOMATCH") {
     return api_response;
   }
+   
+  api_response = webap_process_API_cam_stream(header);
+  if (api_response != "NOMATCH") {
+    return api_response;
+  }
 
   /*
    * API function for processing Web Browser Heartbeat signal
@@ -495,6 +532,9 @@ void webap_build_web_page(String header) {
    if (webap_build_cam_pid(header)) {
     return;
    }
+   if (webap_build_cam_stream(header)) {
+    return;
+   }
   
   /* 
    * if none of the above match, then check for basic utility pages
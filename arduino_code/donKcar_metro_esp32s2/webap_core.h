@@ -56,6 +56,9 @@ String webap_end_local_js(void);
 String webap_commonJS(void);
 
 void webap_print_pageBuf();
+void webap_print(String s);
+int webap_write(const char *buf, int len);
+bool webap_client_connected();
 void webap_closeout_client();
 
 String show_menu(void);
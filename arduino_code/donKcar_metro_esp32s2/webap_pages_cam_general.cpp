@@ -29,6 +29,14 @@
 #include "webap_core.h"
 #include "util.h"
 #include "cam.h"
+#include "cam_stats.h"
+#include "cam_latency.h"
+#include "control.h"
+#include "img_buf.h"
+#include "cam_clock.h"
+#include "sched.h"
+#include "mode_mgr.h"
+#include "recorder.h"
 
 extern String pageBuf;
 
@@ -195,9 +203,219 @@ bool webap_build_cam_general(String header) {
         pageBuf = pageBuf + "</tr>\n";
         
       pageBuf = pageBuf + "</table>\n";        
+     
+      pageBuf = pageBuf + "<table>\n";        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix ltblue' colspan='5'>Camera Link Health</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Frames</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' id='disp_stats_frames'>-</td>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Errors</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' id='disp_stats_errors'>-</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Steer/sec</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' id='disp_stats_steer_rate'>-</td>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Max Gap</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' id='disp_stats_gap_max'>-</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Retry/Fail</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' id='disp_stats_retries'>-</td>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Drops</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' id='disp_stats_drops'>-</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Gaps (mS)</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='3' id='disp_stats_gaps'>-</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>During Pics</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='3' id='disp_stats_pics'>-</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Link Speed</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='2' id='disp_baud'>-</td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnGreen\" onClick=\"get_baud();\">Speed</button></td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Pic Memory</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='2' id='disp_imgbuf'>-</td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnGreen\" onClick=\"get_imgbuf();\">Memory</button></td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Clock Sync</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='2' id='disp_clock'>-</td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnGreen\" onClick=\"get_clock();\">Clock</button></td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Go (mS)</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='2' id='disp_go'>press to first steering</td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnGreen\" onClick=\"get_go();\">Go</button></td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Loop Tasks</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='2' id='disp_sched'>runs, run uS mean/max, late uS mean/max</td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnGreen\" onClick=\"get_sched();\">Tasks</button></td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Recorder</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='2' id='disp_recorder'>records, failed, card busy, write max</td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnGreen\" onClick=\"get_recorder();\">Rec</button></td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Age (mS)</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='3' id='disp_latency'>p50/p95/max at servo</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Control</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='3' id='disp_control'>rate / overruns / jitter</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnBlue\" onClick=\"get_link_stats();\">Refresh</button></td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnRed\" onClick=\"reset_link_stats();\">Reset</button></td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnGreen\" onClick=\"get_latency();\">Latency</button></td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnGreen\" onClick=\"get_control_stats();\">Control</button></td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+      pageBuf = pageBuf + "</table>\n";        
 
     pageBuf = pageBuf + show_menu();  
     pageBuf = pageBuf + webap_start_local_js();
+      
+      // see cam_stats_summary() for the order of the fields
+      pageBuf = pageBuf + "function local_api_process(paramid, myvalue) {\n";
+      pageBuf = pageBuf + "  if (paramid == 'CAMSTATS') {\n";
+      pageBuf = pageBuf + "    v = myvalue.split(':');\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_stats_frames').textContent = v[0] + ' (' + v[9] + '/s)';\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_stats_errors').textContent = v[1] + '/' + v[2] + ' (' + v[12] + '/s)';\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_stats_steer_rate').textContent = v[10];\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_stats_gap_max').textContent = v[13] + ' mS';\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_stats_retries').textContent = v[7] + '/' + v[8];\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_stats_drops').textContent = v[5] + '/' + v[6];\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_stats_gaps').textContent = '<25:' + v[14] + ' <50:' + v[15] + ' <75:' + v[16] + ' <100:' + v[17] + ' <150:' + v[18] + ' <250:' + v[19] + ' <500:' + v[20] + ' more:' + v[21];\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_stats_pics').textContent = 'max gap ' + v[25] + ' mS over ' + v[24] + ' gaps (' + v[22] + ' chunks, ' + v[23] + ' bytes)';\n";
+      pageBuf = pageBuf + "  }\n";
+      // see cam_baud_summary() for the order of the fields
+      pageBuf = pageBuf + "  if (paramid == 'CAMBAUD') {\n";
+      pageBuf = pageBuf + "    v = myvalue.split(':');\n";
+      pageBuf = pageBuf + "    t = v[0] + ' baud, ' + v[1] + ' fallbacks';\n";
+      pageBuf = pageBuf + "    for (i = 2; i + 5 < v.length; i += 6) {\n";
+      pageBuf = pageBuf + "      if (v[i+1] == '1') {\n";
+      pageBuf = pageBuf + "        t = t + ' / ' + v[i] + ': ' + v[i+5] + ' B/s' + ((v[i+2] == '1') ? '' : ' (' + v[i+4] + ' err)');\n";
+      pageBuf = pageBuf + "      }\n";
+      pageBuf = pageBuf + "    }\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_baud').textContent = t;\n";
+      pageBuf = pageBuf + "  }\n";
+      // see imgbuf_summary() for the order of the fields
+      pageBuf = pageBuf + "  if (paramid == 'IMGBUF') {\n";
+      pageBuf = pageBuf + "    v = myvalue.split(':');\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_imgbuf').textContent = 'heap ' + v[2] + ' free (low ' + v[3] + '), ' + v[4] + ' buffers ' + v[5] + ' bytes (' + v[6] + ' in PSRAM, ' + v[1] + ' free), peak ' + v[7] + ', ' + v[9] + ' failed';\n";
+      pageBuf = pageBuf + "  }\n";
+      // see cam_clock_summary() for the order of the fields
+      pageBuf = pageBuf + "  if (paramid == 'CAMCLOCK') {\n";
+      pageBuf = pageBuf + "    v = myvalue.split(':');\n";
+      pageBuf = pageBuf + "    if (v[0] != '1') {\n";
+      pageBuf = pageBuf + "      t = 'no estimate yet (' + v[7] + ' pings, ' + v[8] + ' answered)';\n";
+      pageBuf = pageBuf + "    } else {\n";
+      pageBuf = pageBuf + "      t = 'offset ' + v[1] + ' mS +/- ' + v[4] + ' uS, drift ' + v[2] + ' +/- ' + v[3] + ' ppm, rtt ' + v[6] + ' uS, ' + v[8] + '/' + v[7] + ' pongs, ' + v[10] + ' steps';\n";
+      pageBuf = pageBuf + "    }\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_clock').textContent = t;\n";
+      pageBuf = pageBuf + "  }\n";
+      // see mode_go_summary() for the order of the fields
+      pageBuf = pageBuf + "  if (paramid == 'GOLAT') {\n";
+      pageBuf = pageBuf + "    v = myvalue.split(':');\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_go').textContent = ((v[0] == '1') ? 'hot' : 'cold') + ': ' + v[2] + '/' + v[3] + '/' + v[4] + ' (last/mean/max, ' + v[1] + ' starts), first frame ' + v[5] + '/' + v[6];\n";
+      pageBuf = pageBuf + "  }\n";
+      // see sched_summary() for the order of the fields
+      pageBuf = pageBuf + "  if (paramid == 'SCHED') {\n";
+      pageBuf = pageBuf + "    v = myvalue.split(':');\n";
+      pageBuf = pageBuf + "    t = v[0] + ' passes, ' + v[1] + ' deferred';\n";
+      pageBuf = pageBuf + "    for (i = 3; i + 8 < v.length; i += 9) {\n";
+      pageBuf = pageBuf + "      t = t + '; ' + v[i] + ' ' + v[i+3] + ', ' + v[i+4] + '/' + v[i+5] + ', ' + v[i+6] + '/' + v[i+7] + ((v[i+8] != '0') ? (', ' + v[i+8] + ' skipped') : '');\n";
+      pageBuf = pageBuf + "    }\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_sched').textContent = t;\n";
+      pageBuf = pageBuf + "  }\n";
+      // see rec_summary() for the order of the fields
+      pageBuf = pageBuf + "  if (paramid == 'RECORDER') {\n";
+      pageBuf = pageBuf + "    v = myvalue.split(':');\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_recorder').textContent = ((v[0] == '1') ? 'recording' : 'stopped') + ': ' + v[1] + ' records, ' + v[2] + ' failed, ' + v[3] + ' sectors, ' + v[4] + ' busy, write max ' + v[5] + ' uS';\n";
+      pageBuf = pageBuf + "  }\n";
+      // see cam_latency_summary() for the order of the fields
+      pageBuf = pageBuf + "  if (paramid == 'CAMLAT') {\n";
+      pageBuf = pageBuf + "    v = myvalue.split(':');\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_latency').textContent = v[6] + '/' + v[7] + '/' + v[8] + ' (parse ' + v[0] + '/' + v[1] + '/' + v[2] + ', ' + v[9] + ' frames, ' + v[10] + ' lost)';\n";
+      pageBuf = pageBuf + "  }\n";
+      // see control_stats_summary() for the order of the fields
+      pageBuf = pageBuf + "  if (paramid == 'CTRLSTATS') {\n";
+      pageBuf = pageBuf + "    v = myvalue.split(':');\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_control').textContent = v[0] + ' Hz, ' + v[1] + ' ticks, ' + v[2] + ' overruns, jitter ' + v[4] + '/' + v[5] + ' uS (mean/max), tick max ' + v[6] + ' uS';\n";
+      pageBuf = pageBuf + "  }\n";
+      pageBuf = pageBuf + "}\n"; 
+         
+      pageBuf = pageBuf + "function get_control_stats() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/control');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n"; 
+         
+      pageBuf = pageBuf + "function get_baud() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/baud');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n"; 
+         
+      pageBuf = pageBuf + "function get_imgbuf() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/imgbuf');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n"; 
+         
+      pageBuf = pageBuf + "function get_clock() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/clock');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n"; 
+         
+      pageBuf = pageBuf + "function get_go() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/go');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n"; 
+         
+      pageBuf = pageBuf + "function get_sched() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/sched');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n"; 
+         
+      pageBuf = pageBuf + "function get_recorder() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/recorder');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n"; 
+         
+      pageBuf = pageBuf + "function get_latency() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/latency');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n"; 
+         
+      pageBuf = pageBuf + "function get_link_stats() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/stats');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n"; 
+         
+      pageBuf = pageBuf + "function reset_link_stats() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/stats_reset');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n"; 
          
       pageBuf = pageBuf + "function set_blobs() {\n";
       pageBuf = pageBuf + "  Http.open('GET', urlBase+'camg/set_blobs');\n";
@@ -309,7 +527,49 @@ String webap_process_API_cam_general(String header) {
   * ********************************************************************
   */
   DEBUG_PRINTLN(header);  
-  if (header.indexOf("/wcmd/camg/set_blobs") >= 0) {
+  if (header.indexOf("/wcmd/camg/stats_reset") >= 0) {
+      cam_stats_reset();
+      control_stats_reset();
+      return "SUCCESS camera link stats will be reset (within 1 second)";
+      
+  } else if (header.indexOf("/wcmd/camg/control") >= 0) {
+      return "VALUE CTRLSTATS " + control_stats_summary();
+      
+  } else if (header.indexOf("/wcmd/camg/stats") >= 0) {
+      return "VALUE CAMSTATS " + cam_stats_summary();
+      
+  } else if (header.indexOf("/wcmd/camg/baud") >= 0) {
+      return "VALUE CAMBAUD " + cam_baud_summary();
+      
+  } else if (header.indexOf("/wcmd/camg/imgbuf") >= 0) {
+      return "VALUE IMGBUF " + imgbuf_summary();
+      
+  } else if (header.indexOf("/wcmd/camg/clock") >= 0) {
+      return "VALUE CAMCLOCK " + cam_clock_summary();
+      
+  } else if (header.indexOf("/wcmd/camg/go") >= 0) {
+      return "VALUE GOLAT " + mode_go_summary();
+      
+  } else if (header.indexOf("/wcmd/camg/sched") >= 0) {
+      char schedBuf[800];
+      sched_summary(&loop_sched, schedBuf, sizeof(schedBuf));
+      return "VALUE SCHED " + String(schedBuf);
+      
+  } else if (header.indexOf("/wcmd/camg/recorder") >= 0) {
+#ifdef DATASET_RECORDER
+      return "VALUE RECORDER " + rec_summary();
+#else
+      return "ERROR the recorder is not built in (see DATASET_RECORDER in config.h)";
+#endif
+      
+  } else if (header.indexOf("/wcmd/camg/latency") >= 0) {
+#ifdef CAM_LATENCY_TRACE
+      return "VALUE CAMLAT " + cam_latency_summary();
+#else
+      return "ERROR latency tracing is not built in (see CAM_LATENCY_TRACE in config.h)";
+#endif
+      
+  } else if (header.indexOf("/wcmd/camg/set_blobs") >= 0) {
       cam_send_cmd(CAM_CMD_MODE_BLOBS);
       return "SUCCESS set camera to BLOB TRACKING MODE";
       
@@ -0,0 +1,365 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#include "webap_pages_cam_stream.h"
+#include "webap_core.h"
+#include "util.h"
+#include "cam.h"
+#include "cam_image.h"
+#include "img_buf.h"
+
+extern String pageBuf;
+
+#define CAM_STREAM_MAX_FPS   15
+#define CAM_STREAM_SLICE     512       // most JPEG bytes written to the browser per pass of loop()
+#define CAM_STREAM_FPS_MS    2000      // achieved frame rate is measured over this long
+#define CAM_STREAM_BOUNDARY  "donkcarframe"
+#define CAM_STREAM_BUF_START 24576     // grown (see imgbuf_fit()) if a picture is bigger
+
+/*
+ * *********************************************
+ * private data
+ * *********************************************
+ */
+
+struct CamStreamStats {
+  uint32_t frames;          // sent to the browser
+  uint32_t failed;          // pictures the camera did not deliver
+  uint32_t fps_x10;         // achieved, over the last CAM_STREAM_FPS_MS
+  uint32_t in_last;         // request to whole picture collected (mS)
+  uint32_t in_max;
+  uint32_t out_last;        // request to last byte written to the browser (mS)
+  uint32_t out_max;
+};
+
+WiFiClient streamClient;
+bool     cam_stream_active = false;
+int      cam_stream_fps = CAM_STREAM_FPS;
+uint8_t *cam_stream_buf = NULL;             // frame being sent; only allocated while streaming
+uint32_t cam_stream_buf_size = 0;
+int      cam_stream_len;                    // bytes in cam_stream_buf, 0 when it is free
+int      cam_stream_pos;                    // bytes of it written so far
+bool     cam_stream_pic_outstanding;        // cam_image is collecting a picture for us
+unsigned long cam_stream_next_request_ms;
+unsigned long cam_stream_request_ms;        // when the picture being collected was asked for
+unsigned long cam_stream_sending_ms;        // when the picture being sent was asked for
+unsigned long cam_stream_fps_start_ms;
+uint32_t cam_stream_fps_frames;
+CamStreamStats cam_stream_stats;
+
+/*
+ * templates for private functions
+ */
+void webap_cam_stream_take_picture(unsigned long now);
+void webap_cam_stream_send_slice(unsigned long now);
+
+/*
+ * *********************************************
+ * public functions
+ * *********************************************
+ */
+
+bool webap_build_cam_stream(String header) {
+  bool processed_a_page = false;
+  
+  /*
+   * PPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPP
+   * page cam_stream.html
+   * PPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPP
+   */
+  if (header.indexOf("GET /cam_stream.html") >=0) {
+    pageBuf = pageBuf + webap_start_page();
+    pageBuf = pageBuf + show_mycss(); 
+    pageBuf = pageBuf + "</head>\n";    
+    
+    pageBuf = pageBuf + "<body>\n<h1>Camera Stream</h1>\n";
+      pageBuf = pageBuf + "<div><img src='/cam_stream.mjpg' /></div>\n";
+      pageBuf = pageBuf + "<table>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Frame Rate (target 1-" + String(CAM_STREAM_MAX_FPS) + ")</td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><input style='width:48px; max-width:48px;' type='text' id='inp_fps' value='" + String(cam_stream_fps) + "'/></td>\n";
+          pageBuf = pageBuf + "<td class='matrix'><button class=\"btnsmall btnRed\" onClick=\"set_fps();\">Set</button></td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Achieved (fps)</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='2' id='disp_fps'>-</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Frames (sent/failed)</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='2' id='disp_frames'>-</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix left'>Latency (mS)</td>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='2' id='disp_latency'>collected / sent (last, max)</td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+        
+        pageBuf = pageBuf + "<tr>\n";
+          pageBuf = pageBuf + "<td class='matrix' colspan='3'><button class=\"btnsmall btnBlue\" onClick=\"get_stream_stats();\">Refresh</button></td>\n";
+        pageBuf = pageBuf + "</tr>\n";
+      pageBuf = pageBuf + "</table>\n";        
+
+    pageBuf = pageBuf + show_menu();  
+    pageBuf = pageBuf + webap_start_local_js();
+      
+      // see webap_cam_stream_summary() for the order of the fields
+      pageBuf = pageBuf + "function local_api_process(paramid, myvalue) {\n";
+      pageBuf = pageBuf + "  if (paramid == 'CAMSTREAM') {\n";
+      pageBuf = pageBuf + "    v = myvalue.split(':');\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_fps').textContent = (v[2] / 10) + ' (target ' + v[1] + ')' + ((v[0] == '1') ? '' : ' stopped');\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_frames').textContent = v[3] + '/' + v[4];\n";
+      pageBuf = pageBuf + "    document.getElementById('disp_latency').textContent = v[5] + '/' + v[7] + ' (max ' + v[6] + '/' + v[8] + ')';\n";
+      pageBuf = pageBuf + "  }\n";
+      pageBuf = pageBuf + "}\n"; 
+      
+      pageBuf = pageBuf + "function set_fps() {\n";
+      pageBuf = pageBuf + "  newVal = document.getElementById('inp_fps').value;\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'cams/fps?value=' + newVal + ':XX:0');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n";
+      
+      pageBuf = pageBuf + "function get_stream_stats() {\n";
+      pageBuf = pageBuf + "  Http.open('GET', urlBase+'cams/stats');\n";
+      pageBuf = pageBuf + "  Http.send();\n";
+      pageBuf = pageBuf + "  }\n";
+    pageBuf = pageBuf + webap_end_local_js();
+    pageBuf = pageBuf + webap_commonJS();
+    pageBuf = pageBuf + webap_end_page();
+
+    processed_a_page = true;
+  } // if (header.indexOf("GET /cam_stream.html") >=0)
+  
+  return processed_a_page;
+}
+
+/*
+ * process commands that have been sent by a web button 
+ * note this should not display anything to website
+ * it returns a status code to caller though, which MIGHT display an alert or might use a returned value
+ * 
+ * returns  "OK":  if success; note calling page just continues with no acknowledgement
+ *          "SUCCESS message":   calling page does alert showing this string
+ *          "ERROR message":     calling page does alert showing this string
+ *          "VALUE paramid value" this returns a value that calling page will process (no alert)
+ *                                (note the value can be a string but if so no spaces allowed)
+ *                                
+ *          "NOMATCH"            didn't find any matching URLs                      
+ */
+String webap_process_API_cam_stream(String header) { 
+  String param1;
+  int locOfQuestion;
+
+  if (header.indexOf("/wcmd/cams/fps") >= 0) {
+    // param1 holds the frame rate (value=N:XX:0)
+    locOfQuestion = header.indexOf('?');
+    param1 = header.substring(locOfQuestion+7, header.indexOf(':', locOfQuestion));
+    if (!isInteger(param1)) {
+      return "ERROR only whole numbers allowed (1 - " + String(CAM_STREAM_MAX_FPS) + ")";
+    }
+    if ((param1.toInt() < 1) || (param1.toInt() > CAM_STREAM_MAX_FPS)) {
+      return "ERROR value must be 1 - " + String(CAM_STREAM_MAX_FPS);
+    }
+    cam_stream_fps = param1.toInt();
+    return "SUCCESS frame rate set";
+    
+  } else if (header.indexOf("/wcmd/cams/stats") >= 0) {
+    return "VALUE CAMSTREAM " + webap_cam_stream_summary();
+  }
+  return "NOMATCH";
+}
+
+/*
+ * takes over the connection that asked for /cam_stream.mjpg (the 
+ * caller must not close it); only one viewer at a time
+ */
+void webap_cam_stream_start(WiFiClient &client) {
+  webap_cam_stream_stop();
+  streamClient = client;
+
+  cam_stream_buf = imgbuf_fit(NULL, &cam_stream_buf_size, CAM_STREAM_BUF_START);
+  if (cam_stream_buf == NULL) {
+    DEBUG_PRINTLN("no memory for cam stream");
+    streamClient.print("HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n");
+    streamClient.stop();
+    return;
+  }
+  streamClient.print("HTTP/1.1 200 OK\r\n");
+  streamClient.print("Content-Type: multipart/x-mixed-replace; boundary=" CAM_STREAM_BOUNDARY "\r\n");
+  streamClient.print("Cache-Control: no-cache\r\n");
+  streamClient.print("Connection: close\r\n\r\n");
+
+  cam_stream_len = 0;
+  cam_stream_pos = 0;
+  cam_stream_pic_outstanding = false;
+  cam_stream_next_request_ms = millis();
+  cam_stream_fps_start_ms = millis();
+  cam_stream_fps_frames = 0;
+  memset(&cam_stream_stats, 0, sizeof(cam_stream_stats));
+  cam_stream_active = true;
+}
+
+/*
+ * called on every pass of loop() (from webap_process()); never waits,
+ * so camera frames keep being parsed by cam_loop() in between
+ */
+void webap_cam_stream_loop() {
+  unsigned long now;
+
+  if (!cam_stream_active) {
+    return;
+  }
+  if (!streamClient.connected()) {
+    webap_cam_stream_stop();
+    return;
+  }
+  now = millis();
+
+  webap_cam_stream_take_picture(now);
+
+  // ask for the next picture as soon as the last one is out of cam_image,
+  // even if it is still being sent, but no more often than cam_stream_fps
+  if (!cam_stream_pic_outstanding && (cam_image_state() == CAM_IMG_IDLE)
+      && ((long) (now - cam_stream_next_request_ms) >= 0)) {
+    cam_image_request();
+    cam_stream_pic_outstanding = true;
+    cam_stream_request_ms = now;
+    cam_stream_next_request_ms = now + (1000 / cam_stream_fps);
+  }
+
+  webap_cam_stream_send_slice(now);
+
+  if ((now - cam_stream_fps_start_ms) >= CAM_STREAM_FPS_MS) {
+    cam_stream_stats.fps_x10 = (cam_stream_fps_frames * 10000) / (now - cam_stream_fps_start_ms);
+    cam_stream_fps_frames = 0;
+    cam_stream_fps_start_ms = now;
+  }
+}
+
+void webap_cam_stream_stop() {
+  if (!cam_stream_active) {
+    return;
+  }
+  if (cam_stream_pic_outstanding) {
+    cam_image_release();
+  }
+  streamClient.stop();
+  imgbuf_free(cam_stream_buf);
+  cam_stream_buf = NULL;
+  cam_stream_buf_size = 0;
+  cam_stream_active = false;
+}
+
+/*
+ * stats as one string with no spaces (fields separated by ':'), in the
+ * order: active (0/1), target fps, achieved fps x10, frames sent, frames 
+ * failed, collected latency last, max, sent latency last, max (mS)
+ */
+String webap_cam_stream_summary() {
+  String s;
+
+  s = String(cam_stream_active ? 1 : 0) + ":" + String(cam_stream_fps) + ":" + String(cam_stream_stats.fps_x10);
+  s += ":" + String(cam_stream_stats.frames) + ":" + String(cam_stream_stats.failed);
+  s += ":" + String(cam_stream_stats.in_last) + ":" + String(cam_stream_stats.in_max);
+  s += ":" + String(cam_stream_stats.out_last) + ":" + String(cam_stream_stats.out_max);
+  return s;
+}
+
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+/*
+ * moves a picture that has come in to the send buffer once that is free,
+ * leaving cam_image ready to collect the next one
+ */
+void webap_cam_stream_take_picture(unsigned long now) {
+  const uint8_t *data;
+  int len;
+
+  if (!cam_stream_pic_outstanding) {
+    return;
+  }
+  if (cam_image_state() == CAM_IMG_FAILED) {
+    cam_image_release();
+    cam_stream_pic_outstanding = false;
+    cam_stream_stats.failed++;
+    return;
+  }
+  if ((cam_image_state() != CAM_IMG_READY) || (cam_stream_len != 0)) {
+    return;
+  }
+  data = cam_image_data(&len);
+  cam_stream_buf = imgbuf_fit(cam_stream_buf, &cam_stream_buf_size, len);
+  if (cam_stream_buf == NULL) {
+    webap_cam_stream_stop();
+    return;
+  }
+  memcpy(cam_stream_buf, data, len);
+  cam_image_release();
+  cam_stream_pic_outstanding = false;
+  cam_stream_len = len;
+  cam_stream_pos = 0;
+  cam_stream_sending_ms = cam_stream_request_ms;
+  cam_stream_stats.in_last = now - cam_stream_request_ms;
+  if (cam_stream_stats.in_last > cam_stream_stats.in_max) {
+    cam_stream_stats.in_max = cam_stream_stats.in_last;
+  }
+  streamClient.print("--" CAM_STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: " + String(len) + "\r\n\r\n");
+}
+
+/*
+ * writes the next CAM_STREAM_SLICE bytes of the frame being sent; small
+ * enough to normally fit the socket's send buffer without waiting
+ */
+void webap_cam_stream_send_slice(unsigned long now) {
+  int n;
+
+  if (cam_stream_len == 0) {
+    return;
+  }
+  n = cam_stream_len - cam_stream_pos;
+  if (n > CAM_STREAM_SLICE) {
+    n = CAM_STREAM_SLICE;
+  }
+  cam_stream_pos += streamClient.write(&cam_stream_buf[cam_stream_pos], n);
+  if (cam_stream_pos < cam_stream_len) {
+    return;
+  }
+  streamClient.print("\r\n");
+  cam_stream_len = 0;
+  cam_stream_stats.frames++;
+  cam_stream_fps_frames++;
+  cam_stream_stats.out_last = now - cam_stream_sending_ms;
+  if (cam_stream_stats.out_last > cam_stream_stats.out_max) {
+    cam_stream_stats.out_max = cam_stream_stats.out_last;
+  }
+}
@@ -0,0 +1,54 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+#ifndef WEB_PAGES_CAM_STREAM_H
+#define WEB_PAGES_CAM_STREAM_H
+
+/*
+ * ***************************************************************
+ * cam_stream.html shows live camera pictures as an MJPEG stream 
+ * (multipart/x-mixed-replace) from /cam_stream.mjpg.  the stream
+ * keeps its own connection, so the rest of the configurator (and 
+ * cam_loop()) carries on while it runs.  while one frame is being 
+ * written to the browser, a slice per pass of loop(), the next one
+ * is already being collected from the camera (see cam_image.h)
+ * ***************************************************************
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "config.h"
+
+bool webap_build_cam_stream(String header);
+String webap_process_API_cam_stream(String header);
+
+void webap_cam_stream_start(WiFiClient &client);
+void webap_cam_stream_loop();
+void webap_cam_stream_stop();
+String webap_cam_stream_summary();
+
+#endif // WEB_PAGES_CAM_STREAM_H
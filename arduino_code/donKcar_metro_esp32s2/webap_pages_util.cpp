@@ -28,11 +28,39 @@
 #include "webap_pages_util.h"
 #include "webap_core.h"
 #include "cam.h"
+#include "cam_image.h"
+#include "webap_pages_cam_stream.h"
 
 extern String pageBuf;
 extern bool webap_allow_page_close;
 extern bool in_a_build_waiting_for_cam_to_continue_v1;
 
+#define WEBAP_CAM_IMG_START  "<div><img src=\"data:image/jpeg;base64,"
+#define WEBAP_CAM_QUEUE      2048     // (cut-through) base64 waiting for the browser, about 12 chunks
+#define WEBAP_CAM_SLICE      512      // most of it written to the browser per pass of loop()
+
+/*
+ * *********************************************
+ * private data
+ * *********************************************
+ */
+
+// cam_image.html render time and heap use, reported at the bottom of the page
+unsigned long webap_cam_start_ms;
+uint32_t webap_cam_heap_start;
+uint32_t webap_cam_heap_low;
+bool     webap_cam_img_started;     // (cut-through) the <img> tag has been queued
+char     webap_cam_queue[WEBAP_CAM_QUEUE];
+int      webap_cam_queue_len;       // bytes in webap_cam_queue
+int      webap_cam_queue_pos;       // bytes of it written so far
+
+/*
+ * templates for private functions
+ */
+bool webap_util_cam_chunk(const uint8_t *data, int len, void *ctx);
+void webap_util_cam_send_slice();
+void webap_util_cam_note_heap();
+
 /*
  * this checks for pages that perform basic utility functions
  * 
@@ -79,12 +107,26 @@ void webap_build_util(String header) {
    * PPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPPP
    */
   } else if (header.indexOf("GET /cam_image.html") >=0) {
+    webap_cam_start_ms = millis();
+    webap_cam_heap_start = ESP.getFreeHeap();
+    webap_cam_heap_low = webap_cam_heap_start;
+    webap_cam_img_started = false;
+    webap_cam_queue_len = 0;
+    webap_cam_queue_pos = 0;
+
     pageBuf = pageBuf + webap_start_page();
     pageBuf = pageBuf + show_mycss(); 
     pageBuf = pageBuf + "</head>\n";  
       
     pageBuf = pageBuf + "<body>\n<h1>Current Camera Image</h1>\n"; 
+    webap_cam_stream_stop();      // the stream would be using cam_image
+#ifdef CAM_IMAGE_CUT_THROUGH
+    // the picture is queued chunk by chunk by webap_util_cam_chunk() and
+    // goes to the browser a slice at a time from webap_util_finish_cam()
+    cam_image_stream(webap_util_cam_chunk, NULL);
+#else
     cam_request_pic();
+#endif
     // note this page will be finalized by webap_util_finish_cam() once pic is available
     // do not allow core to close out the clientAP until that happens...
     webap_allow_page_close = false;
@@ -128,13 +170,58 @@ void webap_build_util(String header) {
   }
 }
 
+/*
+ * called from webap_process() on every pass while cam_image.html is 
+ * waiting for its picture; sends the rest of the page once the picture 
+ * has arrived (or been given up on)
+ */
 void webap_util_finish_cam() {
+    bool ok;
+
+    webap_util_cam_note_heap();
+#ifdef CAM_IMAGE_CUT_THROUGH
+    if (!webap_client_connected()) {
+      // browser went away; stop passing chunks on
+      cam_image_release();
+      webap_closeout_client();
+      in_a_build_waiting_for_cam_to_continue_v1 = false;
+      return;
+    }
+    webap_util_cam_send_slice();
+    if (webap_cam_queue_pos < webap_cam_queue_len) {
+      return;       // finish sending what has come in first
+    }
+#endif
     if (!cam_check_cam_image_readiness()) {
       return;
     }
+#ifdef CAM_IMAGE_CUT_THROUGH
+    ok = (cam_image_state() == CAM_IMG_READY);
+    cam_image_release();
+    if (webap_cam_img_started) {
+      webap_print("\" /></div>\n");
+    }
+    pageBuf = "";
+#else
     pageBuf = "<div><img src=\"data:image/jpeg;base64,";
-    cam_append_pic(pageBuf);
-    pageBuf = pageBuf + "\" /></div>\n";      
+    ok = cam_append_pic(pageBuf);
+    webap_util_cam_note_heap();     // the whole picture is in pageBuf now
+    if (ok) {
+      pageBuf = pageBuf + "\" /></div>\n";
+    } else {
+      pageBuf = "";
+    }
+#endif
+    if (ok) {
+      pageBuf = pageBuf + "<p>" + cam_image_stats_get()->last_bytes + " bytes in " + cam_image_stats_get()->last_ms + " mS";
+      pageBuf = pageBuf + " (" + cam_image_stats_get()->last_resends + " chunks resent)</p>\n";
+    } else if (webap_cam_img_started) {
+      pageBuf = pageBuf + "<p>The camera stopped sending part way through the picture</p>\n";
+    } else {
+      pageBuf = pageBuf + "<p>No picture was received from the camera</p>\n";
+    }
+    pageBuf = pageBuf + "<p>Page rendered in " + String(millis() - webap_cam_start_ms) + " mS; free heap ";
+    pageBuf = pageBuf + String(webap_cam_heap_start) + " at start, " + String(webap_cam_heap_low) + " at lowest</p>\n";
     pageBuf = pageBuf + show_menu();  
     pageBuf = pageBuf + webap_start_local_js();
       // note need the start and end local even if no local js needed (the start has constants needed for common)
@@ -147,6 +234,7 @@ void webap_util_finish_cam() {
     webap_print_pageBuf();
     webap_closeout_client();
     in_a_build_waiting_for_cam_to_continue_v1 = false;
+    DEBUG_PRINTLN("cam_image.html " + String(millis() - webap_cam_start_ms) + " mS, heap used " + String(webap_cam_heap_start - webap_cam_heap_low));
 }
 
     
@@ -167,5 +255,71 @@ String webap_process_API_util(String header) {
   return "NOMATCH";
 }
 
+/*
+ * **************************************************
+ * private functions
+ * **************************************************
+ */
+
+/*
+ * (cut-through) gets each chunk of the picture, in order, as it comes off
+ * the camera link and queues it as base64 for webap_util_cam_send_slice().
+ * called from inside cam_loop(), so it never writes to the browser itself.
+ * chunks are a multiple of 3 bytes so no bytes need to be carried over 
+ * between calls.  returns false if the queue has no room for this chunk
+ */
+bool webap_util_cam_chunk(const uint8_t *data, int len, void *ctx) {
+  int need;
+
+  need = ((len + 2) / 3) * 4;
+  if (!webap_cam_img_started) {
+    need += strlen(WEBAP_CAM_IMG_START);
+  }
+  if ((webap_cam_queue_len + need) > WEBAP_CAM_QUEUE) {
+    // move what is still to be sent down to the front
+    memmove(webap_cam_queue, &webap_cam_queue[webap_cam_queue_pos], webap_cam_queue_len - webap_cam_queue_pos);
+    webap_cam_queue_len -= webap_cam_queue_pos;
+    webap_cam_queue_pos = 0;
+    if ((webap_cam_queue_len + need) > WEBAP_CAM_QUEUE) {
+      return false;
+    }
+  }
+  if (!webap_cam_img_started) {
+    memcpy(&webap_cam_queue[webap_cam_queue_len], WEBAP_CAM_IMG_START, strlen(WEBAP_CAM_IMG_START));
+    webap_cam_queue_len += strlen(WEBAP_CAM_IMG_START);
+    webap_cam_img_started = true;
+  }
+  webap_cam_queue_len += cam_base64_encode(data, len, &webap_cam_queue[webap_cam_queue_len]);
+  return true;
+}
+
+/*
+ * (cut-through) writes the next WEBAP_CAM_SLICE bytes of the queue; small
+ * enough to normally fit the socket's send buffer without waiting
+ */
+void webap_util_cam_send_slice() {
+  int n;
+
+  n = webap_cam_queue_len - webap_cam_queue_pos;
+  if (n > WEBAP_CAM_SLICE) {
+    n = WEBAP_CAM_SLICE;
+  }
+  if (n > 0) {
+    webap_cam_queue_pos += webap_write(&webap_cam_queue[webap_cam_queue_pos], n);
+  }
+  if (webap_cam_queue_pos == webap_cam_queue_len) {
+    webap_cam_queue_len = 0;
+    webap_cam_queue_pos = 0;
+  }
+}
+
+void webap_util_cam_note_heap() {
+  uint32_t heap = ESP.getFreeHeap();
+
+  if (heap < webap_cam_heap_low) {
+    webap_cam_heap_low = heap;
+  }
+}
+
 
     
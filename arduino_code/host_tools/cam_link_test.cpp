@@ -0,0 +1,633 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+/*
+ * ***********************************************************************************
+ * lossy-link test of the command / ACK protocol: the robot's own cam.cpp (with
+ * its ACK window, retries and parameter shadow) talks to an emulated camera
+ * over a link that drops, duplicates and delays frames in both directions,
+ * so commands and ACKs get lost, repeated and overtaken
+ *
+ * build:
+ *   g++ -O2 -iquote ../donKcar_metro_esp32s2 -I host_sketch cam_link_test.cpp host_sketch/host_sketch.cpp \
+ *       ../donKcar_metro_esp32s2/cam.cpp ../donKcar_metro_esp32s2/cam_parser.cpp \
+ *       ../donKcar_metro_esp32s2/cam_clock.cpp ../donKcar_metro_esp32s2/cam_stats.cpp \
+ *       ../donKcar_metro_esp32s2/serial_com_esp32.cpp -o cam_link_test
+ *
+ * run:
+ *   ./cam_link_test [-t trials] [-S seed] [loss_percent ...]
+ * (loss defaults to 0 1 5 10 20; duplicates and late frames each happen at
+ * half the loss rate)
+ *
+ * the camera does what communicator.py / commands.py do with a command: it
+ * looks at its input once per image frame, carries out each new command and
+ * ACKs it (NACKs a single CAM_CMD_BLOB_SET_LUMI_LOW over 255, standing in for
+ * any command it turns down), answers a sequence number it has among its last
+ * 8 the same way again without carrying it out again, and forgets those on a
+ * new CAM_CMD_SESSION.  with drive on it sends a steering frame per image.
+ * time is simulated, with loop() (cam_loop()) coming round every mS.
+ *
+ * each trial runs the same start-up: the parameter block and start mode from
+ * cam_init(), a single parameter set while the block is still unanswered,
+ * drive on, a few single parameter changes, a mode change, drive off, a
+ * change big enough to go as a block and a single parameter right behind it.
+ * the camera's state at the end (mode, drive, every parameter) is compared
+ * with a run over a perfect link, and the trial counted as
+ *   converged   the camera got there with no help
+ *   recovered   it did not, but the robot knew (a failed command, cam_mode
+ *               unknown or cam_sync_parameters() finding a difference), and
+ *               one round of re-sending got it there
+ *   failed      it did not get there even so
+ *   SILENT      it did not get there and the robot believed it had; this
+ *               must never happen
+ * settle time is from the start to the last change the camera made
+ *
+ * two more kinds of trial, counted the same way, come after:
+ *   restart     the start-up runs with other values, then the robot restarts
+ *               (cam_init() again, sequence numbers afresh) while the camera
+ *               stays up, and the start-up runs again
+ *   refused     a parameter the camera NACKs; the robot must know it is not set
+ *               (cam_sync_parameters() sends it again) unless it went through in
+ *               a block, or it is SILENT
+ * ***********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+#include "host_sketch.h"
+#include "config.h"
+#include "cam.h"
+#include "cam_parser.h"
+
+#define LINK_BAUD         230400
+#define LINK_LATE_MAX_MS  60      // a late frame turns up this much later, at most
+#define CAM_FRAME_MS      40      // camera image period: commands are looked at once per frame
+#define CAM_RECENT_SEQS   8       // communicator.py ECOMM_RECENT_SEQS
+#define CAM_PARAMS        (CAM_CMD_PARAM_BLOCK + 1)
+#define TEST_QUIET_MS     300     // nothing waiting for an ACK this long ends a phase
+#define TEST_PHASE_MAX_MS 5000
+
+#define RESULT_CONVERGED  0
+#define RESULT_RECOVERED  1
+#define RESULT_FAILED     2
+#define RESULT_SILENT     3
+
+// the CAM_CMD_PARAM_BLOCK payload, as laid out in cam.cpp (cam_block_layout[])
+static const uint8_t test_block_layout[][2] = {
+  {CAM_CMD_BLOB_ROI_WEIGHT_T, 4}, {CAM_CMD_BLOB_ROI_WEIGHT_M, 4}, {CAM_CMD_BLOB_ROI_WEIGHT_B, 4},
+  {CAM_CMD_BLOB_SET_FLOATING_THRESH, 4}, {CAM_CMD_BLOB_SET_SEED_THRESH, 4},
+  {CAM_CMD_PID_SET_KP, 4}, {CAM_CMD_PID_SET_KI, 4}, {CAM_CMD_PID_SET_KD, 4},
+  {CAM_CMD_PID_SET_STEERING_GAIN, 4}, {CAM_CMD_CAM_SET_PERSPECTIVE_FACTOR, 4},
+  {CAM_CMD_BLOB_ROI_POSITION_T, 4}, {CAM_CMD_BLOB_ROI_POSITION_M, 4}, {CAM_CMD_BLOB_ROI_POSITION_B, 4},
+  {CAM_CMD_BLOB_SET_SEED_LOC, 2}, {CAM_CMD_PID_SET_STEERING_DIRECTION, 2},
+  {CAM_CMD_BLOB_SET_LUMI_LOW, 2}, {CAM_CMD_BLOB_SET_LUMI_HIGH, 2},
+  {CAM_CMD_HISTEQ_WANTED, 2}, {CAM_CMD_NEGATE_WANTED, 2}, {CAM_CMD_CAM_PERSPECTIVE_ON, 2},
+};
+#define TEST_BLOCK_FIELDS (sizeof(test_block_layout) / sizeof(test_block_layout[0]))
+
+extern int cam_mode;    // cam.cpp: the mode the robot believes the camera is in
+
+struct LinkFrame {
+  uint64_t due_us;
+  std::vector<uint8_t> bytes;
+};
+
+/*
+ * one direction of the link: whole frames, each lost, doubled or made
+ * late at the configured rates, otherwise delivered after its wire time
+ */
+struct LinkPipe {
+  std::vector<LinkFrame> in_flight;
+  uint64_t wire_free_us;
+  double   loss;
+  double   dup;
+  double   late;
+
+  void reset(double loss_rate) {
+    in_flight.clear();
+    wire_free_us = 0;
+    loss = loss_rate;
+    dup = loss_rate / 2;
+    late = loss_rate / 2;
+  }
+
+  void send(const uint8_t *buf, int len, uint64_t now_us) {
+    LinkFrame f;
+    int copies = 1;
+
+    if (chance(loss)) {
+      return;
+    }
+    if (chance(dup)) {
+      copies = 2;
+    }
+    f.bytes.assign(buf, buf + len);
+    for (int i=0; i<copies; i++) {
+      wire_free_us = std::max(wire_free_us, now_us) + (uint64_t) len * 10000000ULL / LINK_BAUD;
+      f.due_us = wire_free_us;
+      if (chance(late)) {
+        f.due_us += 1000 + rand() % (LINK_LATE_MAX_MS * 1000);
+      }
+      in_flight.push_back(f);
+    }
+  }
+
+  // moves every frame due by now_us, in due order, onto the end of rx
+  void deliver(uint64_t now_us, std::vector<uint8_t> &rx) {
+    std::stable_sort(in_flight.begin(), in_flight.end(),
+                     [](const LinkFrame &a, const LinkFrame &b) { return a.due_us < b.due_us; });
+    size_t n = 0;
+    while ((n < in_flight.size()) && (in_flight[n].due_us <= now_us)) {
+      rx.insert(rx.end(), in_flight[n].bytes.begin(), in_flight[n].bytes.end());
+      n++;
+    }
+    in_flight.erase(in_flight.begin(), in_flight.begin() + n);
+  }
+
+  static bool chance(double p) {
+    return (p > 0) && ((rand() / (RAND_MAX + 1.0)) < p);
+  }
+};
+
+/*
+ * what the camera holds; perspective on/off is kept under
+ * CAM_CMD_CAM_PERSPECTIVE_ON as one 0/1 byte, as in cam.cpp's shadow
+ */
+struct CamState {
+  int     mode;       // the CAM_CMD_MODE_xxx last carried out
+  int     drive;      // CAM_CMD_DRIVE_ON / OFF / READY
+  uint8_t len[CAM_PARAMS];
+  uint8_t val[CAM_PARAMS][4];
+
+  bool operator==(const CamState &o) const {
+    if ((mode != o.mode) || (drive != o.drive)) {
+      return false;
+    }
+    for (int i=0; i<CAM_PARAMS; i++) {
+      if ((len[i] != o.len[i]) || (memcmp(val[i], o.val[i], len[i]) != 0)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+struct TestCamera {
+  CamParser parser;
+  CamState  state;
+  uint8_t   recent[CAM_RECENT_SEQS];
+  uint8_t   recent_answer[CAM_RECENT_SEQS];     // MSG_ACK or MSG_NACK
+  int       num_recent;
+  uint16_t  session;
+  uint64_t  next_frame_us;
+  uint64_t  last_change_us;
+  std::vector<uint8_t> rx;
+  uint8_t   steer_seq;
+};
+
+static LinkPipe   to_cam;
+static LinkPipe   to_robot;
+static std::vector<uint8_t> robot_rx;
+static TestCamera cam;
+
+/*
+ * Serial1 as the robot sees it
+ */
+class TestLink : public HostLink {
+public:
+  int available() {
+    return (int) robot_rx.size();
+  }
+  int read(uint8_t *buf, int len) {
+    len = std::min(len, (int) robot_rx.size());
+    memcpy(buf, robot_rx.data(), len);
+    robot_rx.erase(robot_rx.begin(), robot_rx.begin() + len);
+    return len;
+  }
+  int write(const uint8_t *buf, int len) {
+    to_cam.send(buf, len, host_now_us);
+    return len;
+  }
+};
+
+static TestLink test_link;
+
+static void cam_set_param(uint8_t cmd, const uint8_t *val, int len) {
+  memcpy(cam.state.val[cmd], val, len);
+  cam.state.len[cmd] = len;
+}
+
+static void cam_send(uint8_t msg_type, uint8_t seq, const uint8_t *payload, int len) {
+  uint8_t frame[CAM_MAX_FRAME];
+  int n;
+
+  n = cam_frame_encode(frame, msg_type, seq, payload, len);
+  to_robot.send(frame, n, host_now_us);
+}
+
+/*
+ * commands.py process_cmd(), for the state this test follows; false
+ * for a command it turns down
+ */
+static bool cam_carry_out(uint8_t cmd, const uint8_t *payload, int len) {
+  uint8_t onoff;
+  int index = 0;
+
+  switch(cmd) {
+    case CAM_CMD_MODE_IDLE:
+    case CAM_CMD_MODE_BLOBS:
+    case CAM_CMD_MODE_REGRESSION_LINE:
+    case CAM_CMD_MODE_GRAYSCALE:
+    case CAM_CMD_MODE_LANE_LINES:
+      cam.state.mode = cmd;
+      break;
+    case CAM_CMD_DRIVE_ON:
+    case CAM_CMD_DRIVE_OFF:
+    case CAM_CMD_DRIVE_READY:
+      cam.state.drive = cmd;
+      break;
+    case CAM_CMD_CAM_PERSPECTIVE_ON:
+    case CAM_CMD_CAM_PERSPECTIVE_OFF:
+      onoff = (cmd == CAM_CMD_CAM_PERSPECTIVE_ON) ? 1 : 0;
+      cam_set_param(CAM_CMD_CAM_PERSPECTIVE_ON, &onoff, 1);
+      break;
+    case CAM_CMD_PARAM_BLOCK:
+      for (unsigned int i=0; (i < TEST_BLOCK_FIELDS) && ((index + test_block_layout[i][1]) <= len); i++) {
+        if (test_block_layout[i][0] == CAM_CMD_CAM_PERSPECTIVE_ON) {
+          onoff = ((payload[index] | payload[index+1]) != 0) ? 1 : 0;
+          cam_set_param(CAM_CMD_CAM_PERSPECTIVE_ON, &onoff, 1);
+        } else {
+          cam_set_param(test_block_layout[i][0], &payload[index], test_block_layout[i][1]);
+        }
+        index += test_block_layout[i][1];
+      }
+      break;
+    case CAM_CMD_BLOB_SET_LUMI_LOW:
+      if ((len < 2) || ((payload[0] | (payload[1] << 8)) > 255)) {
+        return false;
+      }
+      cam_set_param(cmd, payload, len);
+      break;
+    default:
+      if ((cmd < CAM_PARAMS) && (len > 0) && (len <= 4)) {
+        cam_set_param(cmd, payload, len);
+      }
+      break;
+  }
+  return true;
+}
+
+/*
+ * communicator.py: a repeated sequence number gets the same answer again
+ * but is not carried out again; a new session forgets them all
+ */
+static void cam_on_frame(uint8_t cmd, uint8_t seq, const uint8_t *payload, int len, void *context) {
+  CamState before = cam.state;
+  uint8_t answer;
+
+  if (seq == 0) {
+    // pictures, link tests and time pings are not part of this test
+    if ((cmd == CAM_CMD_SESSION) && (len >= 2) && ((payload[0] | (payload[1] << 8)) != cam.session)) {
+      cam.session = payload[0] | (payload[1] << 8);
+      cam.num_recent = 0;
+    }
+    return;
+  }
+  for (int i=0; i<cam.num_recent; i++) {
+    if (cam.recent[i] == seq) {
+      cam_send(cam.recent_answer[i], seq, NULL, 0);
+      return;
+    }
+  }
+  answer = cam_carry_out(cmd, payload, len) ? MSG_ACK : MSG_NACK;
+  cam_send(answer, seq, NULL, 0);
+  if (cam.num_recent == CAM_RECENT_SEQS) {
+    memmove(&cam.recent[0], &cam.recent[1], CAM_RECENT_SEQS - 1);
+    memmove(&cam.recent_answer[0], &cam.recent_answer[1], CAM_RECENT_SEQS - 1);
+    cam.num_recent--;
+  }
+  cam.recent[cam.num_recent] = seq;
+  cam.recent_answer[cam.num_recent++] = answer;
+  if (!(cam.state == before)) {
+    cam.last_change_us = host_now_us;
+  }
+}
+
+static void cam_reset() {
+  memset(&cam.state, 0, sizeof(cam.state));
+  cam.num_recent = 0;
+  cam.session = 0;
+  cam.next_frame_us = 0;
+  cam.last_change_us = 0;
+  cam.rx.clear();
+  cam.steer_seq = 0;
+  cam_parser_init(&cam.parser, cam_on_frame, NULL);
+}
+
+/*
+ * one image frame's worth of camera work
+ */
+static void cam_frame() {
+  uint8_t payload[MSG_STEERANGLE_STAMPED_LENGTH];
+  uint32_t now_ms = (uint32_t) (host_now_us / 1000);
+
+  cam_parser_feed(&cam.parser, cam.rx.data(), (int) cam.rx.size());
+  cam.rx.clear();
+  if ((cam.state.drive == CAM_CMD_DRIVE_ON) || (cam.state.drive == CAM_CMD_DRIVE_READY)) {
+    memset(payload, 0, sizeof(payload));
+    memcpy(&payload[6], &now_ms, 4);
+    cam_send(MSG_STEERANGLE, 0, payload, sizeof(payload));
+  }
+}
+
+/*
+ * one mS: the link, the camera if an image is due, then loop()
+ */
+static void test_step() {
+  to_cam.deliver(host_now_us, cam.rx);
+  to_robot.deliver(host_now_us, robot_rx);
+  if (host_now_us >= cam.next_frame_us) {
+    cam_frame();
+    cam.next_frame_us += CAM_FRAME_MS * 1000;
+  }
+  cam_loop();
+  host_now_us += 1000;
+}
+
+// runs until nothing has waited for an ACK for TEST_QUIET_MS
+static void test_settle() {
+  uint64_t start_us = host_now_us;
+  uint64_t quiet_since_us = host_now_us;
+
+  while ((host_now_us - quiet_since_us) < TEST_QUIET_MS * 1000ULL) {
+    test_step();
+    if (cam_cmd_pending() > 0) {
+      quiet_since_us = host_now_us;
+    }
+    if ((host_now_us - start_us) > TEST_PHASE_MAX_MS * 1000ULL) {
+      break;
+    }
+  }
+}
+
+static void test_run_for(uint32_t ms) {
+  uint64_t until_us = host_now_us + ms * 1000ULL;
+
+  while (host_now_us < until_us) {
+    test_step();
+  }
+}
+
+static void test_base_config() {
+  memset(&config, 0, sizeof(config));
+  config.cam_startup_mode = 0;
+  config.blob_roiTloc = 10;   config.blob_roiTheight = 20;
+  config.blob_roiMloc = 40;   config.blob_roiMheight = 20;
+  config.blob_roiBloc = 80;   config.blob_roiBheight = 20;
+  config.blob_roiTweight = 0.2f;
+  config.blob_roiMweight = 0.3f;
+  config.blob_roiBweight = 0.5f;
+  config.blob_float_thresh = 0.4f;
+  config.blob_seed_thresh = 0.6f;
+  config.blob_seed_loc = 100;
+  config.pid_kp = 0.5f;
+  config.pid_ki = 0.01f;
+  config.pid_kd = 0.1f;
+  config.blob_lumi_low = 30;
+  config.blob_lumi_high = 200;
+  config.pid_steering_gain = 1.0f;
+  config.cam_perspective_factor = 0.5f;
+}
+
+/*
+ * the start-up described at the top, with bump added to the values it
+ * sets on the way; returns the mode last asked for
+ */
+static int test_scenario(float bump) {
+  test_base_config();
+  cam_init();
+  cam_enter_preferred_mode();
+  test_run_for(2);
+  config.pid_kp = 0.9f + bump;                          // set from a web page while the block is unanswered
+  cam_send_cmd(CAM_CMD_PID_SET_KP, config.pid_kp);
+  test_run_for(58);
+  cam_send_cmd(CAM_CMD_DRIVE_ON);
+  test_run_for(240);
+  config.blob_seed_loc = 110 + (int) (bump * 100);
+  config.blob_lumi_low = 40 + (int) (bump * 100);
+  config.cam_perspective_wanted = 1;
+  cam_sync_parameters();
+  test_run_for(10);
+  config.cam_startup_mode = 2;
+  cam_enter_preferred_mode();
+  test_run_for(20);
+  cam_send_cmd(CAM_CMD_DRIVE_OFF);
+  test_run_for(20);
+  config.pid_kp = 1.1f + bump;
+  config.pid_ki = 0.02f + bump;
+  config.pid_kd = 0.2f + bump;
+  config.blob_roiTweight = 0.25f + bump;
+  config.blob_roiMweight = 0.35f + bump;
+  config.blob_roiBweight = 0.4f + bump;
+  config.blob_seed_thresh = 0.7f + bump;
+  cam_sync_parameters();                                // 7 changes: goes as a block
+  test_run_for(6);
+  config.pid_kp = 1.3f + bump;                          // and one more right behind it
+  cam_send_cmd(CAM_CMD_PID_SET_KP, config.pid_kp);
+  test_settle();
+  return CAM_CMD_MODE_LANE_LINES;
+}
+
+static int test_cam_mode_for(int cmd) {
+  switch(cmd) {
+    case CAM_CMD_MODE_BLOBS:
+      return 2;     // CAM_MODE_BLOB1
+    case CAM_CMD_MODE_REGRESSION_LINE:
+      return 3;     // CAM_MODE_REGRES1
+    case CAM_CMD_MODE_LANE_LINES:
+      return 4;     // CAM_MODE_LANE_LINES
+  }
+  return 1;         // CAM_MODE_IDLE
+}
+
+/*
+ * with restart, the start-up first runs with other values and then the
+ * robot restarts (the camera does not) before the start-up proper
+ */
+static int test_trial(double loss, const CamState &want, bool restart, uint32_t *settle_ms) {
+  uint64_t start_us;
+  int mode_cmd;
+  bool knows;
+
+  to_cam.reset(loss);
+  to_robot.reset(loss);
+  robot_rx.clear();
+  cam_reset();
+  host_now_us = 0;
+
+  if (restart) {
+    test_scenario(0.25f);
+    test_run_for(100);
+    robot_rx.clear();
+  }
+  start_us = host_now_us;
+  mode_cmd = test_scenario(0);
+  *settle_ms = (uint32_t) ((cam.last_change_us - std::min(cam.last_change_us, start_us)) / 1000);
+  knows = (cam_cmd_failures() > 0) || (cam_mode != test_cam_mode_for(mode_cmd));
+  // the robot would do this after any config change; queues what differs
+  if (cam_sync_parameters() > 0) {
+    knows = true;
+  }
+  if (!knows) {
+    return (cam.state == want) ? RESULT_CONVERGED : RESULT_SILENT;
+  }
+  if (cam.state == want) {
+    test_settle();
+    return RESULT_CONVERGED;
+  }
+  if (cam_mode != test_cam_mode_for(mode_cmd)) {
+    cam_send_cmd(mode_cmd);
+  }
+  if (cam_cmd_failures() > 0) {
+    cam_send_cmd(want.drive);
+  }
+  test_settle();
+  return (cam.state == want) ? RESULT_RECOVERED : RESULT_FAILED;
+}
+
+/*
+ * a parameter the camera turns down: the robot must not take it as set
+ */
+static int test_refused(double loss) {
+  to_cam.reset(loss);
+  to_robot.reset(loss);
+  robot_rx.clear();
+  cam_reset();
+  host_now_us = 0;
+
+  test_base_config();
+  cam_init();
+  test_settle();
+  config.blob_lumi_low = 300;
+  cam_sync_parameters();
+  test_settle();
+  if (cam_sync_parameters() > 0) {
+    return RESULT_CONVERGED;
+  }
+  // (the block cam_init() sent may have failed, and the retry taken 300 in a block)
+  return ((cam.state.len[CAM_CMD_BLOB_SET_LUMI_LOW] == 2) && (cam.state.val[CAM_CMD_BLOB_SET_LUMI_LOW][0] == (300 & 0xFF))
+          && (cam.state.val[CAM_CMD_BLOB_SET_LUMI_LOW][1] == (300 >> 8))) ? RESULT_CONVERGED : RESULT_SILENT;
+}
+
+static uint32_t test_percentile(std::vector<uint32_t> &v, int percent) {
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, v.size() * percent / 100)];
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<double> losses;
+  std::vector<uint32_t> settle;
+  CamState want;
+  uint32_t settle_ms;
+  int trials = 2000;
+  unsigned int seed = 1;
+  int counts[4];
+  int silent_total = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:S:")) != -1) {
+    switch (opt) {
+      case 't':
+        trials = atoi(optarg);
+        break;
+      case 'S':
+        seed = (unsigned int) atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-t trials] [-S seed] [loss_percent ...]\n", argv[0]);
+        return 1;
+    }
+  }
+  for (int i=optind; i<argc; i++) {
+    losses.push_back(atof(argv[i]) / 100.0);
+  }
+  if (losses.empty()) {
+    losses = {0, 0.01, 0.05, 0.10, 0.20};
+  }
+  host_link = &test_link;
+  srand(seed);
+
+  // what the camera ends up with over a perfect link
+  memset(&want, 0, sizeof(want));
+  test_trial(0, want, false, &settle_ms);
+  want = cam.state;
+
+  printf("%d trials per loss rate (duplicates and late frames at half the loss rate, both ways)\n\n", trials);
+  printf(" loss%%  converged  recovered  failed  SILENT   settle mS p50   p90   p99   max\n");
+  for (double loss : losses) {
+    memset(counts, 0, sizeof(counts));
+    settle.clear();
+    for (int t=0; t<trials; t++) {
+      int result = test_trial(loss, want, false, &settle_ms);
+      counts[result]++;
+      if (result == RESULT_CONVERGED) {
+        settle.push_back(settle_ms);
+      }
+    }
+    silent_total += counts[RESULT_SILENT];
+    printf("%6.1f  %9d  %9d  %6d  %6d  %13u %5u %5u %5u\n", loss * 100,
+           counts[RESULT_CONVERGED], counts[RESULT_RECOVERED], counts[RESULT_FAILED], counts[RESULT_SILENT],
+           test_percentile(settle, 50), test_percentile(settle, 90), test_percentile(settle, 99),
+           test_percentile(settle, 100));
+  }
+
+  printf("\n        robot restart                                 refused\n");
+  printf(" loss%%  converged  recovered  failed  SILENT          ok  SILENT\n");
+  for (double loss : losses) {
+    int refused[4];
+
+    memset(counts, 0, sizeof(counts));
+    memset(refused, 0, sizeof(refused));
+    for (int t=0; t<trials; t++) {
+      counts[test_trial(loss, want, true, &settle_ms)]++;
+      refused[test_refused(loss)]++;
+    }
+    silent_total += counts[RESULT_SILENT] + refused[RESULT_SILENT];
+    printf("%6.1f  %9d  %9d  %6d  %6d  %10d  %6d\n", loss * 100,
+           counts[RESULT_CONVERGED], counts[RESULT_RECOVERED], counts[RESULT_FAILED], counts[RESULT_SILENT],
+           refused[RESULT_CONVERGED], refused[RESULT_SILENT]);
+  }
+  return (silent_total == 0) ? 0 : 2;
+}
@@ -0,0 +1,512 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+/*
+ * ***********************************************************************************
+ * PC benchmark for the camera link parser (cam_parser.cpp in the robot sketch),
+ * using the same source as the robot
+ *
+ * build:
+ *   g++ -O2 -I../donKcar_metro_esp32s2 cam_parser_bench.cpp \
+ *       ../donKcar_metro_esp32s2/cam_parser.cpp -o cam_parser_bench
+ *
+ * run:
+ *   ./cam_parser_bench [-s seconds] [-e errors_per_sec] [-m max_span] [-n repeats] [-t trials] [-S seed] [capture.bin ...]
+ *
+ * with no files it builds a synthetic stream of what the camera sends at 230400
+ * baud: a stamped steering frame every 100 mS and picture chunks filling the rest
+ * of the link.  files are raw bytes captured off the link (eg a USB serial adapter
+ * listening on the camera's TX line at 230400) and are replayed as they are.
+ * either way -e injects that many errors per second of link time (a flipped bit,
+ * a dropped byte, or 1-8 bytes of noise, picked at random; noise bytes are often
+ * START_CHAR or END_CHAR, the hard case for resync).
+ *
+ * the stream is handed to the parser in spans of 1 to -m bytes (a loop() pass
+ * picks up whatever the UART has), -n times over.  it prints the frames found
+ * and the errors counted, parser throughput in frames/s and CPU nS per byte, and
+ * the worst and mean number of bytes consumed between an error and the next good
+ * frame.  a PC is many times faster than the ESP32-S2, so use the times to
+ * compare changes, not as the robot's own numbers
+ *
+ * with no files it also compares the frame format with the one it replaced
+ * (10 byte fixed frames with an 8 bit additive checksum, parsed by the old
+ * cam_loop() state machine, copied here as bench_legacy_feed()):
+ *   - parse cost of a stream of steering frames in each format
+ *   - undetected errors: -t times over, a steering frame has 1, 2, 3 or 4
+ *     random bits flipped (or two neighbouring bytes swapped) and is fed to
+ *     a fresh parser; an undetected error is a frame delivered that differs
+ *     from the one sent
+ * ***********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "cam_parser.h"
+
+#define BENCH_BAUD          230400
+#define BENCH_STEER_MS      100     // camera_code_v5.py nextSendData
+#define BENCH_MSG_STEER     1       // MSG_STEERANGLE (cam.h)
+#define BENCH_MSG_CHUNK     6       // MSG_IMG_CHUNK (cam.h)
+
+#define LEGACY_MESSAGE_LENGTH 10    // the old fixed frame: START, status, 3 int16, checksum, END
+#define LEGACY_SEEKING_START    0
+#define LEGACY_COLLECTING_CHARS 1
+#define LEGACY_EXPECTING_STOP   2
+
+struct LegacyParser {
+  uint8_t  buffer[LEGACY_MESSAGE_LENGTH];
+  int      next_buffer_index;
+  int      fsm_state;
+  uint32_t numGoodMessages;
+  uint32_t numErrorFraming;
+  uint32_t numErrorChecksum;
+  uint8_t  last[LEGACY_MESSAGE_LENGTH];   // the last good frame
+};
+
+struct BenchCount {
+  uint32_t frames;
+  uint64_t payload_sum;   // keeps the handler from being optimised away
+};
+
+static void bench_on_frame(uint8_t msg_type, uint8_t seq, const uint8_t *payload, int len, void *context) {
+  BenchCount *c = (BenchCount *) context;
+
+  c->frames++;
+  c->payload_sum += msg_type + seq + len + ((len > 0) ? payload[len - 1] : 0);
+}
+
+static uint64_t bench_now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void bench_append_frame(std::vector<uint8_t> &out, uint8_t msg_type, uint8_t seq, const uint8_t *payload, int len) {
+  uint8_t frame[CAM_MAX_FRAME];
+  int n;
+
+  n = cam_frame_encode(frame, msg_type, seq, payload, len);
+  out.insert(out.end(), frame, frame + n);
+}
+
+/*
+ * what the camera sends over the given time: a steering frame every
+ * BENCH_STEER_MS, picture chunks in between; returns the frames in it
+ */
+static uint32_t bench_synthetic(std::vector<uint8_t> &out, double seconds) {
+  uint8_t payload[CAM_MAX_PAYLOAD];
+  uint32_t frames = 0;
+  uint32_t t_ms;
+  size_t per_tick = (BENCH_BAUD / 10) * BENCH_STEER_MS / 1000;
+  size_t tick_end;
+  uint8_t seq = 0;
+  uint16_t chunk = 0;
+
+  for (t_ms = 0; t_ms < (uint32_t) (seconds * 1000); t_ms += BENCH_STEER_MS) {
+    tick_end = out.size() + per_tick;
+    for (int i=0; i<10; i++) {
+      payload[i] = (uint8_t) rand();
+    }
+    memcpy(&payload[6], &t_ms, 4);
+    bench_append_frame(out, BENCH_MSG_STEER, 0, payload, 10);
+    frames++;
+    while (out.size() + CAM_MAX_FRAME <= tick_end) {
+      payload[0] = 1;
+      payload[1] = 0;
+      memcpy(&payload[2], &chunk, 2);
+      for (int i=4; i<CAM_MAX_PAYLOAD; i++) {
+        payload[i] = (uint8_t) rand();    // JPEG data: START_CHAR and END_CHAR turn up in it
+      }
+      bench_append_frame(out, BENCH_MSG_CHUNK, seq++, payload, CAM_MAX_PAYLOAD);
+      chunk++;
+      frames++;
+    }
+  }
+  return frames;
+}
+
+/*
+ * errors_per_sec errors (of link time at BENCH_BAUD) spread at random over in[]
+ */
+static void bench_add_noise(const std::vector<uint8_t> &in, std::vector<uint8_t> &out, double errors_per_sec, uint32_t *errors) {
+  double p = errors_per_sec / (BENCH_BAUD / 10.0);
+  int kind, n;
+
+  out.clear();
+  out.reserve(in.size() + in.size() / 64);
+  *errors = 0;
+  for (size_t i=0; i<in.size(); i++) {
+    if ((p <= 0) || (((double) rand() / RAND_MAX) >= p)) {
+      out.push_back(in[i]);
+      continue;
+    }
+    (*errors)++;
+    kind = rand() % 3;
+    if (kind == 0) {
+      out.push_back(in[i] ^ (1 << (rand() % 8)));
+    } else if (kind == 2) {
+      n = 1 + (rand() % 8);
+      while (n-- > 0) {
+        switch (rand() % 3) {
+          case 0:  out.push_back(CAM_START_CHAR); break;
+          case 1:  out.push_back(CAM_END_CHAR); break;
+          default: out.push_back((uint8_t) rand()); break;
+        }
+      }
+      out.push_back(in[i]);
+    }
+    // kind 1: the byte is dropped
+  }
+}
+
+/*
+ * the receive state machine of cam_loop() before cam_parser (steering frames only)
+ */
+static void bench_legacy_feed(LegacyParser *p, const uint8_t *bytes, int len) {
+  int checksumCalculated;
+  uint8_t rcvdChar;
+
+  for (int n=0; n<len; n++) {
+    rcvdChar = bytes[n];
+    switch (p->fsm_state) {
+      case LEGACY_SEEKING_START:
+        if (rcvdChar == CAM_START_CHAR) {
+          p->fsm_state = LEGACY_COLLECTING_CHARS;
+          p->buffer[0] = rcvdChar;
+          p->next_buffer_index = 1;
+        }
+        break;
+
+      case LEGACY_COLLECTING_CHARS:
+        p->buffer[p->next_buffer_index++] = rcvdChar;
+        if (p->next_buffer_index >= (LEGACY_MESSAGE_LENGTH - 1)) {
+          p->fsm_state = LEGACY_EXPECTING_STOP;
+          p->next_buffer_index = (LEGACY_MESSAGE_LENGTH - 1);
+        }
+        break;
+
+      case LEGACY_EXPECTING_STOP:
+        if (rcvdChar == CAM_END_CHAR) {
+          checksumCalculated = 0;
+          for (int i=1; i<(LEGACY_MESSAGE_LENGTH - 2); i++) {
+            checksumCalculated += p->buffer[i];
+          }
+          if ((checksumCalculated & 0xFF) != p->buffer[LEGACY_MESSAGE_LENGTH - 2]) {
+            p->numErrorChecksum++;
+          } else {
+            p->buffer[LEGACY_MESSAGE_LENGTH - 1] = rcvdChar;
+            memcpy(p->last, p->buffer, LEGACY_MESSAGE_LENGTH);
+            p->numGoodMessages++;
+          }
+        } else {
+          p->numErrorFraming++;
+        }
+        p->next_buffer_index = 0;
+        p->fsm_state = LEGACY_SEEKING_START;
+        break;
+    }
+  }
+}
+
+static void bench_legacy_encode(uint8_t *out, const uint8_t *payload7) {
+  int sum = 0;
+
+  out[0] = CAM_START_CHAR;
+  memcpy(&out[1], payload7, 7);
+  for (int i=1; i<8; i++) {
+    sum += out[i];
+  }
+  out[8] = (uint8_t) sum;
+  out[9] = CAM_END_CHAR;
+}
+
+struct BenchLast {
+  uint32_t frames;
+  uint8_t  frame[CAM_MAX_FRAME];    // the last frame delivered, re-encoded
+  int      length;
+};
+
+static void bench_on_frame_keep(uint8_t msg_type, uint8_t seq, const uint8_t *payload, int len, void *context) {
+  BenchLast *l = (BenchLast *) context;
+
+  l->frames++;
+  l->length = cam_frame_encode(l->frame, msg_type, seq, payload, len);
+}
+
+/*
+ * flips bits (kind 1-4) or swaps two neighbouring bytes (kind 0) somewhere in frame[]
+ */
+static void bench_damage(uint8_t *frame, int length, int kind) {
+  int bits[4];
+  int i, j, b;
+  uint8_t t;
+
+  if (kind == 0) {
+    do {
+      i = rand() % (length - 1);
+    } while (frame[i] == frame[i + 1]);
+    t = frame[i];
+    frame[i] = frame[i + 1];
+    frame[i + 1] = t;
+    return;
+  }
+  for (i=0; i<kind; i++) {
+    do {
+      b = rand() % (length * 8);
+      for (j=0; (j<i) && (bits[j] != b); j++) {
+      }
+    } while (j < i);
+    bits[i] = b;
+    frame[b / 8] ^= (uint8_t) (1 << (b % 8));
+  }
+}
+
+/*
+ * parse cost and undetected errors, this format against the old one
+ */
+static void bench_formats(int trials, int repeats) {
+  static const char *kinds[] = { "byte swap", "1 bit", "2 bits", "3 bits", "4 bits" };
+  std::vector<uint8_t> legacy_stream, stream;
+  uint8_t payload[CAM_MAX_PAYLOAD];
+  uint8_t sent[CAM_MAX_FRAME], frame[CAM_MAX_FRAME];
+  LegacyParser lp;
+  CamParser p;
+  BenchLast last;
+  BenchCount count;
+  uint64_t t0, ns_legacy, ns_new;
+  uint32_t bad_legacy, bad_new;
+  int n, frames = 100000;
+
+  for (int f=0; f<frames; f++) {
+    for (int i=0; i<10; i++) {
+      payload[i] = (uint8_t) rand();
+    }
+    bench_legacy_encode(frame, payload);
+    legacy_stream.insert(legacy_stream.end(), frame, frame + LEGACY_MESSAGE_LENGTH);
+    bench_append_frame(stream, BENCH_MSG_STEER, 0, payload, 10);
+  }
+  ns_legacy = 0;
+  ns_new = 0;
+  for (int r=0; r<repeats; r++) {
+    memset(&lp, 0, sizeof(lp));
+    t0 = bench_now_ns();
+    bench_legacy_feed(&lp, legacy_stream.data(), (int) legacy_stream.size());
+    ns_legacy += bench_now_ns() - t0;
+
+    memset(&count, 0, sizeof(count));
+    cam_parser_init(&p, bench_on_frame, &count);
+    t0 = bench_now_ns();
+    cam_parser_feed(&p, stream.data(), (int) stream.size());
+    ns_new += bench_now_ns() - t0;
+  }
+  printf("format comparison, %d steering frames, mean of %d runs\n", frames, repeats);
+  printf("  old (10 bytes, additive)    %6.1f nS/frame  %5.2f nS/byte  (%lu good)\n", (double) ns_legacy / repeats / frames,
+         (double) ns_legacy / repeats / legacy_stream.size(), (unsigned long) lp.numGoodMessages);
+  printf("  new (18 bytes, CRC-16)      %6.1f nS/frame  %5.2f nS/byte  (%lu good)\n", (double) ns_new / repeats / frames,
+         (double) ns_new / repeats / stream.size(), (unsigned long) p.numGoodMessages);
+
+  printf("undetected errors in %d damaged steering frames each\n", trials);
+  printf("  damage       old: undetected (rate)     new: undetected (rate)\n");
+  for (int kind=0; kind<5; kind++) {
+    bad_legacy = 0;
+    bad_new = 0;
+    for (int t=0; t<trials; t++) {
+      for (int i=0; i<10; i++) {
+        payload[i] = (uint8_t) rand();
+      }
+
+      bench_legacy_encode(sent, payload);
+      memcpy(frame, sent, LEGACY_MESSAGE_LENGTH);
+      bench_damage(frame, LEGACY_MESSAGE_LENGTH, kind);
+      memset(&lp, 0, sizeof(lp));
+      bench_legacy_feed(&lp, frame, LEGACY_MESSAGE_LENGTH);
+      if ((lp.numGoodMessages > 0) && (memcmp(lp.last, sent, LEGACY_MESSAGE_LENGTH) != 0)) {
+        bad_legacy++;
+      }
+
+      n = cam_frame_encode(sent, BENCH_MSG_STEER, 0, payload, 10);
+      memcpy(frame, sent, n);
+      bench_damage(frame, n, kind);
+      memset(&last, 0, sizeof(last));
+      cam_parser_init(&p, bench_on_frame_keep, &last);
+      cam_parser_feed(&p, frame, n);
+      if ((last.frames > 0) && ((last.length != n) || (memcmp(last.frame, sent, n) != 0))) {
+        bad_new++;
+      }
+    }
+    printf("  %-10s   %10lu  (%.2e)         %10lu  (%.2e)\n", kinds[kind], (unsigned long) bad_legacy, (double) bad_legacy / trials,
+           (unsigned long) bad_new, (double) bad_new / trials);
+  }
+}
+
+static bool bench_read_file(const char *name, std::vector<uint8_t> &buf) {
+  FILE *f;
+  long size;
+
+  f = fopen(name, "rb");
+  if (f == NULL) {
+    perror(name);
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  buf.resize(size);
+  if ((size <= 0) || (fread(buf.data(), 1, size, f) != (size_t) size)) {
+    fprintf(stderr, "%s: could not read\n", name);
+    fclose(f);
+    return false;
+  }
+  fclose(f);
+  return true;
+}
+
+static void bench_run(const char *name, const std::vector<uint8_t> &stream, uint32_t frames_sent, uint32_t errors, 
+                      int max_span, int repeats) {
+  std::vector<int> spans;
+  CamParser p;
+  BenchCount count;
+  uint64_t t0, ns;
+  uint64_t resync_sum = 0;
+  uint32_t resyncs = 0;
+  bool was_pending;
+  size_t pos;
+  int r, k;
+
+  for (pos = 0; pos < stream.size(); pos += spans.back()) {
+    spans.push_back(1 + (rand() % max_span));
+  }
+
+  ns = 0;
+  for (r=0; r<repeats; r++) {
+    memset(&count, 0, sizeof(count));
+    cam_parser_init(&p, bench_on_frame, &count);
+    t0 = bench_now_ns();
+    pos = 0;
+    for (k=0; pos < stream.size(); k++) {
+      int n = spans[k];
+      if (pos + n > stream.size()) {
+        n = (int) (stream.size() - pos);
+      }
+      cam_parser_feed(&p, &stream[pos], n);
+      pos += n;
+    }
+    ns += bench_now_ns() - t0;
+  }
+
+  // once more a byte at a time (untimed) to see every resync end, for the mean
+  memset(&count, 0, sizeof(count));
+  cam_parser_init(&p, bench_on_frame, &count);
+  was_pending = false;
+  for (pos = 0; pos < stream.size(); pos++) {
+    cam_parser_feed(&p, &stream[pos], 1);
+    if (was_pending && !p.resync_pending) {
+      resync_sum += p.resync_bytes_last;
+      resyncs++;
+    }
+    was_pending = p.resync_pending;
+  }
+
+  ns /= repeats;
+  printf("%s: %lu bytes (%.1f s at %d baud), %lu errors injected\n", name, (unsigned long) stream.size(),
+         stream.size() / (BENCH_BAUD / 10.0), BENCH_BAUD, (unsigned long) errors);
+  if (frames_sent > 0) {
+    printf("  frames   %lu of %lu good (%lu lost), %lu framing errors, %lu CRC errors\n", (unsigned long) p.numGoodMessages,
+           (unsigned long) frames_sent, (unsigned long) (frames_sent - ((p.numGoodMessages < frames_sent) ? p.numGoodMessages : frames_sent)),
+           (unsigned long) p.numErrorFraming, (unsigned long) p.numErrorChecksum);
+  } else {
+    printf("  frames   %lu good, %lu framing errors, %lu CRC errors\n", (unsigned long) p.numGoodMessages,
+           (unsigned long) p.numErrorFraming, (unsigned long) p.numErrorChecksum);
+  }
+  printf("  parser   %.0f frames/s, %.2f nS/byte (spans of 1-%d bytes, mean of %d runs)\n",
+         (ns > 0) ? (p.numGoodMessages * 1e9 / ns) : 0.0, (double) ns / stream.size(), max_span, repeats);
+  printf("  resync   worst %lu bytes, mean %.1f bytes over %lu resyncs\n", (unsigned long) p.resync_bytes_max,
+         (resyncs > 0) ? ((double) resync_sum / resyncs) : 0.0, (unsigned long) resyncs);
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<uint8_t> clean, noisy;
+  double seconds = 60;
+  double errors_per_sec = 2;
+  uint32_t frames, errors;
+  int max_span = 128;
+  int repeats = 20;
+  int trials = 1000000;
+  int opt;
+
+  srand(1);
+  while ((opt = getopt(argc, argv, "s:e:m:n:t:S:")) != -1) {
+    switch (opt) {
+      case 's':
+        seconds = atof(optarg);
+        break;
+      case 'e':
+        errors_per_sec = atof(optarg);
+        break;
+      case 'm':
+        max_span = atoi(optarg);
+        break;
+      case 'n':
+        repeats = atoi(optarg);
+        break;
+      case 't':
+        trials = atoi(optarg);
+        break;
+      case 'S':
+        srand(atoi(optarg));
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-s seconds] [-e errors_per_sec] [-m max_span] [-n repeats] [-t trials] [-S seed] [capture.bin ...]\n", argv[0]);
+        return 1;
+    }
+  }
+  if ((max_span < 1) || (repeats < 1) || (trials < 1) || (seconds <= 0)) {
+    fprintf(stderr, "usage: %s [-s seconds] [-e errors_per_sec] [-m max_span] [-n repeats] [-t trials] [-S seed] [capture.bin ...]\n", argv[0]);
+    return 1;
+  }
+
+  if (optind >= argc) {
+    frames = bench_synthetic(clean, seconds);
+    bench_add_noise(clean, noisy, errors_per_sec, &errors);
+    bench_run("synthetic", noisy, frames, errors, max_span, repeats);
+    bench_formats(trials, repeats);
+  }
+  for (; optind < argc; optind++) {
+    if (!bench_read_file(argv[optind], clean)) {
+      continue;
+    }
+    bench_add_noise(clean, noisy, errors_per_sec, &errors);
+    bench_run(argv[optind], noisy, 0, errors, max_span, repeats);
+  }
+  return 0;
+}
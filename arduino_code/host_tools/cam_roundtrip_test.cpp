@@ -0,0 +1,426 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+/*
+ * ***********************************************************************************
+ * round-trip test of every message type the robot takes from the camera: each
+ * is encoded with cam_frame_encode(), put on the link with noise around it, and
+ * taken in by the robot's own cam_loop() (sercom1 ring, cam_parser, the
+ * cam_msg_types[] table and its handlers).  what each handler passes on is
+ * checked against what was encoded
+ *
+ * build:
+ *   g++ -O2 -iquote ../donKcar_metro_esp32s2 -I host_sketch cam_roundtrip_test.cpp host_sketch/host_sketch.cpp \
+ *       ../donKcar_metro_esp32s2/cam.cpp ../donKcar_metro_esp32s2/cam_parser.cpp \
+ *       ../donKcar_metro_esp32s2/cam_stats.cpp ../donKcar_metro_esp32s2/serial_com_esp32.cpp \
+ *       -o cam_roundtrip_test
+ * (cam_clock.cpp is left out: this file stands in for it, to see the pongs)
+ *
+ * run:
+ *   ./cam_roundtrip_test [-n frames] [-p noise_probability] [-S seed]
+ *
+ * each frame is one of: steering (stamped and not), ACK and NACK (for a command
+ * the robot has just sent), picture header, picture chunk (any length), link
+ * test (for a test the robot has just started), time pong, and ones that must
+ * be dropped -- telemetry (no handler yet), an unknown type and a steering frame
+ * too short for its type.  before it, with probability -p, comes one of: random
+ * bytes (mostly START / END chars), a copy of the frame with one bit flipped, or
+ * the frame cut short, and after it a frame's length of idle line (zeros), so
+ * a frame the noise has held up comes out before the next is sent.  a frame
+ * is counted
+ *   ok       its handler ran once with the values sent (or, for the ones to
+ *            drop, nothing ran)
+ *   lost     nothing ran (the noise took the frame with it)
+ *   WRONG    a handler ran with other values, or more than once, or for a
+ *            frame that should have been dropped; must never happen
+ * ***********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "host_sketch.h"
+#include "config.h"
+#include "cam.h"
+#include "cam_parser.h"
+#include "cam_image.h"
+#include "cam_clock.h"
+
+#define KIND_STEER          0
+#define KIND_STEER_STAMPED  1
+#define KIND_ACK            2
+#define KIND_NACK           3
+#define KIND_IMG_HEADER     4
+#define KIND_IMG_CHUNK      5
+#define KIND_LINK_TEST      6
+#define KIND_TIME_PONG      7
+#define KIND_TELEMETRY      8     // the rest must be dropped
+#define KIND_UNKNOWN        9
+#define KIND_SHORT          10
+#define NUM_KINDS           11
+
+#define RESULT_OK     0
+#define RESULT_LOST   1
+#define RESULT_WRONG  2
+
+static const char *kind_names[NUM_KINDS] = {
+  "steer", "steer stamped", "ack", "nack", "img header", "img chunk",
+  "link test", "time pong", "telemetry", "unknown type", "short steer"
+};
+
+// cam.cpp's link test state, laid out as there
+struct CamLinkTest {
+  uint16_t id;
+  int      wanted;
+  int      good;
+  int      bad;
+  uint16_t cam_errors;
+  unsigned long first_us;
+  unsigned long last_us;
+};
+extern CamLinkTest cam_link_test;
+extern CamParser cam_parser;
+void cam_link_test_start(int wanted);
+
+/*
+ * what came out of the robot's side for one frame
+ */
+struct Seen {
+  int      steers;
+  int16_t  steer[3];
+  uint32_t frame_ms;
+  int      images;
+  int      image_type;
+  uint8_t  image[CAM_MAX_PAYLOAD];
+  int      image_len;
+  int      pongs;
+  uint32_t pong[3];
+};
+
+static Seen seen;
+static std::vector<uint8_t> robot_rx;
+static std::vector<uint8_t> last_tx;    // the last frame the robot sent
+
+class TestLink : public HostLink {
+public:
+  int available() {
+    return (int) robot_rx.size();
+  }
+  int read(uint8_t *buf, int len) {
+    len = std::min(len, (int) robot_rx.size());
+    memcpy(buf, robot_rx.data(), len);
+    robot_rx.erase(robot_rx.begin(), robot_rx.begin() + len);
+    return len;
+  }
+  int write(const uint8_t *buf, int len) {
+    last_tx.assign(buf, buf + len);
+    return len;
+  }
+};
+
+static TestLink test_link;
+
+/*
+ * cam_clock.cpp stand-ins
+ */
+void cam_clock_init() {
+}
+
+void cam_clock_note_ping() {
+}
+
+void cam_clock_got_pong(uint32_t t1_us, uint32_t t2_ms, uint32_t t3_ms, int64_t t4_us) {
+  seen.pongs++;
+  seen.pong[0] = t1_us;
+  seen.pong[1] = t2_ms;
+  seen.pong[2] = t3_ms;
+}
+
+static void test_steer(int16_t steer_angle, int16_t angle_error, int16_t target_angle, uint32_t frame_ms) {
+  seen.steers++;
+  seen.steer[0] = steer_angle;
+  seen.steer[1] = angle_error;
+  seen.steer[2] = target_angle;
+  seen.frame_ms = frame_ms;
+}
+
+static void test_image(int msg_type, const uint8_t *payload, int len) {
+  seen.images++;
+  seen.image_type = msg_type;
+  memcpy(seen.image, payload, len);
+  seen.image_len = len;
+}
+
+static void put16(uint8_t *p, int index, uint16_t v) {
+  p[index] = v & 0xFF;
+  p[index+1] = v >> 8;
+}
+
+// fields are checked with these, not the cam_parser readers under test
+static int16_t get16(const uint8_t *p, int index) {
+  return (int16_t) (p[index] | (p[index+1] << 8));
+}
+
+static uint32_t get32(const uint8_t *p, int index) {
+  return p[index] | (p[index+1] << 8) | (p[index+2] << 16) | ((uint32_t) p[index+3] << 24);
+}
+
+static void fill_random(uint8_t *p, int len) {
+  for (int i=0; i<len; i++) {
+    p[i] = (uint8_t) rand();
+  }
+}
+
+// communicator.link_pattern()
+static void link_pattern(uint16_t id, uint8_t *pattern) {
+  uint32_t x = 0x9E3779B9UL ^ id;
+
+  for (int i=0; i<CAM_LINK_TEST_PATTERN_LEN; i++) {
+    x = x * 1103515245UL + 12345UL;
+    pattern[i] = (x >> 16) & 0xFF;
+  }
+}
+
+/*
+ * noise ahead of a frame
+ */
+static void add_noise(std::vector<uint8_t> &out, const uint8_t *frame, int len) {
+  std::vector<uint8_t> copy(frame, frame + len);
+  int n;
+
+  switch (rand() % 3) {
+    case 0:
+      n = 1 + rand() % 16;
+      for (int i=0; i<n; i++) {
+        switch (rand() % 4) {
+          case 0:  out.push_back(CAM_START_CHAR); break;
+          case 1:  out.push_back(CAM_END_CHAR); break;
+          default: out.push_back((uint8_t) rand()); break;
+        }
+      }
+      break;
+    case 1:
+      n = rand() % (len * 8);
+      copy[n / 8] ^= (uint8_t) (1 << (n % 8));
+      out.insert(out.end(), copy.begin(), copy.end());
+      break;
+    default:
+      out.insert(out.end(), frame, frame + 1 + rand() % (len - 1));
+      break;
+  }
+}
+
+/*
+ * sends one frame of the given kind through cam_loop() and checks
+ * what came out
+ */
+static int test_frame(int kind, double noise) {
+  uint8_t payload[CAM_MAX_PAYLOAD];
+  uint8_t frame[CAM_MAX_FRAME];
+  std::vector<uint8_t> wire;
+  uint8_t msg_type = 0;
+  uint8_t seq = 0;
+  int len = 0;
+  int pending = 0;
+  uint32_t acks = 0;
+  int good = 0;
+  bool arrived;
+
+  switch (kind) {
+    case KIND_STEER:
+    case KIND_STEER_STAMPED:
+    case KIND_SHORT:
+      msg_type = MSG_STEERANGLE;
+      seq = (uint8_t) rand();
+      len = (kind == KIND_STEER_STAMPED) ? MSG_STEERANGLE_STAMPED_LENGTH
+          : ((kind == KIND_SHORT) ? (rand() % MSG_STEERANGLE_LENGTH) : MSG_STEERANGLE_LENGTH);
+      fill_random(payload, len);
+      break;
+    case KIND_ACK:
+    case KIND_NACK:
+      cam_send_cmd(CAM_CMD_DRIVE_ON);
+      msg_type = (kind == KIND_ACK) ? MSG_ACK : MSG_NACK;
+      seq = last_tx[3];
+      pending = cam_cmd_pending();
+      acks = cam_cmd_acks();
+      break;
+    case KIND_IMG_HEADER:
+      msg_type = MSG_IMG_HEADER;
+      len = CAM_IMG_HEADER_LENGTH;
+      fill_random(payload, len);
+      break;
+    case KIND_IMG_CHUNK:
+      msg_type = MSG_IMG_CHUNK;
+      len = CAM_IMG_CHUNK_OVERHEAD + rand() % (CAM_MAX_PAYLOAD - CAM_IMG_CHUNK_OVERHEAD + 1);
+      fill_random(payload, len);
+      break;
+    case KIND_LINK_TEST:
+      cam_link_test_start(1);
+      msg_type = MSG_LINK_TEST;
+      len = MSG_LINK_TEST_LENGTH;
+      put16(payload, 0, cam_link_test.id);
+      put16(payload, 2, 0);
+      put16(payload, 4, (uint16_t) (rand() % 100));
+      link_pattern(cam_link_test.id, &payload[6]);
+      break;
+    case KIND_TIME_PONG:
+      msg_type = MSG_TIME_PONG;
+      len = MSG_TIME_PONG_LENGTH;
+      fill_random(payload, len);
+      break;
+    case KIND_TELEMETRY:
+      msg_type = MSG_TELEMETRY;
+      len = rand() % 20;
+      fill_random(payload, len);
+      break;
+    case KIND_UNKNOWN:
+      msg_type = (uint8_t) (MSG_TIME_PONG + 1 + rand() % (255 - MSG_TIME_PONG));
+      len = rand() % 20;
+      fill_random(payload, len);
+      break;
+  }
+  len = cam_frame_encode(frame, msg_type, seq, payload, len);
+  if ((rand() / (RAND_MAX + 1.0)) < noise) {
+    add_noise(wire, frame, len);
+  }
+  wire.insert(wire.end(), frame, frame + len);
+  // idle line after it: a frame held up behind a bad header that claimed a
+  // long payload is let out now, not with the next one
+  wire.insert(wire.end(), CAM_MAX_FRAME, 0);
+  robot_rx.insert(robot_rx.end(), wire.begin(), wire.end());
+
+  memset(&seen, 0, sizeof(seen));
+  cam_loop();
+  host_now_us += 1000;
+
+  switch (kind) {
+    case KIND_STEER:
+    case KIND_STEER_STAMPED:
+      if (seen.steers == 0) {
+        return RESULT_LOST;
+      }
+      good = (seen.steers == 1) && (seen.steer[0] == get16(payload, 0))
+          && (seen.steer[1] == get16(payload, 2)) && (seen.steer[2] == get16(payload, 4));
+      if (kind == KIND_STEER_STAMPED) {
+        good = good && (seen.frame_ms == get32(payload, 6));
+      }
+      break;
+    case KIND_ACK:
+      arrived = (cam_cmd_pending() < pending);
+      if (!arrived) {
+        return RESULT_LOST;
+      }
+      good = (cam_cmd_acks() == acks + 1);
+      break;
+    case KIND_NACK:
+      arrived = (cam_cmd_pending() < pending);
+      if (!arrived) {
+        return RESULT_LOST;
+      }
+      good = (cam_cmd_acks() == acks);
+      break;
+    case KIND_IMG_HEADER:
+    case KIND_IMG_CHUNK:
+      if (seen.images == 0) {
+        return RESULT_LOST;
+      }
+      good = (seen.images == 1) && (seen.image_type == msg_type) && (seen.image_len == frame[4])
+          && (memcmp(seen.image, payload, seen.image_len) == 0);
+      break;
+    case KIND_LINK_TEST:
+      if ((cam_link_test.good + cam_link_test.bad) == 0) {
+        return RESULT_LOST;
+      }
+      good = (cam_link_test.good == 1) && (cam_link_test.bad == 0)
+          && (cam_link_test.cam_errors == (uint16_t) get16(payload, 4));
+      break;
+    case KIND_TIME_PONG:
+      if (seen.pongs == 0) {
+        return RESULT_LOST;
+      }
+      good = (seen.pongs == 1);
+      for (int i=0; i<3; i++) {
+        good = good && (seen.pong[i] == get32(payload, i * 4));
+      }
+      break;
+    default:
+      good = (seen.steers == 0) && (seen.images == 0) && (seen.pongs == 0);
+      break;
+  }
+  return good ? RESULT_OK : RESULT_WRONG;
+}
+
+int main(int argc, char *argv[]) {
+  int counts[NUM_KINDS][3];
+  int frames = 200000;
+  double noise = 0.5;
+  unsigned int seed = 1;
+  int wrong = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:p:S:")) != -1) {
+    switch (opt) {
+      case 'n':
+        frames = atoi(optarg);
+        break;
+      case 'p':
+        noise = atof(optarg);
+        break;
+      case 'S':
+        seed = (unsigned int) atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n frames] [-p noise_probability] [-S seed]\n", argv[0]);
+        return 1;
+    }
+  }
+  srand(seed);
+  host_link = &test_link;
+  host_steer_hook = test_steer;
+  host_image_hook = test_image;
+  memset(&config, 0, sizeof(config));
+  cam_init();
+  memset(counts, 0, sizeof(counts));
+
+  for (int i=0; i<frames; i++) {
+    int kind = rand() % NUM_KINDS;
+    counts[kind][test_frame(kind, noise)]++;
+  }
+
+  printf("%d frames, noise ahead of %.0f%% of them\n\n", frames, noise * 100);
+  printf("%-14s %8s %8s %8s\n", "type", "ok", "lost", "WRONG");
+  for (int k=0; k<NUM_KINDS; k++) {
+    printf("%-14s %8d %8d %8d\n", kind_names[k], counts[k][RESULT_OK], counts[k][RESULT_LOST], counts[k][RESULT_WRONG]);
+    wrong += counts[k][RESULT_WRONG];
+  }
+  printf("\nparser: %u good, %u framing errors, %u CRC errors\n",
+         cam_parser.numGoodMessages, cam_parser.numErrorFraming, cam_parser.numErrorChecksum);
+  return (wrong == 0) ? 0 : 2;
+}
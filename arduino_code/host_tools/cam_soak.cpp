@@ -0,0 +1,249 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+/*
+ * ***********************************************************************************
+ * soak test of the robot's camera receive path against the OpenMV emulator
+ * (code_openmv/host_tools/openmv_emulator.py): the robot's own cam.cpp,
+ * cam_parser.cpp, cam_stats.cpp, cam_clock.cpp, cam_image.cpp and the sercom1
+ * ring in serial_com_esp32.cpp run on the PC with Serial1 on the emulator's
+ * pseudo-terminal, the way loop() runs them on the car
+ *
+ * build:
+ *   g++ -O2 -iquote ../donKcar_metro_esp32s2 -I host_sketch cam_soak.cpp host_sketch/host_sketch.cpp \
+ *       ../donKcar_metro_esp32s2/cam.cpp ../donKcar_metro_esp32s2/cam_parser.cpp \
+ *       ../donKcar_metro_esp32s2/cam_clock.cpp ../donKcar_metro_esp32s2/cam_stats.cpp \
+ *       ../donKcar_metro_esp32s2/cam_image.cpp ../donKcar_metro_esp32s2/img_buf.cpp \
+ *       ../donKcar_metro_esp32s2/serial_com_esp32.cpp -o cam_soak
+ *
+ * run (the emulator first, in another terminal):
+ *   python3 openmv_emulator.py --link /tmp/openmv0 --rate 10 --jitter 15 --corrupt 0.01 --drop 0.01
+ *   ./cam_soak [-s seconds] [-r report_seconds] [-p pic_every_ms] [-P pass_us] [-b] /tmp/openmv0
+ *
+ * it starts the camera as setup() does (cam_init(), with -b the link speed
+ * negotiation, the start mode) and turns drive on, then runs cam_loop() and
+ * cam_timeout_check() every -P uS (default 1000) for -s seconds (default one
+ * hour), asking for a picture every -p mS (default 1000, 0 for none).  every
+ * -r seconds (default 60) it prints the receive side as cam_stats counts it:
+ * frames and bytes per second, parser framing / CRC errors and receive drops,
+ * steering rate and the worst steering gap, command ACKs, retries and
+ * failures, and pictures completed, failed and chunks asked for again.
+ * the PTY has no baud rate, so throughput is the PC's, not 230400's
+ * ***********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include "host_sketch.h"
+#include "config.h"
+#include "cam.h"
+#include "cam_parser.h"
+#include "cam_stats.h"
+#include "cam_image.h"
+#include "serial_com_esp32.h"
+
+extern CamParser cam_parser;
+
+/*
+ * Serial1 on the pseudo-terminal
+ */
+class PtyLink : public HostLink {
+public:
+  int fd;
+
+  int available() {
+    int n = 0;
+
+    if (ioctl(fd, FIONREAD, &n) < 0) {
+      return 0;
+    }
+    return n;
+  }
+  int read(uint8_t *buf, int len) {
+    int got = (int) ::read(fd, buf, len);
+    return (got < 0) ? 0 : got;
+  }
+  int write(const uint8_t *buf, int len) {
+    struct pollfd pfd;
+    int done = 0;
+    int n;
+
+    // cam_tx_service() hands over whole frames; the PTY takes them eventually
+    while (done < len) {
+      n = (int) ::write(fd, buf + done, len - done);
+      if (n > 0) {
+        done += n;
+      } else {
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        poll(&pfd, 1, 10);
+      }
+    }
+    return len;
+  }
+};
+
+static PtyLink pty_link;
+static uint32_t soak_steers;
+
+static void soak_steer(int16_t steer_angle, int16_t angle_error, int16_t target_angle, uint32_t frame_ms) {
+  soak_steers++;
+}
+
+static bool soak_open(const char *path) {
+  struct termios tio;
+
+  pty_link.fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (pty_link.fd < 0) {
+    perror(path);
+    return false;
+  }
+  if (tcgetattr(pty_link.fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    tcsetattr(pty_link.fd, TCSANOW, &tio);
+  }
+  return true;
+}
+
+// the tuning parameters cam_init() sends; any sane values do
+static void soak_config() {
+  memset(&config, 0, sizeof(config));
+  config.cam_startup_mode = 0;      // blobs: the emulator only steers in blob mode
+  config.blob_roiTloc = 10;   config.blob_roiTheight = 20;
+  config.blob_roiMloc = 40;   config.blob_roiMheight = 20;
+  config.blob_roiBloc = 80;   config.blob_roiBheight = 20;
+  config.blob_roiTweight = 0.2f;
+  config.blob_roiMweight = 0.3f;
+  config.blob_roiBweight = 0.5f;
+  config.blob_float_thresh = 0.4f;
+  config.blob_seed_thresh = 0.6f;
+  config.blob_seed_loc = 100;
+  config.pid_kp = 0.8f;
+  config.pid_kd = 0.4f;
+  config.blob_lumi_low = 30;
+  config.blob_lumi_high = 200;
+  config.pid_steering_gain = 1.0f;
+  config.cam_perspective_factor = 0.5f;
+}
+
+static void soak_report(unsigned long elapsed_ms) {
+  const CamStats *st = cam_stats_get();
+  const CamImageStats *img = cam_image_stats_get();
+
+  printf("%7lu S  %5u frames/s %7u bytes/s  errors: framing %u crc %u drops %u  steer %u/s max gap %u mS"
+         "  cmds: acks %u retries %u failed %u  pics %u failed %u resends %u\n",
+         elapsed_ms / 1000, st->frames_per_sec, st->bytes_per_sec, st->framing_errors, st->crc_errors,
+         sercom1_rx_overruns(), st->steer_per_sec, st->gap_max_ms, cam_cmd_acks(), cam_cmd_retries(),
+         cam_cmd_failures(), img->completed, img->failed, img->resends);
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long seconds = 3600;
+  unsigned long report_s = 60;
+  unsigned long pic_every_ms = 1000;
+  unsigned long pass_us = 1000;
+  bool negotiate = false;
+  unsigned long start_ms, next_report_ms, next_pic_ms, now;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:r:p:P:b")) != -1) {
+    switch (opt) {
+      case 's':
+        seconds = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        report_s = strtoul(optarg, NULL, 10);
+        break;
+      case 'p':
+        pic_every_ms = strtoul(optarg, NULL, 10);
+        break;
+      case 'P':
+        pass_us = strtoul(optarg, NULL, 10);
+        break;
+      case 'b':
+        negotiate = true;
+        break;
+      default:
+        optind = argc + 1;
+        break;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: %s [-s seconds] [-r report_seconds] [-p pic_every_ms] [-P pass_us] [-b] pty\n", argv[0]);
+    return 1;
+  }
+  if (!soak_open(argv[optind])) {
+    return 1;
+  }
+  host_realtime = true;
+  host_link = &pty_link;
+  host_steer_hook = soak_steer;
+  soak_config();
+
+  cam_init();
+  if (negotiate) {
+    cam_negotiate_baud();
+    printf("link rates: %s\n", cam_baud_summary().c_str());
+  }
+  cam_enter_preferred_mode();
+  cam_send_cmd(CAM_CMD_DRIVE_ON);
+  cam_stats_reset();
+
+  start_ms = millis();
+  next_report_ms = start_ms + report_s * 1000;
+  next_pic_ms = start_ms + pic_every_ms;
+  while ((millis() - start_ms) < seconds * 1000) {
+    cam_loop();
+    cam_timeout_check();
+    now = millis();
+    if ((cam_image_state() == CAM_IMG_READY) || (cam_image_state() == CAM_IMG_FAILED)) {
+      cam_image_release();
+    }
+    if ((pic_every_ms > 0) && ((long) (now - next_pic_ms) >= 0) && (cam_image_state() == CAM_IMG_IDLE)) {
+      next_pic_ms = now + pic_every_ms;
+      cam_request_pic();
+    }
+    if ((long) (now - next_report_ms) >= 0) {
+      next_report_ms += report_s * 1000;
+      soak_report(now - start_ms);
+    }
+    usleep(pass_us);
+  }
+  soak_report(millis() - start_ms);
+  printf("parser: %u good frames, %u framing errors, %u CRC errors, worst resync %u bytes; %u steering frames handed on\n",
+         cam_parser.numGoodMessages, cam_parser.numErrorFraming, cam_parser.numErrorChecksum,
+         cam_parser.resync_bytes_max, soak_steers);
+  return 0;
+}
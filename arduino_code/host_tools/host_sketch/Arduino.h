@@ -0,0 +1,146 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+/*
+ * ***********************************************************************************
+ * the parts of the Arduino core that the robot's camera link code uses
+ * (cam.cpp, cam_parser.cpp, cam_clock.cpp, cam_stats.cpp, serial_com_esp32.cpp),
+ * for building that code on a linux host.  only what those files need is here.
+ *
+ * millis() / micros() run from host_sketch.cpp's clock, and Serial1 reads and
+ * writes whatever HostLink the harness has plugged in (see host_sketch.h)
+ * ***********************************************************************************
+ */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+#define OUTPUT      1
+#define INPUT       0
+#define SERIAL_8N1  0
+
+// no PSRAM on the host: img_buf.cpp takes its buffers from the heap
+inline bool psramFound() { return false; }
+inline void *ps_malloc(size_t size) { return malloc(size); }
+
+class EspClass {
+public:
+  uint32_t getFreePsram() { return 0; }
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getMinFreeHeap() { return 0; }
+};
+
+extern EspClass ESP;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+// the ESP32 core's random() is the hardware RNG; here it is rand(), so srand() repeats a run
+inline long random(long howsmall, long howbig) { return (howsmall < howbig) ? howsmall + rand() % (howbig - howsmall) : howsmall; }
+void pinMode(int pin, int mode);
+
+class String {
+public:
+  String() {}
+  String(const char *c) : s(c) {}
+  String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned int v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+  String(float v, int decimals = 2) { fmt(v, decimals); }
+  String(double v, int decimals = 2) { fmt(v, decimals); }
+
+  String operator+(const String &o) const { return String(s + o.s, 0); }
+  friend String operator+(const char *a, const String &b) { return String(std::string(a) + b.s, 0); }
+  String &operator+=(const String &o) { s += o.s; return *this; }
+  bool concat(const String &o) { s += o.s; return true; }
+  unsigned int length() const { return (unsigned int) s.size(); }
+  const char *c_str() const { return s.c_str(); }
+  void reserve(unsigned int n) { s.reserve(n); }
+  int indexOf(const char *c) const { size_t p = s.find(c); return (p == std::string::npos) ? -1 : (int) p; }
+
+private:
+  std::string s;
+  String(const std::string &x, int) : s(x) {}
+  void fmt(double v, int decimals) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    s = buf;
+  }
+};
+
+/*
+ * Serial (debug output) prints to stdout; Serial1 goes to host_link
+ */
+class HardwareSerial {
+public:
+  explicit HardwareSerial(int num) : uart_num(num) {}
+  void begin(unsigned long baud, int config = SERIAL_8N1, int rx_pin = -1, int tx_pin = -1);
+  size_t setRxBufferSize(size_t n) { return n; }
+  size_t setTxBufferSize(size_t n) { return n; }
+  void updateBaudRate(unsigned long baud);
+  void flush() {}
+  int  available();
+  int  availableForWrite();
+  int  read();
+  size_t read(uint8_t *buf, size_t len);
+  size_t write(const uint8_t *buf, size_t len);
+  size_t print(char c) { return write((const uint8_t *) &c, 1); }
+  size_t print(const char *c);
+  size_t print(const String &c) { return print(c.c_str()); }
+  size_t print(long v) { return print(String(v)); }
+  size_t print(unsigned long v) { return print(String(v)); }
+  size_t print(int v) { return print(String(v)); }
+  size_t print(unsigned int v) { return print(String(v)); }
+  size_t print(double v) { return print(String(v)); }
+  template<typename T> size_t println(T v) { size_t n = print(v); return n + print('\n'); }
+  operator bool() { return true; }
+
+private:
+  int uart_num;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif  /* HOST_ARDUINO_H */
@@ -0,0 +1,206 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+/*
+ * ***********************************************************************************
+ * the Arduino core and sketch stand-ins declared in host_sketch.h and Arduino.h
+ * ***********************************************************************************
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include "host_sketch.h"
+#include "config.h"
+#include "cam.h"
+#include "cam_image.h"
+#include "status.h"
+#include "mode_mgr.h"
+#include "esp_timer.h"
+
+HostLink *host_link;
+bool     host_realtime;
+uint64_t host_now_us;
+void     (*host_delay_hook)(unsigned long ms);
+void     (*host_steer_hook)(int16_t steer_angle, int16_t angle_error, int16_t target_angle, uint32_t frame_ms);
+void     (*host_image_hook)(int msg_type, const uint8_t *payload, int len);
+
+Config config;
+
+EspClass ESP;
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+
+/*
+ * **************************************************
+ * clock
+ * **************************************************
+ */
+uint64_t host_time_us() {
+  struct timespec ts;
+
+  if (!host_realtime) {
+    return host_now_us;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+unsigned long millis() {
+  return (unsigned long) (uint32_t) (host_time_us() / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long) (uint32_t) host_time_us();
+}
+
+int64_t esp_timer_get_time() {
+  return (int64_t) host_time_us();
+}
+
+void delay(unsigned long ms) {
+  if (host_realtime) {
+    usleep(ms * 1000);
+  } else {
+    host_now_us += (uint64_t) ms * 1000;
+  }
+  if (host_delay_hook != NULL) {
+    host_delay_hook(ms);
+  }
+}
+
+void pinMode(int pin, int mode) {
+}
+
+/*
+ * **************************************************
+ * Serial (stdout) and Serial1 (host_link)
+ * **************************************************
+ */
+void HardwareSerial::begin(unsigned long baud, int config, int rx_pin, int tx_pin) {
+  updateBaudRate(baud);
+}
+
+void HardwareSerial::updateBaudRate(unsigned long baud) {
+  if ((uart_num == 1) && (host_link != NULL)) {
+    host_link->set_baud(baud);
+  }
+}
+
+int HardwareSerial::available() {
+  if ((uart_num != 1) || (host_link == NULL)) {
+    return 0;
+  }
+  return host_link->available();
+}
+
+int HardwareSerial::availableForWrite() {
+  if ((uart_num != 1) || (host_link == NULL)) {
+    return 0;
+  }
+  return host_link->tx_room();
+}
+
+int HardwareSerial::read() {
+  uint8_t c;
+
+  if ((uart_num != 1) || (host_link == NULL) || (host_link->read(&c, 1) != 1)) {
+    return -1;
+  }
+  return c;
+}
+
+size_t HardwareSerial::read(uint8_t *buf, size_t len) {
+  if ((uart_num != 1) || (host_link == NULL)) {
+    return 0;
+  }
+  return host_link->read(buf, (int) len);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len) {
+  if (uart_num != 1) {
+    return fwrite(buf, 1, len, stdout);
+  }
+  if (host_link == NULL) {
+    return len;
+  }
+  return host_link->write(buf, (int) len);
+}
+
+size_t HardwareSerial::print(const char *c) {
+  return write((const uint8_t *) c, strlen(c));
+}
+
+/*
+ * **************************************************
+ * the sketch modules around cam.cpp
+ * **************************************************
+ */
+void mode_got_msg_steerangle(int16_t steer_angle, int16_t angle_error, int16_t target_angle, uint32_t frame_ms) {
+  if (host_steer_hook != NULL) {
+    host_steer_hook(steer_angle, angle_error, target_angle, frame_ms);
+  }
+}
+
+void status_disp_cam_stats(uint32_t steer_per_sec, uint32_t errors_per_sec, uint32_t gap_max_ms, char colorcode) {
+}
+
+/*
+ * no pictures: headers and chunks only go to host_image_hook, and a request
+ * never completes.  these are weak so a tool can link the real cam_image.cpp
+ * and img_buf.cpp instead
+ */
+__attribute__((weak)) void cam_image_init() {
+}
+
+__attribute__((weak)) void cam_image_request() {
+}
+
+__attribute__((weak)) void cam_image_got_header(const uint8_t *payload, int len) {
+  if (host_image_hook != NULL) {
+    host_image_hook(MSG_IMG_HEADER, payload, len);
+  }
+}
+
+__attribute__((weak)) void cam_image_got_chunk(const uint8_t *payload, int len) {
+  if (host_image_hook != NULL) {
+    host_image_hook(MSG_IMG_CHUNK, payload, len);
+  }
+}
+
+__attribute__((weak)) void cam_image_check() {
+}
+
+__attribute__((weak)) int cam_image_state() {
+  return CAM_IMG_IDLE;
+}
+
+__attribute__((weak)) void cam_image_release() {
+}
+
+__attribute__((weak)) void cam_image_append_base64(String &s) {
+}
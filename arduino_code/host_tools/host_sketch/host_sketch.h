@@ -0,0 +1,83 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+/*
+ * ***********************************************************************************
+ * what the host tools need to run the robot's own camera link code (cam.cpp,
+ * cam_parser.cpp, cam_clock.cpp, cam_stats.cpp, serial_com_esp32.cpp) on a PC:
+ * a clock, a place for Serial1's bytes to go, and stand-ins for the modules
+ * around cam.cpp (pictures, TFT status, mode_mgr) that the tools do not run.
+ *
+ * build a tool against it with (from host_tools/):
+ *   g++ -O2 -iquote ../donKcar_metro_esp32s2 -I host_sketch tool.cpp host_sketch/host_sketch.cpp \
+ *       ../donKcar_metro_esp32s2/cam.cpp ../donKcar_metro_esp32s2/cam_parser.cpp \
+ *       ../donKcar_metro_esp32s2/cam_clock.cpp ../donKcar_metro_esp32s2/cam_stats.cpp \
+ *       ../donKcar_metro_esp32s2/serial_com_esp32.cpp
+ * (-iquote, not -I, for the sketch: its sched.h would hide the system one)
+ * ***********************************************************************************
+ */
+#ifndef HOST_SKETCH_H
+#define HOST_SKETCH_H
+
+#include <Arduino.h>
+
+/*
+ * the far end of Serial1.  write() gets each frame cam.cpp sends in one
+ * call (cam_tx_service() writes whole frames)
+ */
+class HostLink {
+public:
+  virtual ~HostLink() {}
+  virtual int  available() = 0;
+  virtual int  read(uint8_t *buf, int len) = 0;
+  virtual int  write(const uint8_t *buf, int len) = 0;
+  virtual int  tx_room() { return 4096; }
+  virtual void set_baud(unsigned long baud) {}
+};
+
+extern HostLink *host_link;
+
+/*
+ * the clock behind millis(), micros() and esp_timer_get_time().  with
+ * host_realtime false (the default) it only moves when the tool moves it,
+ * and delay() moves it and then calls host_delay_hook so the tool can run
+ * the far end meanwhile
+ */
+extern bool     host_realtime;
+extern uint64_t host_now_us;
+extern void     (*host_delay_hook)(unsigned long ms);
+
+uint64_t host_time_us();
+
+// every MSG_STEERANGLE cam.cpp hands on to mode_mgr ends up here
+extern void     (*host_steer_hook)(int16_t steer_angle, int16_t angle_error, int16_t target_angle, uint32_t frame_ms);
+
+// and every picture header / chunk it hands on to cam_image (msg_type is MSG_IMG_xxx)
+extern void     (*host_image_hook)(int msg_type, const uint8_t *payload, int len);
+
+#endif  /* HOST_SKETCH_H */
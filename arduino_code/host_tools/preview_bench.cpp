@@ -0,0 +1,212 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+/*
+ * ***********************************************************************************
+ * PC benchmark for the TFT camera preview decoder (jpeg_preview.cpp in the
+ * robot sketch), using the same code and the same JPEGDEC library as the robot
+ *
+ * build (JPEGDEC from https://github.com/bitbank2/JPEGDEC):
+ *   g++ -O2 -D__LINUX__ -I<JPEGDEC>/src -I../donKcar_metro_esp32s2 \
+ *       preview_bench.cpp ../donKcar_metro_esp32s2/jpeg_preview.cpp <JPEGDEC>/src/JPEGDEC.cpp -o preview_bench
+ *
+ * run:
+ *   ./preview_bench [-n repeats] [-b budget_us] [-p out_prefix] picture.jpg ...
+ * pictures can be pulled off the robot with code_openmv/host_tools/recording_tool.py
+ * (extract), or saved from the web configurator's camera page.
+ *
+ * for each picture and each scale (1, 2, 4, 8) it prints the mean and worst 
+ * decode time, the strips per picture, and (with -b) how often the budget would
+ * have cut the picture off.  the sink copies each strip into a frame buffer, 
+ * roughly the memory traffic of a blit; -p writes that buffer out as a .ppm per
+ * scale so the output can be checked by eye.  a PC is many times faster than
+ * the ESP32-S2, so use the numbers to compare scales and pictures; the robot 
+ * shows its own times under the preview
+ * ***********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "jpeg_preview.h"
+
+#define BENCH_MAX_WIDTH   2048
+#define BENCH_MAX_HEIGHT  2048
+
+static uint16_t frame[BENCH_MAX_WIDTH * BENCH_MAX_HEIGHT];
+
+/*
+ * copies the strip into frame[] (clipped to it)
+ */
+static bool bench_sink(int x, int y, int w, int h, uint16_t *pixels, void *ctx) {
+  int r, cols;
+
+  if ((x >= BENCH_MAX_WIDTH) || (y >= BENCH_MAX_HEIGHT)) {
+    return true;
+  }
+  cols = (x + w > BENCH_MAX_WIDTH) ? (BENCH_MAX_WIDTH - x) : w;
+  for (r=0; (r < h) && (y + r < BENCH_MAX_HEIGHT); r++) {
+    memcpy(&frame[((y + r) * BENCH_MAX_WIDTH) + x], &pixels[r * w], cols * sizeof(uint16_t));
+  }
+  return true;
+}
+
+/*
+ * frame[] (RGB565, high byte first) as a binary .ppm
+ */
+static void bench_write_ppm(const char *name, int width, int height) {
+  FILE *f;
+  uint16_t p;
+  int x, y;
+
+  f = fopen(name, "wb");
+  if (f == NULL) {
+    perror(name);
+    return;
+  }
+  fprintf(f, "P6\n%d %d\n255\n", width, height);
+  for (y=0; y<height; y++) {
+    for (x=0; x<width; x++) {
+      p = frame[(y * BENCH_MAX_WIDTH) + x];
+      p = (uint16_t) ((p >> 8) | (p << 8));
+      fputc(((p >> 11) & 0x1F) << 3, f);
+      fputc(((p >> 5) & 0x3F) << 2, f);
+      fputc((p & 0x1F) << 3, f);
+    }
+  }
+  fclose(f);
+}
+
+static bool bench_read_file(const char *name, std::vector<uint8_t> &buf) {
+  FILE *f;
+  long size;
+
+  f = fopen(name, "rb");
+  if (f == NULL) {
+    perror(name);
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  buf.resize(size);
+  if ((size <= 0) || (fread(buf.data(), 1, size, f) != (size_t) size)) {
+    fprintf(stderr, "%s: could not read\n", name);
+    fclose(f);
+    return false;
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  static const int scales[] = { 1, 2, 4, 8 };
+  std::vector<uint8_t> jpg;
+  JpvResult res;
+  const char *prefix = NULL;
+  uint32_t budget_us = 0xFFFFFFFF;
+  uint64_t sum_us;
+  uint32_t max_us, total_us;
+  int repeats = 50;
+  int width, height, over, failed;
+  int opt, s, n;
+  char name[256];
+
+  while ((opt = getopt(argc, argv, "n:b:p:")) != -1) {
+    switch (opt) {
+      case 'n':
+        repeats = atoi(optarg);
+        break;
+      case 'b':
+        budget_us = (uint32_t) atol(optarg);
+        break;
+      case 'p':
+        prefix = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n repeats] [-b budget_us] [-p out_prefix] picture.jpg ...\n", argv[0]);
+        return 1;
+    }
+  }
+  if ((optind >= argc) || (repeats < 1)) {
+    fprintf(stderr, "usage: %s [-n repeats] [-b budget_us] [-p out_prefix] picture.jpg ...\n", argv[0]);
+    return 1;
+  }
+  if (!jpv_begin()) {
+    fprintf(stderr, "no memory for the decoder\n");
+    return 1;
+  }
+
+  for (; optind < argc; optind++) {
+    if (!bench_read_file(argv[optind], jpg)) {
+      continue;
+    }
+    if (!jpv_open(jpg.data(), (int) jpg.size(), &width, &height)) {
+      fprintf(stderr, "%s: not a JPEG the decoder can open\n", argv[optind]);
+      continue;
+    }
+    jpv_close();
+    printf("%s: %dx%d, %d bytes\n", argv[optind], width, height, (int) jpg.size());
+    printf("  scale   size       mean uS   max uS  sink uS  strips  over  failed\n");
+
+    for (s=0; s<4; s++) {
+      sum_us = 0;
+      max_us = 0;
+      over = 0;
+      failed = 0;
+      memset(&res, 0, sizeof(res));
+      for (n=0; n<repeats; n++) {
+        jpv_open(jpg.data(), (int) jpg.size(), &width, &height);
+        if (!jpv_decode(scales[s], 0, 0, budget_us, bench_sink, NULL, &res)) {
+          failed++;
+        }
+        jpv_close();
+        total_us = res.decode_us + res.sink_us;
+        sum_us += total_us;
+        if (total_us > max_us) {
+          max_us = total_us;
+        }
+        if (res.over_budget) {
+          over++;
+        }
+      }
+      printf("  1/%-4d %4dx%-4d %9lu %8lu %8lu %7d %5d %7d\n", scales[s], res.width, res.height, 
+             (unsigned long) (sum_us / repeats), (unsigned long) max_us, (unsigned long) res.sink_us, 
+             res.strips, over, failed);
+      if (prefix != NULL) {
+        snprintf(name, sizeof(name), "%s_%d.ppm", prefix, scales[s]);
+        bench_write_ppm(name, (res.width < BENCH_MAX_WIDTH) ? res.width : BENCH_MAX_WIDTH, 
+                        (res.height < BENCH_MAX_HEIGHT) ? res.height : BENCH_MAX_HEIGHT);
+      }
+    }
+  }
+  jpv_end();
+  return 0;
+}
@@ -0,0 +1,331 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+/*
+ * ***********************************************************************************
+ * unit test and overhead benchmark of the loop() scheduler (sched.cpp) on a PC.
+ * sched.cpp takes its clock as a function, so here it runs on a fake uS clock
+ * that the test moves on by hand (and that task functions can move on, to take
+ * "time")
+ *
+ * build:
+ *   g++ -O2 -iquote ../donKcar_metro_esp32s2 sched_test.cpp ../donKcar_metro_esp32s2/sched.cpp -o sched_test
+ * (-iquote, not -I: the sketch's sched.h would hide the system one)
+ *
+ * run:
+ *   ./sched_test [-n bench_passes] [-p pass_us]
+ *
+ * the tests:
+ *   order      several tasks due in one pass: every urgent one runs, highest
+ *              priority first, then one minor task (highest priority, then most
+ *              overdue), the rest one per pass after that
+ *   skip       a periodic task held up for several periods runs once, counts the
+ *              missed periods and keeps to its own deadlines; one that runs over
+ *              its own period does not run twice in a pass
+ *   one-shot   a one-shot that re-arms itself keeps its slot (and statistics),
+ *              a full table is refused
+ *   wrap       a schedule that crosses the 32 bit uS wrap keeps every deadline,
+ *              and nothing due after the wrap runs before it
+ * then the benchmark runs loop()'s own task table (as registered in setup())
+ * for -n passes (default 1000000), the fake clock moving -p uS (default 200)
+ * each pass, and prints the CPU time sched_run() takes per pass.  a PC is many
+ * times faster than the ESP32-S2, so read it against the other host benches
+ * ***********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "sched.h"
+
+static Sched test_sched;
+static uint32_t fake_us;
+static char run_order[64];
+static int run_count;
+static uint32_t task_takes_us;    // how far each task moves the clock on
+static int rearm_left;
+static int failures;
+
+static uint32_t fake_clock_us() {
+  return fake_us;
+}
+
+static void note_run(char c) {
+  if (run_count < (int) sizeof(run_order) - 1) {
+    run_order[run_count++] = c;
+    run_order[run_count] = 0;
+  } else {
+    task_takes_us = 0;    // a task running over and over in one pass; let the pass end
+  }
+  fake_us += task_takes_us;
+}
+
+static void task_a() { note_run('A'); }
+static void task_b() { note_run('B'); }
+static void task_c() { note_run('C'); }
+static void task_d() { note_run('D'); }
+static void task_e() { note_run('E'); }
+static void task_f() { note_run('F'); }
+static void task_nothing() { }
+
+static void task_rearm() {
+  note_run('R');
+  if (--rearm_left > 0) {
+    sched_once(&test_sched, "rearm", task_rearm, SCHED_PRIO_HOUSEKEEP, 5);
+  }
+}
+
+static void test_setup(uint32_t start_us) {
+  fake_us = start_us;
+  run_order[0] = 0;
+  run_count = 0;
+  task_takes_us = 0;
+  sched_init(&test_sched, fake_clock_us);
+}
+
+static void check(bool ok, const char *test, const char *what) {
+  if (!ok) {
+    printf("  %-9s FAILED: %s\n", test, what);
+    failures++;
+  }
+}
+
+static void check_order(const char *test, const char *expected) {
+  char what[128];
+
+  snprintf(what, sizeof(what), "ran \"%s\", expected \"%s\"", run_order, expected);
+  check(strcmp(run_order, expected) == 0, test, what);
+  run_order[0] = 0;
+  run_count = 0;
+}
+
+static void test_order() {
+  const char *name = "order";
+  int ran;
+
+  test_setup(1000000);
+  sched_every(&test_sched, "disp", task_a, SCHED_PRIO_DISPLAY, 100, 1);
+  sched_every(&test_sched, "hk3", task_b, SCHED_PRIO_HOUSEKEEP, 100, 3);
+  sched_every(&test_sched, "safe", task_c, SCHED_PRIO_SAFETY, 100, 5);
+  sched_every(&test_sched, "ctrl", task_d, SCHED_PRIO_CONTROL, 100, 0);
+  sched_every(&test_sched, "hk2", task_e, SCHED_PRIO_HOUSEKEEP, 100, 2);
+  sched_every(&test_sched, "later", task_f, SCHED_PRIO_CONTROL, 100, 50);
+
+  ran = sched_run(&test_sched);
+  check(ran == 1, name, "only the task due at once runs");
+  check_order(name, "D");
+
+  fake_us += 10000;
+  ran = sched_run(&test_sched);
+  check(ran == 2, name, "the urgent task and one minor task in the first pass");
+  check_order(name, "CE");
+  sched_run(&test_sched);
+  check_order(name, "B");
+  sched_run(&test_sched);
+  check_order(name, "A");
+  ran = sched_run(&test_sched);
+  check(ran == 0, name, "nothing left");
+  check(test_sched.deferred == 2, name, "two passes left a minor task behind");
+
+  // two control tasks due: the more overdue first
+  fake_us += 90000;
+  sched_run(&test_sched);
+  check_order(name, "FD");
+}
+
+static void test_skip() {
+  const char *name = "skip";
+  SchedTask *t;
+  uint32_t start_us, due_us;
+  int id, ran;
+
+  test_setup(5000000);
+  start_us = fake_us;
+  id = sched_every(&test_sched, "tick", task_a, SCHED_PRIO_CONTROL, 10, 10);
+  t = &test_sched.task[id];
+
+  fake_us = start_us + 45000;       // due at 10 mS, 35 mS late
+  sched_run(&test_sched);
+  check(t->runs == 1, name, "a late task runs once");
+  check(t->skipped == 3, name, "3 whole periods missed");
+  check(t->late_max_us == 35000, name, "lateness measured from the missed deadline");
+  check(sched_next_due(&test_sched, &due_us) && (due_us == start_us + 50000), name, "next run on its own 10 mS grid");
+
+  fake_us = start_us + 49000;
+  check(sched_run(&test_sched) == 0, name, "not run before its deadline");
+  fake_us = start_us + 50000;
+  sched_run(&test_sched);
+  check((t->runs == 2) && (t->skipped == 3) && (t->late_max_us == 35000), name, "on time after the skip");
+  check_order(name, "AA");
+
+  // a task that takes longer than its period is due again at once, but not in the same pass
+  test_setup(5000000);
+  id = sched_every(&test_sched, "slow", task_b, SCHED_PRIO_CONTROL, 10, 0);
+  task_takes_us = 25000;
+  ran = sched_run(&test_sched);
+  check(ran == 1, name, "no task runs twice in one pass");
+  ran = sched_run(&test_sched);
+  check((ran == 1) && (test_sched.task[id].skipped == 1), name, "overrun counted as a skip next pass");
+  check(test_sched.task[id].run_max_us == 25000, name, "run time taken from the clock");
+}
+
+static void test_oneshot() {
+  const char *name = "one-shot";
+  char task_name[SCHED_MAX_TASKS][8];
+  int id, again, other, i;
+
+  test_setup(2000000);
+  rearm_left = 100;
+  id = sched_once(&test_sched, "rearm", task_rearm, SCHED_PRIO_HOUSEKEEP, 5);
+  for (i = 0; i < 200; i++) {
+    fake_us += 5000;
+    sched_run(&test_sched);
+  }
+  check(test_sched.count == 1, name, "a one-shot that re-arms itself keeps one slot");
+  check(test_sched.task[id].runs == 100, name, "and keeps its statistics");
+  check(!test_sched.task[id].active, name, "inactive once it stops re-arming");
+
+  again = sched_once(&test_sched, "rearm", task_rearm, SCHED_PRIO_HOUSEKEEP, 5);
+  other = sched_once(&test_sched, "other", task_c, SCHED_PRIO_HOUSEKEEP, 5);
+  check(again == id, name, "a finished one-shot's slot is re-used by name");
+  check(other != id, name, "another name gets its own slot");
+  check(sched_once(&test_sched, "other", task_c, SCHED_PRIO_HOUSEKEEP, 5) != other, name,
+        "a pending one-shot is not overwritten");
+
+  sched_cancel(&test_sched, other);
+  fake_us += 5000;
+  rearm_left = 1;
+  run_order[0] = 0;
+  run_count = 0;
+  sched_run(&test_sched);
+  sched_run(&test_sched);
+  check_order(name, "RC");          // the cancelled one does not run, the second "other" does
+
+  test_setup(2000000);
+  for (i = 0; i < SCHED_MAX_TASKS; i++) {
+    snprintf(task_name[i], sizeof(task_name[i]), "t%d", i);
+    sched_every(&test_sched, task_name[i], task_nothing, SCHED_PRIO_DISPLAY, 100, 0);
+  }
+  check(sched_once(&test_sched, "full", task_a, SCHED_PRIO_DISPLAY, 5) == -1, name, "a full table is refused");
+  check(sched_every(&test_sched, "zero", task_a, SCHED_PRIO_DISPLAY, 0, 0) == -1, name, "a periodic task needs a period");
+}
+
+static void test_wrap() {
+  const char *name = "wrap";
+  uint32_t due_us;
+  int tick, once;
+
+  test_setup(0xFFFFFFFFUL - 30000 + 1);     // 30 mS before micros() wraps
+  tick = sched_every(&test_sched, "tick", task_a, SCHED_PRIO_CONTROL, 10, 0);
+  once = sched_once(&test_sched, "once", task_b, SCHED_PRIO_HOUSEKEEP, 45);
+  check(test_sched.task[once].due_us < 20000, name, "the one-shot is due after the wrap");
+
+  for (int ms = 0; ms < 100; ms++) {
+    sched_run(&test_sched);
+    if (ms == 44) {
+      check(strchr(run_order, 'B') == NULL, name, "nothing due after the wrap runs before it");
+      check(sched_next_due(&test_sched, &due_us) && (due_us == test_sched.task[once].due_us), name,
+            "next due found across the wrap");
+    }
+    fake_us += 1000;
+  }
+  check(test_sched.task[tick].runs == 10, name, "every 10 mS deadline met across the wrap");
+  check((test_sched.task[tick].skipped == 0) && (test_sched.task[tick].late_max_us == 0), name,
+        "no skips or lateness at the wrap");
+  check((test_sched.task[once].runs == 1) && (test_sched.task[once].late_max_us == 0), name,
+        "the one-shot ran once, on time");
+  check_order(name, "AAAAABAAAAA");
+}
+
+static uint64_t bench_now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench(long passes, uint32_t pass_us) {
+  char summary[400];
+  uint64_t t0, ns;
+  long ran;
+
+  test_setup(0);
+  // as setup() in donKcar_metro_esp32s2.ino registers them
+  sched_every(&test_sched, "hbeat", task_nothing, SCHED_PRIO_SAFETY, 500, 0);
+  sched_every(&test_sched, "battE", task_nothing, SCHED_PRIO_HOUSEKEEP, 60000, 233);
+  sched_every(&test_sched, "battM", task_nothing, SCHED_PRIO_HOUSEKEEP, 60000, 468);
+  sched_every(&test_sched, "menu", task_nothing, SCHED_PRIO_HOUSEKEEP, 1000, 0);
+  sched_every(&test_sched, "sendE", task_nothing, SCHED_PRIO_DISPLAY, 60000, 570);
+  sched_every(&test_sched, "sendM", task_nothing, SCHED_PRIO_DISPLAY, 60000, 1540);
+  sched_every(&test_sched, "msg", task_nothing, SCHED_PRIO_DISPLAY, 100, 263);
+
+  ran = 0;
+  t0 = bench_now_ns();
+  for (long i = 0; i < passes; i++) {
+    ran += sched_run(&test_sched);
+    fake_us += pass_us;
+  }
+  ns = bench_now_ns() - t0;
+  sched_summary(&test_sched, summary, sizeof(summary));
+  printf("bench: %ld passes of %u uS (%.0f S of loop()), %ld tasks run, %d in the table\n",
+         passes, pass_us, (double) passes * pass_us / 1e6, ran, test_sched.count);
+  printf("  sched_run(): %.1f nS per pass\n", (double) ns / passes);
+  printf("  summary: %s\n", summary);
+}
+
+int main(int argc, char *argv[]) {
+  long passes = 1000000;
+  uint32_t pass_us = 200;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:p:")) != -1) {
+    switch (opt) {
+      case 'n':
+        passes = atol(optarg);
+        break;
+      case 'p':
+        pass_us = (uint32_t) atol(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n bench_passes] [-p pass_us]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  test_order();
+  test_skip();
+  test_oneshot();
+  test_wrap();
+  printf("%s: %d check(s) failed\n", (failures == 0) ? "ok" : "FAILED", failures);
+  if (passes > 0) {
+    bench(passes, pass_us);
+  }
+  return (failures == 0) ? 0 : 2;
+}
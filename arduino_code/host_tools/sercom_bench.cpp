@@ -0,0 +1,342 @@
+/*
+ * Summary: openMV + esp32 based autonomous racer
+ * 
+ * Author(s):  Don Korte
+ * Repository: https://github.com/dnkorte/DonKCar
+ *
+ * MIT License
+ * Copyright (c) 2023 Don Korte
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. * 
+ */
+
+/*
+ * ***********************************************************************************
+ * PC benchmark of the two ways of taking camera bytes off the UART: one
+ * sercom1_read() per byte (as cam_loop() used to), against sercom1_poll() moving
+ * them into the ring in bulk and the parser taking whole spans
+ *
+ * build:
+ *   g++ -O2 -iquote ../donKcar_metro_esp32s2 sercom_bench.cpp \
+ *       ../donKcar_metro_esp32s2/cam_parser.cpp -o sercom_bench -lpthread
+ *
+ * run:
+ *   ./sercom_bench [-s seconds] [-p pass_us] [-n repeats] [baud ...]
+ * (bauds default to 230400 and 921600)
+ *
+ * the UART driver is stood in for by a class with the same virtual
+ * available() / read() / read(buf, len) calls as HardwareSerial, over a ring
+ * of SERCOM1_RX_DRIVER_SIZE bytes; like the ESP32 core each call takes a lock.
+ * the camera stream (a steering frame every 100 mS, picture chunks filling the
+ * rest of the link) arrives into it at the given baud, and loop() comes round
+ * every -p uS to take what is there.  the ring and poll code are the steps of
+ * sercom1_poll() / sercom1_rx_span() in serial_com_esp32.cpp, and both ways
+ * feed the real cam_parser.cpp.
+ *
+ * it prints the CPU nS per byte of each way (the receive path only, not the
+ * simulated arrival) and the bytes taken per loop() pass.  a PC is many times
+ * faster than the ESP32-S2 and its locks are cheaper, so use the ratio
+ * ***********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <vector>
+#include "cam_parser.h"
+
+#define BENCH_STEER_MS      100     // camera_code_v5.py nextSendData
+#define BENCH_MSG_STEER     1       // MSG_STEERANGLE (cam.h)
+#define BENCH_MSG_CHUNK     6       // MSG_IMG_CHUNK (cam.h)
+
+#define BENCH_RING_SIZE     1024    // SERCOM1_RX_RING_SIZE (serial_com_esp32.h)
+#define BENCH_DRIVER_SIZE   4096    // SERCOM1_RX_DRIVER_SIZE with CAM_BAUD_NEGOTIATE
+
+/*
+ * the UART driver's receive buffer, behind the calls HardwareSerial makes virtual
+ */
+class BenchStream {
+public:
+  virtual int available();
+  virtual int read();
+  virtual size_t read(uint8_t *buf, size_t len);
+  void arrive(const uint8_t *bytes, int len);
+  uint32_t dropped;
+
+  BenchStream() : dropped(0), head(0), tail(0) {
+    pthread_mutex_init(&lock, NULL);
+  }
+
+private:
+  uint8_t  buf[BENCH_DRIVER_SIZE];
+  uint32_t head, tail;
+  pthread_mutex_t lock;
+};
+
+int BenchStream::available() {
+  int n;
+
+  pthread_mutex_lock(&lock);
+  n = (int) (head - tail);
+  pthread_mutex_unlock(&lock);
+  return n;
+}
+
+int BenchStream::read() {
+  int c = -1;
+
+  pthread_mutex_lock(&lock);
+  if (head != tail) {
+    c = buf[tail++ % BENCH_DRIVER_SIZE];
+  }
+  pthread_mutex_unlock(&lock);
+  return c;
+}
+
+size_t BenchStream::read(uint8_t *out, size_t len) {
+  size_t n = 0;
+
+  pthread_mutex_lock(&lock);
+  while ((n < len) && (head != tail)) {
+    out[n++] = buf[tail++ % BENCH_DRIVER_SIZE];
+  }
+  pthread_mutex_unlock(&lock);
+  return n;
+}
+
+void BenchStream::arrive(const uint8_t *bytes, int len) {
+  for (int i=0; i<len; i++) {
+    if ((head - tail) >= BENCH_DRIVER_SIZE) {
+      dropped++;
+    } else {
+      buf[head++ % BENCH_DRIVER_SIZE] = bytes[i];
+    }
+  }
+}
+
+BenchStream *bench_uart;   // a pointer, so calls go through the vtable as Serial1's do
+
+uint8_t  bench_ring[BENCH_RING_SIZE];
+uint32_t bench_ring_head;
+uint32_t bench_ring_tail;
+
+/*
+ * the old path: cam_loop() as it was before the ring
+ */
+static void bench_per_byte(CamParser *p) {
+  uint8_t c;
+
+  while (bench_uart->available()) {
+    c = (uint8_t) bench_uart->read();
+    cam_parser_feed(p, &c, 1);
+  }
+}
+
+/*
+ * sercom1_poll() as in serial_com_esp32.cpp
+ */
+static int bench_poll() {
+  int waiting, space, piece, got, total;
+  uint32_t head_index;
+
+  waiting = bench_uart->available();
+  total = 0;
+  while (waiting > 0) {
+    space = BENCH_RING_SIZE - (int) (bench_ring_head - bench_ring_tail);
+    if (space <= 0) {
+      break;
+    }
+    head_index = bench_ring_head & (BENCH_RING_SIZE - 1);
+    piece = BENCH_RING_SIZE - head_index;
+    if (piece > space) {
+      piece = space;
+    }
+    if (piece > waiting) {
+      piece = waiting;
+    }
+    got = (int) bench_uart->read(&bench_ring[head_index], piece);
+    if (got <= 0) {
+      break;
+    }
+    bench_ring_head += got;
+    total += got;
+    waiting -= got;
+  }
+  return total;
+}
+
+/*
+ * cam_loop(), with sercom1_rx_span() and sercom1_rx_consume() as in serial_com_esp32.cpp
+ */
+static void bench_bulk(CamParser *p) {
+  uint32_t tail_index;
+  int num_bytes;
+
+  while (bench_poll() > 0) {
+    while ((num_bytes = (int) (bench_ring_head - bench_ring_tail)) > 0) {
+      tail_index = bench_ring_tail & (BENCH_RING_SIZE - 1);
+      if (num_bytes > (int) (BENCH_RING_SIZE - tail_index)) {
+        num_bytes = BENCH_RING_SIZE - tail_index;
+      }
+      cam_parser_feed(p, &bench_ring[tail_index], num_bytes);
+      bench_ring_tail += num_bytes;
+    }
+  }
+}
+
+static uint64_t bench_now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void bench_append_frame(std::vector<uint8_t> &out, uint8_t msg_type, uint8_t seq, const uint8_t *payload, int len) {
+  uint8_t frame[CAM_MAX_FRAME];
+  int n;
+
+  n = cam_frame_encode(frame, msg_type, seq, payload, len);
+  out.insert(out.end(), frame, frame + n);
+}
+
+/*
+ * what the camera sends at this baud: a steering frame every BENCH_STEER_MS,
+ * picture chunks in between
+ */
+static void bench_synthetic(std::vector<uint8_t> &out, uint32_t baud, double seconds) {
+  uint8_t payload[CAM_MAX_PAYLOAD];
+  size_t per_tick = (baud / 10) * BENCH_STEER_MS / 1000;
+  size_t tick_end;
+  uint8_t seq = 0;
+
+  out.clear();
+  for (uint32_t t_ms = 0; t_ms < (uint32_t) (seconds * 1000); t_ms += BENCH_STEER_MS) {
+    tick_end = out.size() + per_tick;
+    for (int i=0; i<10; i++) {
+      payload[i] = (uint8_t) rand();
+    }
+    bench_append_frame(out, BENCH_MSG_STEER, 0, payload, 10);
+    while (out.size() + CAM_MAX_FRAME <= tick_end) {
+      for (int i=0; i<CAM_MAX_PAYLOAD; i++) {
+        payload[i] = (uint8_t) rand();
+      }
+      bench_append_frame(out, BENCH_MSG_CHUNK, seq++, payload, CAM_MAX_PAYLOAD);
+    }
+  }
+}
+
+/*
+ * runs the stream through one of the two paths, one loop() pass every pass_us;
+ * returns the receive path's CPU nS
+ */
+static uint64_t bench_run(const std::vector<uint8_t> &stream, uint32_t baud, uint32_t pass_us, bool bulk, 
+                          uint32_t *frames, uint32_t *dropped) {
+  BenchStream uart;
+  CamParser p;
+  uint64_t ns = 0;
+  uint64_t t0;
+  size_t pos = 0;
+  size_t due;
+  uint64_t t_us = 0;
+
+  bench_uart = &uart;
+  bench_ring_head = 0;
+  bench_ring_tail = 0;
+  cam_parser_init(&p, NULL, NULL);
+  while (pos < stream.size()) {
+    t_us += pass_us;
+    due = (size_t) (t_us * (baud / 10) / 1000000);
+    if (due > stream.size()) {
+      due = stream.size();
+    }
+    uart.arrive(&stream[pos], (int) (due - pos));
+    pos = due;
+
+    t0 = bench_now_ns();
+    if (bulk) {
+      bench_bulk(&p);
+    } else {
+      bench_per_byte(&p);
+    }
+    ns += bench_now_ns() - t0;
+  }
+  *frames = p.numGoodMessages;
+  *dropped = uart.dropped;
+  return ns;
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<uint8_t> stream;
+  std::vector<uint32_t> bauds;
+  double seconds = 30;
+  uint32_t pass_us = 2000;
+  uint32_t frames, dropped;
+  uint64_t ns_byte, ns_bulk;
+  int repeats = 5;
+  int opt, r;
+
+  srand(1);
+  while ((opt = getopt(argc, argv, "s:p:n:")) != -1) {
+    switch (opt) {
+      case 's':
+        seconds = atof(optarg);
+        break;
+      case 'p':
+        pass_us = (uint32_t) atol(optarg);
+        break;
+      case 'n':
+        repeats = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-s seconds] [-p pass_us] [-n repeats] [baud ...]\n", argv[0]);
+        return 1;
+    }
+  }
+  if ((seconds <= 0) || (pass_us < 1) || (repeats < 1)) {
+    fprintf(stderr, "usage: %s [-s seconds] [-p pass_us] [-n repeats] [baud ...]\n", argv[0]);
+    return 1;
+  }
+  for (; optind < argc; optind++) {
+    bauds.push_back((uint32_t) atol(argv[optind]));
+  }
+  if (bauds.empty()) {
+    bauds.push_back(230400);
+    bauds.push_back(921600);
+  }
+
+  printf("%.0f s of camera stream, loop() every %lu uS, mean of %d runs\n", seconds, (unsigned long) pass_us, repeats);
+  printf("     baud  bytes/pass   per-byte nS/B   bulk nS/B   speedup   frames  dropped\n");
+  for (size_t b=0; b<bauds.size(); b++) {
+    bench_synthetic(stream, bauds[b], seconds);
+    ns_byte = 0;
+    ns_bulk = 0;
+    for (r=0; r<repeats; r++) {
+      ns_byte += bench_run(stream, bauds[b], pass_us, false, &frames, &dropped);
+      ns_bulk += bench_run(stream, bauds[b], pass_us, true, &frames, &dropped);
+    }
+    printf("  %7lu  %10.0f  %14.2f  %10.2f  %7.1fx  %7lu  %7lu\n", (unsigned long) bauds[b], 
+           (bauds[b] / 10.0) * pass_us / 1e6, (double) ns_byte / repeats / stream.size(), 
+           (double) ns_bulk / repeats / stream.size(), (ns_bulk > 0) ? ((double) ns_byte / ns_bulk) : 0.0,
+           (unsigned long) frames, (unsigned long) dropped);
+  }
+  return 0;
+}
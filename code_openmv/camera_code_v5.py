@@ -57,7 +57,8 @@ rho = 0
 theta = 0
 
 lastServoCmdVal = 0
-out_buf = bytearray(10)
+steer_seq = 0       # counts steering messages (1-255) so the robot can notice lost ones
+frame_ms = 0        # pyb.millis() when the current image was taken
 clock = time.clock() # Tracks FPS
 
 #commands.set_mode('R', sensor)              #  TEMPORARY FOR DEBUGGING --------------------
@@ -73,6 +74,7 @@ while(True):
         img = sensor.snapshot().histeq() # Take a picture and return the image. The "histeq()" function does a histogram equalization to compensate for lighting changes
     else:
         img = sensor.snapshot() # Take a picture and return the image. The "histeq()" function does a histogram equalization to compensate for lighting changes
+    frame_ms = pyb.millis()
 
     if utility.get_negate_wanted():
         img.negate()
@@ -106,24 +108,22 @@ while(True):
         nextPID = now + 20
         if (commands.get_mode() == 'B'):
             angle_error, servo_angle = mypid.update_pid(target_angle)
+            if commands.get_drive_ready():
+                mypid.clear_i_term()    # the robot is standing by, not steering; nothing to integrate
 
 
     if (now > nextSendData) and (commands.get_mode() == 'B') and (commands.get_send_driving_info()):
         nextSendData = now + 100
-        notused = 0
-        checksum = 0
         # note PID function returns number between -50 and +50, so we scale it by 5 to get +/- 250 for servo command
         #servo_cmd_val = utility.constrain( (mypid.get_pid_steering_gain() * mypid.get_pid_steering_direction() * servo_angle), -255, 255)
         servo_cmd_val = utility.constrain( (5 * mypid.get_pid_steering_direction() * servo_angle), -255, 255)
         #if (abs(servo_cmd_val - lastServoCmdVal) > 2):
         #if (int(servo_cmd_val) != int(lastServoCmdVal)):
         if True:
-            out_buf = ustruct.pack("<bbhhhbb", 0xAA, 1, int(servo_cmd_val), int(angle_error), int(target_angle), checksum, 0xA8)
-            for i in range(1, 8, 1):
-                checksum += out_buf[i]
-            checksum = checksum & 0xFF
-            out_buf = ustruct.pack("<bbhhhbb", 0xAA, 1, int(servo_cmd_val), int(angle_error), int(target_angle), checksum, 0xA8)
-            communicator.write_buf(out_buf)
+            # the image time lets the robot measure how old this steering command is
+            steer_seq = (steer_seq % 255) + 1
+            out_buf = ustruct.pack("<hhhI", int(servo_cmd_val), int(angle_error), int(target_angle), frame_ms & 0xFFFFFFFF)
+            communicator.send_frame(communicator.MSG_STEERANGLE, out_buf, steer_seq)
 
             lastServoCmdVal = servo_cmd_val
 
@@ -131,6 +131,13 @@ while(True):
                 print("sent message:", str(int(servo_cmd_val)), str(int(target_angle)))
 
     communicator.check_for_commands(sensor, img)
+    # picture chunks go in the time left before the next steering frame; that frame
+    # goes out after the next snapshot is processed, which takes about as long as 
+    # this one did
+    if (commands.get_mode() == 'B') and (commands.get_send_driving_info()):
+        communicator.service_image(nextSendData - (pyb.millis() - frame_ms))
+    else:
+        communicator.service_image()
 
     if (now > nextDebug) and (wantDebug):
         nextDebug = now + 1000
@@ -5,7 +5,6 @@
 
 import pyb, math, time
 import ustruct
-import ubinascii
 import communicator  # this is a "local library" and must be manually stored on OpenMV cam root folder
 import blob_tracker  # this is a "local library" and must be manually stored on OpenMV cam root folder
 import color_tracker # this is a "local library" and must be manually stored on OpenMV cam root folder
@@ -44,6 +43,14 @@ CMD_BLOB_SET_LUMI_LOW = 26
 CMD_BLOB_SET_LUMI_HIGH = 27
 CMD_HISTEQ_WANTED = 28
 CMD_NEGATE_WANTED = 29
+CMD_PARAM_BLOCK = 30
+CMD_RESEND_CHUNK = 31
+CMD_RESEND_FROM = 32
+CMD_SET_BAUD = 33
+CMD_LINK_TEST = 34
+CMD_TIME_PING = 35
+CMD_DRIVE_READY = 36
+CMD_SESSION = 37
 
 red_led = pyb.LED(1)
 green_led = pyb.LED(2)
@@ -51,12 +58,14 @@ blue_led = pyb.LED(3)
 ir_leds = pyb.LED(4)
 
 send_driving_info = None    # true to send periodic steering commands to main (from PID)
+drive_ready = False         # ... but the robot is only standing by (CMD_DRIVE_READY), so the PID holds its I term
 mode = None
 
 def init_commands(sensor):
     set_mode('I', sensor)
     set_send_driving_info(False)
 
+# returns True if the command was understood (and carried out), False if not
 def process_cmd(cmd_char, sensor, img):
     if cmd_char == CMD_MODE_IDLE:          # blue LED
         set_mode('I', sensor)
@@ -71,12 +80,24 @@ def process_cmd(cmd_char, sensor, img):
     elif cmd_char == CMD_MODE_GRAYSCALE:   # white LED for GRAYSCALE mode
         set_mode('G', sensor)
     elif cmd_char == CMD_SEND_PIC:
-        # start = pyb.millis()
-        base64_data = ubinascii.b2a_base64(img.compress(quality=90))
-        communicator.write_buf(base64_data)
-        # end = pyb.millis()
+        # binary JPEG in chunks; the robot does any base64 encoding itself
+        communicator.send_image(bytes(img.compress(quality=90)))
+    elif cmd_char == CMD_RESEND_CHUNK:
+        return communicator.send_image_chunk(communicator.get_int_param1(), communicator.get_int_param2())
+    elif cmd_char == CMD_RESEND_FROM:
+        return communicator.send_image_from(communicator.get_int_param1(), communicator.get_int_param2())
+    elif cmd_char == CMD_SET_BAUD:
+        return communicator.request_baud(communicator.get_payload())
+    elif cmd_char == CMD_LINK_TEST:
+        return communicator.link_test(communicator.get_payload())
+    elif cmd_char == CMD_TIME_PING:
+        return communicator.time_pong(communicator.get_payload())
+    elif cmd_char == CMD_SESSION:
+        return communicator.new_session(communicator.get_payload())
     elif cmd_char == CMD_DRIVE_ON:
         set_send_driving_info(True)
+    elif cmd_char == CMD_DRIVE_READY:
+        set_send_driving_info(True, ready=True)
     elif cmd_char == CMD_DRIVE_OFF:
         set_send_driving_info(False)
     elif cmd_char == CMD_BLOB_SET_SEED_LOC:
@@ -119,9 +140,42 @@ def process_cmd(cmd_char, sensor, img):
         utility.set_negate_wanted(communicator.get_int_param1())
     elif cmd_char == CMD_BLOB_SET_LUMI_LOW:
         color_tracker.set_lumi_low(communicator.get_int_param1())
-    elif cmd_char == CMD_BLOB_SET_LUMI_LOW:
+    elif cmd_char == CMD_BLOB_SET_LUMI_HIGH:
         color_tracker.set_lumi_high(communicator.get_int_param1())
-
+    elif cmd_char == CMD_PARAM_BLOCK:
+        return set_param_block(communicator.get_payload())
+    else:
+        return False
+    return True
+
+# all tuning parameters in one message; layout must match cam_preset_paremeters() on the robot
+def set_param_block(payload):
+    if len(payload) < 66:
+        return False
+    (wt_t, wt_m, wt_b, float_thresh, seed_thresh, kp, ki, kd, steering_gain, persp_factor,
+        loc_t, ht_t, loc_m, ht_m, loc_b, ht_b, seed_loc, steering_dir,
+        lumi_low, lumi_high, histeq, negate, persp_wanted) = ustruct.unpack('<10f13h', payload)
+    color_tracker.adjust_roi_weight(0, wt_t)
+    color_tracker.adjust_roi_weight(1, wt_m)
+    color_tracker.adjust_roi_weight(2, wt_b)
+    color_tracker.adjust_roi_position(0, loc_t, ht_t)
+    color_tracker.adjust_roi_position(1, loc_m, ht_m)
+    color_tracker.adjust_roi_position(2, loc_b, ht_b)
+    color_tracker.adjust_floating_threshold(float_thresh)
+    color_tracker.adjust_seed_threshold(seed_thresh)
+    color_tracker.adjust_seed_loc_y(seed_loc)
+    mypid.set_pid_kp(kp)
+    mypid.set_pid_ki(ki)
+    mypid.set_pid_kd(kd)
+    mypid.set_pid_steering_gain(steering_gain)
+    mypid.set_pid_steering_direction(steering_dir)
+    utility.set_perspective_factor(persp_factor)
+    color_tracker.set_lumi_low(lumi_low)
+    color_tracker.set_lumi_high(lumi_high)
+    utility.set_histeq_wanted(histeq)
+    utility.set_negate_wanted(negate)
+    utility.set_perspective_correction(persp_wanted != 0)
+    return True
 
 # modes may be 'I' (idle), 'B' (blobs), 'L' (lines), 'G' (grayscale)
 def set_mode(newmode, sensor):
@@ -181,10 +235,15 @@ def set_LED_off():
     green_led.off()
     blue_led.off()
 
-def set_send_driving_info(newstate):
-    global send_driving_info
+def set_send_driving_info(newstate, ready=False):
+    global send_driving_info, drive_ready
     send_driving_info = newstate
+    drive_ready = ready
 
 def get_send_driving_info():
     global send_driving_info
     return send_driving_info
+
+def get_drive_ready():
+    global drive_ready
+    return drive_ready
@@ -16,24 +16,253 @@ FSM_EXPECTING_STOP = 2
 MSG_SET_MODE = 0
 MSG_SEND_PIC = 1
 
+# message types sent from camera to main (must match cam.h on the robot)
+# they travel on two logical channels, told apart by type:
+#   control -- steering, telemetry, ACK / NACK and picture headers; small, and
+#              always sent as soon as they are ready
+#   image   -- picture chunks; sent from service_image() in whatever time the
+#              link has before the next control frame is due
+MSG_STEERANGLE = 1
+MSG_TELEMETRY = 2
+MSG_ACK = 3
+MSG_NACK = 4
+MSG_IMG_HEADER = 5
+MSG_IMG_CHUNK = 6
+MSG_LINK_TEST = 7           # control channel (one a second as a keep-alive, or a burst while testing)
+MSG_TIME_PONG = 8           # control channel (answer to CMD_TIME_PING, a few a second)
+
+# frame format (must match cam_parser.h on the robot); see cam.cpp for layout
+#   START, version, type, seq, length, payload[length], crc lsb, crc msb, END
 ECOMM_START_CHAR = 0xAA
 ECOMM_END_CHAR = 0xA8
-ECOMM_MESSAGE_LENGTH_ENHANCED = 8
+ECOMM_PROTOCOL_VERSION = 2
+ECOMM_HEADER_LENGTH = 5
+ECOMM_TRAILER_LENGTH = 3
+ECOMM_MAX_PAYLOAD = 128     # largest payload is MSG_IMG_CHUNK
+ECOMM_MAX_FRAME = ECOMM_HEADER_LENGTH + ECOMM_MAX_PAYLOAD + ECOMM_TRAILER_LENGTH
 
 ecomm_param_int_1 = None
 ecomm_param_int_2 = None
 ecomm_param_float = None
+ecomm_payload = b''
+ecomm_recent_seqs = []      # (sequence number, answer) of the last few commands carried out
+ECOMM_RECENT_SEQS = 8
+ecomm_session = 0           # the robot's CMD_SESSION id; a new one clears ecomm_recent_seqs
+ecomm_frame_length = 0
+
+# pictures go out as a header then fixed size chunks (see cam_image.h on the robot);
+# the last one is kept so that chunks the robot missed can be sent again.  chunks
+# are sent a few per pass of the main loop (service_image()) so that steering
+# frames keep going out on time while a picture is on its way
+IMG_CHUNK_SIZE = 120        # must be a multiple of 3 (robot base64-encodes chunk by chunk)
+IMG_CHUNKS_PER_PASS = 6     # about 30 mS of the link at 230400 baud
+IMG_MIN_CHUNKS_PER_PASS = 1 # sent even when a control frame is due, so a picture always gets there
+IMG_CHUNK_FRAME = 136       # bytes on the link for one chunk frame (128 + 8)
+IMG_PASS_BYTES = 2048       # at faster rates, up to this much picture per pass (the robot's UART buffer is 4096)
+ecomm_chunk_ms = 6          # link time of one chunk frame (set by set_link_timing())
+ecomm_chunks_per_pass = IMG_CHUNKS_PER_PASS
+ecomm_image = None
+ecomm_image_id = 0
+ecomm_image_next = -1       # next chunk service_image() sends, -1 when there is none
+
+# link speed (see cam_negotiate_baud() on the robot).  the link starts at
+# ECOMM_BAUD_BASE; CMD_SET_BAUD moves it to one of ECOMM_BAUD_RATES (the ACK
+# goes out at the old rate, then we switch) and CMD_LINK_TEST checks it with
+# pattern frames.  at a faster rate, if no good frame comes in for a while we
+# go back to the base rate by ourselves -- that is where the robot starts over
+# after a fallback or a reset
+ECOMM_BAUD_BASE = 230400
+ECOMM_BAUD_RATES = (230400, 921600, 2000000)
+ECOMM_BAUD_CONFIRM_MS = 500     # the first good frame must come this soon after a switch
+ECOMM_BAUD_LOST_MS = 3000       # ... and then at least this often (the robot sends one a second)
+LINK_TEST_PATTERN_LEN = 120
+LINK_TEST_MAX_FRAMES = 64
+ecomm_baud = ECOMM_BAUD_BASE
+ecomm_baud_pending = 0          # rate to switch to once the ACK is out
+ecomm_baud_deadline = 0
+ecomm_baud_errors = 0           # errors counted before the rate was set
+ecomm_link_pattern_errors = 0
+
+uart = pyb.UART(3, ECOMM_BAUD_BASE, timeout_char=1000)
+ecomm_buffer = bytearray(ECOMM_MAX_FRAME)
+
+# CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) -- same as cam_crc16() on the robot
+# table driven (one lookup per byte) since every picture byte goes through it
+def make_crc16_table():
+    table = []
+    for n in range(256):
+        crc = n << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+        table.append(crc)
+    return table
+
+crc16_table = make_crc16_table()
+
+def crc16(buf, start, end):
+    crc = 0xFFFF
+    for i in range(start, end):
+        crc = ((crc << 8) & 0xFFFF) ^ crc16_table[(crc >> 8) ^ buf[i]]
+    return crc
+
+# builds a complete frame around the payload (a bytes or bytearray)
+def build_frame(msg_type, payload, seq=0):
+    n = len(payload)
+    frame = bytearray(ECOMM_HEADER_LENGTH + n + ECOMM_TRAILER_LENGTH)
+    frame[0] = ECOMM_START_CHAR
+    frame[1] = ECOMM_PROTOCOL_VERSION
+    frame[2] = msg_type
+    frame[3] = seq
+    frame[4] = n
+    frame[ECOMM_HEADER_LENGTH:ECOMM_HEADER_LENGTH + n] = payload
+    crc = crc16(frame, 1, ECOMM_HEADER_LENGTH + n)
+    frame[ECOMM_HEADER_LENGTH + n] = crc & 0xFF
+    frame[ECOMM_HEADER_LENGTH + n + 1] = (crc >> 8) & 0xFF
+    frame[ECOMM_HEADER_LENGTH + n + 2] = ECOMM_END_CHAR
+    return frame
+
+def send_frame(msg_type, payload, seq=0):
+    uart.write(build_frame(msg_type, payload, seq))
+
+# starts sending a compressed (JPEG) picture: the header now, then the chunks
+# in order from service_image()
+def send_image(jpg):
+    global ecomm_image, ecomm_image_id, ecomm_image_next
+    ecomm_image = jpg
+    ecomm_image_id = (ecomm_image_id + 1) & 0xFFFF
+    n = len(jpg)
+    num_chunks = (n + IMG_CHUNK_SIZE - 1) // IMG_CHUNK_SIZE
+    send_frame(MSG_IMG_HEADER, ustruct.pack('<HIHH', ecomm_image_id, n, IMG_CHUNK_SIZE, num_chunks))
+    ecomm_image_next = 0
+
+# called once per pass of the main loop; sends the next few chunks of the picture.
+# control_due_ms is when (pyb.millis()) the next control frame must be able to go
+# out, or None when none is expected; no chunk is started that would still be on
+# the link then (past the first IMG_MIN_CHUNKS_PER_PASS), so a picture never
+# delays a steering frame by more than about one chunk
+def service_image(control_due_ms=None):
+    global ecomm_image_next
+    if ecomm_image_next < 0:
+        return
+    for n in range(ecomm_chunks_per_pass):
+        if (n >= IMG_MIN_CHUNKS_PER_PASS) and (control_due_ms is not None) and (control_due_ms - pyb.millis() < ecomm_chunk_ms):
+            return
+        if not send_image_chunk(ecomm_image_id, ecomm_image_next):
+            ecomm_image_next = -1
+            return
+        ecomm_image_next += 1
+
+# (re)sends one chunk of the last picture; False if there is no such chunk
+def send_image_chunk(image_id, index):
+    if (ecomm_image is None) or (image_id != ecomm_image_id):
+        return False
+    start = index * IMG_CHUNK_SIZE
+    if (index < 0) or (start >= len(ecomm_image)):
+        return False
+    chunk = ecomm_image[start:start + IMG_CHUNK_SIZE]
+    send_frame(MSG_IMG_CHUNK, ustruct.pack('<HH', image_id, index) + chunk)
+    return True
+
+# (re)sends the last picture from chunk index to the end (a robot that streams
+# the picture on as it comes can only use chunks in order); service_image() 
+# carries on from there
+def send_image_from(image_id, index):
+    global ecomm_image_next
+    if (ecomm_image is None) or (image_id != ecomm_image_id) or (index < 0) or (index * IMG_CHUNK_SIZE >= len(ecomm_image)):
+        return False
+    ecomm_image_next = index
+    return True
 
-uart = pyb.UART(3, 230400, timeout_char=1000)
-ecomm_buffer = bytearray(ECOMM_MESSAGE_LENGTH_ENHANCED)
+# how long a chunk frame is on the link, and how many to send per pass, at baud
+def set_link_timing(baud):
+    global ecomm_chunk_ms, ecomm_chunks_per_pass
+    ecomm_chunk_ms = (IMG_CHUNK_FRAME * 10000) // baud + 1
+    if baud == ECOMM_BAUD_BASE:
+        ecomm_chunks_per_pass = IMG_CHUNKS_PER_PASS
+    else:
+        ecomm_chunks_per_pass = IMG_PASS_BYTES // IMG_CHUNK_FRAME
+
+# CMD_SET_BAUD: payload is the rate (uint32); the switch itself is made in
+# check_for_commands() once the ACK has gone out
+def request_baud(payload):
+    global ecomm_baud_pending
+    if len(payload) < 4:
+        return False
+    baud = ustruct.unpack('<I', payload[0:4])[0]
+    if baud not in ECOMM_BAUD_RATES:
+        return False
+    ecomm_baud_pending = baud
+    return True
+
+def switch_baud(baud):
+    global ecomm_baud, ecomm_baud_pending, ecomm_baud_deadline, ecomm_baud_errors
+    global ecomm_next_buffer_index, ecomm_fsm_state
+    ecomm_baud_pending = 0
+    time.sleep_ms(2)            # let the last bytes leave at the old rate
+    uart.init(baud, timeout_char=1000)
+    ecomm_baud = baud
+    ecomm_baud_deadline = pyb.millis() + ECOMM_BAUD_CONFIRM_MS
+    ecomm_baud_errors = ecomm_num_error_framing + ecomm_num_error_checksum + ecomm_link_pattern_errors
+    ecomm_next_buffer_index = 0
+    ecomm_fsm_state = FSM_SEEKING_START
+    set_link_timing(baud)
+    print(" LINK BAUD", baud)
+
+# the test pattern for a test id (must match cam_link_pattern() on the robot)
+def link_pattern(test_id):
+    x = 0x9E3779B9 ^ test_id
+    pattern = bytearray(LINK_TEST_PATTERN_LEN)
+    for i in range(LINK_TEST_PATTERN_LEN):
+        x = (x * 1103515245 + 12345) & 0xFFFFFFFF
+        pattern[i] = (x >> 16) & 0xFF
+    return pattern
+
+# CMD_LINK_TEST: check the pattern the robot sent, then send back as many
+# MSG_LINK_TEST frames as it asked for, each with our error count since the
+# rate was set
+def link_test(payload):
+    global ecomm_link_pattern_errors
+    if len(payload) < 4:
+        return False
+    test_id, count = ustruct.unpack('<HH', payload[0:4])
+    pattern = link_pattern(test_id)
+    if payload[4:] != pattern:
+        ecomm_link_pattern_errors += 1
+    errors = (ecomm_num_error_framing + ecomm_num_error_checksum + ecomm_link_pattern_errors - ecomm_baud_errors) & 0xFFFF
+    for index in range(min(count, LINK_TEST_MAX_FRAMES)):
+        send_frame(MSG_LINK_TEST, ustruct.pack('<HHH', test_id, index, errors) + pattern)
+    return True
+
+# CMD_TIME_PING: send the robot's time straight back with ours on receipt and
+# on sending (see cam_clock.h on the robot).  our times are pyb.millis(), the
+# same clock that stamps the steering frames, so the robot can map those stamps
+# to its own time
+def time_pong(payload):
+    t_rx = pyb.millis()
+    if len(payload) < 4:
+        return False
+    send_frame(MSG_TIME_PONG, payload[0:4] + ustruct.pack('<II', t_rx, pyb.millis()))
+    return True
+
+# CMD_SESSION: the robot has (re)started and numbers its commands afresh, so
+# the sequence numbers of its last session must not count as repeats
+def new_session(payload):
+    global ecomm_session, ecomm_recent_seqs
+    if len(payload) < 2:
+        return False
+    session = payload[0] | (payload[1] << 8)
+    if session != ecomm_session:
+        ecomm_session = session
+        ecomm_recent_seqs = []
+    return True
 
 def init_communicator():
     global ecomm_next_buffer_index, ecomm_fsm_state, ecomm_msg_type_expected, ecomm_buffer
     global ecomm_num_good_messages, ecomm_num_error_framing, ecomm_num_error_checksum
-    global checksum_calculated
-    global FSM_SEEKING_START, FSM_COLLECTING_CHARS, FSM_EXPECTING_STOP
-    global MSG_SET_MODE, MSG_SEND_PIC
-    global ECOMM_START_CHAR, ECOMM_END_CHAR, ECOMM_MESSAGE_LENGTH
+    global ecomm_frame_length
 
     ecomm_next_buffer_index = 0
     ecomm_fsm_state = FSM_SEEKING_START
@@ -44,7 +273,7 @@ def init_communicator():
     ecomm_num_good_messages = 0
     ecomm_num_error_framing = 0
     ecomm_num_error_checksum = 0
-    checksum_calculated = 0
+    ecomm_frame_length = 0
 
 def write_buf(out_buf):
     uart.write(out_buf)
@@ -52,11 +281,9 @@ def write_buf(out_buf):
 def check_for_commands(sensor, img):
     global ecomm_next_buffer_index, ecomm_fsm_state, ecomm_msg_type_expected, ecomm_buffer
     global ecomm_num_good_messages, ecomm_num_error_framing, ecomm_num_error_checksum
-    global checksum_calculated
-    global FSM_SEEKING_START, FSM_COLLECTING_CHARS, FSM_EXPECTING_STOP
-    global MSG_SET_MODE, MSG_SEND_PIC
-    global ECOMM_START_CHAR, ECOMM_END_CHAR, ECOMM_MESSAGE_LENGTH
+    global ecomm_frame_length
     global ecomm_param_int_1, ecomm_param_int_2, ecomm_param_float
+    global ecomm_payload, ecomm_recent_seqs, ecomm_baud_deadline
 
     while uart.any() > 0:
         rcvd_char = uart.readchar()
@@ -65,45 +292,73 @@ def check_for_commands(sensor, img):
                 ecomm_fsm_state = FSM_COLLECTING_CHARS
                 ecomm_buffer[0] = rcvd_char
                 ecomm_next_buffer_index = 1
-                checksum_calculated = 0
+                ecomm_frame_length = 0
 
         elif (ecomm_fsm_state == FSM_COLLECTING_CHARS):
             # note START or STOP character is ok in middle of message
-            # when we reach the LAST expected char, it must be a STOP char
-            # if not, then we discard whole message and return to FSM_SEEKING_START
-            # if it IS a STOP character, then we check the message for valid checksum
-            # and parse it of checksum ok, else discard it
+            # once the header is in we know the frame length; a bad version or
+            # impossible length means we started on a data byte (framing error)
             # there is no ACK or NACK on messages or discarded messages, they just
             # disappear.
             ecomm_buffer[ecomm_next_buffer_index] = rcvd_char
-            if ((ecomm_next_buffer_index < ECOMM_MESSAGE_LENGTH_ENHANCED - 2)):
-                checksum_calculated += rcvd_char
             ecomm_next_buffer_index += 1
-            if (ecomm_next_buffer_index >= (ECOMM_MESSAGE_LENGTH_ENHANCED -1)):
+            if (ecomm_next_buffer_index == ECOMM_HEADER_LENGTH):
+                if (ecomm_buffer[1] != ECOMM_PROTOCOL_VERSION) or (ecomm_buffer[4] > ECOMM_MAX_PAYLOAD):
+                    ecomm_next_buffer_index = 0
+                    ecomm_fsm_state = FSM_SEEKING_START
+                    ecomm_num_error_framing += 1
+                    continue
+                ecomm_frame_length = ECOMM_HEADER_LENGTH + ecomm_buffer[4] + ECOMM_TRAILER_LENGTH
+            if (ecomm_frame_length > 0) and (ecomm_next_buffer_index >= (ecomm_frame_length - 1)):
                 # waiting for end character
                 ecomm_fsm_state = FSM_EXPECTING_STOP
-                ecomm_next_buffer_index = ECOMM_MESSAGE_LENGTH_ENHANCED - 1
 
         elif (ecomm_fsm_state == FSM_EXPECTING_STOP):
             if (rcvd_char == ECOMM_END_CHAR):
                 # successfully received END_CHAR as expected, so buffer is complete
-                # now verify checksum before accepting message
-                checksum_calculated = checksum_calculated & 0xFF
-                if (checksum_calculated != ecomm_buffer[ECOMM_MESSAGE_LENGTH_ENHANCED - 2]):
+                # now verify CRC before accepting message
+                n = ecomm_buffer[4]
+                crc_rcvd = ecomm_buffer[ECOMM_HEADER_LENGTH + n] | (ecomm_buffer[ECOMM_HEADER_LENGTH + n + 1] << 8)
+                if (crc_rcvd != crc16(ecomm_buffer, 1, ECOMM_HEADER_LENGTH + n)):
                     ecomm_next_buffer_index = 0
                     ecomm_fsm_state = FSM_SEEKING_START
                     ecomm_num_error_checksum += 1
                     print(" CHECKSUM FAILED")
                 else:
                     # here we capture parameters from message
-                    cmd = ecomm_buffer[1]
-                    ecomm_param_int_1 = ecomm_buffer[2] | (ecomm_buffer[3] << 8)
-                    ecomm_param_int_2 = ecomm_buffer[4] | (ecomm_buffer[5] << 8)
-                    aa = bytearray([ ecomm_buffer[2], ecomm_buffer[3], ecomm_buffer[4], ecomm_buffer[5] ])
-                    # note the ustruct.unpack returns a tuple with the floating point value in the first element
-                    ecomm_param_float = ustruct.unpack('<f', aa)[0]
+                    cmd = ecomm_buffer[2]
+                    p = ECOMM_HEADER_LENGTH
+                    ecomm_payload = bytes(ecomm_buffer[p:p + n])
+                    if (n >= 2):
+                        ecomm_param_int_1 = ecomm_buffer[p] | (ecomm_buffer[p + 1] << 8)
+                    if (n >= 4):
+                        ecomm_param_int_2 = ecomm_buffer[p + 2] | (ecomm_buffer[p + 3] << 8)
+                        # note the ustruct.unpack returns a tuple with the floating point value in the first element
+                        ecomm_param_float = ustruct.unpack('<f', ecomm_buffer[p:p + 4])[0]
                     # and call a function to actually DO the action requested
-                    commands.process_cmd(cmd, sensor, img)
+                    # sequenced commands (seq != 0) are answered with ACK or NACK; a repeat of one
+                    # we already carried out (our answer was lost) gets the same answer again,
+                    # and is not re-applied
+                    seq = ecomm_buffer[3]
+                    if ecomm_baud != ECOMM_BAUD_BASE:
+                        ecomm_baud_deadline = pyb.millis() + ECOMM_BAUD_LOST_MS
+                    answer = None
+                    if (seq != 0):
+                        for recent_seq, recent_answer in ecomm_recent_seqs:
+                            if recent_seq == seq:
+                                answer = recent_answer
+                    if answer is not None:
+                        send_frame(answer, b'', seq)
+                    else:
+                        ok = commands.process_cmd(cmd, sensor, img)
+                        if (seq != 0):
+                            answer = MSG_ACK if ok else MSG_NACK
+                            send_frame(answer, b'', seq)
+                            ecomm_recent_seqs.append((seq, answer))
+                            if len(ecomm_recent_seqs) > ECOMM_RECENT_SEQS:
+                                ecomm_recent_seqs.pop(0)
+                        if ecomm_baud_pending:
+                            switch_baud(ecomm_baud_pending)
 
                     # then close out the (good) message
                     ecomm_next_buffer_index = 0
@@ -116,6 +371,10 @@ def check_for_commands(sensor, img):
                     ecomm_fsm_state = FSM_SEEKING_START
                     ecomm_num_error_framing += 1
 
+    # nothing good for too long at a faster rate: go back to where the robot starts over
+    if (ecomm_baud != ECOMM_BAUD_BASE) and (pyb.millis() > ecomm_baud_deadline):
+        switch_baud(ECOMM_BAUD_BASE)
+
 def get_int_param1():
     global ecomm_param_int_1
     return ecomm_param_int_1
@@ -127,3 +386,8 @@ def get_int_param2():
 def get_float_param():
     global ecomm_param_float
     return ecomm_param_float
+
+# raw payload bytes of the last good command (for commands with more than 2 params)
+def get_payload():
+    global ecomm_payload
+    return ecomm_payload
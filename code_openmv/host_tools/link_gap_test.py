@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+#
+# worst-case steering gap on the camera link while pictures are being sent
+#
+# this runs on a PC (plain python 3, no extra packages).  it loads the camera's
+# own communicator.py with stand-ins for pyb (a simulated clock and a UART that
+# takes as long to write as the real one at --baud), ustruct and commands, and
+# drives it the way camera_code_v5.py does: each pass takes --pass-ms (+/-
+# --pass-jitter) to grab and process a snapshot, a steering frame goes out when
+# one is due (every 100 mS), then commands are read and picture chunks sent.
+# the robot asks for the next picture once the last one is in, but not more often
+# than every --pic-every mS (as the recorder and the MJPEG stream do).
+#
+# the bytes are timed onto the simulated link and the steering frames picked out
+# at the far end, so the gaps printed are what cam_stats on the robot would see.
+# each run is done three ways:
+#   none    -- no pictures, the baseline
+#   burst   -- a whole picture written in one go (as before chunks were paced)
+#   paced   -- communicator.service_image() as it is now
+#
+# examples:
+#   python3 link_gap_test.py
+#   python3 link_gap_test.py --pass-ms 60 --pic-size 16000 --seconds 120
+# exits 1 if pictures add more than --margin mS to the worst gap (paced against
+# none), so it can be used as a check
+#
+
+import argparse, os, random, struct, sys, types
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, '..'))
+
+STEER_PERIOD_MS = 100       # camera_code_v5.py nextSendData
+CMD_SEND_PIC = 4            # commands.py
+
+
+class Link:
+    """simulated clock, and the camera's UART onto a simulated wire"""
+    def __init__(self, baud):
+        self.ms_per_byte = 10000.0 / baud      # 8N1
+        self.now = 0.0
+        self.busy_until = 0.0
+        self.sent = []          # (time the last byte is on the wire, bytes)
+        self.rx = bytearray()   # robot-to-camera bytes waiting to be read
+
+    # pyb.UART.write() returns once the bytes are out, so the camera waits for them
+    def write(self, data):
+        start = max(self.now, self.busy_until)
+        self.busy_until = start + len(data) * self.ms_per_byte
+        self.sent.append((self.busy_until, bytes(data)))
+        self.now = self.busy_until
+        return len(data)
+
+    def any(self):
+        return len(self.rx)
+
+    def readchar(self):
+        c = self.rx[0]
+        del self.rx[0]
+        return c
+
+
+def load_communicator(link, pic_size):
+    pyb = types.ModuleType('pyb')
+    pyb.UART = lambda *args, **kwargs: link
+    pyb.millis = lambda: int(link.now)
+    sys.modules['pyb'] = pyb
+    sys.modules['ustruct'] = struct
+
+    commands = types.ModuleType('commands')
+    def process_cmd(cmd, sensor, img):
+        if cmd == CMD_SEND_PIC:
+            communicator.send_image(b'\xff\xd8' + os.urandom(pic_size) + b'\xff\xd9')
+            return True
+        return False
+    commands.process_cmd = process_cmd
+    sys.modules['commands'] = commands
+
+    sys.modules.pop('communicator', None)
+    import communicator
+    communicator.init_communicator()
+    return communicator
+
+
+# pulls the steering frames (and finished pictures) out of what went over the link
+def far_end(link, communicator):
+    steer_times = []
+    pics_done = 0
+    chunks = {}
+    for t, frame in link.sent:
+        msg_type = frame[2]
+        if msg_type == communicator.MSG_STEERANGLE:
+            steer_times.append(t)
+        elif msg_type == communicator.MSG_IMG_HEADER:
+            pic_id, length, chunk_size, num_chunks = struct.unpack('<HIHH', frame[5:15])
+            chunks = dict(id=pic_id, left=num_chunks)
+        elif (msg_type == communicator.MSG_IMG_CHUNK) and chunks:
+            pic_id, index = struct.unpack('<HH', frame[5:9])
+            if pic_id == chunks['id']:
+                chunks['left'] -= 1
+                if chunks['left'] == 0:
+                    pics_done += 1
+    return steer_times, pics_done
+
+
+def run(args, style):
+    random.seed(args.seed)
+    link = Link(args.baud)
+    communicator = load_communicator(link, args.pic_size)
+    next_send = 0.0
+    next_pic = 1000.0
+    end = args.seconds * 1000.0
+
+    while link.now < end:
+        # snapshot and processing
+        frame_ms = link.now
+        link.now += max(1.0, args.pass_ms + random.uniform(-args.pass_jitter, args.pass_jitter))
+
+        if link.now > next_send:
+            next_send = link.now + STEER_PERIOD_MS
+            communicator.send_frame(communicator.MSG_STEERANGLE, struct.pack('<hhhI', 0, 0, 0, int(frame_ms)), 1)
+
+        if (style != 'none') and (link.now >= next_pic) and (communicator.ecomm_image_next < 0):
+            next_pic = link.now + args.pic_every
+            link.rx += communicator.build_frame(CMD_SEND_PIC, b'')
+        communicator.check_for_commands(None, None)
+
+        if style == 'burst':
+            while communicator.ecomm_image_next >= 0:
+                communicator.service_image()
+        else:
+            communicator.service_image(int(next_send - (link.now - frame_ms)))
+
+    steer_times, pics_done = far_end(link, communicator)
+    gaps = sorted(b - a for a, b in zip(steer_times, steer_times[1:]))
+    return gaps, pics_done
+
+
+def main():
+    parser = argparse.ArgumentParser(description="steering gaps on the simulated camera link while pictures are sent")
+    parser.add_argument('--baud', type=int, default=230400)
+    parser.add_argument('--pass-ms', type=float, default=40.0, help="camera snapshot + processing time per pass")
+    parser.add_argument('--pass-jitter', type=float, default=10.0, help="+/- mS on each pass")
+    parser.add_argument('--pic-size', type=int, default=11000, help="JPEG bytes per picture")
+    parser.add_argument('--pic-every', type=float, default=500.0, help="mS between picture requests")
+    parser.add_argument('--seconds', type=float, default=60.0, help="simulated run length")
+    parser.add_argument('--margin', type=float, default=20.0, help="fail if pictures add more than this to the worst gap (mS)")
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    print("baud %d, pass %.0f+/-%.0f mS, %d byte pictures every %.0f mS, %.0f s"
+          % (args.baud, args.pass_ms, args.pass_jitter, args.pic_size, args.pic_every, args.seconds))
+    print("  style   steer  pics    mean    p99     max  (gap mS)")
+    worst = {}
+    for style in ('none', 'burst', 'paced'):
+        gaps, pics_done = run(args, style)
+        if not gaps:
+            print("  %-6s  no steering frames" % style)
+            continue
+        p99 = gaps[min(len(gaps) - 1, int(len(gaps) * 0.99))]
+        print("  %-6s %6d %5d %7.1f %6.1f %7.1f" % (style, len(gaps) + 1, pics_done, sum(gaps) / len(gaps), p99, gaps[-1]))
+        worst[style] = gaps[-1]
+
+    added = worst['paced'] - worst['none']
+    if added > args.margin:
+        print("FAIL: pictures add %.1f mS to the worst gap (margin %.0f mS)" % (added, args.margin))
+        sys.exit(1)
+    print("ok: pictures add %.1f mS to the worst gap (margin %.0f mS)" % (added, args.margin))
+
+
+if __name__ == '__main__':
+    main()
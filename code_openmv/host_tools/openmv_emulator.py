@@ -0,0 +1,447 @@
+#!/usr/bin/env python3
+#
+# OpenMV camera emulator for soak testing the robot's camera link on a linux host
+#
+# this runs on a PC (plain python 3, no extra packages), NOT on the camera.  it opens
+# a pseudo-terminal and speaks the same serial protocol as camera_code_v5.py and
+# communicator.py, so anything that would talk to the camera on Serial1 (a host build
+# of the robot's camera code, a USB-serial bridge, a replay script) can talk to this
+# instead.  the PTY has no baud rate; it runs as fast as the other side reads.
+#
+# what it does:
+#   - parses robot commands (v2 frames, CRC-16/CCITT-FALSE) and answers sequenced
+#     ones with MSG_ACK / MSG_NACK, answering repeats the same way again without
+#     re-applying them, and forgets the sequence numbers on a new CMD_SESSION,
+#     just like communicator.check_for_commands()
+#   - keeps the camera mode (I/B/R/L/G) and drive on/off, and checks the length
+#     of parameter commands (including CMD_PARAM_BLOCK)
+#   - answers CMD_SEND_PIC with MSG_IMG_HEADER and MSG_IMG_CHUNK frames (a real
+#     .jpg with --image, otherwise random bytes between JPEG start and end markers)
+#     and CMD_RESEND_CHUNK / CMD_RESEND_FROM with the chunks asked for; --corrupt
+#     and --drop apply to chunks too, so the robot's resend paths get exercised.
+#     like communicator.service_image(), chunks go out a few at a time and not
+#     when a steering frame is about to be due
+#   - accepts CMD_SET_BAUD for the rates communicator.py knows (the PTY has no baud
+#     rate, so it only notes it) and answers CMD_LINK_TEST with pattern frames, so
+#     the robot's link speed negotiation runs against it
+#   - answers CMD_TIME_PING with MSG_TIME_PONG; its clock can be made to run
+#     --clock-ppm fast (or slow, negative) so the robot's drift estimate can be checked
+#   - while driving (or ready to, CMD_DRIVE_READY) in blob mode (as the camera
+#     does) sends MSG_STEERANGLE frames at --rate with --jitter, a steering counter
+#     in the sequence byte and the "image" time in the payload; --corrupt and
+#     --drop inject bad and lost frames
+#   - prints a report every --report seconds
+#
+# example:
+#   python3 openmv_emulator.py --link /tmp/openmv0 --rate 10 --jitter 15 --corrupt 0.01
+# then point the robot side at /tmp/openmv0, eg the host build of the robot's own
+# receive path (cam.cpp, cam_parser.cpp, cam_image.cpp ...) in
+# arduino_code/host_tools/cam_soak.cpp:
+#   ./cam_soak -s 14400 -r 300 /tmp/openmv0
+# which reports throughput, parser errors, steering gaps and picture resends
+#
+
+import argparse, math, os, pty, random, select, struct, sys, time, tty
+
+# message types sent from camera to main (must match cam.h on the robot)
+MSG_STEERANGLE = 1
+MSG_TELEMETRY = 2
+MSG_ACK = 3
+MSG_NACK = 4
+MSG_IMG_HEADER = 5
+MSG_IMG_CHUNK = 6
+MSG_LINK_TEST = 7
+MSG_TIME_PONG = 8
+
+# commands from main (must match commands.py)
+CMD_MODE_IDLE = 1
+CMD_MODE_BLOBS = 2
+CMD_MODE_REGRESSION_LINE = 3
+CMD_SEND_PIC = 4
+CMD_MODE_GRAYSCALE = 5
+CMD_DRIVE_ON = 6
+CMD_DRIVE_OFF = 7
+CMD_MODE_LANE_LINES = 25
+CMD_PARAM_BLOCK = 30
+CMD_RESEND_CHUNK = 31
+CMD_RESEND_FROM = 32
+CMD_SET_BAUD = 33
+CMD_LINK_TEST = 34
+CMD_TIME_PING = 35
+CMD_DRIVE_READY = 36
+CMD_SESSION = 37
+
+MODE_CMDS = {CMD_MODE_IDLE: 'I', CMD_MODE_BLOBS: 'B', CMD_MODE_REGRESSION_LINE: 'R',
+             CMD_MODE_LANE_LINES: 'L', CMD_MODE_GRAYSCALE: 'G'}
+
+# payload length each parameter command needs (see cam.cpp on the robot)
+PARAM_LENGTHS = {8: 2, 9: 4, 10: 4, 11: 4, 12: 4, 13: 4, 14: 4, 15: 4, 16: 4, 17: 4, 18: 4,
+                 19: 4, 20: 4, 21: 2, 22: 4, 23: 0, 24: 0, 26: 2, 27: 2, 28: 2, 29: 2,
+                 CMD_PARAM_BLOCK: 66, CMD_RESEND_CHUNK: 4,
+                 CMD_RESEND_FROM: 4}
+
+# frame format (must match cam_parser.h on the robot); see cam.cpp for layout
+#   START, version, type, seq, length, payload[length], crc lsb, crc msb, END
+ECOMM_START_CHAR = 0xAA
+ECOMM_END_CHAR = 0xA8
+ECOMM_PROTOCOL_VERSION = 2
+ECOMM_HEADER_LENGTH = 5
+ECOMM_TRAILER_LENGTH = 3
+ECOMM_MAX_PAYLOAD = 128
+IMG_CHUNK_SIZE = 120        # as communicator.py
+IMG_CHUNKS_PER_PASS = 6
+IMG_MIN_CHUNKS_PER_PASS = 1
+IMG_CHUNK_MS = 6
+ECOMM_RECENT_SEQS = 8
+BAUD_RATES = (230400, 921600, 2000000)     # as communicator.py
+LINK_TEST_PATTERN_LEN = 120
+LINK_TEST_MAX_FRAMES = 64
+
+FSM_SEEKING_START = 0
+FSM_COLLECTING_CHARS = 1
+FSM_EXPECTING_STOP = 2
+
+
+# CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) -- same as cam_crc16() on the robot
+def crc16(buf):
+    crc = 0xFFFF
+    for b in buf:
+        crc ^= b << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+
+def build_frame(msg_type, payload, seq=0):
+    body = bytes([ECOMM_PROTOCOL_VERSION, msg_type, seq, len(payload)]) + payload
+    crc = crc16(body)
+    return bytes([ECOMM_START_CHAR]) + body + bytes([crc & 0xFF, (crc >> 8) & 0xFF, ECOMM_END_CHAR])
+
+
+# the test pattern for a link test id, as communicator.link_pattern()
+def link_pattern(test_id):
+    x = 0x9E3779B9 ^ test_id
+    pattern = bytearray(LINK_TEST_PATTERN_LEN)
+    for i in range(LINK_TEST_PATTERN_LEN):
+        x = (x * 1103515245 + 12345) & 0xFFFFFFFF
+        pattern[i] = (x >> 16) & 0xFF
+    return bytes(pattern)
+
+
+class Camera:
+    def __init__(self, fd, args):
+        self.fd = fd
+        self.args = args
+        self.start = time.monotonic()
+        self.mode = 'I'
+        self.driving = False
+        self.steer_seq = 0
+        self.recent_seqs = []      # (seq, MSG_ACK or MSG_NACK)
+        self.session = 0
+        self.next_steer = self.millis() + self.steer_interval()
+        self.image = None
+        if args.image:
+            with open(args.image, 'rb') as f:
+                self.image = f.read()
+        # last picture sent, kept for CMD_RESEND_CHUNK
+        self.pic = None
+        self.pic_id = 0
+        self.pic_next = -1      # next chunk service_pic() sends, -1 when there is none
+        self.baud = BAUD_RATES[0]
+
+        # receive state machine (as communicator.check_for_commands)
+        self.fsm_state = FSM_SEEKING_START
+        self.buffer = bytearray()
+        self.frame_length = 0
+
+        # counters since start, and at the last report
+        self.stats = dict(steer_sent=0, steer_dropped=0, steer_corrupted=0, bytes_out=0,
+                          bytes_in=0, cmds=0, acks=0, nacks=0, repeats=0, pics=0,
+                          chunks_dropped=0, chunks_corrupted=0, chunks_resent=0,
+                          framing_errors=0, crc_errors=0, link_tests=0, pattern_errors=0, pings=0)
+        self.last_stats = dict(self.stats)
+        self.last_report = time.monotonic()
+
+    def millis(self):
+        return int((time.monotonic() - self.start) * (1000 + self.args.clock_ppm / 1000.0))
+
+    def steer_interval(self):
+        return 1000.0 / self.args.rate
+
+    def write(self, data):
+        self.stats['bytes_out'] += len(data)
+        view = memoryview(data)
+        while len(view) > 0:
+            try:
+                n = os.write(self.fd, view)
+                view = view[n:]
+            except BlockingIOError:
+                select.select([], [self.fd], [], 0.1)
+
+    # ---------------------------------------------------------- camera to robot
+    def send_steering(self):
+        now = self.millis()
+        # a smooth target with a little noise, so the robot's predictor has something to do
+        target = int(30 * math.sin(now / 1500.0) + random.uniform(-2, 2))
+        error = -target
+        cmd = max(-255, min(255, 5 * target))
+        self.steer_seq = (self.steer_seq % 255) + 1
+        # the image is taken a little before the frame goes out
+        frame_ms = (now - random.randint(5, 25)) & 0xFFFFFFFF
+        frame = build_frame(MSG_STEERANGLE, struct.pack('<hhhI', cmd, error, target, frame_ms), self.steer_seq)
+        if self.write_lossy(frame, 'steer'):
+            self.stats['steer_sent'] += 1
+
+    # writes a frame, or drops it or flips a bit in it per --drop / --corrupt;
+    # returns False if it was dropped
+    def write_lossy(self, frame, kind):
+        if random.random() < self.args.drop:
+            self.stats[kind + '_dropped'] += 1
+            return False
+        if random.random() < self.args.corrupt:
+            frame = bytearray(frame)
+            i = random.randrange(1, len(frame))
+            frame[i] ^= 1 << random.randrange(8)
+            self.stats[kind + '_corrupted'] += 1
+        self.write(bytes(frame))
+        return True
+
+    def send_pic(self):
+        if self.image is not None:
+            jpg = self.image
+        else:
+            jpg = b'\xff\xd8' + os.urandom(self.args.pic_size) + b'\xff\xd9'
+        self.pic = jpg
+        self.pic_id = (self.pic_id + 1) & 0xFFFF
+        num_chunks = (len(jpg) + IMG_CHUNK_SIZE - 1) // IMG_CHUNK_SIZE
+        # the header is not subject to loss; losing it is covered by the robot's header timeout
+        self.write(build_frame(MSG_IMG_HEADER, struct.pack('<HIHH', self.pic_id, len(jpg), IMG_CHUNK_SIZE,
+                                                           num_chunks)))
+        self.pic_next = 0
+        self.stats['pics'] += 1
+
+    # the next few chunks of the picture, as communicator.service_image()
+    def service_pic(self):
+        if self.pic_next < 0:
+            return
+        steering = self.args.always or (self.driving and self.mode == 'B')
+        for n in range(IMG_CHUNKS_PER_PASS):
+            if (n >= IMG_MIN_CHUNKS_PER_PASS) and steering and (self.next_steer - self.millis() < IMG_CHUNK_MS):
+                return
+            if not self.send_pic_chunk(self.pic_id, self.pic_next):
+                self.pic_next = -1
+                return
+            self.pic_next += 1
+
+    # returns False if there is no such chunk, as communicator.send_image_chunk()
+    def send_pic_chunk(self, pic_id, index):
+        if (self.pic is None) or (pic_id != self.pic_id) or (index * IMG_CHUNK_SIZE >= len(self.pic)):
+            return False
+        start = index * IMG_CHUNK_SIZE
+        chunk = self.pic[start:start + IMG_CHUNK_SIZE]
+        self.write_lossy(build_frame(MSG_IMG_CHUNK, struct.pack('<HH', pic_id, index) + chunk), 'chunks')
+        return True
+
+    # ---------------------------------------------------------- robot to camera
+    def feed(self, data):
+        self.stats['bytes_in'] += len(data)
+        for c in data:
+            self.step(c)
+
+    def step(self, c):
+        if self.fsm_state == FSM_SEEKING_START:
+            if c == ECOMM_START_CHAR:
+                self.buffer = bytearray([c])
+                self.frame_length = 0
+                self.fsm_state = FSM_COLLECTING_CHARS
+
+        elif self.fsm_state == FSM_COLLECTING_CHARS:
+            self.buffer.append(c)
+            if len(self.buffer) == ECOMM_HEADER_LENGTH:
+                if (self.buffer[1] != ECOMM_PROTOCOL_VERSION) or (self.buffer[4] > ECOMM_MAX_PAYLOAD):
+                    self.stats['framing_errors'] += 1
+                    self.fsm_state = FSM_SEEKING_START
+                    return
+                self.frame_length = ECOMM_HEADER_LENGTH + self.buffer[4] + ECOMM_TRAILER_LENGTH
+            if (self.frame_length > 0) and (len(self.buffer) >= self.frame_length - 1):
+                self.fsm_state = FSM_EXPECTING_STOP
+
+        elif self.fsm_state == FSM_EXPECTING_STOP:
+            self.fsm_state = FSM_SEEKING_START
+            if c != ECOMM_END_CHAR:
+                self.stats['framing_errors'] += 1
+                return
+            n = self.buffer[4]
+            crc_rcvd = self.buffer[ECOMM_HEADER_LENGTH + n] | (self.buffer[ECOMM_HEADER_LENGTH + n + 1] << 8)
+            if crc_rcvd != crc16(self.buffer[1:ECOMM_HEADER_LENGTH + n]):
+                self.stats['crc_errors'] += 1
+                return
+            self.got_command(self.buffer[2], self.buffer[3],
+                             bytes(self.buffer[ECOMM_HEADER_LENGTH:ECOMM_HEADER_LENGTH + n]))
+
+    def got_command(self, cmd, seq, payload):
+        self.stats['cmds'] += 1
+        for recent_seq, answer in self.recent_seqs:
+            if (seq != 0) and (recent_seq == seq):
+                # our answer was lost; answer the same again but don't carry it out twice
+                self.stats['repeats'] += 1
+                self.write(build_frame(answer, b'', seq))
+                return
+        ok = self.process_cmd(cmd, payload)
+        if seq != 0:
+            self.stats['acks' if ok else 'nacks'] += 1
+            self.write(build_frame(MSG_ACK if ok else MSG_NACK, b'', seq))
+            self.recent_seqs.append((seq, MSG_ACK if ok else MSG_NACK))
+            if len(self.recent_seqs) > ECOMM_RECENT_SEQS:
+                self.recent_seqs.pop(0)
+
+    # returns True if the command was understood, as commands.process_cmd()
+    def process_cmd(self, cmd, payload):
+        if cmd in MODE_CMDS:
+            self.mode = MODE_CMDS[cmd]
+        elif cmd == CMD_SEND_PIC:
+            self.send_pic()
+        elif cmd == CMD_RESEND_CHUNK:
+            if len(payload) < 4:
+                return False
+            pic_id, index = struct.unpack('<HH', payload[:4])
+            self.stats['chunks_resent'] += 1
+            return self.send_pic_chunk(pic_id, index)
+        elif cmd == CMD_RESEND_FROM:
+            if len(payload) < 4:
+                return False
+            pic_id, index = struct.unpack('<HH', payload[:4])
+            if (self.pic is None) or (pic_id != self.pic_id) or (index * IMG_CHUNK_SIZE >= len(self.pic)):
+                return False
+            # service_pic() carries on from there
+            self.stats['chunks_resent'] += ((len(self.pic) + IMG_CHUNK_SIZE - 1) // IMG_CHUNK_SIZE) - index
+            self.pic_next = index
+        elif cmd == CMD_SET_BAUD:
+            if (len(payload) < 4) or (struct.unpack('<I', payload[:4])[0] not in BAUD_RATES):
+                return False
+            self.baud = struct.unpack('<I', payload[:4])[0]
+        elif cmd == CMD_LINK_TEST:
+            if len(payload) < 4:
+                return False
+            test_id, count = struct.unpack('<HH', payload[:4])
+            pattern = link_pattern(test_id)
+            if payload[4:] != pattern:
+                self.stats['pattern_errors'] += 1
+            self.stats['link_tests'] += 1
+            for index in range(min(count, LINK_TEST_MAX_FRAMES)):
+                self.write(build_frame(MSG_LINK_TEST, struct.pack('<HHH', test_id, index, self.stats['pattern_errors'] & 0xFFFF) + pattern))
+        elif cmd == CMD_TIME_PING:
+            if len(payload) < 4:
+                return False
+            self.stats['pings'] += 1
+            t_rx = self.millis()
+            self.write(build_frame(MSG_TIME_PONG, payload[:4] + struct.pack('<II', t_rx, self.millis())))
+        elif cmd == CMD_SESSION:
+            if len(payload) < 2:
+                return False
+            session = struct.unpack('<H', payload[:2])[0]
+            if session != self.session:
+                self.session = session
+                self.recent_seqs = []
+        elif cmd in (CMD_DRIVE_ON, CMD_DRIVE_READY):
+            self.driving = True
+        elif cmd == CMD_DRIVE_OFF:
+            self.driving = False
+        elif cmd in PARAM_LENGTHS:
+            return len(payload) >= PARAM_LENGTHS[cmd]
+        else:
+            return False
+        return True
+
+    # ---------------------------------------------------------- main loop
+    def run(self):
+        while True:
+            now = self.millis()
+            wait = max(0.0, (self.next_steer - now) / 1000.0)
+            wait = min(wait, 0.05)
+            readable, _, _ = select.select([self.fd], [], [], wait)
+            if readable:
+                try:
+                    data = os.read(self.fd, 4096)
+                except OSError:
+                    data = b''      # nobody has the other end open yet
+                if data:
+                    self.feed(data)
+                else:
+                    time.sleep(0.05)
+
+            now = self.millis()
+            if now >= self.next_steer:
+                # the camera only sends steering in blob mode with driving info turned on
+                if self.args.always or (self.driving and self.mode == 'B'):
+                    self.send_steering()
+                self.next_steer += self.steer_interval() + random.uniform(-self.args.jitter, self.args.jitter)
+                if self.next_steer < now:
+                    self.next_steer = now
+
+            self.service_pic()
+
+            if time.monotonic() - self.last_report >= self.args.report:
+                self.report()
+
+    def report(self):
+        elapsed = time.monotonic() - self.last_report
+        s, p = self.stats, self.last_stats
+        print("%7.0fs mode %s drive %-3s | steer %d (%.1f/s) dropped %d corrupted %d | out %.0f B/s in %.0f B/s"
+              " | cmds %d acks %d nacks %d repeats %d | pics %d chunks dropped %d corrupted %d resent %d"
+              " | rx framing %d crc %d | baud %d link tests %d pattern errors %d | pings %d"
+              % (time.monotonic() - self.start, self.mode, 'on' if self.driving else 'off',
+                 s['steer_sent'], (s['steer_sent'] - p['steer_sent']) / elapsed,
+                 s['steer_dropped'], s['steer_corrupted'],
+                 (s['bytes_out'] - p['bytes_out']) / elapsed, (s['bytes_in'] - p['bytes_in']) / elapsed,
+                 s['cmds'], s['acks'], s['nacks'], s['repeats'], s['pics'],
+                 s['chunks_dropped'], s['chunks_corrupted'], s['chunks_resent'],
+                 s['framing_errors'], s['crc_errors'], self.baud, s['link_tests'], s['pattern_errors'], s['pings']), flush=True)
+        self.last_stats = dict(s)
+        self.last_report = time.monotonic()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="OpenMV camera emulator on a pseudo-terminal")
+    parser.add_argument('--link', help="also make this symlink to the PTY (eg /tmp/openmv0)")
+    parser.add_argument('--rate', type=float, default=10.0, help="steering frames per second (camera sends 10)")
+    parser.add_argument('--jitter', type=float, default=0.0, help="+/- mS of random jitter on each steering frame")
+    parser.add_argument('--corrupt', type=float, default=0.0, help="fraction of steering and picture frames with a flipped bit")
+    parser.add_argument('--drop', type=float, default=0.0, help="fraction of steering and picture frames not sent at all")
+    parser.add_argument('--always', action='store_true', help="send steering in every mode, not just driving in blob mode")
+    parser.add_argument('--image', help="jpeg file to send for CMD_SEND_PIC")
+    parser.add_argument('--pic-size', type=int, default=6000, help="size of the made-up picture when there is no --image")
+    parser.add_argument('--report', type=float, default=10.0, help="seconds between reports")
+    parser.add_argument('--clock-ppm', type=float, default=0.0, help="make the emulated camera clock run this many parts per million fast")
+    parser.add_argument('--seed', type=int, help="random seed, to repeat a run")
+    args = parser.parse_args()
+
+    if args.seed is not None:
+        random.seed(args.seed)
+
+    master, slave = pty.openpty()
+    tty.setraw(slave)
+    os.set_blocking(master, False)
+    name = os.ttyname(slave)
+    if args.link:
+        if os.path.islink(args.link):
+            os.remove(args.link)
+        os.symlink(name, args.link)
+        print("camera emulator on %s (%s)" % (args.link, name), flush=True)
+    else:
+        print("camera emulator on %s" % name, flush=True)
+
+    try:
+        Camera(master, args).run()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if args.link and os.path.islink(args.link):
+            os.remove(args.link)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+#
+# index and extract the robot's dataset recordings (/recNNNN.dkr on its SD card)
+#
+# this runs on a PC (plain python 3, no extra packages).  the record layout is
+# described in recorder.h on the robot: each record starts on a 512 byte sector
+# with a 32 byte header (labels, JPEG length, its own length in sectors and a
+# CRC), then the JPEG.  reading hops from header to header using that length, so
+# only the headers are looked at when indexing -- the pictures are never scanned.
+# a file ends at the first header that does not check out (bad magic or CRC, or
+# the record number / session id does not follow on), which also covers a file
+# left at its full preallocated length after a power cut
+#
+# examples:
+#   python3 recording_tool.py index /media/sd/rec0003.dkr
+#   python3 recording_tool.py index /media/sd/*.dkr --csv index.csv
+#   python3 recording_tool.py extract /media/sd/rec0003.dkr --out run3 --every 2
+# extract writes run3/rec0003_000000.jpg ... and run3/labels.csv
+#
+
+import argparse, csv, mmap, os, struct, sys
+
+REC_SECTOR = 512
+REC_HEADER_LEN = 32
+REC_MAGIC = 0x31524B44      # "DKR1"
+
+# must match recorder.h: magic, record, request ms, done ms, jpeg length,
+# throttle, steering, mode, (0), session, sectors, crc
+HEADER = struct.Struct('<IIIIIhhBBHHH')
+
+# MODE_xxx in mode_mgr.h
+MODES = {2: 'manual1', 3: 'manual2', 4: 'auto'}
+
+FIELDS = ['file', 'record', 'offset', 'jpeg_len', 'request_ms', 'done_ms', 'throttle', 'steering', 'mode']
+
+
+# CRC-16/CCITT-FALSE, as cam_crc16() on the robot
+def crc16(buf):
+    crc = 0xFFFF
+    for b in buf:
+        crc ^= b << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+
+# yields (header dict, jpeg memoryview) for every good record of one file
+def records(path):
+    with open(path, 'rb') as f:
+        size = os.fstat(f.fileno()).st_size
+        if size < REC_SECTOR:
+            return
+        with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as m:
+            offset = 0
+            expected = 0
+            session = None
+            while offset + REC_HEADER_LEN <= size:
+                head = m[offset:offset + REC_HEADER_LEN]
+                (magic, record, request_ms, done_ms, jpeg_len, throttle, steering, mode, _,
+                 rec_session, sectors, crc) = HEADER.unpack(head)
+                if (magic != REC_MAGIC) or (crc != crc16(head[:30])) or (record != expected):
+                    break
+                if (session is not None) and (rec_session != session):
+                    break
+                if (sectors * REC_SECTOR < REC_HEADER_LEN + jpeg_len) or (offset + REC_HEADER_LEN + jpeg_len > size):
+                    break       # cut short (power lost, or the card filled up, mid record)
+                session = rec_session
+                yield (dict(file=os.path.basename(path), record=record, offset=offset, jpeg_len=jpeg_len,
+                            request_ms=request_ms, done_ms=done_ms, throttle=throttle, steering=steering,
+                            mode=MODES.get(mode, str(mode))),
+                       memoryview(m)[offset + REC_HEADER_LEN:offset + REC_HEADER_LEN + jpeg_len])
+                expected += 1
+                offset += sectors * REC_SECTOR
+
+
+def cmd_index(args):
+    writer = None
+    if args.csv:
+        out = open(args.csv, 'w', newline='')
+        writer = csv.DictWriter(out, fieldnames=FIELDS)
+        writer.writeheader()
+    for path in args.files:
+        n = 0
+        first = last = None
+        nbytes = 0
+        for head, jpg in records(path):
+            jpg.release()
+            n += 1
+            nbytes += head['jpeg_len']
+            if first is None:
+                first = head['request_ms']
+            last = head['request_ms']
+            if writer:
+                writer.writerow(head)
+        if n == 0:
+            print("%s: no records" % path)
+            continue
+        secs = (last - first) / 1000.0
+        print("%s: %d records over %.1f s (%.2f/s), mean JPEG %d bytes"
+              % (path, n, secs, (n - 1) / secs if secs > 0 else 0.0, nbytes // n))
+
+
+def cmd_extract(args):
+    os.makedirs(args.out, exist_ok=True)
+    with open(os.path.join(args.out, 'labels.csv'), 'w', newline='') as out:
+        writer = csv.DictWriter(out, fieldnames=['image'] + FIELDS)
+        writer.writeheader()
+        for path in args.files:
+            stem = os.path.splitext(os.path.basename(path))[0]
+            n = 0
+            for head, jpg in records(path):
+                if head['record'] % args.every == 0:
+                    name = "%s_%06d.jpg" % (stem, head['record'])
+                    with open(os.path.join(args.out, name), 'wb') as f:
+                        f.write(jpg)
+                    writer.writerow(dict(image=name, **head))
+                    n += 1
+                jpg.release()
+            print("%s: %d pictures extracted" % (path, n))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="index and extract robot dataset recordings (.dkr)")
+    sub = parser.add_subparsers(dest='command')
+    p = sub.add_parser('index', help="summarize recordings, optionally writing every record to a CSV")
+    p.add_argument('files', nargs='+')
+    p.add_argument('--csv', help="write one line per record here")
+    p = sub.add_parser('extract', help="write the pictures as .jpg files plus labels.csv")
+    p.add_argument('files', nargs='+')
+    p.add_argument('--out', required=True, help="output directory")
+    p.add_argument('--every', type=int, default=1, help="keep only every Nth record")
+    args = parser.parse_args()
+
+    if args.command == 'index':
+        cmd_index(args)
+    elif args.command == 'extract':
+        cmd_extract(args)
+    else:
+        parser.print_help()
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+#
+# check the robot's steer_pid.cpp against the camera's mypid.update_pid()
+#
+# this runs on a PC (plain python 3 and g++, no extra packages).  it loads the
+# camera's own mypid.py (with stand-ins for pyb, sensor and image) and builds the
+# robot's steer_pid.cpp into a shared library, then feeds both the same target
+# angle sequences at the same frame times and compares the turn cmd each gives
+# (5 x servo angle, as camera_code_v5.py sends it, steering direction +1).
+#
+# steer_pid.h lists where the two are meant to differ; the comparison takes
+# those into account:
+#   - the derivative filter is built out (STEER_PID_D_TAU_MS=0), so the
+#     derivative is the plain one mypid.py takes
+#   - mypid.py takes dt from its old_time, which it never moves on from
+#     initialize_pid(), so its derivative shrinks the longer it runs; here
+#     old_time is moved to each frame's time, which is what steer_pid does
+#   - the first frame (no derivative kick on the robot) is not compared
+#   - anti-windup: sequences that pin the output at +/-50 degrees are expected
+#     to differ once they come off the limit, and are only reported
+# every other frame must give the same turn cmd, within 1 for float rounding
+#
+# examples:
+#   python3 steer_pid_compare.py
+#   python3 steer_pid_compare.py --frames 2000 --seed 7
+# exits 1 if a sequence that should match does not
+#
+
+import argparse, ctypes, math, os, random, subprocess, sys, tempfile, types
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, '..'))
+SKETCH = os.path.join(HERE, '..', '..', 'arduino_code', 'donKcar_metro_esp32s2')
+
+PID_PERIOD_MS = 20          # camera_code_v5.py runs the PID at 50 Hz
+OUT_SCALE = 5               # servo degrees to turn cmd
+
+# the C++ functions, under names ctypes can find
+SHIM = r'''
+#include "steer_pid.h"
+extern "C" {
+int  compare_size() { return sizeof(SteerPid); }
+void compare_init(SteerPid *pid) { steer_pid_init(pid); }
+int  compare_update(SteerPid *pid, float kp, float ki, float kd, uint32_t frame_ms, int16_t target_angle) {
+  return steer_pid_update(pid, kp, ki, kd, frame_ms, target_angle);
+}
+}
+'''
+
+# (name, kp, ki, kd)
+GAINS = [
+    ('p only', 0.8, 0.0, 0.0),
+    ('camera default', 0.8, 0.0, 0.4),
+    ('with i', 0.8, 0.05, 0.4),
+    ('stiff', 1.5, 0.1, 1.0),
+]
+
+
+class Clock:
+    now = 0
+
+
+def build_library(workdir):
+    shim = os.path.join(workdir, 'shim.cpp')
+    lib = os.path.join(workdir, 'steer_pid.so')
+    with open(shim, 'w') as f:
+        f.write(SHIM)
+    subprocess.check_call(['g++', '-O2', '-shared', '-fPIC', '-DSTEER_PID_D_TAU_MS=0', '-I', SKETCH, shim,
+                           os.path.join(SKETCH, 'steer_pid.cpp'), '-o', lib])
+    lib = ctypes.CDLL(lib)
+    lib.compare_update.argtypes = [ctypes.c_void_p, ctypes.c_float, ctypes.c_float, ctypes.c_float,
+                                   ctypes.c_uint32, ctypes.c_int16]
+    return lib
+
+
+def load_mypid():
+    pyb = types.ModuleType('pyb')
+    pyb.millis = lambda: Clock.now
+    sys.modules['pyb'] = pyb
+    sys.modules['sensor'] = types.ModuleType('sensor')
+    sys.modules['image'] = types.ModuleType('image')
+    import mypid
+    return mypid
+
+
+# target angles (degrees) for each kind of sequence; the last ones pin the output
+def sequences(frames, rng):
+    walk = [0.0]
+    for _ in range(frames - 1):
+        walk.append(max(-25.0, min(25.0, walk[-1] + rng.uniform(-3, 3))))
+    return [
+        ('step', [0 if i < frames // 4 else (12 if i < frames // 2 else -8) for i in range(frames)], False),
+        ('weave', [int(20 * math.sin(2 * math.pi * i / 150)) for i in range(frames)], False),
+        ('random walk', [int(a) for a in walk], False),
+        ('hard turn', [0 if i < frames // 4 else (75 if i < frames // 2 else 5) for i in range(frames)], True),
+    ]
+
+
+def compare(lib, mypid, targets, kp, ki, kd, rng):
+    pid = ctypes.create_string_buffer(lib.compare_size())
+    lib.compare_init(pid)
+    Clock.now = 1000
+    mypid.initialize_pid()
+    mypid.steering_direction = 1
+    mypid.kp, mypid.ki, mypid.kd = kp, ki, kd
+    t = Clock.now
+    worst = 0
+    differ = 0
+    for i, target in enumerate(targets):
+        t += PID_PERIOD_MS + rng.randint(-5, 5)
+        Clock.now = t
+        _, servo_angle = mypid.update_pid(target)
+        mypid.old_time = t
+        camera = int(OUT_SCALE * servo_angle)
+        robot = lib.compare_update(pid, kp, ki, kd, t, target)
+        if i == 0:
+            continue
+        worst = max(worst, abs(camera - robot))
+        if abs(camera - robot) > 1:
+            differ += 1
+    return worst, differ
+
+
+def main():
+    parser = argparse.ArgumentParser(description="steer_pid.cpp against mypid.update_pid()")
+    parser.add_argument('--frames', type=int, default=1000, help="frames per sequence")
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    mypid = load_mypid()
+    failed = False
+    with tempfile.TemporaryDirectory() as workdir:
+        lib = build_library(workdir)
+        print("%-15s %-12s %6s %10s %8s" % ('gains', 'sequence', 'frames', 'max diff', 'differ'))
+        for name, kp, ki, kd in GAINS:
+            for seq_name, targets, saturates in sequences(args.frames, rng):
+                worst, differ = compare(lib, mypid, targets, kp, ki, kd, rng)
+                note = ''
+                if saturates:
+                    note = '  (pinned: anti-windup, expected)' if differ else ''
+                elif differ:
+                    note = '  MISMATCH'
+                    failed = True
+                print("%-15s %-12s %6d %10d %8d%s" % (name, seq_name, len(targets) - 1, worst, differ, note))
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
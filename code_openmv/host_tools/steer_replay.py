@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+#
+# replay steering streams through the robot's steer_predict.cpp and score it
+#
+# this runs on a PC (plain python 3 and g++, no extra packages).  it builds the
+# robot's own steer_predict.cpp into a shared library (the module has no Arduino
+# dependencies) and feeds it steering samples the way mode_mgr does in MODE_AUTO.
+# a --drop fraction of the samples are held back from the predictor as if lost on
+# the link; at the time of each one the prediction is compared with the command
+# the camera really sent, and with just holding the last command (what the servo
+# did before steer_predict).  errors are in steering units (-255..255).
+#
+# streams can be:
+#   *.bin   a raw capture of the camera link (as for cam_parser_bench); the
+#           stamped MSG_STEERANGLE frames are picked out, timed by camera millis()
+#   *.csv   with t_ms and cmd columns, or an index from recording_tool.py
+#           (request_ms and steering; auto mode records only)
+#   (none)  a made-up stream: 10 frames/s with --jitter, a weaving line with
+#           some noise, and a 600 mS dropout every 20 S
+#
+# gaps longer than STEER_PREDICT_STALE_MS (dropouts) are counted, and the first
+# predictions after each one reported on their own: those are the ones a history
+# left over from before the dropout used to throw off
+#
+# examples:
+#   python3 steer_replay.py
+#   python3 steer_replay.py --drop 0.3 capture1.bin run3_index.csv
+#
+
+import argparse, csv, ctypes, math, os, random, struct, subprocess, sys, tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SKETCH = os.path.join(HERE, '..', '..', 'arduino_code', 'donKcar_metro_esp32s2')
+
+# must match steer_predict.h
+STEER_PREDICT_HISTORY = 4
+STEER_PREDICT_STALE_MS = 400
+STATES = ['none', 'fresh', 'extrapolated', 'hold', 'stale']
+EXTRAPOLATED = 2
+
+# the frame format from cam_parser.h / cam.cpp
+START_CHAR = 0xAA
+END_CHAR = 0xA8
+HEADER_LEN = 5
+TRAILER_LEN = 3
+MSG_STEERANGLE = 1
+MSG_STEERANGLE_STAMPED_LENGTH = 10
+
+# the C++ functions, under names ctypes can find
+SHIM = r'''
+#include "steer_predict.h"
+extern "C" {
+void replay_init(SteerPredictor *sp) { steer_predict_init(sp); }
+void replay_add(SteerPredictor *sp, uint32_t now_ms, int16_t cmd) { steer_predict_add(sp, now_ms, cmd, 0, 0); }
+int  replay_get(SteerPredictor *sp, uint32_t now_ms, int16_t *cmd_out) { return steer_predict_get(sp, now_ms, cmd_out); }
+}
+'''
+
+
+class SteerSample(ctypes.Structure):
+    _fields_ = [('t_ms', ctypes.c_uint32), ('cmd', ctypes.c_int16),
+                ('angle_error', ctypes.c_int16), ('target_angle', ctypes.c_int16)]
+
+
+class SteerPredictor(ctypes.Structure):
+    _fields_ = [('hist', SteerSample * STEER_PREDICT_HISTORY), ('count', ctypes.c_int),
+                ('newest', ctypes.c_int), ('hold_cmd', ctypes.c_int16)]
+
+
+def build_library(workdir):
+    shim = os.path.join(workdir, 'shim.cpp')
+    lib = os.path.join(workdir, 'steer_predict.so')
+    with open(shim, 'w') as f:
+        f.write(SHIM)
+    subprocess.check_call(['g++', '-O2', '-shared', '-fPIC', '-I', SKETCH, shim,
+                           os.path.join(SKETCH, 'steer_predict.cpp'), '-o', lib])
+    return ctypes.CDLL(lib)
+
+
+# CRC-16/CCITT-FALSE, as cam_crc16() on the robot
+def crc16(buf):
+    crc = 0xFFFF
+    for b in buf:
+        crc ^= b << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+
+# (t_ms, cmd) for every good stamped steering frame in a link capture
+def samples_from_capture(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    out = []
+    i = 0
+    while i + HEADER_LEN + TRAILER_LEN <= len(data):
+        if data[i] != START_CHAR:
+            i += 1
+            continue
+        length = data[i + 4]
+        end = i + HEADER_LEN + length + TRAILER_LEN
+        if (end > len(data)) or (data[end - 1] != END_CHAR):
+            i += 1
+            continue
+        crc = data[end - 3] | (data[end - 2] << 8)
+        if crc != crc16(data[i + 1:end - 3]):
+            i += 1
+            continue
+        payload = data[i + HEADER_LEN:end - TRAILER_LEN]
+        if (data[i + 2] == MSG_STEERANGLE) and (length >= MSG_STEERANGLE_STAMPED_LENGTH):
+            cmd, _, _, t_ms = struct.unpack('<hhhI', payload[:MSG_STEERANGLE_STAMPED_LENGTH])
+            out.append((t_ms, cmd))
+        i = end
+    return out
+
+
+def samples_from_csv(path):
+    out = []
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            if 't_ms' in row:
+                out.append((int(row['t_ms']), int(row['cmd'])))
+            elif row.get('mode') == 'auto':
+                out.append((int(row['request_ms']), int(row['steering'])))
+    return out
+
+
+def samples_synthetic(seconds, jitter, rng):
+    out = []
+    t = 1000.0
+    while t < seconds * 1000:
+        if (int(t) % 20000) < 600:
+            t += 600                # dropout
+        cmd = 150 * math.sin(2 * math.pi * t / 3000) + rng.uniform(-8, 8)
+        out.append((int(t + rng.uniform(-jitter, jitter)), int(max(-255, min(255, cmd)))))
+        t += 100
+    return out
+
+
+def replay(lib, samples, drop, rng):
+    sp = SteerPredictor()
+    predicted = ctypes.c_int16()
+    lib.replay_init(ctypes.byref(sp))
+    r = dict(samples=len(samples), dropouts=0, states=[0] * len(STATES), pred_err=0.0, hold_err=0.0, scored=0,
+             after_err=0.0, after_hold_err=0.0, after_scored=0)
+    last_kept = None
+    last_cmd = 0
+    since_dropout = STEER_PREDICT_HISTORY     # samples kept since the last dropout
+    for t_ms, cmd in samples:
+        if (last_kept is not None) and (t_ms - last_kept > STEER_PREDICT_STALE_MS):
+            r['dropouts'] += 1
+            since_dropout = 0
+        if (last_kept is not None) and (rng.random() < drop):
+            state = lib.replay_get(ctypes.byref(sp), ctypes.c_uint32(t_ms), ctypes.byref(predicted))
+            r['states'][state] += 1
+            if state == EXTRAPOLATED:
+                r['scored'] += 1
+                r['pred_err'] += abs(predicted.value - cmd)
+                r['hold_err'] += abs(last_cmd - cmd)
+                if since_dropout < STEER_PREDICT_HISTORY:
+                    r['after_scored'] += 1
+                    r['after_err'] += abs(predicted.value - cmd)
+                    r['after_hold_err'] += abs(last_cmd - cmd)
+            continue
+        lib.replay_add(ctypes.byref(sp), ctypes.c_uint32(t_ms), ctypes.c_int16(cmd))
+        last_kept = t_ms
+        last_cmd = cmd
+        since_dropout += 1
+    return r
+
+
+def report(name, r):
+    def mean(total, n):
+        return (total / n) if n else 0.0
+    print("%s: %d samples, %d dropouts" % (name, r['samples'], r['dropouts']))
+    print("  at lost samples: " + ", ".join("%s %d" % (STATES[i], r['states'][i]) for i in range(1, len(STATES))))
+    print("  extrapolated, mean |error|: predicted %.1f, held %.1f  (%d samples)" %
+          (mean(r['pred_err'], r['scored']), mean(r['hold_err'], r['scored']), r['scored']))
+    print("  ... right after a dropout:  predicted %.1f, held %.1f  (%d samples)" %
+          (mean(r['after_err'], r['after_scored']), mean(r['after_hold_err'], r['after_scored']), r['after_scored']))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="replay steering streams through steer_predict.cpp")
+    parser.add_argument('--drop', type=float, default=0.2, help="fraction of samples lost on the way to the predictor")
+    parser.add_argument('--seconds', type=float, default=300.0, help="length of the made-up stream")
+    parser.add_argument('--jitter', type=float, default=15.0, help="+/- mS on each made-up frame")
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('streams', nargs='*', help="link captures (.bin) or csv files")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    with tempfile.TemporaryDirectory() as workdir:
+        lib = build_library(workdir)
+        if not args.streams:
+            report('made-up stream', replay(lib, samples_synthetic(args.seconds, args.jitter, rng), args.drop, rng))
+        for path in args.streams:
+            if path.endswith('.csv'):
+                samples = samples_from_csv(path)
+            else:
+                samples = samples_from_capture(path)
+            samples.sort()
+            report(path, replay(lib, samples, args.drop, rng))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
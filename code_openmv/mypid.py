@@ -81,6 +81,10 @@ def initialize_pid():
     ki = 0.0   # I gain of the PID
     kd = 0.4   # D gain of the PID
 
+def clear_i_term():
+    global i_term
+    i_term = 0
+
 def set_pid_kp(newvalue):
     global kp, ki, kd
     kp = newvalue